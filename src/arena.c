@@ -0,0 +1,145 @@
+/*---[ arena.c ]------------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Bump allocator for the short lived data of the parse path
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 8 /* Enough for any of the structures allocated */
+
+typedef struct _ArenaBlock ArenaBlock;
+struct _ArenaBlock
+{
+	ArenaBlock *next;
+	gsize size; /* Usable bytes following the header */
+};
+
+#define BLOCK_HEADER ((sizeof (ArenaBlock) + ARENA_ALIGN-1) & ~(gsize)(ARENA_ALIGN-1))
+#define BLOCK_DATA(block) ((gchar *)(block) + BLOCK_HEADER)
+
+struct _Arena
+{
+	ArenaBlock *blocks; /* The one being filled first */
+	gsize block_size;
+	gsize used; /* Bytes taken in the first block */
+};
+
+/* [ new_block ]
+ * Allocate a block of at least size usable bytes
+ */
+static ArenaBlock *
+new_block (gsize size)
+{
+	ArenaBlock *block = g_malloc (BLOCK_HEADER + size);
+
+	block->next = NULL;
+	block->size = size;
+
+	return block;
+}
+
+/* [ arena_new ]
+ * Create an arena that grows by blocks of the given size, 0 for the default
+ */
+Arena *
+arena_new (gsize block_size)
+{
+	Arena *arena = g_new (Arena, 1);
+
+	arena->block_size = (block_size > 0) ? block_size : ARENA_BLOCK;
+	arena->blocks = new_block (arena->block_size);
+	arena->used = 0;
+
+	return arena;
+}
+
+/* [ arena_alloc ]
+ * Return size bytes from the arena, valid until it is reset or freed
+ */
+gpointer
+arena_alloc (Arena *arena, gsize size)
+{
+	ArenaBlock *block = arena->blocks;
+	gpointer memory;
+
+	size = (size + ARENA_ALIGN-1) & ~(gsize)(ARENA_ALIGN-1);
+
+	if (size > block->size - arena->used) {
+		/* Requests larger than a block get one of their own, kept behind
+		   the current block so that its free space isn't wasted */
+		if (size > arena->block_size / 4) {
+			ArenaBlock *large = new_block (size);
+
+			large->next = block->next;
+			block->next = large;
+			return BLOCK_DATA (large);
+		}
+
+		block = new_block (arena->block_size);
+		block->next = arena->blocks;
+		arena->blocks = block;
+		arena->used = 0;
+	}
+
+	memory = BLOCK_DATA (block) + arena->used;
+	arena->used += size;
+
+	return memory;
+}
+
+/* [ arena_alloc0 ]
+ * Like arena_alloc, with the memory cleared
+ */
+gpointer
+arena_alloc0 (Arena *arena, gsize size)
+{
+	return memset (arena_alloc (arena, size), 0, size);
+}
+
+/* [ arena_reset ]
+ * Release everything allocated from the arena at once. The block being
+ * filled is kept for reuse, so an arena reset per chunk stops allocating
+ * once it has warmed up
+ */
+void
+arena_reset (Arena *arena)
+{
+	ArenaBlock *block = arena->blocks->next;
+
+	/* Large requests never get the first block, it is always a normal one */
+	while (block != NULL) {
+		ArenaBlock *next = block->next;
+
+		g_free (block);
+		block = next;
+	}
+	arena->blocks->next = NULL;
+	arena->used = 0;
+}
+
+/* [ arena_free ]
+ * Free an arena and everything allocated from it
+ */
+void
+arena_free (Arena *arena)
+{
+	ArenaBlock *block = arena->blocks;
+
+	while (block != NULL) {
+		ArenaBlock *next = block->next;
+
+		g_free (block);
+		block = next;
+	}
+	g_free (arena);
+}
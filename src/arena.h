@@ -0,0 +1,33 @@
+/*---[ arena.h ]------------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Bump allocator for the short lived data of the parse path
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_ARENA
+#define _FORTIFIED_ARENA
+
+#include <config.h>
+#include <gnome.h>
+
+#define ARENA_BLOCK (64*1024) /* Default block size, fits the hits of a few thousand lines */
+
+/* Memory handed out by an arena is only freed all at once, when the arena
+   is reset or freed. An arena is used by one thread at a time */
+typedef struct _Arena Arena;
+
+Arena *arena_new (gsize block_size);
+gpointer arena_alloc (Arena *arena, gsize size);
+gpointer arena_alloc0 (Arena *arena, gsize size);
+void arena_reset (Arena *arena);
+void arena_free (Arena *arena);
+
+#define arena_new0(arena, type) ((type *)arena_alloc0 ((arena), sizeof (type)))
+
+#endif
@@ -0,0 +1,385 @@
+/*---[ bench-hitmodel.c ]----------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Benchmark of the events list at its largest. Bursts of hits go into the
+ * full list a batch per frame, the way the view puts them there, timing
+ * each iteration of the main loop, the fastest once more counting the
+ * repeated hits into rows. Then the list is sorted on several columns and
+ * scrolled to random places, timing each. With a display the list is
+ * shown in a tree view too
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+
+#include "hitmodel.h"
+#include "hitflush.h"
+#include "hitview.h"
+#include "util.h"
+
+#define CAPACITY 10000000 /* Hits kept in the list, it is filled before the bursts */
+#define HISTORY_RATE 1000 /* Hits per second of those filling the list */
+#define FRAME_INTERVAL 16 /* Milliseconds between putting the queued hits into the list */
+#define PRODUCE_INTERVAL 1 /* Milliseconds between queueing the hits due */
+#define BURST_SECONDS 3
+#define AGGREGATE_WINDOW 60 /* Seconds repeated hits are counted into one row for */
+#define REPEATED_SOURCES 1000 /* Sources of the hits of the aggregated burst */
+#define SCROLLS 200 /* Jumps to random places of the list after each sort */
+#define PAGE_ROWS 40 /* Rows shown at once */
+#define SEED 17
+
+static const guint rates[] = { 10000, 100000, 1000000 }; /* Hits offered per second */
+
+/* The columns the list is sorted on, ending back in time order */
+typedef struct _BenchSort BenchSort;
+struct _BenchSort
+{
+	HitField field;
+	const gchar *name;
+};
+
+static const BenchSort sorts[] = {
+	{ HIT_PORT, "port" },
+	{ HIT_SOURCE, "source" },
+	{ HIT_SERVICE, "service" },
+	{ HIT_TIME, "time" }
+};
+
+static HitModel *model = NULL;
+static GtkWidget *view = NULL; /* NULL without a display */
+static HitFlush *flush = NULL; /* Hits waiting for the next frame, put into the list as the view does */
+static gboolean aggregate; /* Repeated hits are counted into one row */
+static GRand *generator = NULL;
+static guint16 names[3];
+static guint rate;
+static gint64 burst_time = 1476662400; /* Of the first hit of the next burst, each one follows the last */
+static gint64 burst_start;
+static guint64 produced, appended;
+static GPollFunc default_poll;
+static gint64 polled; /* Time spent waiting in the current iteration */
+
+/* [ timed_poll ]
+ * Poll as the main loop does, adding up the time spent waiting
+ */
+static gint
+timed_poll (GPollFD *fds, guint nfds, gint timeout)
+{
+	gint64 start = g_get_monotonic_time ();
+	gint result;
+
+	result = default_poll (fds, nfds, timeout);
+	polled += g_get_monotonic_time () - start;
+
+	return result;
+}
+
+/* [ hitview_append_hit ]
+ * Queue a hit for the next frame, as the view does
+ */
+gboolean
+hitview_append_hit (Hit *h)
+{
+	hitflush_queue (flush, h);
+	return TRUE;
+}
+
+/* [ make_hit ]
+ * Fill in a random hit logged at a time
+ */
+static void
+make_hit (Hit *h, gint64 time)
+{
+	memset (h, 0, sizeof (*h));
+	h->time = time;
+	h->destination = g_htonl (0x0a000001);
+	if (aggregate) {
+		/* Few sources probing few ports, so the hits repeat */
+		h->source = g_htonl (0xc0a80000 + g_rand_int_range (generator, 0, REPEATED_SOURCES));
+		h->port = g_rand_int_range (generator, 0, 2) ? 22 : 80;
+	} else {
+		h->source = g_htonl (g_rand_int (generator));
+		h->port = g_rand_int_range (generator, 1, 65536);
+	}
+	h->length = g_rand_int_range (generator, 40, 1500);
+	h->in = names[0];
+	h->service = names[g_rand_int_range (generator, 1, G_N_ELEMENTS (names))];
+	h->protocol = 6;
+	h->direction = HIT_INBOUND;
+	h->flags = HIT_HAS_SOURCE | HIT_HAS_DESTINATION | HIT_HAS_PORT | HIT_HAS_LENGTH | HIT_HAS_PROTOCOL;
+}
+
+/* [ produce_hits ]
+ * Queue the hits due at the offered rate, as a log read would
+ */
+static gboolean
+produce_hits (gpointer data)
+{
+	guint64 due = (guint64)(g_get_monotonic_time () - burst_start) * rate / G_USEC_PER_SEC;
+	Hit h;
+
+	while (produced < due) {
+		make_hit (&h, burst_time + produced / rate);
+		hitview_append_hit (&h);
+		produced++;
+	}
+
+	return TRUE;
+}
+
+/* [ fill_list ]
+ * Fill the list with hits older than those of the bursts, before it is
+ * shown. The bursts then evict a hit for each one they put in
+ */
+static void
+fill_list (void)
+{
+	gint64 start = g_get_monotonic_time ();
+	Hit h;
+	guint i;
+
+	for (i = 0; i < CAPACITY; i++) {
+		make_hit (&h, burst_time - 1 - (CAPACITY - i) / HISTORY_RATE);
+		hit_model_append (model, &h);
+	}
+
+	g_print ("%u hits put in the list in %.2f s\n", CAPACITY,
+	         (gdouble)(g_get_monotonic_time () - start) / G_USEC_PER_SEC);
+}
+
+/* [ flush_hits ]
+ * Put the queued hits into the list and scroll to the newest once, as
+ * the view does
+ */
+static gboolean
+flush_hits (gpointer data)
+{
+	GtkTreeIter iter;
+	GtkTreePath *path;
+	gint64 newest;
+
+	appended += hitflush_get_queued (flush);
+	if (hitflush_run (flush, aggregate, AGGREGATE_WINDOW, &newest) && view != NULL &&
+	    hit_model_find_serial (model, newest, &iter)) {
+		path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
+		gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (view), path, NULL, TRUE, 1.0, 1.0);
+		gtk_tree_path_free (path);
+	}
+
+	return TRUE;
+}
+
+/* [ render_hit_cell ]
+ * Cell data function, show a column of a row
+ */
+static void
+render_hit_cell (GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                 GtkTreeModel *tree_model, GtkTreeIter *iter, gpointer data)
+{
+	gchar buffer[HIT_TEXT_MAX];
+
+	g_object_set (renderer, "text", hitflush_cell_text (flush, iter, GPOINTER_TO_INT (data), buffer), NULL);
+}
+
+/* [ create_view ]
+ * Show the list in a window with a column for each field and total, as
+ * the events list has
+ */
+static void
+create_view (void)
+{
+	GtkWidget *window, *scrolled;
+	GtkTreeViewColumn *column;
+	GtkCellRenderer *renderer;
+	gint field;
+
+	window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_default_size (GTK_WINDOW (window), 800, 600);
+	scrolled = gtk_scrolled_window_new (NULL, NULL);
+	gtk_container_add (GTK_CONTAINER (window), scrolled);
+	view = gtk_tree_view_new ();
+	gtk_container_add (GTK_CONTAINER (scrolled), view);
+
+	for (field = 0; field < NUM_HITCOLUMNS; field++) {
+		renderer = gtk_cell_renderer_text_new ();
+		column = gtk_tree_view_column_new ();
+		gtk_tree_view_column_pack_start (column, renderer, TRUE);
+		gtk_tree_view_column_set_cell_data_func (column, renderer, render_hit_cell, GINT_TO_POINTER (field), NULL);
+		gtk_tree_view_append_column (GTK_TREE_VIEW (view), column);
+	}
+
+	gtk_widget_show_all (window);
+}
+
+/* [ compare_times ]
+ * Order iteration times for the percentiles
+ */
+static gint
+compare_times (gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* [ run_burst ]
+ * Offer hits at a rate for a while into the full list, then print how many
+ * went in and how long the main loop was kept busy at a time
+ */
+static void
+run_burst (guint offered)
+{
+	GArray *busy = g_array_new (FALSE, FALSE, sizeof (gint64));
+	guint produce_source, flush_source, late = 0;
+	gint64 start, elapsed, total = 0;
+
+	rate = offered;
+	produced = appended = 0;
+	burst_start = g_get_monotonic_time ();
+	produce_source = g_timeout_add (PRODUCE_INTERVAL, produce_hits, NULL);
+	flush_source = g_timeout_add (FRAME_INTERVAL, flush_hits, NULL);
+
+	while (g_get_monotonic_time () - burst_start < BURST_SECONDS * G_USEC_PER_SEC) {
+		start = g_get_monotonic_time ();
+		polled = 0;
+		g_main_context_iteration (NULL, TRUE);
+		elapsed = g_get_monotonic_time () - start - polled;
+		g_array_append_val (busy, elapsed);
+		total += elapsed;
+		if (elapsed > FRAME_INTERVAL * 1000)
+			late++;
+	}
+
+	g_source_remove (produce_source);
+	g_source_remove (flush_source);
+	g_array_sort (busy, compare_times);
+
+	g_print ("%7u hits/s offered%s: %7.0f hits/s went in, %u iterations, busy mean %.2f ms, p99 %.2f ms, max %.2f ms, %u over %u ms\n",
+	         offered, aggregate ? ", aggregated" : "", (gdouble)appended / BURST_SECONDS, busy->len,
+	         total / 1000.0 / MAX (busy->len, 1),
+	         g_array_index (busy, gint64, busy->len * 99 / 100) / 1000.0,
+	         g_array_index (busy, gint64, busy->len - 1) / 1000.0,
+	         late, FRAME_INTERVAL);
+
+	burst_time += produced / rate + 1;
+	hitflush_clear (flush);
+	g_array_free (busy, TRUE);
+}
+
+/* [ show_page ]
+ * Bring the rows from a position into sight. Without a view the text of
+ * their cells is made, as the view would to draw them
+ */
+static void
+show_page (guint position)
+{
+	GtkTreeModel *tree_model = GTK_TREE_MODEL (model);
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	gchar buffer[HIT_TEXT_MAX];
+	gint field;
+	guint i;
+
+	if (view != NULL) {
+		path = gtk_tree_path_new_from_indices (position, -1);
+		gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (view), path, NULL, TRUE, 0.0, 0.0);
+		gtk_tree_path_free (path);
+		gdk_window_process_all_updates ();
+		return;
+	}
+
+	if (!gtk_tree_model_iter_nth_child (tree_model, &iter, NULL, position))
+		return;
+	for (i = 0; i < PAGE_ROWS; i++) {
+		for (field = 0; field < NUM_HITCOLUMNS; field++)
+			hitflush_cell_text (flush, &iter, field, buffer);
+		if (!gtk_tree_model_iter_next (tree_model, &iter))
+			break;
+	}
+}
+
+/* [ run_sorts ]
+ * Sort the full list on each column in turn, then scroll it to random
+ * places, printing how long each took
+ */
+static void
+run_sorts (void)
+{
+	GArray *scrolls = g_array_new (FALSE, FALSE, sizeof (gint64));
+	gint64 start, sorted, elapsed, total;
+	guint i, n;
+
+	for (i = 0; i < G_N_ELEMENTS (sorts); i++) {
+		start = g_get_monotonic_time ();
+		gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (model), sorts[i].field, GTK_SORT_ASCENDING);
+		sorted = g_get_monotonic_time () - start;
+
+		g_array_set_size (scrolls, 0);
+		total = 0;
+		for (n = 0; n < SCROLLS; n++) {
+			guint position = g_rand_int_range (generator, 0, hit_model_get_total (model) - PAGE_ROWS);
+
+			start = g_get_monotonic_time ();
+			show_page (position);
+			elapsed = g_get_monotonic_time () - start;
+			g_array_append_val (scrolls, elapsed);
+			total += elapsed;
+		}
+		g_array_sort (scrolls, compare_times);
+
+		g_print ("sorted by %-7s in %.2f s, %u scrolls of %u rows: mean %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		         sorts[i].name, (gdouble)sorted / G_USEC_PER_SEC, SCROLLS, PAGE_ROWS,
+		         total / 1000.0 / SCROLLS,
+		         g_array_index (scrolls, gint64, SCROLLS * 99 / 100) / 1000.0,
+		         g_array_index (scrolls, gint64, SCROLLS - 1) / 1000.0);
+	}
+
+	g_array_free (scrolls, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+	guint i;
+
+	if (gtk_init_check (&argc, &argv))
+		create_view ();
+	else
+		g_print ("No display, the list is measured without a view\n");
+
+	default_poll = g_main_context_get_poll_func (NULL);
+	g_main_context_set_poll_func (NULL, timed_poll);
+
+	generator = g_rand_new_with_seed (SEED);
+	names[0] = hit_intern ("eth0", 4);
+	names[1] = hit_intern ("ssh", 3);
+	names[2] = hit_intern ("http", 4);
+
+	/* The list is shown once full, the view takes in all the rows at once */
+	model = hit_model_new (CAPACITY);
+	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (model), HIT_TIME, GTK_SORT_ASCENDING);
+	fill_list ();
+	flush = hitflush_new (model, (view != NULL) ? GTK_TREE_VIEW (view) : NULL);
+	if (view != NULL)
+		gtk_tree_view_set_model (GTK_TREE_VIEW (view), GTK_TREE_MODEL (model));
+
+	for (i = 0; i < G_N_ELEMENTS (rates); i++)
+		run_burst (rates[i]);
+	/* The fastest again, counting repeated hits into rows */
+	aggregate = TRUE;
+	run_burst (rates[G_N_ELEMENTS (rates) - 1]);
+	aggregate = FALSE;
+	run_sorts ();
+
+	if (view != NULL)
+		gtk_tree_view_set_model (GTK_TREE_VIEW (view), NULL);
+	hitflush_free (flush);
+	g_object_unref (model);
+	g_rand_free (generator);
+
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*---[ bench-logparse.c ]---------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Benchmark of parsing the system log as it is followed, counting the
+ * allocations made per hit and timing each chunk read, for each of the
+ * formats a log may be written in
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+
+#include "logparse.h"
+#include "logread.h"
+#include "hitview.h"
+
+#define LOG_LINES 200000 /* In the generated log */
+#define FIREWALL_SHARE 80 /* Percent of the lines logged by the firewall */
+#define RANDOM_PORT_SHARE 30 /* Percent of the firewall lines to a port picked at random */
+#define LINES_PER_SECOND 10
+#define CHUNK_SIZE 4096 /* Read from the log at a time, the way it is followed */
+#define SEED 17
+
+static const guint common_ports[] = { 22, 25, 53, 80, 110, 137, 139, 443, 445, 3389 };
+
+/* The formats of the logs generated */
+typedef struct _BenchFormat BenchFormat;
+struct _BenchFormat
+{
+	LogFormat format;
+	const gchar *name;
+};
+
+static const BenchFormat bench_formats[] = {
+	{ LOGFORMAT_BSD, "BSD syslog" },
+	{ LOGFORMAT_RFC5424, "RFC 5424" },
+	{ LOGFORMAT_NFTABLES, "nftables" }
+};
+
+static guint hits = 0;
+static gboolean counting = FALSE;
+static guint allocations = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *p, size_t size);
+extern void __libc_free (void *p);
+
+/* Count the allocations the parsing makes, by standing in for those of the
+   C library, which GLib uses too */
+void *
+malloc (size_t size)
+{
+	if (counting)
+		allocations++;
+	return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+	if (counting)
+		allocations++;
+	return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *p, size_t size)
+{
+	if (counting)
+		allocations++;
+	return __libc_realloc (p, size);
+}
+
+void
+free (void *p)
+{
+	__libc_free (p);
+}
+#endif
+
+/* [ hitview_append_hit ]
+ * Count the hits, the view copies them and that isn't measured
+ */
+gboolean
+hitview_append_hit (Hit *h)
+{
+	hits++;
+	return TRUE;
+}
+
+/* [ generate_log ]
+ * Return a log of firewall lines mixed with those of other daemons, in a
+ * format. RFC 5424 lines carry RFC 3339 times with fractions and an
+ * offset, nftables ones have the log prefix running into "IN="
+ */
+static GString *
+generate_log (LogFormat format)
+{
+	GRand *rand = g_rand_new_with_seed (SEED);
+	GString *log = g_string_new (NULL);
+	const gchar *kernel = "kernel:", *glue = " ";
+	guint n;
+
+	if (format == LOGFORMAT_RFC5424)
+		kernel = "kernel - - -";
+	if (format == LOGFORMAT_NFTABLES)
+		glue = "";
+
+	for (n = 0; n < LOG_LINES; n++) {
+		guint seconds = n / LINES_PER_SECOND;
+		gchar stamp[64], daemon[32];
+
+		if (format == LOGFORMAT_RFC5424) {
+			g_snprintf (stamp, sizeof (stamp), "<4>1 2016-10-%02uT%02u:%02u:%02u.%06u+02:00",
+			            17 + seconds/86400, seconds/3600 % 24, seconds/60 % 60, seconds % 60,
+			            g_rand_int_range (rand, 0, 1000000));
+			g_snprintf (daemon, sizeof (daemon), "CRON %u - -", g_rand_int_range (rand, 1000, 32768));
+		} else {
+			g_snprintf (stamp, sizeof (stamp), "Oct %2u %02u:%02u:%02u", 17 + seconds/86400,
+			            seconds/3600 % 24, seconds/60 % 60, seconds % 60);
+			g_snprintf (daemon, sizeof (daemon), "CRON[%u]:", g_rand_int_range (rand, 1000, 32768));
+		}
+
+		if (g_rand_int_range (rand, 0, 100) < FIREWALL_SHARE) {
+			guint port;
+
+			if (g_rand_int_range (rand, 0, 100) < RANDOM_PORT_SHARE)
+				port = g_rand_int_range (rand, 1024, 65536);
+			else
+				port = common_ports[g_rand_int_range (rand, 0, G_N_ELEMENTS (common_ports))];
+
+			g_string_append_printf (log,
+			                        "%s host %s [%6u.%06u] Inbound%sIN=eth0 OUT= "
+			                        "MAC=00:11:22:33:44:55:66:77:88:99:aa:bb:08:00 SRC=%u.%u.%u.%u DST=10.0.0.1 "
+			                        "LEN=60 TOS=0x00 PREC=0x00 TTL=%u ID=%u DF PROTO=TCP SPT=%u DPT=%u "
+			                        "WINDOW=29200 RES=0x00 SYN URGP=0\n",
+			                        stamp, kernel, seconds, g_rand_int_range (rand, 0, 1000000), glue,
+			                        g_rand_int_range (rand, 1, 224), g_rand_int_range (rand, 0, 256),
+			                        g_rand_int_range (rand, 0, 256), g_rand_int_range (rand, 1, 255),
+			                        g_rand_int_range (rand, 32, 129), g_rand_int_range (rand, 0, 65536),
+			                        g_rand_int_range (rand, 1024, 65536), port);
+		} else
+			g_string_append_printf (log, "%s host %s (root) CMD (command -v debian-sa1 > /dev/null && debian-sa1 1 1)\n",
+			                        stamp, daemon);
+	}
+
+	g_rand_free (rand);
+	return log;
+}
+
+/* [ parse_chunks ]
+ * Parse the log a chunk at a time, cut after the last whole line like a
+ * read of the followed log is, as if it was just written. The time each
+ * chunk took goes in times
+ */
+static void
+parse_chunks (const GString *log, LogFormat format, GArray *times)
+{
+	time_t anchor = time (NULL);
+	gsize position = 0;
+
+	while (position < log->len) {
+		gsize length = MIN (CHUNK_SIZE, log->len - position);
+		const gchar *last;
+		gint64 start;
+
+		last = g_strrstr_len (log->str + position, length, "\n");
+		if (last != NULL)
+			length = last - (log->str + position) + 1;
+
+		start = g_get_monotonic_time ();
+		logread_parse_buffer (log->str + position, length, format, anchor);
+		if (times != NULL) {
+			gint64 elapsed = g_get_monotonic_time () - start;
+
+			g_array_append_val (times, elapsed);
+		}
+
+		position += length;
+	}
+}
+
+/* [ compare_times ]
+ * Order chunk times for the percentiles
+ */
+static gint
+compare_times (gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* [ run_format ]
+ * Parse a log generated in a format and print the allocations and times
+ */
+static void
+run_format (const BenchFormat *bench)
+{
+	GString *log;
+	GArray *times;
+	LogFormat format;
+	gint64 total = 0;
+	guint i;
+
+	log = generate_log (bench->format);
+	format = logparse_detect_format (log->str, log->len);
+	allocations = 0;
+
+	/* The first pass fills the services and time caches */
+	parse_chunks (log, format, NULL);
+
+	times = g_array_new (FALSE, FALSE, sizeof (gint64));
+	hits = 0;
+	counting = TRUE;
+	parse_chunks (log, format, times);
+	counting = FALSE;
+
+	for (i = 0; i < times->len; i++)
+		total += g_array_index (times, gint64, i);
+	g_array_sort (times, compare_times);
+
+	g_print ("%s: %u lines, %u hits, %u chunks of up to %u bytes\n", bench->name, LOG_LINES, hits, times->len, CHUNK_SIZE);
+#ifdef __GLIBC__
+	g_print ("allocations per hit: %.2f\n", hits ? (gdouble)allocations / hits : 0.0);
+#endif
+	g_print ("chunk mean %" G_GINT64_FORMAT " us, p99 %" G_GINT64_FORMAT " us\n",
+	         total / MAX (times->len, 1), g_array_index (times, gint64, times->len * 99 / 100));
+
+	g_array_free (times, TRUE);
+	g_string_free (log, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (bench_formats); i++)
+		run_format (&bench_formats[i]);
+
+	return 0;
+}
@@ -27,6 +27,9 @@
 #include "menus.h"
 #include "util.h"
 #include "logread.h"
+#include "journal.h"
+#include "nflog.h"
+#include "kmsg.h"
 #include "wizard.h"
 #include "preferences.h"
 #include "scriptwriter.h"
@@ -47,6 +50,7 @@ static void session_die (GnomeClient        *client,
                          gpointer            client_data);
 
 gboolean fortified_is_locked (void);
+static void open_event_source (void);
 
 static FirewallStatus firewall_state_prelock;
 
@@ -115,8 +119,11 @@ start_firewall (void)
 	printf ("%s", output);
 
 	if (retval == 0) {
-		if (!CONSOLE)
+		if (!CONSOLE) {
 			status_set_state (STATUS_RUNNING);
+			/* The kernel may lack NFLOG, the script then logs to the system log */
+			open_event_source ();
+		}
 	} else {
 		gchar *message;
 		retval = WEXITSTATUS (retval);
@@ -228,6 +235,10 @@ unlock_firewall (void)
 void
 exit_fortified (void)
 {
+	close_logfile ();
+	journal_close ();
+	kmsg_close ();
+	nflog_close ();
 	gtk_main_quit ();
 }
 
@@ -290,6 +301,67 @@ fortified_is_locked (void)
 	return g_file_test (get_lock_file_path (), G_FILE_TEST_EXISTS);
 }
 
+/* [ get_log_target ]
+ * Return the target the running firewall logs events with, "NFLOG" or "LOG",
+ * as the script recorded it in the lock file. NULL if the firewall is not
+ * running or the script didn't record it
+ */
+static gchar *
+get_log_target (void)
+{
+	const gchar *path = get_lock_file_path ();
+	gchar *target;
+
+	if (path == NULL || !g_file_get_contents (path, &target, NULL, NULL))
+		return NULL;
+
+	g_strstrip (target);
+	if (target[0] == '\0') {
+		g_free (target);
+		return NULL;
+	}
+
+	return target;
+}
+
+/* [ open_event_source ]
+ * Start receiving new events, over netlink when the firewall logs with NFLOG,
+ * otherwise from the system log. Without a log, from the journal or the kernel.
+ * The target the running firewall actually uses overrides the preference
+ */
+static void
+open_event_source (void)
+{
+	static gboolean opened = FALSE;
+	gboolean nflog;
+	gchar *target;
+
+	target = get_log_target ();
+	nflog = preferences_get_bool (PREFS_FW_NFLOG) && (target == NULL || strcmp (target, "NFLOG") == 0);
+	g_free (target);
+
+	if (opened && nflog == nflog_is_active ())
+		return;
+
+	/* Reopening the system log resumes from its checkpoint, nothing is lost */
+	nflog_close ();
+	close_logfile ();
+	journal_close ();
+	kmsg_close ();
+
+	if (!nflog || !nflog_open (preferences_get_int (PREFS_FW_NFLOG_GROUP),
+	                           preferences_get_int (PREFS_FW_NFLOG_THRESHOLD))) {
+		if (get_system_log_path () != NULL)
+			open_logfile (get_system_log_path ());
+		else if (!journal_open ())
+			kmsg_open ();
+	}
+	opened = TRUE;
+
+	/* Packets received over netlink never reach a log that could be read back */
+	menus_events_reload_enabled (!nflog_is_active ());
+}
+
 static void
 show_help (void)
 {
@@ -408,8 +480,8 @@ main (int argc, char* argv[])
 	status_sync_timeout (NULL); /* Do one immediate refresh */
 	g_timeout_add (5000, status_sync_timeout, NULL);
 
-	/* Initialize the system log file polling function */
-	open_logfile ((gchar *)get_system_log_path ());
+	/* Start receiving new events */
+	open_event_source ();
 
 	if (preferences_get_bool (PREFS_FIRST_RUN))
 		policyview_install_default_ruleset ();
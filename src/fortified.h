@@ -17,19 +17,55 @@
 
 typedef struct _Hit  Hit;
 
+/* The fields of a hit, in the order they are shown */
+typedef enum
+{
+	HIT_TIME,
+	HIT_DIRECTION,
+	HIT_IN,
+	HIT_OUT,
+	HIT_PORT,
+	HIT_SOURCE,
+	HIT_DESTINATION,
+	HIT_LENGTH,
+	HIT_TOS,
+	HIT_PROTOCOL,
+	HIT_SERVICE,
+	NUM_HIT_FIELDS
+} HitField;
+
+/* Which way a packet was going, from the prefix of its log line */
+typedef enum
+{
+	HIT_UNKNOWN,
+	HIT_INBOUND,
+	HIT_OUTBOUND
+} HitDirection;
+
+/* Fields that may be missing from a logged packet */
+#define HIT_HAS_SOURCE      (1 << 0)
+#define HIT_HAS_DESTINATION (1 << 1)
+#define HIT_HAS_PORT        (1 << 2)
+#define HIT_HAS_LENGTH      (1 << 3)
+#define HIT_HAS_TOS         (1 << 4)
+#define HIT_HAS_PROTOCOL    (1 << 5)
+
+/* A logged packet, kept in binary. The fields are only turned into text
+   when they are shown or saved, see hit_format */
 struct _Hit
 {
-	gchar *time;
-	gchar *direction;
-	gchar *in;
-	gchar *out;
-	gchar *port;
-	gchar *source;
-	gchar *destination;
-	gchar *length;
-	gchar *tos;
-	gchar *protocol;
-	gchar *service;
+	gint64 time; /* Seconds since the epoch, 0 if unknown */
+	guint32 source; /* IPv4 addresses, in network byte order */
+	guint32 destination;
+	guint16 port; /* Destination port */
+	guint16 length;
+	guint16 in; /* Interface names, see hit_intern */
+	guint16 out;
+	guint16 service; /* Service name, see hit_intern */
+	guint8 tos;
+	guint8 protocol; /* IP protocol number */
+	guint8 direction; /* A HitDirection */
+	guint8 flags; /* The HIT_HAS_ fields present */
 };
 
 gboolean fortified_is_locked (void);
@@ -0,0 +1,498 @@
+/*---[ hitcache.c ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * On-disk cache of the hits parsed from the system log
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hitcache.h"
+#include "util.h"
+
+#define CACHE_FILE "events.cache"
+#define CACHE_MAGIC 0x43485446 /* "FTHC" */
+#define CACHE_VERSION 2
+#define CACHE_MAX_SIZE (64*1024*1024) /* The cache stops growing past this size */
+#define CACHE_SAME 0xFF /* Name length meaning the name of the previous hit is repeated */
+#define NUM_CACHE_NAMES 3
+#define CACHE_BLOCK 1024 /* Hits decoded at a time when reading back newest first */
+
+/* The file starts with the header, followed by the hits. A hit is stored as
+   the Hit itself, in host byte order, followed by its interface and service
+   names, each an 8 bit length and the text. The ids of the names are only
+   good for one session */
+typedef struct _HitCacheHeader HitCacheHeader;
+struct _HitCacheHeader
+{
+	guint32 magic;
+	guint32 version;
+	guint64 dev;
+	guint64 inode; /* Identity of the log the hits were parsed from */
+	guint64 offset; /* Bytes of the log covered, always ending a line */
+	guint64 length; /* Bytes of hits following the header */
+	guint32 hash; /* Of the line ending at offset, tells if the log was replaced */
+	guint32 count; /* Number of hits */
+};
+
+/* Where reading back a block of hits can start: the position of its first
+   hit and of the names last stored in full before it, 0 for none */
+typedef struct _HitCacheBlock HitCacheBlock;
+struct _HitCacheBlock
+{
+	gsize position;
+	gsize names[NUM_CACHE_NAMES];
+};
+
+struct _HitCache
+{
+	gint fd;
+	gint staging; /* Holds hits parsed out of order until they can be appended, or -1 */
+	guint64 staged; /* Bytes written to the staging file */
+	HitCacheHeader header;
+	gchar *mapping; /* Of the hits cached by an earlier reload, or NULL */
+	gsize mapping_size;
+	guint cached; /* Number of hits in the mapping */
+	guint read; /* Hits read back so far */
+	gsize position; /* Start of the next hit to read in the mapping */
+	guint16 previous[NUM_CACHE_NAMES]; /* Names of the last hit read */
+	GArray *blocks; /* Of HitCacheBlock, every CACHE_BLOCK hits of the mapping */
+	GArray *block; /* Of Hit, read back newest first */
+	gboolean full; /* Nothing more can be appended */
+};
+
+/* The names of a hit, in the order they are stored */
+static const glong hit_names[NUM_CACHE_NAMES] = {
+	G_STRUCT_OFFSET (Hit, in),
+	G_STRUCT_OFFSET (Hit, out),
+	G_STRUCT_OFFSET (Hit, service)
+};
+
+/* [ cache_path ]
+ * Return the path of the cache file, creating its directory if needed.
+ * Return NULL if that fails
+ */
+static gchar *
+cache_path (void)
+{
+	gchar *dir, *path = NULL;
+
+	dir = g_build_filename (g_get_user_cache_dir (), "fortified", NULL);
+	if (g_mkdir_with_parents (dir, 0700) == 0)
+		path = g_build_filename (dir, CACHE_FILE, NULL);
+	else
+		g_warning ("Failed to create %s: %s", dir, g_strerror (errno));
+	g_free (dir);
+
+	return path;
+}
+
+/* [ skip_hit ]
+ * Return the end of the stored hit starting at p, or NULL if it runs past end.
+ * Names stored in full are remembered in names
+ */
+static const gchar *
+skip_hit (const gchar *p, const gchar *end, const gchar **names)
+{
+	guint8 length;
+	guint i;
+
+	if (end-p < (gssize)sizeof (Hit))
+		return NULL;
+	p += sizeof (Hit);
+
+	for (i = 0; i < NUM_CACHE_NAMES; i++) {
+		if (end-p < (gssize)sizeof (length))
+			return NULL;
+		length = *p;
+
+		if (length != CACHE_SAME) {
+			if (end-p-1 < length)
+				return NULL;
+			names[i] = p;
+			p += length;
+		}
+		p++;
+	}
+
+	return p;
+}
+
+/* [ write_header ]
+ * Update the header, making the hits appended so far part of the cache
+ */
+static gboolean
+write_header (HitCache *cache)
+{
+	if (pwrite (cache->fd, &cache->header, sizeof (cache->header), 0) != sizeof (cache->header)) {
+		g_warning ("Failed to write the event cache: %s", g_strerror (errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* [ load_hits ]
+ * Check that the cache file holds the hits of the start of the log, and map
+ * them for reading back. Return FALSE if the log was rotated, truncated or
+ * the cache is damaged
+ */
+static gboolean
+load_hits (HitCache *cache, const gchar *data, gsize size, const struct stat *st)
+{
+	HitCacheHeader *header = &cache->header;
+	const gchar *p, *end;
+	const gchar *names[NUM_CACHE_NAMES] = { NULL, NULL, NULL };
+	gpointer mapping;
+	gsize mapping_size;
+	GArray *blocks;
+	guint i;
+
+	if (pread (cache->fd, header, sizeof (*header), 0) != sizeof (*header))
+		return FALSE;
+
+	if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+	    header->dev != (guint64)st->st_dev || header->inode != (guint64)st->st_ino ||
+	    header->length > CACHE_MAX_SIZE)
+		return FALSE;
+
+	if (header->offset == 0 || header->offset > size || data[header->offset-1] != '\n' ||
+	    hash_line_end (data, header->offset) != header->hash)
+		return FALSE;
+
+	/* Drop anything written after the header was last updated */
+	mapping_size = sizeof (*header) + header->length;
+	if (ftruncate (cache->fd, mapping_size) != 0)
+		return FALSE;
+
+	mapping = mmap (NULL, mapping_size, PROT_READ, MAP_PRIVATE, cache->fd, 0);
+	if (mapping == MAP_FAILED)
+		return FALSE;
+
+	/* Reading the hits back trusts the lengths, check them once up front.
+	   Note where each block starts for reading them back newest first */
+	p = (const gchar *)mapping + sizeof (*header);
+	end = (const gchar *)mapping + mapping_size;
+	blocks = g_array_new (FALSE, FALSE, sizeof (HitCacheBlock));
+	for (i = 0; i < header->count && p != NULL; i++) {
+		if (i % CACHE_BLOCK == 0) {
+			HitCacheBlock block;
+			guint j;
+
+			block.position = p - (const gchar *)mapping;
+			for (j = 0; j < NUM_CACHE_NAMES; j++)
+				block.names[j] = (names[j] != NULL) ? names[j] - (const gchar *)mapping : 0;
+			g_array_append_val (blocks, block);
+		}
+		p = skip_hit (p, end, names);
+	}
+
+	if (p != end) {
+		g_array_free (blocks, TRUE);
+		munmap (mapping, mapping_size);
+		return FALSE;
+	}
+
+	cache->mapping = mapping;
+	cache->mapping_size = mapping_size;
+	cache->cached = header->count;
+	cache->position = sizeof (*header);
+	cache->blocks = blocks;
+
+	return TRUE;
+}
+
+/* [ hitcache_open ]
+ * Open the cache for a mapped log. The hits cached for the start of the log
+ * can be read back with hitcache_read_reverse, the rest of it has to be parsed. A
+ * cache that doesn't match the log is emptied. Return NULL if there is no
+ * usable cache file
+ */
+HitCache *
+hitcache_open (const gchar *data, gsize size, const struct stat *st)
+{
+	HitCache *cache;
+	gchar *path;
+	gint fd;
+
+	path = cache_path ();
+	if (path == NULL)
+		return NULL;
+
+	fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		g_warning ("Failed to open the event cache %s: %s", path, g_strerror (errno));
+		g_free (path);
+		return NULL;
+	}
+	g_free (path);
+
+	cache = g_new0 (HitCache, 1);
+	cache->fd = fd;
+	cache->staging = -1;
+
+	if (!load_hits (cache, data, size, st)) {
+		memset (&cache->header, 0, sizeof (cache->header));
+		cache->header.magic = CACHE_MAGIC;
+		cache->header.version = CACHE_VERSION;
+		cache->header.dev = st->st_dev;
+		cache->header.inode = st->st_ino;
+
+		if (ftruncate (fd, 0) != 0 || !write_header (cache)) {
+			close (fd);
+			g_free (cache);
+			return NULL;
+		}
+	}
+
+	return cache;
+}
+
+/* [ hitcache_get_offset ]
+ * Return the number of bytes at the start of the log the cached hits cover
+ */
+gsize
+hitcache_get_offset (const HitCache *cache)
+{
+	return cache->header.offset;
+}
+
+/* [ decode_hit ]
+ * Read back the cached hit at the current position into h and move past it
+ */
+static void
+decode_hit (HitCache *cache, Hit *h)
+{
+	const gchar *p;
+	guint i;
+
+	p = cache->mapping + cache->position;
+	memcpy (h, p, sizeof (Hit));
+	p += sizeof (Hit);
+
+	for (i = 0; i < NUM_CACHE_NAMES; i++) {
+		guint8 length = *p++;
+
+		if (length != CACHE_SAME) {
+			cache->previous[i] = hit_intern (p, length);
+			p += length;
+		}
+		G_STRUCT_MEMBER (guint16, h, hit_names[i]) = cache->previous[i];
+	}
+	cache->position = p - cache->mapping;
+}
+
+/* [ hitcache_read_reverse ]
+ * Read back the next cached hit, newest first, into h. The hits are decoded
+ * a block at a time from where the block starts. Return FALSE after the
+ * oldest one
+ */
+gboolean
+hitcache_read_reverse (HitCache *cache, Hit *h)
+{
+	if (cache->block == NULL)
+		cache->block = g_array_sized_new (FALSE, FALSE, sizeof (Hit), CACHE_BLOCK);
+
+	if (cache->block->len == 0) {
+		const HitCacheBlock *block;
+		guint first, i;
+
+		if (cache->read == cache->cached)
+			return FALSE;
+
+		/* The blocks before the last one are full */
+		first = (cache->cached - cache->read - 1) / CACHE_BLOCK * CACHE_BLOCK;
+		block = &g_array_index (cache->blocks, HitCacheBlock, first / CACHE_BLOCK);
+
+		cache->position = block->position;
+		for (i = 0; i < NUM_CACHE_NAMES; i++) {
+			const gchar *name = cache->mapping + block->names[i];
+
+			cache->previous[i] = (block->names[i] != 0) ? hit_intern (name+1, *(const guint8 *)name) : 0;
+		}
+
+		g_array_set_size (cache->block, cache->cached - cache->read - first);
+		for (i = 0; i < cache->block->len; i++)
+			decode_hit (cache, &g_array_index (cache->block, Hit, i));
+	}
+
+	*h = g_array_index (cache->block, Hit, cache->block->len-1);
+	g_array_set_size (cache->block, cache->block->len-1);
+	cache->read++;
+
+	return TRUE;
+}
+
+/* [ hitcache_encode ]
+ * Encode hits for appending to the cache. Names repeating those of the
+ * previous hit, like the interfaces usually do, take only a marker. Safe to
+ * call from any thread
+ */
+GByteArray *
+hitcache_encode (GPtrArray *hits)
+{
+	GByteArray *records;
+	const Hit *previous = NULL;
+	guint i, j;
+
+	records = g_byte_array_new ();
+	for (i = 0; i < hits->len; i++) {
+		const Hit *h = g_ptr_array_index (hits, i);
+
+		g_byte_array_append (records, (const guint8 *)h, sizeof (Hit));
+		for (j = 0; j < NUM_CACHE_NAMES; j++) {
+			guint16 id = G_STRUCT_MEMBER (guint16, h, hit_names[j]);
+			guint8 length;
+
+			if (previous != NULL && id == G_STRUCT_MEMBER (guint16, previous, hit_names[j])) {
+				length = CACHE_SAME;
+				g_byte_array_append (records, &length, sizeof (length));
+			} else {
+				const gchar *name = hit_name (id);
+
+				length = strlen (name);
+				g_byte_array_append (records, &length, sizeof (length));
+				g_byte_array_append (records, (const guint8 *)name, length);
+			}
+		}
+		previous = h;
+	}
+
+	return records;
+}
+
+/* [ hitcache_append ]
+ * Append the encoded hits of the part of the log ending at offset, which
+ * must follow the part cached so far. A part not ending a line, or one
+ * taking the cache over its size limit, ends the caching
+ */
+static void
+hitcache_append (HitCache *cache, GByteArray *records, guint count, const gchar *data, gsize offset)
+{
+	HitCacheHeader *header = &cache->header;
+	gsize position = sizeof (*header) + header->length;
+
+	if (cache->full)
+		return;
+
+	if (data[offset-1] != '\n' || position + records->len > CACHE_MAX_SIZE) {
+		cache->full = TRUE;
+		return;
+	}
+
+	if (pwrite (cache->fd, records->data, records->len, position) != (gssize)records->len) {
+		g_warning ("Failed to write the event cache: %s", g_strerror (errno));
+		cache->full = TRUE;
+		return;
+	}
+
+	header->length += records->len;
+	header->count += count;
+	header->offset = offset;
+	header->hash = hash_line_end (data, offset);
+	if (!write_header (cache))
+		cache->full = TRUE;
+}
+
+/* [ hitcache_stage ]
+ * Set aside encoded hits that can't be appended yet, because the part of the
+ * log before them is still being parsed, in a staging file. Return their
+ * position there for hitcache_append_staged, or -1 if they can't be staged,
+ * which ends the caching
+ */
+gint64
+hitcache_stage (HitCache *cache, GByteArray *records)
+{
+	gint64 position = cache->staged;
+
+	if (cache->full)
+		return -1;
+
+	if (sizeof (cache->header) + cache->header.length + cache->staged + records->len > CACHE_MAX_SIZE) {
+		cache->full = TRUE;
+		return -1;
+	}
+
+	if (cache->staging < 0) {
+		gchar *path, *staging;
+
+		path = cache_path ();
+		if (path == NULL) {
+			cache->full = TRUE;
+			return -1;
+		}
+		staging = g_strconcat (path, ".staging", NULL);
+		g_free (path);
+
+		/* Only needed for this reload, gone once closed */
+		cache->staging = open (staging, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (cache->staging >= 0)
+			unlink (staging);
+		else
+			g_warning ("Failed to open %s: %s", staging, g_strerror (errno));
+		g_free (staging);
+
+		if (cache->staging < 0) {
+			cache->full = TRUE;
+			return -1;
+		}
+	}
+
+	if (pwrite (cache->staging, records->data, records->len, position) != (gssize)records->len) {
+		g_warning ("Failed to write the event cache: %s", g_strerror (errno));
+		cache->full = TRUE;
+		return -1;
+	}
+	cache->staged += records->len;
+
+	return position;
+}
+
+/* [ hitcache_append_staged ]
+ * Append staged hits, like hitcache_append, once the part of the log before
+ * them is cached
+ */
+void
+hitcache_append_staged (HitCache *cache, gint64 position, gsize length, guint count, const gchar *data, gsize offset)
+{
+	GByteArray *records;
+
+	if (cache->full || position < 0)
+		return;
+
+	records = g_byte_array_sized_new (length);
+	g_byte_array_set_size (records, length);
+	if (pread (cache->staging, records->data, length, position) != (gssize)length) {
+		g_warning ("Failed to read the event cache: %s", g_strerror (errno));
+		cache->full = TRUE;
+	} else
+		hitcache_append (cache, records, count, data, offset);
+	g_byte_array_free (records, TRUE);
+}
+
+/* [ hitcache_close ]
+ * Close the cache, the hits appended so far are kept for the next reload
+ */
+void
+hitcache_close (HitCache *cache)
+{
+	if (cache->mapping != NULL)
+		munmap (cache->mapping, cache->mapping_size);
+	if (cache->blocks != NULL)
+		g_array_free (cache->blocks, TRUE);
+	if (cache->block != NULL)
+		g_array_free (cache->block, TRUE);
+	if (cache->staging >= 0)
+		close (cache->staging);
+	close (cache->fd);
+	g_free (cache);
+}
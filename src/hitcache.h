@@ -0,0 +1,33 @@
+/*---[ hitcache.h ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * On-disk cache of the hits parsed from the system log
+ *--------------------------------------------------------------------*/
+
+#ifndef _FORTIFIED_HITCACHE
+#define _FORTIFIED_HITCACHE
+
+#include <config.h>
+#include <gnome.h>
+#include <sys/stat.h>
+
+#include "fortified.h"
+
+typedef struct _HitCache HitCache;
+
+HitCache *hitcache_open (const gchar *data, gsize size, const struct stat *st);
+gsize hitcache_get_offset (const HitCache *cache);
+gboolean hitcache_read_reverse (HitCache *cache, Hit *h);
+
+GByteArray *hitcache_encode (GPtrArray *hits);
+gint64 hitcache_stage (HitCache *cache, GByteArray *records);
+void hitcache_append_staged (HitCache *cache, gint64 position, gsize length, guint count, const gchar *data, gsize offset);
+
+void hitcache_close (HitCache *cache);
+
+#endif
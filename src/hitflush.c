@@ -0,0 +1,479 @@
+/*---[ hitflush.c ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * New hits going into the events list a batch at a time, and the columns
+ * of the list widened for them
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+
+#include "hitflush.h"
+#include "hitview.h"
+#include "util.h"
+
+#define FIT_ROWS 1024 /* Newest rows of a flush the columns are widened for */
+
+typedef struct _Aggregate Aggregate;
+typedef struct _Aggregates Aggregates;
+
+/* The row hits of the same traffic are counted into while they keep
+   repeating within the window */
+struct _Aggregate
+{
+	guint32 source; /* The traffic, as in the hit */
+	guint32 destination;
+	guint16 port;
+	guint8 protocol;
+	guint8 direction;
+	gint64 serial; /* The row's first hit, see hit_model_find_serial */
+	gint64 first_seen; /* Times of the hits counted, the row's included */
+	gint64 last_seen;
+	GList link; /* Its place in the by_age queue */
+};
+
+/* The aggregates of the rows at one end of the list */
+struct _Aggregates
+{
+	GHashTable *table; /* Aggregates by their traffic */
+	GQueue *by_age; /* The aggregates, least recently counted into first */
+	gint64 now; /* Time of the hit aggregated furthest from the other end */
+	gboolean backward; /* The hits come newest first */
+};
+
+struct _HitFlush
+{
+	HitModel *model;
+	GtkTreeView *view; /* Or NULL, nothing is widened without one */
+	GArray *queued; /* New hits waiting to go into the list together */
+	guint fitted_lengths[NUM_HITCOLUMNS]; /* Longest text each column was widened for since the last autosize */
+	GHashTable *hostnames; /* Resolved names of addresses, shown in their place. Not owned, may be NULL */
+	Aggregates newer; /* Of the rows of new hits */
+	Aggregates older; /* Of the rows of hits put in older than all the others */
+};
+
+/* [ aggregate_hash ]
+ * Hash function for the traffic of an aggregate
+ */
+static guint
+aggregate_hash (gconstpointer key)
+{
+	const Aggregate *a = key;
+
+	return (a->source * 2654435761u) ^ a->destination ^
+	       ((guint)a->port << 16 | (guint)a->protocol << 8 | a->direction);
+}
+
+/* [ aggregate_equal ]
+ * Test if two aggregates are for the same traffic
+ */
+static gboolean
+aggregate_equal (gconstpointer key1, gconstpointer key2)
+{
+	const Aggregate *a = key1, *b = key2;
+
+	return (a->source == b->source && a->destination == b->destination &&
+	        a->port == b->port && a->protocol == b->protocol &&
+	        a->direction == b->direction);
+}
+
+/* [ init_aggregates ]
+ * Set up an empty table of aggregates
+ */
+static void
+init_aggregates (Aggregates *set)
+{
+	set->table = g_hash_table_new_full (aggregate_hash, aggregate_equal, g_free, NULL);
+	set->by_age = g_queue_new ();
+	set->now = 0;
+	set->backward = FALSE;
+}
+
+/* [ forget_aggregates ]
+ * Stop counting into rows, least recently counted into first, until at
+ * most keep of them are left
+ */
+static void
+forget_aggregates (Aggregates *set, guint keep)
+{
+	GList *oldest;
+
+	while (g_queue_get_length (set->by_age) > keep) {
+		oldest = g_queue_pop_head_link (set->by_age);
+		g_hash_table_remove (set->table, oldest->data);
+	}
+}
+
+/* [ reset_aggregates ]
+ * Forget all the aggregates, the next hits come in the given direction
+ */
+static void
+reset_aggregates (Aggregates *set, gboolean backward)
+{
+	forget_aggregates (set, 0);
+	set->now = 0;
+	set->backward = backward;
+}
+
+/* [ expire_aggregates ]
+ * Forget the aggregates not counted into within the window of the time
+ * the hits have got to
+ */
+static void
+expire_aggregates (Aggregates *set, gint64 window)
+{
+	GList *oldest;
+	Aggregate *a;
+
+	while ((oldest = g_queue_peek_head_link (set->by_age)) != NULL) {
+		a = oldest->data;
+		if (set->backward ? a->first_seen - set->now <= window : set->now - a->last_seen <= window)
+			break;
+		g_queue_pop_head_link (set->by_age);
+		g_hash_table_remove (set->table, a);
+	}
+}
+
+/* [ count_into_aggregate ]
+ * Count a hit into the row of the same traffic if the hit is within the
+ * window of the hits counted there, by the time they were logged, and the
+ * row is still in the list. Return true if it was, serial is set to the
+ * serial of the row
+ */
+static gboolean
+count_into_aggregate (HitFlush *flush, Aggregates *set, const Hit *h, gint64 window, gint64 *serial)
+{
+	Aggregate key, *a;
+	gint64 time;
+
+	/* Hits without a time happened about when the one before them did */
+	time = (h->time != 0) ? h->time : set->now;
+	if (set->now == 0)
+		set->now = time;
+	else
+		set->now = set->backward ? MIN (set->now, time) : MAX (set->now, time);
+	expire_aggregates (set, window);
+
+	key.source = h->source;
+	key.destination = h->destination;
+	key.port = h->port;
+	key.protocol = h->protocol;
+	key.direction = h->direction;
+
+	a = g_hash_table_lookup (set->table, &key);
+	if (a == NULL)
+		return FALSE;
+
+	g_queue_unlink (set->by_age, &a->link);
+	if (time < a->first_seen - window || time > a->last_seen + window ||
+	    !hit_model_count_hit (flush->model, a->serial, h)) {
+		g_hash_table_remove (set->table, a);
+		return FALSE;
+	}
+
+	a->first_seen = MIN (a->first_seen, time);
+	a->last_seen = MAX (a->last_seen, time);
+	g_queue_push_tail_link (set->by_age, &a->link);
+	*serial = a->serial;
+
+	return TRUE;
+}
+
+/* [ add_aggregate ]
+ * Count the hits repeating a hit into the row it was just given
+ */
+static void
+add_aggregate (HitFlush *flush, Aggregates *set, const Hit *h, gint64 serial)
+{
+	Aggregate *a = g_new (Aggregate, 1);
+
+	a->source = h->source;
+	a->destination = h->destination;
+	a->port = h->port;
+	a->protocol = h->protocol;
+	a->direction = h->direction;
+	a->serial = serial;
+	a->first_seen = a->last_seen = (h->time != 0) ? h->time : set->now;
+	a->link.data = a;
+	a->link.prev = a->link.next = NULL;
+	g_hash_table_insert (set->table, a, a);
+	g_queue_push_tail_link (set->by_age, &a->link);
+
+	/* The rows dropped from the list take their aggregates along, sooner
+	   or later */
+	forget_aggregates (set, hit_model_get_total (flush->model));
+}
+
+/* [ format_totals ]
+ * Return the text of a totals column of a row, written into a buffer of
+ * HIT_TEXT_MAX bytes
+ */
+static const gchar *
+format_totals (HitModel *model, GtkTreeIter *iter, gint column, gchar *buffer)
+{
+	HitTotals totals;
+	Hit last;
+
+	hit_model_get_totals (model, iter, &totals);
+
+	switch (column) {
+	case HITCOL_COUNT:
+		g_snprintf (buffer, HIT_TEXT_MAX, "%u", totals.count);
+		return buffer;
+	case HITCOL_LAST_SEEN:
+		last = *hit_model_get_hit (model, iter);
+		last.time = totals.last_seen;
+		return hit_format (&last, HIT_TIME, buffer);
+	case HITCOL_BYTES:
+		if (totals.bytes == 0 && !(hit_model_get_hit (model, iter)->flags & HIT_HAS_LENGTH))
+			return "";
+		g_snprintf (buffer, HIT_TEXT_MAX, "%" G_GUINT64_FORMAT, totals.bytes);
+		return buffer;
+	default:
+		return "";
+	}
+}
+
+/* [ fit_columns ]
+ * Widen the columns for a new row, before it is drawn. Only text longer
+ * than any the column was widened for is measured, the view measures the
+ * rest of the rows on its own as it gets to them
+ */
+static void
+fit_columns (HitFlush *flush, GtkTreeIter *iter)
+{
+	GtkTreeViewColumn *column;
+	gchar buffer[HIT_TEXT_MAX];
+	gint i, width, separator;
+	guint length;
+
+	for (i = 0; i < NUM_HITCOLUMNS; i++) {
+		column = gtk_tree_view_get_column (flush->view, i);
+		if (column == NULL || !gtk_tree_view_column_get_visible (column))
+			continue;
+		length = strlen (hitflush_cell_text (flush, iter, i, buffer));
+		if (length <= flush->fitted_lengths[i])
+			continue;
+		flush->fitted_lengths[i] = length;
+
+		gtk_tree_view_column_cell_set_cell_data (column, GTK_TREE_MODEL (flush->model), iter, FALSE, FALSE);
+		gtk_tree_view_column_cell_get_size (column, NULL, NULL, NULL, &width, NULL);
+		gtk_widget_style_get (GTK_WIDGET (flush->view), "horizontal-separator", &separator, NULL);
+		width += separator;
+		if (width > gtk_tree_view_column_get_width (column))
+			gtk_tree_view_column_set_min_width (column, width);
+	}
+}
+
+/* [ hitflush_new ]
+ * Create the queue of new hits of a list, shown in view. The view may be
+ * NULL, or have fewer than NUM_HITCOLUMNS columns
+ */
+HitFlush *
+hitflush_new (HitModel *model, GtkTreeView *view)
+{
+	HitFlush *flush = g_new0 (HitFlush, 1);
+
+	flush->model = model;
+	flush->view = view;
+	flush->queued = g_array_new (FALSE, FALSE, sizeof (Hit));
+	init_aggregates (&flush->newer);
+	init_aggregates (&flush->older);
+
+	return flush;
+}
+
+/* [ hitflush_set_hostnames ]
+ * Show the names in a table of addresses in their place, NULL for none
+ */
+void
+hitflush_set_hostnames (HitFlush *flush, GHashTable *hostnames)
+{
+	flush->hostnames = hostnames;
+}
+
+/* [ hitflush_queue ]
+ * Queue a copy of a new hit for the next flush
+ */
+void
+hitflush_queue (HitFlush *flush, const Hit *h)
+{
+	g_array_append_vals (flush->queued, h, 1);
+}
+
+/* [ hitflush_get_queued ]
+ * Return the number of hits waiting for the next flush
+ */
+guint
+hitflush_get_queued (HitFlush *flush)
+{
+	return flush->queued->len;
+}
+
+/* [ hitflush_run ]
+ * Put the hits queued since the last flush into the list, counting the
+ * repeated ones into the rows of the first ones if aggregate is set, and
+ * widen the columns for the newest of them. The rows of a burst scrolled
+ * past are measured by the view if it gets to them. Return true if a row
+ * was added, newest is set to its serial
+ */
+gboolean
+hitflush_run (HitFlush *flush, gboolean aggregate, gint64 window, gint64 *newest)
+{
+	GtkTreeIter iter;
+	gboolean appended = FALSE;
+	gint64 serial;
+	const Hit *h;
+	guint i;
+
+	for (i = 0; i < flush->queued->len; i++) {
+		h = &g_array_index (flush->queued, Hit, i);
+		if (!aggregate || !count_into_aggregate (flush, &flush->newer, h, window, &serial)) {
+			serial = hit_model_append (flush->model, h);
+			if (aggregate)
+				add_aggregate (flush, &flush->newer, h, serial);
+			*newest = serial;
+			appended = TRUE;
+		}
+		/* The totals of a row counted into grow too */
+		if (flush->view != NULL && flush->queued->len - i <= FIT_ROWS &&
+		    hit_model_find_serial (flush->model, serial, &iter))
+			fit_columns (flush, &iter);
+	}
+	g_array_set_size (flush->queued, 0);
+
+	return appended;
+}
+
+/* [ hitflush_put_older ]
+ * Put a hit older than all the rows into the list right away, at the front
+ * if the hits come newest first, or else after the older ones put in since
+ * hitflush_end_older. The hit is counted into a row of the same traffic
+ * instead if aggregate is set, as in hitflush_run. Return false if it
+ * neither fit nor was counted
+ */
+gboolean
+hitflush_put_older (HitFlush *flush, const Hit *h, gboolean front, gboolean aggregate, gint64 window)
+{
+	gint64 serial;
+
+	/* The older hits turned around, the rows counted into are behind them */
+	if (front != flush->older.backward)
+		reset_aggregates (&flush->older, front);
+
+	if (aggregate && count_into_aggregate (flush, &flush->older, h, window, &serial))
+		return TRUE;
+
+	if (front) {
+		if (!hit_model_has_room_front (flush->model))
+			return FALSE;
+		serial = hit_model_prepend (flush->model, h);
+	} else {
+		if (!hit_model_has_room_older (flush->model))
+			return FALSE;
+		serial = hit_model_append_older (flush->model, h);
+	}
+	if (aggregate)
+		add_aggregate (flush, &flush->older, h, serial);
+
+	return TRUE;
+}
+
+/* [ hitflush_end_older ]
+ * Stop counting into the rows of the older hits, none are coming for now
+ */
+void
+hitflush_end_older (HitFlush *flush)
+{
+	reset_aggregates (&flush->older, FALSE);
+}
+
+/* [ hitflush_clear ]
+ * Drop the queued hits and stop counting into the rows, as the list is
+ * cleared
+ */
+void
+hitflush_clear (HitFlush *flush)
+{
+	g_array_set_size (flush->queued, 0);
+	reset_aggregates (&flush->newer, FALSE);
+	reset_aggregates (&flush->older, FALSE);
+}
+
+/* [ hitflush_get_aggregate_size ]
+ * Return the memory a row takes on top of its hit when hits are counted
+ * into it, its totals and its aggregate in the table
+ */
+gsize
+hitflush_get_aggregate_size (void)
+{
+	return sizeof (HitTotals) + sizeof (Aggregate) + 2 * sizeof (gpointer);
+}
+
+/* [ hitflush_cell_text ]
+ * Return the text of a column of a row, written into a buffer of
+ * HIT_TEXT_MAX bytes unless it is kept elsewhere
+ */
+const gchar *
+hitflush_cell_text (HitFlush *flush, GtkTreeIter *iter, gint column, gchar *buffer)
+{
+	const gchar *text = NULL;
+	const Hit *h;
+
+	h = hit_model_get_hit (flush->model, iter);
+
+	if (column >= NUM_HIT_FIELDS)
+		text = format_totals (flush->model, iter, column, buffer);
+	else if (flush->hostnames != NULL && (column == HIT_SOURCE || column == HIT_DESTINATION))
+		text = g_hash_table_lookup (flush->hostnames, GUINT_TO_POINTER (column == HIT_SOURCE ? h->source : h->destination));
+	if (text == NULL)
+		text = hit_format (h, column, buffer);
+
+	return text;
+}
+
+/* [ hitflush_autosize_columns ]
+ * Size the columns to the contents of all the rows again
+ */
+void
+hitflush_autosize_columns (HitFlush *flush)
+{
+	GtkTreeViewColumn *column;
+	gint i;
+
+	if (flush->view == NULL)
+		return;
+
+	for (i = 0; i < NUM_HITCOLUMNS; i++) {
+		flush->fitted_lengths[i] = 0;
+		column = gtk_tree_view_get_column (flush->view, i);
+		if (column != NULL)
+			gtk_tree_view_column_set_min_width (column, -1);
+	}
+
+	/* Fixes a glitch in the view's rendering that causes
+	   text to jump around when mouse moves over an entry */
+	gtk_tree_view_columns_autosize (flush->view);
+}
+
+/* [ hitflush_free ]
+ * Free the queue, the list and the view are left alone
+ */
+void
+hitflush_free (HitFlush *flush)
+{
+	forget_aggregates (&flush->newer, 0);
+	forget_aggregates (&flush->older, 0);
+	g_hash_table_destroy (flush->newer.table);
+	g_hash_table_destroy (flush->older.table);
+	g_queue_free (flush->newer.by_age);
+	g_queue_free (flush->older.by_age);
+	g_array_free (flush->queued, TRUE);
+	g_free (flush);
+}
@@ -0,0 +1,41 @@
+/*---[ hitflush.h ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * New hits going into the events list a batch at a time, and the columns
+ * of the list widened for them
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_HITFLUSH
+#define _FORTIFIED_HITFLUSH
+
+#include <config.h>
+#include <gnome.h>
+
+#include "fortified.h"
+#include "hitmodel.h"
+
+typedef struct _HitFlush HitFlush;
+
+HitFlush *hitflush_new (HitModel *model, GtkTreeView *view);
+void hitflush_set_hostnames (HitFlush *flush, GHashTable *hostnames);
+
+void hitflush_queue (HitFlush *flush, const Hit *h);
+guint hitflush_get_queued (HitFlush *flush);
+gboolean hitflush_run (HitFlush *flush, gboolean aggregate, gint64 window, gint64 *newest);
+gboolean hitflush_put_older (HitFlush *flush, const Hit *h, gboolean front, gboolean aggregate, gint64 window);
+void hitflush_end_older (HitFlush *flush);
+void hitflush_clear (HitFlush *flush);
+gsize hitflush_get_aggregate_size (void);
+
+const gchar *hitflush_cell_text (HitFlush *flush, GtkTreeIter *iter, gint column, gchar *buffer);
+void hitflush_autosize_columns (HitFlush *flush);
+
+void hitflush_free (HitFlush *flush);
+
+#endif
@@ -0,0 +1,666 @@
+/*---[ hitindex.c ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Indexes of the rows of the Events page by the fields of their hits
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+#include <arpa/inet.h>
+
+#include "hitindex.h"
+
+#define CHUNK_SHIFT 16 /* Rows are kept in chunks by their high bits */
+#define CHUNK_ROWS (1 << CHUNK_SHIFT)
+#define CHUNK_WORDS (CHUNK_ROWS / 64)
+#define ARRAY_MAX 4096 /* A chunk with more rows than this becomes a bitmap */
+
+typedef struct _RowChunk RowChunk;
+typedef struct _RowSet RowSet;
+typedef struct _TrieNode TrieNode;
+
+/* The rows of a set that share their high bits. A few of them are a sorted
+   array of their low bits, many a bitmap */
+struct _RowChunk
+{
+	guint32 high; /* The bits shared, row >> CHUNK_SHIFT */
+	guint32 count; /* Rows in the chunk */
+	guint32 size; /* Slots allocated in rows */
+	guint16 *rows;
+	guint64 *bits; /* CHUNK_ROWS bits, NULL while the rows are an array */
+};
+
+/* The rows with a value in a field */
+struct _RowSet
+{
+	guint count;
+	guint chunks_used;
+	guint chunks_size;
+	RowChunk *chunks; /* By high bits */
+};
+
+/* A radix trie of addresses, branching only where they differ. A network
+   is a branch or leaf, with its count of rows */
+struct _TrieNode
+{
+	guint32 key; /* A leaf's address, or the prefix shared under a branch */
+	gint bits; /* Bits of a branch's prefix, its children differ in the next one. -1 for a leaf */
+	guint count; /* Rows under the node */
+	TrieNode *child[2];
+	RowSet rows; /* The rows of a leaf's address */
+};
+
+/* The rows by each field a query can be answered from */
+struct _HitIndex
+{
+	gsize size; /* Bytes taken by the nodes and sets */
+	TrieNode *sources;
+	TrieNode *destinations;
+	RowSet *ports[G_MAXUINT16+1];
+	RowSet *protocols[G_MAXUINT8+1];
+	RowSet *services[G_MAXUINT16+1];
+};
+
+/* [ find_chunk ]
+ * Return the chunk of a set with the given high bits, or NULL. place is set
+ * to where it is or would go
+ */
+static RowChunk *
+find_chunk (RowSet *set, guint32 high, guint *place)
+{
+	guint low = 0, top = set->chunks_used, middle;
+
+	while (low < top) {
+		middle = low + (top - low) / 2;
+		if (set->chunks[middle].high < high)
+			low = middle + 1;
+		else
+			top = middle;
+	}
+
+	*place = low;
+	if (low < set->chunks_used && set->chunks[low].high == high)
+		return &set->chunks[low];
+
+	return NULL;
+}
+
+/* [ find_low ]
+ * Return where the low bits of a row are or would go in an array chunk
+ */
+static guint
+find_low (RowChunk *chunk, guint16 row)
+{
+	guint low = 0, top = chunk->count, middle;
+
+	while (low < top) {
+		middle = low + (top - low) / 2;
+		if (chunk->rows[middle] < row)
+			low = middle + 1;
+		else
+			top = middle;
+	}
+
+	return low;
+}
+
+/* [ chunk_to_bitmap ]
+ * Turn an array chunk into a bitmap, size is updated for the change
+ */
+static void
+chunk_to_bitmap (RowChunk *chunk, gsize *size)
+{
+	guint i;
+
+	chunk->bits = g_new0 (guint64, CHUNK_WORDS);
+	for (i = 0; i < chunk->count; i++)
+		chunk->bits[chunk->rows[i] / 64] |= G_GUINT64_CONSTANT (1) << (chunk->rows[i] % 64);
+	*size += CHUNK_WORDS * sizeof (guint64) - chunk->size * sizeof (guint16);
+	g_free (chunk->rows);
+	chunk->rows = NULL;
+	chunk->size = 0;
+}
+
+/* [ chunk_to_array ]
+ * Turn a bitmap chunk back into an array, size is updated for the change
+ */
+static void
+chunk_to_array (RowChunk *chunk, gsize *size)
+{
+	guint64 word;
+	guint i, n = 0;
+
+	chunk->size = chunk->count;
+	chunk->rows = g_new (guint16, chunk->size);
+	for (i = 0; i < CHUNK_WORDS; i++)
+		for (word = chunk->bits[i]; word != 0; word &= word - 1)
+			chunk->rows[n++] = i * 64 + g_bit_nth_lsf (word, -1);
+	*size += chunk->size * sizeof (guint16) - CHUNK_WORDS * sizeof (guint64);
+	g_free (chunk->bits);
+	chunk->bits = NULL;
+}
+
+/* [ chunk_size ]
+ * Return the bytes taken by the rows of a chunk
+ */
+static gsize
+chunk_size (const RowChunk *chunk)
+{
+	return (chunk->bits != NULL) ? CHUNK_WORDS * sizeof (guint64) : chunk->size * sizeof (guint16);
+}
+
+/* [ rowset_add ]
+ * Add a row to a set, size is updated for what it takes
+ */
+static void
+rowset_add (RowSet *set, guint row, gsize *size)
+{
+	guint16 low = row & (CHUNK_ROWS - 1);
+	guint64 bit = G_GUINT64_CONSTANT (1) << (low % 64);
+	RowChunk *chunk;
+	guint place;
+
+	chunk = find_chunk (set, row >> CHUNK_SHIFT, &place);
+	if (chunk == NULL) {
+		if (set->chunks_used == set->chunks_size) {
+			*size -= set->chunks_size * sizeof (RowChunk);
+			set->chunks_size = MAX (set->chunks_size * 2, 1);
+			set->chunks = g_renew (RowChunk, set->chunks, set->chunks_size);
+			*size += set->chunks_size * sizeof (RowChunk);
+		}
+		memmove (&set->chunks[place + 1], &set->chunks[place],
+		         (set->chunks_used - place) * sizeof (RowChunk));
+		set->chunks_used++;
+		chunk = &set->chunks[place];
+		memset (chunk, 0, sizeof (RowChunk));
+		chunk->high = row >> CHUNK_SHIFT;
+	}
+
+	if (chunk->bits == NULL && chunk->count == ARRAY_MAX)
+		chunk_to_bitmap (chunk, size);
+
+	if (chunk->bits != NULL) {
+		if (chunk->bits[low / 64] & bit)
+			return;
+		chunk->bits[low / 64] |= bit;
+	} else {
+		place = find_low (chunk, low);
+		if (place < chunk->count && chunk->rows[place] == low)
+			return;
+		if (chunk->count == chunk->size) {
+			*size -= chunk->size * sizeof (guint16);
+			chunk->size = MAX (chunk->size * 2, 4);
+			chunk->rows = g_renew (guint16, chunk->rows, chunk->size);
+			*size += chunk->size * sizeof (guint16);
+		}
+		memmove (&chunk->rows[place + 1], &chunk->rows[place],
+		         (chunk->count - place) * sizeof (guint16));
+		chunk->rows[place] = low;
+	}
+
+	chunk->count++;
+	set->count++;
+}
+
+/* [ rowset_remove ]
+ * Remove a row from a set, return false if it wasn't in it. size is
+ * updated for what it no longer takes
+ */
+static gboolean
+rowset_remove (RowSet *set, guint row, gsize *size)
+{
+	guint16 low = row & (CHUNK_ROWS - 1);
+	guint64 bit = G_GUINT64_CONSTANT (1) << (low % 64);
+	RowChunk *chunk;
+	guint place;
+
+	chunk = find_chunk (set, row >> CHUNK_SHIFT, &place);
+	if (chunk == NULL)
+		return FALSE;
+
+	if (chunk->bits != NULL) {
+		if (!(chunk->bits[low / 64] & bit))
+			return FALSE;
+		chunk->bits[low / 64] &= ~bit;
+		chunk->count--;
+		/* Halfway back, so that a chunk on the edge doesn't flip back and forth */
+		if (chunk->count == ARRAY_MAX / 2)
+			chunk_to_array (chunk, size);
+	} else {
+		guint i = find_low (chunk, low);
+
+		if (i == chunk->count || chunk->rows[i] != low)
+			return FALSE;
+		chunk->count--;
+		memmove (&chunk->rows[i], &chunk->rows[i + 1], (chunk->count - i) * sizeof (guint16));
+	}
+	set->count--;
+
+	if (chunk->count == 0) {
+		*size -= chunk_size (chunk);
+		g_free (chunk->rows);
+		g_free (chunk->bits);
+		set->chunks_used--;
+		memmove (&set->chunks[place], &set->chunks[place + 1],
+		         (set->chunks_used - place) * sizeof (RowChunk));
+	}
+
+	return TRUE;
+}
+
+/* [ rowset_collect ]
+ * Append the rows of a set to an array of them
+ */
+static void
+rowset_collect (const RowSet *set, GArray *rows)
+{
+	const RowChunk *chunk;
+	guint64 word;
+	guint i, j, row;
+
+	for (i = 0; i < set->chunks_used; i++) {
+		chunk = &set->chunks[i];
+		if (chunk->bits != NULL) {
+			for (j = 0; j < CHUNK_WORDS; j++)
+				for (word = chunk->bits[j]; word != 0; word &= word - 1) {
+					row = (chunk->high << CHUNK_SHIFT) | (j * 64 + g_bit_nth_lsf (word, -1));
+					g_array_append_val (rows, row);
+				}
+		} else {
+			for (j = 0; j < chunk->count; j++) {
+				row = (chunk->high << CHUNK_SHIFT) | chunk->rows[j];
+				g_array_append_val (rows, row);
+			}
+		}
+	}
+}
+
+/* [ rowset_clear ]
+ * Empty a set, size is updated for what it no longer takes
+ */
+static void
+rowset_clear (RowSet *set, gsize *size)
+{
+	guint i;
+
+	for (i = 0; i < set->chunks_used; i++) {
+		*size -= chunk_size (&set->chunks[i]);
+		g_free (set->chunks[i].rows);
+		g_free (set->chunks[i].bits);
+	}
+	*size -= set->chunks_size * sizeof (RowChunk);
+	g_free (set->chunks);
+	memset (set, 0, sizeof (RowSet));
+}
+
+/* [ valued_free ]
+ * Free the set of a value
+ */
+static void
+valued_free (RowSet **set, gsize *size)
+{
+	if (*set == NULL)
+		return;
+
+	rowset_clear (*set, size);
+	*size -= sizeof (RowSet);
+	g_free (*set);
+	*set = NULL;
+}
+
+/* [ valued_add ]
+ * Add a row to the set of a value, creating the set
+ */
+static void
+valued_add (RowSet **sets, guint value, guint row, gsize *size)
+{
+	if (sets[value] == NULL) {
+		sets[value] = g_new0 (RowSet, 1);
+		*size += sizeof (RowSet);
+	}
+	rowset_add (sets[value], row, size);
+}
+
+/* [ valued_remove ]
+ * Remove a row from the set of a value, freeing the set once it's empty
+ */
+static void
+valued_remove (RowSet **sets, guint value, guint row, gsize *size)
+{
+	if (sets[value] == NULL)
+		return;
+
+	rowset_remove (sets[value], row, size);
+	if (sets[value]->count == 0)
+		valued_free (&sets[value], size);
+}
+
+/* [ prefix_mask ]
+ * Return the mask of the first bits of an address
+ */
+static guint32
+prefix_mask (gint bits)
+{
+	return (bits <= 0) ? 0 : G_MAXUINT32 << (32 - bits);
+}
+
+/* [ bit_at ]
+ * Return a bit of an address, counted from the top
+ */
+static guint
+bit_at (guint32 key, gint bit)
+{
+	return (key >> (31 - bit)) & 1;
+}
+
+/* [ trie_add ]
+ * Add a row to the leaf of an address, creating the leaf. size is updated
+ * for what it takes
+ */
+static void
+trie_add (TrieNode **root, guint32 key, guint row, gsize *size)
+{
+	TrieNode **link = root;
+	TrieNode *node, *leaf, *branch;
+	gint bits;
+
+	while ((node = *link) != NULL && node->bits >= 0 &&
+	       ((key ^ node->key) & prefix_mask (node->bits)) == 0)
+		link = &node->child[bit_at (key, node->bits)];
+
+	if (node == NULL || node->bits >= 0 || node->key != key) {
+		leaf = g_new0 (TrieNode, 1);
+		leaf->key = key;
+		leaf->bits = -1;
+		*size += sizeof (TrieNode);
+
+		if (node == NULL)
+			*link = leaf;
+		else {
+			/* Branch off where the address first differs from the node */
+			bits = 31 - g_bit_nth_msf (key ^ node->key, -1);
+			branch = g_new0 (TrieNode, 1);
+			branch->key = key & prefix_mask (bits);
+			branch->bits = bits;
+			branch->count = node->count;
+			branch->child[bit_at (key, bits)] = leaf;
+			branch->child[!bit_at (key, bits)] = node;
+			*link = branch;
+			*size += sizeof (TrieNode);
+		}
+	}
+
+	for (node = *root; node->bits >= 0; node = node->child[bit_at (key, node->bits)])
+		node->count++;
+	node->count++;
+	rowset_add (&node->rows, row, size);
+}
+
+/* [ trie_remove ]
+ * Remove a row from the leaf of an address, removing the leaf once it has
+ * no rows left. size is updated for what it no longer takes
+ */
+static void
+trie_remove (TrieNode **root, guint32 key, guint row, gsize *size)
+{
+	TrieNode **link = root, **parent = NULL;
+	TrieNode *node, *branch;
+
+	while ((node = *link) != NULL && node->bits >= 0) {
+		parent = link;
+		link = &node->child[bit_at (key, node->bits)];
+	}
+	if (node == NULL || node->key != key || !rowset_remove (&node->rows, row, size))
+		return;
+
+	for (node = *root; node->bits >= 0; node = node->child[bit_at (key, node->bits)])
+		node->count--;
+	node->count--;
+
+	if (node->count == 0) {
+		rowset_clear (&node->rows, size);
+		if (parent == NULL)
+			*root = NULL;
+		else {
+			/* The branch is left with one child, which takes its place */
+			branch = *parent;
+			*parent = branch->child[branch->child[0] == node ? 1 : 0];
+			g_free (branch);
+			*size -= sizeof (TrieNode);
+		}
+		g_free (node);
+		*size -= sizeof (TrieNode);
+	}
+}
+
+/* [ trie_network ]
+ * Return the node with all the addresses of a network under it and no
+ * others, or NULL if there are none
+ */
+static TrieNode *
+trie_network (TrieNode *root, guint32 network, guint32 mask)
+{
+	gint bits = (mask == 0) ? 0 : 32 - g_bit_nth_lsf (mask, -1);
+	TrieNode *node = root;
+
+	while (node != NULL && node->bits >= 0 && node->bits < bits) {
+		if ((node->key ^ network) & prefix_mask (node->bits))
+			return NULL;
+		node = node->child[bit_at (network, node->bits)];
+	}
+
+	if (node == NULL || ((node->key ^ network) & mask) != 0)
+		return NULL;
+
+	return node;
+}
+
+/* [ trie_collect ]
+ * Append the rows under a node to an array of them
+ */
+static void
+trie_collect (const TrieNode *node, GArray *rows)
+{
+	if (node->bits < 0)
+		rowset_collect (&node->rows, rows);
+	else {
+		trie_collect (node->child[0], rows);
+		trie_collect (node->child[1], rows);
+	}
+}
+
+/* [ trie_free ]
+ * Free the nodes of a trie
+ */
+static void
+trie_free (TrieNode *node, gsize *size)
+{
+	if (node == NULL)
+		return;
+
+	trie_free (node->child[0], size);
+	trie_free (node->child[1], size);
+	rowset_clear (&node->rows, size);
+	g_free (node);
+	*size -= sizeof (TrieNode);
+}
+
+/* [ hitindex_new ]
+ * Create an empty index
+ */
+HitIndex *
+hitindex_new (void)
+{
+	return g_new0 (HitIndex, 1);
+}
+
+/* [ hitindex_add ]
+ * Index a row by the fields of its hit
+ */
+void
+hitindex_add (HitIndex *index, guint row, const Hit *h)
+{
+	if (h->flags & HIT_HAS_SOURCE)
+		trie_add (&index->sources, ntohl (h->source), row, &index->size);
+	if (h->flags & HIT_HAS_DESTINATION)
+		trie_add (&index->destinations, ntohl (h->destination), row, &index->size);
+	if (h->flags & HIT_HAS_PORT)
+		valued_add (index->ports, h->port, row, &index->size);
+	if (h->flags & HIT_HAS_PROTOCOL)
+		valued_add (index->protocols, h->protocol, row, &index->size);
+	valued_add (index->services, h->service, row, &index->size);
+}
+
+/* [ hitindex_remove ]
+ * Drop a row from the index, h has to be the hit it was added with
+ */
+void
+hitindex_remove (HitIndex *index, guint row, const Hit *h)
+{
+	if (h->flags & HIT_HAS_SOURCE)
+		trie_remove (&index->sources, ntohl (h->source), row, &index->size);
+	if (h->flags & HIT_HAS_DESTINATION)
+		trie_remove (&index->destinations, ntohl (h->destination), row, &index->size);
+	if (h->flags & HIT_HAS_PORT)
+		valued_remove (index->ports, h->port, row, &index->size);
+	if (h->flags & HIT_HAS_PROTOCOL)
+		valued_remove (index->protocols, h->protocol, row, &index->size);
+	valued_remove (index->services, h->service, row, &index->size);
+}
+
+/* [ hitindex_find ]
+ * Append to rows the rows that may match a query, from the indexed term
+ * that matches the fewest. They still have to be matched against the
+ * whole query, and a row may be given twice. Return false if no term is
+ * indexed or if more than limit rows would be given, the rows are better
+ * matched one by one then
+ */
+gboolean
+hitindex_find (HitIndex *index, const HitQuery *query, guint limit, GArray *rows)
+{
+	TrieNode *sources = NULL, *destinations = NULL, *host_sources = NULL, *host_destinations = NULL;
+	guint best = G_MAXUINT, count, term = 0, i;
+
+	if (query->terms & HITQUERY_SOURCE) {
+		sources = trie_network (index->sources, query->source, query->source_mask);
+		count = (sources != NULL) ? sources->count : 0;
+		if (count < best) {
+			best = count;
+			term = HITQUERY_SOURCE;
+		}
+	}
+	if (query->terms & HITQUERY_DESTINATION) {
+		destinations = trie_network (index->destinations, query->destination, query->destination_mask);
+		count = (destinations != NULL) ? destinations->count : 0;
+		if (count < best) {
+			best = count;
+			term = HITQUERY_DESTINATION;
+		}
+	}
+	if (query->terms & HITQUERY_HOST) {
+		host_sources = trie_network (index->sources, query->host, query->host_mask);
+		host_destinations = trie_network (index->destinations, query->host, query->host_mask);
+		count = (host_sources != NULL) ? host_sources->count : 0;
+		count += (host_destinations != NULL) ? host_destinations->count : 0;
+		if (count < best) {
+			best = count;
+			term = HITQUERY_HOST;
+		}
+	}
+	if (query->terms & HITQUERY_PORT) {
+		count = 0;
+		for (i = query->port_low; i <= query->port_high; i++)
+			count += (index->ports[i] != NULL) ? index->ports[i]->count : 0;
+		if (count < best) {
+			best = count;
+			term = HITQUERY_PORT;
+		}
+	}
+	if (query->terms & HITQUERY_PROTOCOL) {
+		count = (index->protocols[query->protocol] != NULL) ? index->protocols[query->protocol]->count : 0;
+		if (count < best) {
+			best = count;
+			term = HITQUERY_PROTOCOL;
+		}
+	}
+	if (query->terms & HITQUERY_SERVICE) {
+		count = 0;
+		for (i = 0; i < query->service_count; i++)
+			if (index->services[query->services[i]] != NULL)
+				count += index->services[query->services[i]]->count;
+		if (count < best) {
+			best = count;
+			term = HITQUERY_SERVICE;
+		}
+	}
+
+	if (term == 0 || best > limit)
+		return FALSE;
+
+	switch (term) {
+	case HITQUERY_SOURCE:
+		if (sources != NULL)
+			trie_collect (sources, rows);
+		break;
+	case HITQUERY_DESTINATION:
+		if (destinations != NULL)
+			trie_collect (destinations, rows);
+		break;
+	case HITQUERY_HOST:
+		if (host_sources != NULL)
+			trie_collect (host_sources, rows);
+		if (host_destinations != NULL)
+			trie_collect (host_destinations, rows);
+		break;
+	case HITQUERY_PORT:
+		for (i = query->port_low; i <= query->port_high; i++)
+			if (index->ports[i] != NULL)
+				rowset_collect (index->ports[i], rows);
+		break;
+	case HITQUERY_PROTOCOL:
+		if (index->protocols[query->protocol] != NULL)
+			rowset_collect (index->protocols[query->protocol], rows);
+		break;
+	case HITQUERY_SERVICE:
+		for (i = 0; i < query->service_count; i++)
+			if (index->services[query->services[i]] != NULL)
+				rowset_collect (index->services[query->services[i]], rows);
+		break;
+	}
+
+	return TRUE;
+}
+
+/* [ hitindex_get_size ]
+ * Return the bytes an index takes, its nodes and sets of rows included
+ */
+gsize
+hitindex_get_size (HitIndex *index)
+{
+	return sizeof (HitIndex) + index->size;
+}
+
+/* [ hitindex_free ]
+ * Free an index
+ */
+void
+hitindex_free (HitIndex *index)
+{
+	guint i;
+
+	trie_free (index->sources, &index->size);
+	trie_free (index->destinations, &index->size);
+	for (i = 0; i <= G_MAXUINT16; i++) {
+		valued_free (&index->ports[i], &index->size);
+		valued_free (&index->services[i], &index->size);
+	}
+	for (i = 0; i <= G_MAXUINT8; i++)
+		valued_free (&index->protocols[i], &index->size);
+	g_free (index);
+}
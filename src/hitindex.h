@@ -0,0 +1,31 @@
+/*---[ hitindex.h ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Indexes of the rows of the Events page by the fields of their hits
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_HITINDEX
+#define _FORTIFIED_HITINDEX
+
+#include <config.h>
+#include <gnome.h>
+
+#include "fortified.h"
+#include "hitquery.h"
+
+typedef struct _HitIndex HitIndex;
+
+HitIndex *hitindex_new (void);
+void hitindex_add (HitIndex *index, guint row, const Hit *h);
+void hitindex_remove (HitIndex *index, guint row, const Hit *h);
+gboolean hitindex_find (HitIndex *index, const HitQuery *query, guint limit, GArray *rows);
+gsize hitindex_get_size (HitIndex *index);
+void hitindex_free (HitIndex *index);
+
+#endif
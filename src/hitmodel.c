@@ -0,0 +1,1318 @@
+/*---[ hitmodel.c ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The list model of the Events page, drawn straight from the hits
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+#include <arpa/inet.h>
+
+#include "hitmodel.h"
+#include "hitring.h"
+#include "hittree.h"
+#include "hitindex.h"
+#include "util.h"
+
+#define MODEL_MIN_ROWS 1024 /* Rows allocated at first, more are added as needed */
+#define QUERY_SCAN_SHARE 16 /* A query whose best indexed term gives more than this share of the rows is matched row by row */
+
+/* The hits are kept as records, the list only points at them. A row is
+   found by its place in the ring while the list is sorted by time, as
+   long as the hits came in the order of their times. Any other sorting,
+   or a hit coming in out of time, is kept in a tree of the rows, so they
+   come and go without moving the rest, and a row is found by position
+   in the tree. Rows equal in the column clicked last keep the order of
+   the columns clicked before.
+   While there is a query, only the rows matching it are shown, in the
+   same order. They are found from the index of the rows by their fields */
+struct _HitModel
+{
+	GObject parent;
+
+	gint stamp; /* Changed whenever rows move, to tell stale iters apart */
+	Hit *hits; /* The hits, by row */
+	gint64 *serials; /* The order the hits came in, by row */
+	HitTotals *totals; /* The hits counted into each row, by row. NULL until one is */
+	guint rows; /* Rows allocated */
+	guint next_row; /* The rows from here on have never been used */
+	GArray *free_rows; /* Rows of evicted hits, used again first */
+	HitRing *ring; /* The rows in the order the hits came in */
+	gint64 first_serial; /* Serials of the oldest and newest hits added */
+	gint64 last_serial;
+	gboolean older; /* Older hits are coming in oldest first */
+	gint64 older_serial; /* Serial of the next of them */
+	gboolean timely; /* The ring has the rows in the order of their times too */
+
+	gint sort_column; /* The column clicked last */
+	GtkSortType sort_order;
+	HitField sort_fields[NUM_HIT_FIELDS]; /* The columns sorted by, sort_column first */
+	GtkSortType sort_orders[NUM_HIT_FIELDS];
+	guint sort_keys; /* Columns in sort_fields */
+	guint *name_ranks; /* Place of each name of hit_intern in the collation order, by id */
+	guint names_ranked;
+	guint protocol_ranks[G_MAXUINT8+1]; /* The same for the protocol names, by number */
+	guint direction_ranks[HIT_OUTBOUND+1]; /* And for the directions */
+	gboolean ranked; /* The protocols and directions have their ranks */
+	HitTree *order; /* The rows in the sorted order, NULL when the ring has it */
+
+	HitQuery *query; /* Only the hits matching it are shown, NULL to show all */
+	HitIndex *index; /* The rows by their fields, once there has been a query */
+	HitTree *shown; /* The rows shown while there is a query, in the order of the list */
+};
+
+struct _HitModelClass
+{
+	GObjectClass parent_class;
+};
+
+static void hit_model_tree_model_init (GtkTreeModelIface *iface);
+static void hit_model_sortable_init (GtkTreeSortableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (HitModel, hit_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL, hit_model_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_SORTABLE, hit_model_sortable_init))
+
+/* [ model_count ]
+ * Return the number of rows shown
+ */
+static guint
+model_count (HitModel *model)
+{
+	if (model->query != NULL)
+		return hittree_get_count (model->shown);
+
+	return hitring_get_count (model->ring);
+}
+
+/* [ is_chronological ]
+ * Test if the list is sorted by time, the ring has that order without
+ * sorting while the hits come in on time
+ */
+static gboolean
+is_chronological (HitModel *model)
+{
+	return (model->sort_column == HIT_TIME ||
+	        model->sort_column == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID ||
+	        model->sort_column == GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID);
+}
+
+/* [ row_in_order ]
+ * Return the row at a position of the list, shown or not
+ */
+static guint
+row_in_order (HitModel *model, guint position)
+{
+	if (model->order != NULL)
+		return hittree_nth (model->order, position);
+
+	if (model->sort_order == GTK_SORT_DESCENDING)
+		position = hitring_get_count (model->ring) - 1 - position;
+
+	return hitring_nth (model->ring, position);
+}
+
+/* [ row_at ]
+ * Return the row at a position of the rows shown
+ */
+static guint
+row_at (HitModel *model, guint position)
+{
+	if (model->query != NULL)
+		return hittree_nth (model->shown, position);
+
+	return row_in_order (model, position);
+}
+
+/* [ get_rows_in_order ]
+ * Copy all the rows, shown or not, in the order of the list
+ */
+static void
+get_rows_in_order (HitModel *model, guint *rows)
+{
+	guint count = hitring_get_count (model->ring);
+	guint i;
+
+	if (model->order != NULL)
+		hittree_get_rows (model->order, rows);
+	else
+		for (i = 0; i < count; i++)
+			rows[i] = row_in_order (model, i);
+}
+
+/* [ compare_numbers ]
+ * Compare two numbers the way strcmp does
+ */
+static gint
+compare_numbers (gint64 a, gint64 b)
+{
+	return (a > b) - (a < b);
+}
+
+/* [ compare_texts ]
+ * Sort function for the collation keys of rank_texts
+ */
+static gint
+compare_texts (gconstpointer a, gconstpointer b, gpointer keys)
+{
+	return strcmp (((gchar **)keys)[*(const guint *)a], ((gchar **)keys)[*(const guint *)b]);
+}
+
+/* [ rank_texts ]
+ * Give each of n texts its place in the collation order, equal texts the
+ * same, so that they can be sorted by a number
+ */
+static void
+rank_texts (const gchar **texts, guint n, guint *ranks)
+{
+	gchar **keys = g_new (gchar *, n);
+	guint *sorted = g_new (guint, n);
+	guint i, rank = 0;
+
+	for (i = 0; i < n; i++) {
+		keys[i] = g_utf8_collate_key (texts[i], -1);
+		sorted[i] = i;
+	}
+	g_qsort_with_data (sorted, n, sizeof (guint), compare_texts, keys);
+
+	for (i = 0; i < n; i++) {
+		if (i > 0 && strcmp (keys[sorted[i]], keys[sorted[i-1]]) != 0)
+			rank++;
+		ranks[sorted[i]] = rank;
+	}
+
+	for (i = 0; i < n; i++)
+		g_free (keys[i]);
+	g_free (keys);
+	g_free (sorted);
+}
+
+/* [ update_ranks ]
+ * Rank the texts of the fields shown by name, again for the names that
+ * have been added since. Their order among the others stays the same
+ */
+static void
+update_ranks (HitModel *model)
+{
+	guint count = hit_name_count ();
+	const gchar **texts;
+	guint i;
+
+	if (!model->ranked) {
+		texts = g_new (const gchar *, G_MAXUINT8+1);
+		for (i = 0; i <= G_MAXUINT8; i++)
+			texts[i] = hit_protocol_name (i);
+		rank_texts (texts, G_MAXUINT8+1, model->protocol_ranks);
+		for (i = 0; i <= HIT_OUTBOUND; i++) {
+			Hit h = { .direction = i };
+			texts[i] = hit_format (&h, HIT_DIRECTION, NULL);
+		}
+		rank_texts (texts, HIT_OUTBOUND+1, model->direction_ranks);
+		g_free (texts);
+		model->ranked = TRUE;
+	}
+
+	if (count != model->names_ranked) {
+		texts = g_new (const gchar *, count);
+		for (i = 0; i < count; i++)
+			texts[i] = hit_name (i);
+		model->name_ranks = g_renew (guint, model->name_ranks, count);
+		rank_texts (texts, count, model->name_ranks);
+		g_free (texts);
+		model->names_ranked = count;
+	}
+}
+
+/* [ name_rank ]
+ * Return the rank of a name of hit_intern, one given since the ranks were
+ * last updated goes last
+ */
+static guint32
+name_rank (HitModel *model, guint16 id)
+{
+	return (id < model->names_ranked ? model->name_ranks[id] : model->names_ranked);
+}
+
+/* [ sort_key ]
+ * Return the number a hit is sorted by in a column, other than the time.
+ * Missing fields come first, as their empty text would
+ */
+static guint32
+sort_key (HitModel *model, const Hit *h, HitField field)
+{
+	switch (field) {
+	case HIT_DIRECTION:
+		return model->direction_ranks[MIN (h->direction, HIT_OUTBOUND)];
+	case HIT_IN:
+		return name_rank (model, h->in);
+	case HIT_OUT:
+		return name_rank (model, h->out);
+	case HIT_PORT:
+		return (h->flags & HIT_HAS_PORT) ? h->port + 1 : 0;
+	case HIT_SOURCE:
+		return (h->flags & HIT_HAS_SOURCE) ? ntohl (h->source) : 0;
+	case HIT_DESTINATION:
+		return (h->flags & HIT_HAS_DESTINATION) ? ntohl (h->destination) : 0;
+	case HIT_LENGTH:
+		return (h->flags & HIT_HAS_LENGTH) ? h->length + 1 : 0;
+	case HIT_TOS:
+		return (h->flags & HIT_HAS_TOS) ? h->tos + 1 : 0;
+	case HIT_PROTOCOL:
+		return (h->flags & HIT_HAS_PROTOCOL) ? model->protocol_ranks[h->protocol] + 1 : 0;
+	case HIT_SERVICE:
+		return name_rank (model, h->service);
+	default:
+		return 0;
+	}
+}
+
+/* [ compare_times ]
+ * Compare two rows by the times of their hits, the hits at the same time
+ * in the order they came in
+ */
+static gint
+compare_times (HitModel *model, guint a, guint b)
+{
+	if (model->hits[a].time != model->hits[b].time)
+		return compare_numbers (model->hits[a].time, model->hits[b].time);
+
+	return compare_numbers (model->serials[a], model->serials[b]);
+}
+
+/* [ compare_rows ]
+ * Compare two rows by the sort columns from the given one on. The time
+ * also settles the rows equal in every column
+ */
+static gint
+compare_rows (HitModel *model, guint a, guint b, guint first)
+{
+	gboolean ascending;
+	guint32 key1, key2;
+	guint i;
+
+	for (i = first; i < model->sort_keys; i++) {
+		ascending = (model->sort_orders[i] == GTK_SORT_ASCENDING);
+		if (model->sort_fields[i] == HIT_TIME)
+			return ascending ? compare_times (model, a, b) : compare_times (model, b, a);
+
+		key1 = sort_key (model, &model->hits[a], model->sort_fields[i]);
+		key2 = sort_key (model, &model->hits[b], model->sort_fields[i]);
+		if (key1 != key2)
+			return ((key1 < key2) == ascending) ? -1 : 1;
+	}
+
+	return compare_times (model, a, b);
+}
+
+/* [ compare_tree_rows ]
+ * Compare function of the trees of rows in the order of the list
+ */
+static gint
+compare_tree_rows (guint a, guint b, gpointer model)
+{
+	return compare_rows (model, a, b, 0);
+}
+
+/* [ compare_keyed_rows ]
+ * Sort function for rows packed with their key in the high half
+ */
+static gint
+compare_keyed_rows (gconstpointer a, gconstpointer b, gpointer data)
+{
+	guint64 keyed1 = *(const guint64 *)a, keyed2 = *(const guint64 *)b;
+
+	return (keyed1 > keyed2) - (keyed1 < keyed2);
+}
+
+/* [ find_in_ring ]
+ * Return the place of a row in the ring. A row no longer present is found
+ * where it was
+ */
+static guint
+find_in_ring (HitModel *model, guint row, gboolean present)
+{
+	guint count = hitring_get_count (model->ring);
+	gint64 serial = model->serials[row];
+	guint low = 0, high = count, middle;
+
+	/* Hits mostly come in at the new end and leave from the old one */
+	if (present && hitring_nth (model->ring, count - 1) == row)
+		low = count - 1;
+	else if (!present && (count == 0 || model->serials[hitring_nth (model->ring, 0)] > serial))
+		low = 0;
+	else {
+		while (low < high) {
+			middle = low + (high - low) / 2;
+			if (model->serials[hitring_nth (model->ring, middle)] < serial)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+	}
+
+	return low;
+}
+
+/* [ find_chronological ]
+ * Return the position of a row while the ring has the order of the list
+ */
+static guint
+find_chronological (HitModel *model, guint row, gboolean present)
+{
+	guint count = hitring_get_count (model->ring);
+	guint index = find_in_ring (model, row, present);
+
+	if (model->sort_order == GTK_SORT_DESCENDING)
+		return (present ? count - 1 : count) - index;
+
+	return index;
+}
+
+/* [ in_time_order ]
+ * Test if a row just added to the ring is no earlier than the hit before
+ * it and no later than the one after it
+ */
+static gboolean
+in_time_order (HitModel *model, guint row)
+{
+	guint count = hitring_get_count (model->ring);
+	guint index = find_in_ring (model, row, TRUE);
+	gint64 time = model->hits[row].time;
+
+	return ((index == 0 || model->hits[hitring_nth (model->ring, index - 1)].time <= time) &&
+	        (index == count - 1 || time <= model->hits[hitring_nth (model->ring, index + 1)].time));
+}
+
+/* [ set_iter ]
+ * Point an iter at a position of the list
+ */
+static void
+set_iter (HitModel *model, GtkTreeIter *iter, guint position)
+{
+	iter->stamp = model->stamp;
+	iter->user_data = GUINT_TO_POINTER (position);
+}
+
+/* [ iter_position ]
+ * Return the position of the list an iter points at
+ */
+static guint
+iter_position (GtkTreeIter *iter)
+{
+	return GPOINTER_TO_UINT (iter->user_data);
+}
+
+/* [ start_totals ]
+ * Set the totals of a row to just its own hit
+ */
+static void
+start_totals (HitTotals *totals, const Hit *h)
+{
+	totals->count = 1;
+	totals->last_seen = h->time;
+	totals->bytes = (h->flags & HIT_HAS_LENGTH) ? h->length : 0;
+}
+
+/* [ store_hit ]
+ * Keep a hit in a free row, return the row
+ */
+static guint
+store_hit (HitModel *model, const Hit *h, gint64 serial)
+{
+	guint row;
+
+	if (model->free_rows->len > 0) {
+		row = g_array_index (model->free_rows, guint, model->free_rows->len - 1);
+		g_array_set_size (model->free_rows, model->free_rows->len - 1);
+	} else {
+		if (model->next_row == model->rows) {
+			model->rows = MAX (model->rows * 2, MODEL_MIN_ROWS);
+			model->hits = g_renew (Hit, model->hits, model->rows);
+			model->serials = g_renew (gint64, model->serials, model->rows);
+			if (model->totals != NULL)
+				model->totals = g_renew (HitTotals, model->totals, model->rows);
+		}
+		row = model->next_row++;
+	}
+
+	model->hits[row] = *h;
+	model->serials[row] = serial;
+	if (model->totals != NULL)
+		start_totals (&model->totals[row], h);
+	if (model->index != NULL)
+		hitindex_add (model->index, row, h);
+
+	return row;
+}
+
+/* [ sort_by_time ]
+ * Put the rows in a tree by time, once the ring no longer has them in
+ * that order. A row just added is left to insert_row, G_MAXUINT for none
+ */
+static void
+sort_by_time (HitModel *model, guint added)
+{
+	guint count = hitring_get_count (model->ring);
+	guint i, row;
+
+	if (model->order == NULL)
+		model->order = hittree_new (compare_tree_rows, model);
+	hittree_clear (model->order);
+	for (i = 0; i < count; i++) {
+		row = hitring_nth (model->ring, i);
+		if (row != added)
+			hittree_insert (model->order, row);
+	}
+}
+
+/* [ insert_row ]
+ * Add a row added to the ring to the list, and show it unless the query
+ * leaves it out
+ */
+static void
+insert_row (HitModel *model, guint row)
+{
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	guint position;
+
+	/* The rows before it are still in the order of their times */
+	if (model->timely && !in_time_order (model, row)) {
+		model->timely = FALSE;
+		if (model->order == NULL)
+			sort_by_time (model, row);
+	}
+
+	if (model->order != NULL) {
+		update_ranks (model);
+		position = hittree_insert (model->order, row);
+	} else
+		position = find_chronological (model, row, TRUE);
+
+	if (model->query != NULL) {
+		if (!hitquery_match (model->query, &model->hits[row]))
+			return;
+		update_ranks (model);
+		position = hittree_insert (model->shown, row);
+	}
+
+	model->stamp++;
+	set_iter (model, &iter, position);
+	path = gtk_tree_path_new ();
+	gtk_tree_path_append_index (path, position);
+	gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+/* [ evict_row ]
+ * Remove the row of a hit that no longer fits, it has already left the ring
+ */
+static void
+evict_row (guint row, gpointer data)
+{
+	HitModel *model = data;
+	GtkTreePath *path;
+	guint position;
+
+	if (model->index != NULL)
+		hitindex_remove (model->index, row, &model->hits[row]);
+
+	if (model->order != NULL)
+		position = hittree_remove (model->order, row);
+	else
+		position = find_chronological (model, row, FALSE);
+
+	g_array_append_val (model->free_rows, row);
+
+	if (model->query != NULL) {
+		if (!hitquery_match (model->query, &model->hits[row]))
+			return;
+		position = hittree_remove (model->shown, row);
+	}
+
+	model->stamp++;
+	path = gtk_tree_path_new ();
+	gtk_tree_path_append_index (path, position);
+	gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+	gtk_tree_path_free (path);
+}
+
+/* [ hit_model_new ]
+ * Create an empty list keeping at most capacity hits, HITRING_UNLIMITED for
+ * no limit
+ */
+HitModel *
+hit_model_new (guint capacity)
+{
+	HitModel *model = g_object_new (HIT_TYPE_MODEL, NULL);
+
+	hitring_set_capacity (model->ring, capacity);
+
+	return model;
+}
+
+/* [ hit_model_get_total ]
+ * Return the number of hits in the list, shown or not
+ */
+guint
+hit_model_get_total (HitModel *model)
+{
+	return hitring_get_count (model->ring);
+}
+
+/* [ hit_model_get_index_size ]
+ * Return the bytes taken by the index of the rows, none before a query
+ */
+gsize
+hit_model_get_index_size (HitModel *model)
+{
+	return (model->index != NULL) ? hitindex_get_size (model->index) : 0;
+}
+
+/* [ hit_model_set_capacity ]
+ * Change the number of hits kept, evicting the oldest ones that no longer fit
+ */
+void
+hit_model_set_capacity (HitModel *model, guint capacity)
+{
+	hitring_set_capacity (model->ring, capacity);
+}
+
+/* [ hit_model_has_room_front ]
+ * Test if a hit older than all the others would still fit
+ */
+gboolean
+hit_model_has_room_front (HitModel *model)
+{
+	return hitring_has_room_front (model->ring);
+}
+
+/* [ hit_model_has_room_older ]
+ * Test if a hit can be added with hit_model_append_older
+ */
+gboolean
+hit_model_has_room_older (HitModel *model)
+{
+	return hitring_has_room_older (model->ring);
+}
+
+/* [ hit_model_append ]
+ * Add the newest hit, evicting the oldest one if the list is full. Return
+ * the serial of the hit, see hit_model_find_serial
+ */
+gint64
+hit_model_append (HitModel *model, const Hit *h)
+{
+	guint row = store_hit (model, h, ++model->last_serial);
+
+	hitring_push_back (model->ring, row);
+	insert_row (model, row);
+
+	return model->last_serial;
+}
+
+/* [ hit_model_prepend ]
+ * Add a hit older than all the others, there has to be room for it.
+ * Return the serial of the hit
+ */
+gint64
+hit_model_prepend (HitModel *model, const Hit *h)
+{
+	guint row;
+
+	g_return_val_if_fail (hitring_has_room_front (model->ring), 0);
+
+	row = store_hit (model, h, --model->first_serial);
+	hitring_push_front (model->ring, row);
+	insert_row (model, row);
+
+	return model->first_serial;
+}
+
+/* [ hit_model_append_older ]
+ * Add a hit older than all the others, when such hits come oldest first.
+ * They take the room left at the front until hit_model_end_older. Return
+ * the serial of the hit
+ */
+gint64
+hit_model_append_older (HitModel *model, const Hit *h)
+{
+	guint row;
+
+	g_return_val_if_fail (hitring_has_room_older (model->ring), 0);
+
+	/* Leave them room below the hits already there */
+	if (!model->older) {
+		model->older = TRUE;
+		model->older_serial = model->first_serial - G_MAXUINT32;
+	}
+
+	row = store_hit (model, h, model->older_serial);
+	hitring_push_older (model->ring, row);
+	insert_row (model, row);
+
+	return model->older_serial++;
+}
+
+/* [ hit_model_end_older ]
+ * Stop adding hits with hit_model_append_older
+ */
+void
+hit_model_end_older (HitModel *model)
+{
+	hitring_end_older (model->ring);
+
+	if (model->older) {
+		model->first_serial -= G_MAXUINT32;
+		model->older = FALSE;
+	}
+}
+
+/* [ delete_rows ]
+ * Tell that the first count rows shown are gone, from the end
+ */
+static void
+delete_rows (HitModel *model, guint count)
+{
+	GtkTreePath *path;
+
+	path = gtk_tree_path_new ();
+	gtk_tree_path_append_index (path, 0);
+	while (count > 0) {
+		count--;
+		gtk_tree_path_get_indices (path)[0] = count;
+		gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+	}
+	gtk_tree_path_free (path);
+}
+
+/* [ hit_model_clear ]
+ * Remove all the hits. The rows are deleted one at a time from the end,
+ * a view with many of them is better taken off the model first
+ */
+void
+hit_model_clear (HitModel *model)
+{
+	guint count = model_count (model);
+
+	hitring_clear (model->ring);
+	g_free (model->hits);
+	g_free (model->serials);
+	g_free (model->totals);
+	model->hits = NULL;
+	model->serials = NULL;
+	model->totals = NULL;
+	model->rows = 0;
+	model->next_row = 0;
+	g_array_set_size (model->free_rows, 0);
+	model->first_serial = 0;
+	model->last_serial = 0;
+	model->older = FALSE;
+	model->timely = TRUE;
+	if (model->order != NULL && is_chronological (model)) {
+		hittree_free (model->order);
+		model->order = NULL;
+	} else if (model->order != NULL)
+		hittree_clear (model->order);
+	if (model->shown != NULL)
+		hittree_clear (model->shown);
+	if (model->index != NULL) {
+		hitindex_free (model->index);
+		model->index = hitindex_new ();
+	}
+	model->stamp++;
+
+	delete_rows (model, count);
+}
+
+/* [ hit_model_get_hit ]
+ * Return the hit of a row, valid until the list changes
+ */
+const Hit *
+hit_model_get_hit (HitModel *model, GtkTreeIter *iter)
+{
+	g_return_val_if_fail (iter->stamp == model->stamp, NULL);
+
+	return &model->hits[row_at (model, iter_position (iter))];
+}
+
+/* [ find_serial_row ]
+ * Find the row of the hit with the given serial. Return false if the hit
+ * is no longer in the list
+ */
+static gboolean
+find_serial_row (HitModel *model, gint64 serial, guint *row)
+{
+	guint count = hitring_get_count (model->ring);
+	guint low = 0, high = count, middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (model->serials[hitring_nth (model->ring, middle)] < serial)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if (low == count)
+		return FALSE;
+
+	*row = hitring_nth (model->ring, low);
+
+	return (model->serials[*row] == serial);
+}
+
+/* [ find_position ]
+ * Return the position of a row shown
+ */
+static guint
+find_position (HitModel *model, guint row)
+{
+	if (model->query != NULL)
+		return hittree_find (model->shown, row);
+	if (model->order != NULL)
+		return hittree_find (model->order, row);
+
+	return find_chronological (model, row, TRUE);
+}
+
+/* [ hit_model_find_serial ]
+ * Point iter at the row of the hit with the given serial. Return false if
+ * the hit is no longer in the list, or not shown
+ */
+gboolean
+hit_model_find_serial (HitModel *model, gint64 serial, GtkTreeIter *iter)
+{
+	guint row;
+
+	if (!find_serial_row (model, serial, &row))
+		return FALSE;
+	if (model->query != NULL && !hitquery_match (model->query, &model->hits[row]))
+		return FALSE;
+
+	set_iter (model, iter, find_position (model, row));
+
+	return TRUE;
+}
+
+/* [ hit_model_count_hit ]
+ * Count another hit into the row of the hit with the given serial, instead
+ * of giving it a row of its own. The row keeps showing its first hit, so it
+ * stays where it is in any order. Return false if the row is gone
+ */
+gboolean
+hit_model_count_hit (HitModel *model, gint64 serial, const Hit *h)
+{
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	HitTotals *totals;
+	guint row, i;
+
+	if (!find_serial_row (model, serial, &row))
+		return FALSE;
+
+	/* Only a list that aggregates pays for the totals */
+	if (model->totals == NULL) {
+		model->totals = g_new (HitTotals, MAX (model->rows, 1));
+		for (i = 0; i < model->next_row; i++)
+			start_totals (&model->totals[i], &model->hits[i]);
+	}
+
+	totals = &model->totals[row];
+	if (totals->count < G_MAXUINT32)
+		totals->count++;
+	totals->last_seen = MAX (totals->last_seen, h->time);
+	if (h->flags & HIT_HAS_LENGTH)
+		totals->bytes += h->length;
+
+	if (model->query != NULL && !hitquery_match (model->query, &model->hits[row]))
+		return TRUE;
+
+	set_iter (model, &iter, find_position (model, row));
+	path = gtk_tree_path_new ();
+	gtk_tree_path_append_index (path, iter_position (&iter));
+	gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+	gtk_tree_path_free (path);
+
+	return TRUE;
+}
+
+/* [ hit_model_get_totals ]
+ * Fill in the totals of the hits counted into a row
+ */
+void
+hit_model_get_totals (HitModel *model, GtkTreeIter *iter, HitTotals *totals)
+{
+	guint row;
+
+	g_return_if_fail (iter->stamp == model->stamp);
+
+	row = row_at (model, iter_position (iter));
+	if (model->totals != NULL)
+		*totals = model->totals[row];
+	else
+		start_totals (totals, &model->hits[row]);
+}
+
+/* [ compare_shown ]
+ * Sort function for rows in the order of the list
+ */
+static gint
+compare_shown (gconstpointer a, gconstpointer b, gpointer model)
+{
+	return compare_rows (model, *(const guint *)a, *(const guint *)b, 0);
+}
+
+/* [ show_matching ]
+ * Show the rows matching the query in the order of the list. With rows
+ * given only they are matched, they are then sorted on their own instead
+ * of picked from the whole list
+ */
+static void
+show_matching (HitModel *model, const guint *rows, guint count)
+{
+	guint total = hitring_get_count (model->ring);
+	guint *shown;
+	guint i, matched = 0, kept;
+
+	if (rows == NULL) {
+		shown = g_new (guint, MAX (total, 1));
+		get_rows_in_order (model, shown);
+		for (i = 0; i < total; i++)
+			if (hitquery_match (model->query, &model->hits[shown[i]]))
+				shown[matched++] = shown[i];
+		hittree_set_rows (model->shown, shown, matched);
+		g_free (shown);
+		return;
+	}
+
+	shown = g_new (guint, MAX (count, 1));
+	for (i = 0; i < count; i++)
+		if (hitquery_match (model->query, &model->hits[rows[i]]))
+			shown[matched++] = rows[i];
+
+	update_ranks (model);
+	g_qsort_with_data (shown, matched, sizeof (guint), compare_shown, model);
+
+	/* A row found by both its addresses is there twice */
+	for (i = 1, kept = MIN (matched, 1); i < matched; i++)
+		if (shown[i] != shown[kept - 1])
+			shown[kept++] = shown[i];
+	hittree_set_rows (model->shown, shown, kept);
+	g_free (shown);
+}
+
+/* [ hit_model_set_query ]
+ * Show only the hits matching a query, or all of them if it's NULL. The
+ * list takes the query over. All the rows shown are deleted and inserted
+ * again one at a time, a view with many of them is better taken off the
+ * model first
+ */
+void
+hit_model_set_query (HitModel *model, HitQuery *query)
+{
+	guint total = hitring_get_count (model->ring);
+	GArray *found;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	guint i, row;
+
+	delete_rows (model, model_count (model));
+
+	if (model->query != NULL)
+		hitquery_free (model->query);
+	model->query = query;
+	model->stamp++;
+
+	if (query != NULL) {
+		if (model->shown == NULL)
+			model->shown = hittree_new (compare_tree_rows, model);
+
+		/* Kept up to date from the first query on */
+		if (model->index == NULL) {
+			model->index = hitindex_new ();
+			for (i = 0; i < total; i++) {
+				row = hitring_nth (model->ring, i);
+				hitindex_add (model->index, row, &model->hits[row]);
+			}
+		}
+
+		found = g_array_new (FALSE, FALSE, sizeof (guint));
+		if (hitindex_find (model->index, query, total / QUERY_SCAN_SHARE, found))
+			show_matching (model, (guint *)found->data, found->len);
+		else
+			show_matching (model, NULL, 0);
+		g_array_free (found, TRUE);
+	} else if (model->shown != NULL) {
+		hittree_free (model->shown);
+		model->shown = NULL;
+	}
+
+	path = gtk_tree_path_new ();
+	gtk_tree_path_append_index (path, 0);
+	for (i = 0; i < model_count (model); i++) {
+		gtk_tree_path_get_indices (path)[0] = i;
+		set_iter (model, &iter, i);
+		gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+	}
+	gtk_tree_path_free (path);
+}
+
+static GtkTreeModelFlags
+hit_model_get_flags (GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+hit_model_get_n_columns (GtkTreeModel *tree_model)
+{
+	return 1;
+}
+
+static GType
+hit_model_get_column_type (GtkTreeModel *tree_model, gint column)
+{
+	return G_TYPE_POINTER;
+}
+
+static gboolean
+hit_model_get_iter (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	HitModel *model = HIT_MODEL (tree_model);
+	gint position;
+
+	if (gtk_tree_path_get_depth (path) != 1)
+		return FALSE;
+
+	position = gtk_tree_path_get_indices (path)[0];
+	if (position < 0 || (guint)position >= model_count (model))
+		return FALSE;
+
+	set_iter (model, iter, position);
+	return TRUE;
+}
+
+static GtkTreePath *
+hit_model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	HitModel *model = HIT_MODEL (tree_model);
+	GtkTreePath *path;
+
+	g_return_val_if_fail (iter->stamp == model->stamp, NULL);
+
+	path = gtk_tree_path_new ();
+	gtk_tree_path_append_index (path, iter_position (iter));
+
+	return path;
+}
+
+static void
+hit_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+	HitModel *model = HIT_MODEL (tree_model);
+
+	g_value_init (value, G_TYPE_POINTER);
+	g_value_set_pointer (value, (gpointer)hit_model_get_hit (model, iter));
+}
+
+static gboolean
+hit_model_iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	HitModel *model = HIT_MODEL (tree_model);
+	guint position = iter_position (iter) + 1;
+
+	if (iter->stamp != model->stamp || position >= model_count (model))
+		return FALSE;
+
+	set_iter (model, iter, position);
+	return TRUE;
+}
+
+static gboolean
+hit_model_iter_nth_child (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+	HitModel *model = HIT_MODEL (tree_model);
+
+	if (parent != NULL || n < 0 || (guint)n >= model_count (model))
+		return FALSE;
+
+	set_iter (model, iter, n);
+	return TRUE;
+}
+
+static gboolean
+hit_model_iter_children (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	return hit_model_iter_nth_child (tree_model, iter, parent, 0);
+}
+
+static gboolean
+hit_model_iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+static gint
+hit_model_iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	if (iter != NULL)
+		return 0;
+
+	return model_count (HIT_MODEL (tree_model));
+}
+
+static gboolean
+hit_model_iter_parent (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+static void
+hit_model_tree_model_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags = hit_model_get_flags;
+	iface->get_n_columns = hit_model_get_n_columns;
+	iface->get_column_type = hit_model_get_column_type;
+	iface->get_iter = hit_model_get_iter;
+	iface->get_path = hit_model_get_path;
+	iface->get_value = hit_model_get_value;
+	iface->iter_next = hit_model_iter_next;
+	iface->iter_children = hit_model_iter_children;
+	iface->iter_has_child = hit_model_iter_has_child;
+	iface->iter_n_children = hit_model_iter_n_children;
+	iface->iter_nth_child = hit_model_iter_nth_child;
+	iface->iter_parent = hit_model_iter_parent;
+}
+
+static gboolean
+hit_model_get_sort_column_id (GtkTreeSortable *sortable, gint *sort_column_id, GtkSortType *order)
+{
+	HitModel *model = HIT_MODEL (sortable);
+
+	if (sort_column_id != NULL)
+		*sort_column_id = model->sort_column;
+	if (order != NULL)
+		*order = model->sort_order;
+
+	return (model->sort_column != GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID &&
+	        model->sort_column != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID);
+}
+
+/* [ push_sort_column ]
+ * Make a column the first one sorted by, the others clicked before it
+ * settle the rows equal in it. The time settles all of them. None are
+ * forgotten, the rows keep the order sort_rows gives them
+ */
+static void
+push_sort_column (HitModel *model, gint sort_column_id, GtkSortType order)
+{
+	HitField fields[NUM_HIT_FIELDS];
+	GtkSortType orders[NUM_HIT_FIELDS];
+	guint keys = 0, i;
+
+	model->sort_column = sort_column_id;
+	model->sort_order = order;
+
+	/* Unsorted, the list is still in the order of the times */
+	fields[keys] = (sort_column_id < 0 ? HIT_TIME : sort_column_id);
+	orders[keys++] = order;
+	for (i = 0; i < model->sort_keys && fields[keys-1] != HIT_TIME; i++) {
+		if (model->sort_fields[i] == (HitField)sort_column_id)
+			continue;
+		fields[keys] = model->sort_fields[i];
+		orders[keys++] = model->sort_orders[i];
+	}
+
+	memcpy (model->sort_fields, fields, keys * sizeof (HitField));
+	memcpy (model->sort_orders, orders, keys * sizeof (GtkSortType));
+	model->sort_keys = keys;
+}
+
+/* [ sort_rows ]
+ * Put the rows in the order of the first sort column, keeping the order
+ * they were in when equal, as given by old_rows. Each is packed with its
+ * key and old position, so that they are sorted by integer comparisons
+ * alone. new_order is set to the old position of each row
+ */
+static void
+sort_rows (HitModel *model, const guint *old_rows, guint count, gint *new_order)
+{
+	gboolean ascending = (model->sort_order == GTK_SORT_ASCENDING);
+	guint64 *keyed = g_new (guint64, MAX (count, 1));
+	guint *rows;
+	guint32 key;
+	guint i;
+
+	update_ranks (model);
+
+	for (i = 0; i < count; i++) {
+		key = sort_key (model, &model->hits[old_rows[i]], model->sort_column);
+		if (!ascending)
+			key = G_MAXUINT32 - key;
+		keyed[i] = ((guint64)key << 32) | i;
+	}
+	g_qsort_with_data (keyed, count, sizeof (guint64), compare_keyed_rows, NULL);
+
+	rows = g_new (guint, MAX (count, 1));
+	for (i = 0; i < count; i++) {
+		new_order[i] = (guint32)keyed[i];
+		rows[i] = old_rows[new_order[i]];
+	}
+	if (model->order == NULL)
+		model->order = hittree_new (compare_tree_rows, model);
+	hittree_set_rows (model->order, rows, count);
+
+	g_free (rows);
+	g_free (keyed);
+}
+
+/* [ hit_model_set_sort_column_id ]
+ * Sort the list by a field of the hits. Only the positions of the rows are
+ * sorted, sorting by time drops them and shows the ring as it is unless a
+ * hit came in out of time
+ */
+static void
+hit_model_set_sort_column_id (GtkTreeSortable *sortable, gint sort_column_id, GtkSortType order)
+{
+	HitModel *model = HIT_MODEL (sortable);
+	guint count = hitring_get_count (model->ring);
+	guint *old_rows, *old_positions;
+	gint *new_order;
+	GtkTreePath *path;
+	guint i;
+
+	g_return_if_fail (sort_column_id < NUM_HIT_FIELDS);
+
+	if (model->sort_column == sort_column_id && model->sort_order == order)
+		return;
+
+	old_rows = g_new (guint, MAX (count, 1));
+	get_rows_in_order (model, old_rows);
+	new_order = g_new (gint, MAX (count, 1));
+
+	push_sort_column (model, sort_column_id, order);
+
+	if (is_chronological (model) && !model->timely)
+		sort_by_time (model, G_MAXUINT);
+	else if (is_chronological (model)) {
+		if (model->order != NULL)
+			hittree_free (model->order);
+		model->order = NULL;
+	} else
+		sort_rows (model, old_rows, count, new_order);
+
+	/* The same rows are shown, put in the new order on their own when
+	   there are few of them */
+	if (model->query != NULL) {
+		g_free (old_rows);
+		count = hittree_get_count (model->shown);
+		old_rows = g_new (guint, MAX (count, 1));
+		hittree_get_rows (model->shown, old_rows);
+		if (count < hitring_get_count (model->ring) / QUERY_SCAN_SHARE)
+			show_matching (model, old_rows, count);
+		else
+			show_matching (model, NULL, 0);
+	}
+
+	if (is_chronological (model) || model->query != NULL) {
+		/* Look up where each row was, by row */
+		old_positions = g_new (guint, MAX (model->next_row, 1));
+		for (i = 0; i < count; i++)
+			old_positions[old_rows[i]] = i;
+		if (model->query != NULL)
+			hittree_get_rows (model->shown, old_rows);
+		else
+			get_rows_in_order (model, old_rows);
+		for (i = 0; i < count; i++)
+			new_order[i] = old_positions[old_rows[i]];
+		g_free (old_positions);
+	}
+	g_free (old_rows);
+
+	model->stamp++;
+	gtk_tree_sortable_sort_column_changed (sortable);
+	if (count > 0) {
+		path = gtk_tree_path_new ();
+		gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model), path, NULL, new_order);
+		gtk_tree_path_free (path);
+	}
+	g_free (new_order);
+}
+
+static void
+hit_model_set_sort_func (GtkTreeSortable *sortable, gint sort_column_id,
+                         GtkTreeIterCompareFunc func, gpointer data, GDestroyNotify destroy)
+{
+	g_warning ("The events list is only sorted by the fields of the hits");
+}
+
+static void
+hit_model_set_default_sort_func (GtkTreeSortable *sortable,
+                                 GtkTreeIterCompareFunc func, gpointer data, GDestroyNotify destroy)
+{
+	g_warning ("The events list is only sorted by the fields of the hits");
+}
+
+static gboolean
+hit_model_has_default_sort_func (GtkTreeSortable *sortable)
+{
+	return FALSE;
+}
+
+static void
+hit_model_sortable_init (GtkTreeSortableIface *iface)
+{
+	iface->get_sort_column_id = hit_model_get_sort_column_id;
+	iface->set_sort_column_id = hit_model_set_sort_column_id;
+	iface->set_sort_func = hit_model_set_sort_func;
+	iface->set_default_sort_func = hit_model_set_default_sort_func;
+	iface->has_default_sort_func = hit_model_has_default_sort_func;
+}
+
+static void
+hit_model_init (HitModel *model)
+{
+	model->stamp = g_random_int ();
+	model->free_rows = g_array_new (FALSE, FALSE, sizeof (guint));
+	model->ring = hitring_new (HITRING_UNLIMITED, evict_row, model);
+	model->sort_column = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+	model->sort_order = GTK_SORT_ASCENDING;
+	model->timely = TRUE;
+}
+
+static void
+hit_model_finalize (GObject *object)
+{
+	HitModel *model = HIT_MODEL (object);
+
+	hitring_free (model->ring);
+	g_array_free (model->free_rows, TRUE);
+	g_free (model->hits);
+	g_free (model->serials);
+	g_free (model->totals);
+	if (model->order != NULL)
+		hittree_free (model->order);
+	g_free (model->name_ranks);
+	if (model->shown != NULL)
+		hittree_free (model->shown);
+	if (model->query != NULL)
+		hitquery_free (model->query);
+	if (model->index != NULL)
+		hitindex_free (model->index);
+
+	G_OBJECT_CLASS (hit_model_parent_class)->finalize (object);
+}
+
+static void
+hit_model_class_init (HitModelClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = hit_model_finalize;
+}
@@ -0,0 +1,62 @@
+/*---[ hitmodel.h ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The list model of the Events page, drawn straight from the hits
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_HITMODEL
+#define _FORTIFIED_HITMODEL
+
+#include <config.h>
+#include <gnome.h>
+
+#include "fortified.h"
+#include "hitquery.h"
+
+#define HIT_TYPE_MODEL (hit_model_get_type ())
+#define HIT_MODEL(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), HIT_TYPE_MODEL, HitModel))
+#define HIT_IS_MODEL(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HIT_TYPE_MODEL))
+
+#define HIT_MODEL_HIT 0 /* The only column, a pointer to the hit shown on a row */
+
+typedef struct _HitModel HitModel;
+typedef struct _HitModelClass HitModelClass;
+typedef struct _HitTotals HitTotals;
+
+/* The hits counted into a row, its own included */
+struct _HitTotals
+{
+	guint32 count;
+	gint64 last_seen; /* Time of the newest of them */
+	guint64 bytes; /* Their lengths added up */
+};
+
+GType hit_model_get_type (void);
+HitModel *hit_model_new (guint capacity);
+
+guint hit_model_get_total (HitModel *model);
+gsize hit_model_get_index_size (HitModel *model);
+void hit_model_set_capacity (HitModel *model, guint capacity);
+gboolean hit_model_has_room_front (HitModel *model);
+gboolean hit_model_has_room_older (HitModel *model);
+
+gint64 hit_model_append (HitModel *model, const Hit *h);
+gint64 hit_model_prepend (HitModel *model, const Hit *h);
+gint64 hit_model_append_older (HitModel *model, const Hit *h);
+void hit_model_end_older (HitModel *model);
+void hit_model_clear (HitModel *model);
+
+const Hit *hit_model_get_hit (HitModel *model, GtkTreeIter *iter);
+gboolean hit_model_find_serial (HitModel *model, gint64 serial, GtkTreeIter *iter);
+gboolean hit_model_count_hit (HitModel *model, gint64 serial, const Hit *h);
+void hit_model_get_totals (HitModel *model, GtkTreeIter *iter, HitTotals *totals);
+
+void hit_model_set_query (HitModel *model, HitQuery *query);
+
+#endif
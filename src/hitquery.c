@@ -0,0 +1,401 @@
+/*---[ hitquery.c ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Queries that pick the hits shown on the Events page
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+#include "hitquery.h"
+#include "util.h"
+
+/* A query is a list of terms separated by spaces, a hit has to match all
+   of them. Each term is a field and a value:
+
+     src:ADDRESS[/BITS] dst:ADDRESS[/BITS] host:ADDRESS[/BITS]
+     port:PORT[-PORT] proto:NAME|NUMBER service:NAME dir:in|out
+     since:TIME until:TIME
+
+   where a time is YYYY-MM-DD, HH:MM[:SS] today, or both joined by a T.
+   A value given without its field is taken as an address, ports, a
+   direction, a protocol or a service, whichever it reads as first. A
+   service is matched whatever its case, one never seen matches nothing */
+
+/* [ parse_number ]
+ * Read a decimal number between min and max. Return false if it's not one
+ */
+static gboolean
+parse_number (const gchar *text, gint64 min, gint64 max, gint64 *number)
+{
+	gchar *end;
+
+	if (!g_ascii_isdigit (*text))
+		return FALSE;
+
+	*number = g_ascii_strtoll (text, &end, 10);
+
+	return (*end == '\0' && *number >= min && *number <= max);
+}
+
+/* [ parse_address ]
+ * Read an address, or a network with the bits of its prefix
+ */
+static gboolean
+parse_address (const gchar *text, guint32 *address, guint32 *mask)
+{
+	gchar **parts = g_strsplit (text, "/", 2);
+	struct in_addr in;
+	gint64 bits = 32;
+	gboolean valid;
+
+	valid = (inet_pton (AF_INET, parts[0], &in) == 1);
+	if (valid && parts[1] != NULL)
+		valid = parse_number (parts[1], 0, 32, &bits);
+	g_strfreev (parts);
+
+	if (valid) {
+		*mask = (bits == 0) ? 0 : G_MAXUINT32 << (32 - bits);
+		*address = ntohl (in.s_addr) & *mask;
+	}
+
+	return valid;
+}
+
+/* [ parse_ports ]
+ * Read a port or a range of them
+ */
+static gboolean
+parse_ports (const gchar *text, guint16 *low, guint16 *high)
+{
+	gchar **parts = g_strsplit (text, "-", 2);
+	gint64 first, last;
+	gboolean valid;
+
+	valid = parse_number (parts[0], 0, G_MAXUINT16, &first);
+	last = first;
+	if (valid && parts[1] != NULL)
+		valid = parse_number (parts[1], first, G_MAXUINT16, &last);
+	g_strfreev (parts);
+
+	*low = first;
+	*high = last;
+
+	return valid;
+}
+
+/* [ parse_protocol ]
+ * Read a protocol by its name or number
+ */
+static gboolean
+parse_protocol (const gchar *text, guint8 *protocol)
+{
+	gint64 number;
+	guint i;
+
+	if (parse_number (text, 0, G_MAXUINT8, &number)) {
+		*protocol = number;
+		return TRUE;
+	}
+
+	for (i = 0; i <= G_MAXUINT8; i++)
+		if (g_ascii_strcasecmp (text, hit_protocol_name (i)) == 0) {
+			*protocol = i;
+			return TRUE;
+		}
+
+	return FALSE;
+}
+
+/* [ parse_direction ]
+ * Read which way the packets went
+ */
+static gboolean
+parse_direction (const gchar *text, guint8 *direction)
+{
+	if (g_ascii_strcasecmp (text, "in") == 0 || g_ascii_strcasecmp (text, "inbound") == 0)
+		*direction = HIT_INBOUND;
+	else if (g_ascii_strcasecmp (text, "out") == 0 || g_ascii_strcasecmp (text, "outbound") == 0)
+		*direction = HIT_OUTBOUND;
+	else
+		return FALSE;
+
+	return TRUE;
+}
+
+/* [ parse_time ]
+ * Read a local time. A time that ends a range reaches to the end of the
+ * minute or the day given
+ */
+static gboolean
+parse_time (const gchar *text, gboolean end, gint64 *when)
+{
+	gint year, month, day, hour, minute, second;
+	gint length = 0, span = 0;
+	gboolean dated = FALSE;
+	time_t now = time (NULL);
+	time_t t;
+	struct tm tm;
+
+	localtime_r (&now, &tm);
+	tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+
+	if (sscanf (text, "%d-%d-%d%n", &year, &month, &day, &length) == 3) {
+		tm.tm_year = year - 1900;
+		tm.tm_mon = month - 1;
+		tm.tm_mday = day;
+		span = 24*60*60 - 1;
+		dated = TRUE;
+		text += length;
+		if (*text == 'T')
+			text++;
+		else if (*text != '\0')
+			return FALSE;
+	}
+
+	if (!dated || *text != '\0') {
+		if (sscanf (text, "%d:%d%n", &hour, &minute, &length) != 2)
+			return FALSE;
+		tm.tm_hour = hour;
+		tm.tm_min = minute;
+		span = 59;
+		text += length;
+		if (*text == ':') {
+			if (sscanf (text, ":%d%n", &second, &length) != 1)
+				return FALSE;
+			tm.tm_sec = second;
+			span = 0;
+			text += length;
+		}
+		if (*text != '\0')
+			return FALSE;
+	}
+
+	tm.tm_isdst = -1;
+	t = mktime (&tm);
+	if (t == (time_t)-1)
+		return FALSE;
+
+	*when = end ? (gint64)t + span : t;
+
+	return TRUE;
+}
+
+/* [ parse_term ]
+ * Add a field and its value to a query, or the value alone. Return an
+ * error message if they can't be read
+ */
+static gchar *
+parse_term (HitQuery *query, const gchar *field, const gchar *value)
+{
+	HitQuery term;
+	guint given;
+
+	memset (&term, 0, sizeof (term));
+
+	if (field == NULL) {
+		if (parse_address (value, &term.host, &term.host_mask))
+			given = HITQUERY_HOST;
+		else if (parse_ports (value, &term.port_low, &term.port_high))
+			given = HITQUERY_PORT;
+		else if (parse_direction (value, &term.direction))
+			given = HITQUERY_DIRECTION;
+		else if (parse_protocol (value, &term.protocol))
+			given = HITQUERY_PROTOCOL;
+		else {
+			term.services = hit_lookup (value, &term.service_count);
+			given = HITQUERY_SERVICE;
+		}
+	} else if (strcmp (field, "src") == 0) {
+		if (!parse_address (value, &term.source, &term.source_mask))
+			return g_strdup_printf (_("%s is not an address or a network"), value);
+		given = HITQUERY_SOURCE;
+	} else if (strcmp (field, "dst") == 0) {
+		if (!parse_address (value, &term.destination, &term.destination_mask))
+			return g_strdup_printf (_("%s is not an address or a network"), value);
+		given = HITQUERY_DESTINATION;
+	} else if (strcmp (field, "host") == 0) {
+		if (!parse_address (value, &term.host, &term.host_mask))
+			return g_strdup_printf (_("%s is not an address or a network"), value);
+		given = HITQUERY_HOST;
+	} else if (strcmp (field, "port") == 0) {
+		if (!parse_ports (value, &term.port_low, &term.port_high))
+			return g_strdup_printf (_("%s is not a port or a range of ports"), value);
+		given = HITQUERY_PORT;
+	} else if (strcmp (field, "proto") == 0) {
+		if (!parse_protocol (value, &term.protocol))
+			return g_strdup_printf (_("%s is not a protocol"), value);
+		given = HITQUERY_PROTOCOL;
+	} else if (strcmp (field, "service") == 0) {
+		term.services = hit_lookup (value, &term.service_count);
+		given = HITQUERY_SERVICE;
+	} else if (strcmp (field, "dir") == 0) {
+		if (!parse_direction (value, &term.direction))
+			return g_strdup_printf (_("%s is not in or out"), value);
+		given = HITQUERY_DIRECTION;
+	} else if (strcmp (field, "since") == 0 || strcmp (field, "until") == 0) {
+		gboolean until = (field[0] == 'u');
+
+		if (!parse_time (value, until, until ? &term.until : &term.since))
+			return g_strdup_printf (_("%s is not a time, eg. 2016-01-31T18:30"), value);
+		given = until ? HITQUERY_UNTIL : HITQUERY_SINCE;
+	} else
+		return g_strdup_printf (_("There is no field called %s"), field);
+
+	if (query->terms & given) {
+		g_free (term.services);
+		return g_strdup_printf (_("%s is given twice"), field != NULL ? field : value);
+	}
+
+	query->terms |= given;
+	switch (given) {
+	case HITQUERY_SOURCE:
+		query->source = term.source;
+		query->source_mask = term.source_mask;
+		break;
+	case HITQUERY_DESTINATION:
+		query->destination = term.destination;
+		query->destination_mask = term.destination_mask;
+		break;
+	case HITQUERY_HOST:
+		query->host = term.host;
+		query->host_mask = term.host_mask;
+		break;
+	case HITQUERY_PORT:
+		query->port_low = term.port_low;
+		query->port_high = term.port_high;
+		break;
+	case HITQUERY_PROTOCOL:
+		query->protocol = term.protocol;
+		break;
+	case HITQUERY_SERVICE:
+		query->services = term.services;
+		query->service_count = term.service_count;
+		break;
+	case HITQUERY_DIRECTION:
+		query->direction = term.direction;
+		break;
+	case HITQUERY_SINCE:
+		query->since = term.since;
+		break;
+	case HITQUERY_UNTIL:
+		query->until = term.until;
+		break;
+	}
+
+	return NULL;
+}
+
+/* [ hitquery_parse ]
+ * Read a query. Return NULL if there are no terms, or if one of them
+ * can't be read, then error is set to a message saying why
+ */
+HitQuery *
+hitquery_parse (const gchar *text, gchar **error)
+{
+	HitQuery *query = g_new0 (HitQuery, 1);
+	gchar **terms = g_strsplit_set (text, " \t", -1);
+	gchar *value;
+	guint i;
+
+	*error = NULL;
+
+	for (i = 0; terms[i] != NULL && *error == NULL; i++) {
+		if (terms[i][0] == '\0')
+			continue;
+
+		value = strchr (terms[i], ':');
+		if (value != NULL) {
+			*value++ = '\0';
+			*error = parse_term (query, terms[i], value);
+		} else
+			*error = parse_term (query, NULL, terms[i]);
+	}
+	g_strfreev (terms);
+
+	if (*error != NULL || query->terms == 0) {
+		hitquery_free (query);
+		return NULL;
+	}
+
+	return query;
+}
+
+/* [ address_in ]
+ * Test if an address of a hit, in network byte order, is in a network
+ */
+static gboolean
+address_in (const Hit *h, guint has, guint32 address, guint32 network, guint32 mask)
+{
+	return ((h->flags & has) && (ntohl (address) & mask) == network);
+}
+
+/* [ has_service ]
+ * Test if a service id is one of those of a query
+ */
+static gboolean
+has_service (const HitQuery *query, guint16 service)
+{
+	guint i;
+
+	for (i = 0; i < query->service_count; i++)
+		if (query->services[i] == service)
+			return TRUE;
+
+	return FALSE;
+}
+
+/* [ hitquery_match ]
+ * Test if a hit matches every term of a query. Fields missing from the hit
+ * match no term about them
+ */
+gboolean
+hitquery_match (const HitQuery *query, const Hit *h)
+{
+	guint terms = query->terms;
+
+	if ((terms & HITQUERY_SOURCE) &&
+	    !address_in (h, HIT_HAS_SOURCE, h->source, query->source, query->source_mask))
+		return FALSE;
+	if ((terms & HITQUERY_DESTINATION) &&
+	    !address_in (h, HIT_HAS_DESTINATION, h->destination, query->destination, query->destination_mask))
+		return FALSE;
+	if ((terms & HITQUERY_HOST) &&
+	    !address_in (h, HIT_HAS_SOURCE, h->source, query->host, query->host_mask) &&
+	    !address_in (h, HIT_HAS_DESTINATION, h->destination, query->host, query->host_mask))
+		return FALSE;
+	if ((terms & HITQUERY_PORT) &&
+	    (!(h->flags & HIT_HAS_PORT) || h->port < query->port_low || h->port > query->port_high))
+		return FALSE;
+	if ((terms & HITQUERY_PROTOCOL) &&
+	    (!(h->flags & HIT_HAS_PROTOCOL) || h->protocol != query->protocol))
+		return FALSE;
+	if ((terms & HITQUERY_SERVICE) && !has_service (query, h->service))
+		return FALSE;
+	if ((terms & HITQUERY_DIRECTION) && h->direction != query->direction)
+		return FALSE;
+	if ((terms & HITQUERY_SINCE) && (h->time == 0 || h->time < query->since))
+		return FALSE;
+	if ((terms & HITQUERY_UNTIL) && (h->time == 0 || h->time > query->until))
+		return FALSE;
+
+	return TRUE;
+}
+
+/* [ hitquery_free ]
+ * Free a query
+ */
+void
+hitquery_free (HitQuery *query)
+{
+	g_free (query->services);
+	g_free (query);
+}
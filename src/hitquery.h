@@ -0,0 +1,58 @@
+/*---[ hitquery.h ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Queries that pick the hits shown on the Events page
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_HITQUERY
+#define _FORTIFIED_HITQUERY
+
+#include <config.h>
+#include <gnome.h>
+
+#include "fortified.h"
+
+/* The terms given in a query, a hit has to match all of them */
+#define HITQUERY_SOURCE      (1 << 0)
+#define HITQUERY_DESTINATION (1 << 1)
+#define HITQUERY_HOST        (1 << 2) /* Either address */
+#define HITQUERY_PORT        (1 << 3)
+#define HITQUERY_PROTOCOL    (1 << 4)
+#define HITQUERY_SERVICE     (1 << 5)
+#define HITQUERY_DIRECTION   (1 << 6)
+#define HITQUERY_SINCE       (1 << 7)
+#define HITQUERY_UNTIL       (1 << 8)
+
+typedef struct _HitQuery HitQuery;
+
+/* A parsed query. Addresses and their masks are in host byte order */
+struct _HitQuery
+{
+	guint terms; /* The HITQUERY_ terms given */
+	guint32 source;
+	guint32 source_mask;
+	guint32 destination;
+	guint32 destination_mask;
+	guint32 host;
+	guint32 host_mask;
+	guint16 port_low; /* Destination ports, both ends included */
+	guint16 port_high;
+	guint8 protocol;
+	guint16 *services; /* Ids of the names equal to the service given but for case, see hit_lookup */
+	guint service_count; /* None of them matches no hit */
+	guint8 direction; /* A HitDirection */
+	gint64 since; /* Seconds since the epoch, both ends included */
+	gint64 until;
+};
+
+HitQuery *hitquery_parse (const gchar *text, gchar **error);
+gboolean hitquery_match (const HitQuery *query, const Hit *h);
+void hitquery_free (HitQuery *query);
+
+#endif
@@ -0,0 +1,265 @@
+/*---[ hitring.c ]----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Bounded ring of the rows of the events list, oldest first
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+
+#include "hitring.h"
+
+#define RING_MIN_SIZE 1024 /* Slots allocated at first, the ring grows up to its capacity */
+
+/* The rows of the list are remembered in the order the hits were logged,
+   so that the oldest one is found in constant time once the list is full.
+   A row is the number its owner stores the hit under */
+struct _HitRing
+{
+	guint *slots;
+	guint size; /* Slots allocated */
+	guint capacity; /* Most rows kept */
+	guint start; /* Slot of the oldest row */
+	guint count;
+	HitRing *older; /* Rows older than all the others, still coming in oldest first. The capacity is on both together */
+	HitRingEvictFunc evict;
+	gpointer data; /* Passed to evict */
+};
+
+/* [ ring_slot ]
+ * Return the slot of the nth oldest row
+ */
+static guint *
+ring_slot (const HitRing *ring, guint n)
+{
+	return &ring->slots[(ring->start + n) % ring->size];
+}
+
+/* [ ring_resize ]
+ * Move the rows to a new array of the given number of slots, oldest first
+ */
+static void
+ring_resize (HitRing *ring, guint size)
+{
+	guint *slots = g_new (guint, size);
+	guint i;
+
+	for (i = 0; i < ring->count; i++)
+		slots[i] = *ring_slot (ring, i);
+
+	g_free (ring->slots);
+	ring->slots = slots;
+	ring->size = size;
+	ring->start = 0;
+}
+
+/* [ ring_make_room ]
+ * Make sure there is a free slot for one more row, the ring must not be full
+ */
+static void
+ring_make_room (HitRing *ring)
+{
+	if (ring->count == ring->size)
+		ring_resize (ring, MIN (MAX (ring->size * 2, RING_MIN_SIZE), ring->capacity));
+}
+
+/* [ ring_evict_oldest ]
+ * Drop the oldest row, letting the owner remove it
+ */
+static void
+ring_evict_oldest (HitRing *ring)
+{
+	guint row = *ring_slot (ring, 0);
+
+	ring->start = (ring->start + 1) % ring->size;
+	ring->count--;
+	ring->evict (row, ring->data);
+}
+
+/* [ hitring_new ]
+ * Create a ring keeping at most capacity rows, HITRING_UNLIMITED for no limit.
+ * evict is called with data for each row dropped to make room
+ */
+HitRing *
+hitring_new (guint capacity, HitRingEvictFunc evict, gpointer data)
+{
+	HitRing *ring = g_new0 (HitRing, 1);
+
+	ring->capacity = MAX (capacity, 1);
+	ring->evict = evict;
+	ring->data = data;
+
+	return ring;
+}
+
+/* [ hitring_set_capacity ]
+ * Change the number of rows kept, evicting the oldest ones that no longer fit
+ */
+void
+hitring_set_capacity (HitRing *ring, guint capacity)
+{
+	ring->capacity = MAX (capacity, 1);
+
+	/* The rows still coming in oldest first are older than the others */
+	if (ring->older != NULL) {
+		while (ring->older->count > 0 && hitring_get_count (ring) > ring->capacity)
+			ring_evict_oldest (ring->older);
+		ring->older->capacity = ring->capacity;
+		if (ring->older->size > ring->older->capacity)
+			ring_resize (ring->older, ring->older->capacity);
+	}
+
+	while (ring->count > ring->capacity)
+		ring_evict_oldest (ring);
+
+	/* Give back the slots that can't be used anymore */
+	if (ring->size > ring->capacity)
+		ring_resize (ring, ring->capacity);
+}
+
+/* [ hitring_get_count ]
+ * Return the number of rows in the ring
+ */
+guint
+hitring_get_count (const HitRing *ring)
+{
+	return ring->count + (ring->older != NULL ? ring->older->count : 0);
+}
+
+/* [ hitring_nth ]
+ * Return the nth oldest row
+ */
+guint
+hitring_nth (const HitRing *ring, guint n)
+{
+	if (ring->older != NULL) {
+		if (n < ring->older->count)
+			return *ring_slot (ring->older, n);
+		n -= ring->older->count;
+	}
+
+	return *ring_slot (ring, n);
+}
+
+/* [ hitring_push_back ]
+ * Add the row of the newest hit, evicting the oldest row if the ring is full
+ */
+void
+hitring_push_back (HitRing *ring, guint row)
+{
+	/* The oldest row may be one still coming in oldest first */
+	if (hitring_get_count (ring) >= ring->capacity)
+		ring_evict_oldest ((ring->older != NULL && ring->older->count > 0) ? ring->older : ring);
+	ring_make_room (ring);
+
+	*ring_slot (ring, ring->count) = row;
+	ring->count++;
+}
+
+/* [ hitring_has_room_front ]
+ * Test if a row older than all the others would still fit
+ */
+gboolean
+hitring_has_room_front (const HitRing *ring)
+{
+	return (ring->count < ring->capacity);
+}
+
+/* [ hitring_push_front ]
+ * Add the row of a hit older than all the others, as happens when the log
+ * is read newest first. There has to be room for it
+ */
+void
+hitring_push_front (HitRing *ring, guint row)
+{
+	g_return_if_fail (ring->count < ring->capacity);
+
+	ring_make_room (ring);
+	ring->start = (ring->start + ring->size - 1) % ring->size;
+	*ring_slot (ring, 0) = row;
+	ring->count++;
+}
+
+/* [ hitring_has_room_older ]
+ * Test if a row can be added with hitring_push_older
+ */
+gboolean
+hitring_has_room_older (HitRing *ring)
+{
+	/* Once some have come in, the newest of them replace the oldest */
+	return (hitring_get_count (ring) < ring->capacity || (ring->older != NULL && ring->older->count > 0));
+}
+
+/* [ hitring_push_older ]
+ * Add the row of a hit older than all the others, when such hits come
+ * oldest first, as the rotated logs are read. The newest of them are kept
+ * in the room left at the front, until hitring_end_older puts them there.
+ * Once the ring is full they make room by evicting the oldest of them
+ */
+void
+hitring_push_older (HitRing *ring, guint row)
+{
+	g_return_if_fail (hitring_has_room_older (ring));
+
+	if (ring->older == NULL)
+		ring->older = hitring_new (ring->capacity, ring->evict, ring->data);
+	else if (hitring_get_count (ring) >= ring->capacity)
+		ring_evict_oldest (ring->older);
+
+	hitring_push_back (ring->older, row);
+}
+
+/* [ hitring_end_older ]
+ * Move the rows added by hitring_push_older in front of the others
+ */
+void
+hitring_end_older (HitRing *ring)
+{
+	HitRing *older = ring->older;
+
+	if (older == NULL)
+		return;
+
+	/* Newer rows added meanwhile have already pushed out the oldest of these */
+	while (older->count > 0) {
+		hitring_push_front (ring, *ring_slot (older, older->count - 1));
+		older->count--;
+	}
+
+	ring->older = NULL;
+	hitring_free (older);
+}
+
+/* [ hitring_clear ]
+ * Forget all the rows, without evicting them
+ */
+void
+hitring_clear (HitRing *ring)
+{
+	if (ring->older != NULL) {
+		hitring_free (ring->older);
+		ring->older = NULL;
+	}
+
+	g_free (ring->slots);
+	ring->slots = NULL;
+	ring->size = 0;
+	ring->start = 0;
+	ring->count = 0;
+}
+
+/* [ hitring_free ]
+ * Free a ring, without evicting its rows
+ */
+void
+hitring_free (HitRing *ring)
+{
+	hitring_clear (ring);
+	g_free (ring);
+}
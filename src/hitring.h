@@ -0,0 +1,41 @@
+/*---[ hitring.h ]----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Bounded ring of the rows of the events list, oldest first
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_HITRING
+#define _FORTIFIED_HITRING
+
+#include <config.h>
+#include <gnome.h>
+
+#define HITRING_UNLIMITED G_MAXUINT
+
+/* Called with a row that no longer fits, after it has left the ring */
+typedef void (*HitRingEvictFunc) (guint row, gpointer data);
+
+typedef struct _HitRing HitRing;
+
+HitRing *hitring_new (guint capacity, HitRingEvictFunc evict, gpointer data);
+void hitring_set_capacity (HitRing *ring, guint capacity);
+guint hitring_get_count (const HitRing *ring);
+guint hitring_nth (const HitRing *ring, guint n);
+
+void hitring_push_back (HitRing *ring, guint row);
+gboolean hitring_has_room_front (const HitRing *ring);
+void hitring_push_front (HitRing *ring, guint row);
+gboolean hitring_has_room_older (HitRing *ring);
+void hitring_push_older (HitRing *ring, guint row);
+void hitring_end_older (HitRing *ring);
+
+void hitring_clear (HitRing *ring);
+void hitring_free (HitRing *ring);
+
+#endif
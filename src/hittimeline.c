@@ -0,0 +1,165 @@
+/*---[ hittimeline.c ]------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Counts of hits over time, at a few fixed resolutions
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+
+#include "hittimeline.h"
+
+/* Seconds covered by a bucket and buckets kept, for each level */
+static const guint level_widths[HITTIMELINE_NUM_LEVELS] = {1, 60, 60*60, 24*60*60};
+static const guint level_lengths[HITTIMELINE_NUM_LEVELS] = {60, 60, 24, 30};
+
+#define OFFSET_SPAN (15*60) /* Seconds the local time offset is taken to hold for, time zones change on the quarter hour */
+
+/* A stretch of time, counting the hits of each series logged in it */
+typedef struct _Bucket Bucket;
+struct _Bucket
+{
+	gint64 slot; /* Start of the stretch, in bucket widths since the epoch */
+	guint32 counts[HITTIMELINE_NUM_SERIES];
+};
+
+/* Every level is a ring of buckets, the bucket of a slot is always the
+   same one, taken over by a later slot once the ring has come around.
+   A hit is counted at every level, in constant time whatever order the
+   hits come in, and the memory used never grows */
+struct _HitTimeline
+{
+	Bucket *levels[HITTIMELINE_NUM_LEVELS];
+	gint64 offset_span; /* Quarter hour the offset was found for, -1 for none */
+	gint64 offset; /* Seconds the local time was ahead of UTC in it */
+};
+
+/* [ utc_offset ]
+ * Return the seconds the local time was ahead of UTC at a time
+ */
+static gint64
+utc_offset (gint64 time)
+{
+	GDateTime *date = g_date_time_new_from_unix_local (time);
+	gint64 offset = 0;
+
+	if (date != NULL) {
+		offset = g_date_time_get_utc_offset (date) / G_TIME_SPAN_SECOND;
+		g_date_time_unref (date);
+	}
+
+	return offset;
+}
+
+/* [ hittimeline_new ]
+ * Create an empty timeline
+ */
+HitTimeline *
+hittimeline_new (void)
+{
+	HitTimeline *timeline = g_new (HitTimeline, 1);
+	gint level;
+
+	for (level = 0; level < HITTIMELINE_NUM_LEVELS; level++)
+		timeline->levels[level] = g_new (Bucket, level_lengths[level]);
+	timeline->offset_span = -1;
+	hittimeline_clear (timeline);
+
+	return timeline;
+}
+
+/* [ hittimeline_add ]
+ * Count a hit of a series logged at the given time, in seconds since the
+ * epoch. Hours and days start at local midnight. Hits older than a level
+ * reaches back from the newest one are left out of it
+ */
+void
+hittimeline_add (HitTimeline *timeline, gint64 time, HitTimelineSeries series)
+{
+	Bucket *bucket;
+	gint64 slot;
+	gint level;
+
+	if (time / OFFSET_SPAN != timeline->offset_span) {
+		timeline->offset_span = time / OFFSET_SPAN;
+		timeline->offset = utc_offset (time);
+	}
+	time += timeline->offset;
+	if (time < 0)
+		return;
+
+	for (level = 0; level < HITTIMELINE_NUM_LEVELS; level++) {
+		slot = time / level_widths[level];
+		bucket = &timeline->levels[level][slot % level_lengths[level]];
+
+		if (bucket->slot > slot)
+			continue;
+		if (bucket->slot < slot) {
+			bucket->slot = slot;
+			memset (bucket->counts, 0, sizeof (bucket->counts));
+		}
+		bucket->counts[series]++;
+	}
+}
+
+/* [ hittimeline_get_length ]
+ * Return the number of buckets of a level
+ */
+guint
+hittimeline_get_length (HitTimelineLevel level)
+{
+	return level_lengths[level];
+}
+
+/* [ hittimeline_get ]
+ * Fill counts with the hits of a series in each bucket of a level, oldest
+ * first, up to the one holding the time now
+ */
+void
+hittimeline_get (const HitTimeline *timeline, HitTimelineLevel level, gint64 now,
+                 HitTimelineSeries series, guint32 *counts)
+{
+	guint length = level_lengths[level];
+	gint64 slot = (now + utc_offset (now)) / level_widths[level] - length + 1;
+	const Bucket *bucket;
+	guint i;
+
+	for (i = 0; i < length; i++, slot++) {
+		bucket = &timeline->levels[level][(slot >= 0 ? slot : 0) % length];
+		counts[i] = (bucket->slot == slot) ? bucket->counts[series] : 0;
+	}
+}
+
+/* [ hittimeline_clear ]
+ * Forget all the hits counted
+ */
+void
+hittimeline_clear (HitTimeline *timeline)
+{
+	guint level, i;
+
+	for (level = 0; level < HITTIMELINE_NUM_LEVELS; level++)
+		for (i = 0; i < level_lengths[level]; i++) {
+			timeline->levels[level][i].slot = -1;
+			memset (timeline->levels[level][i].counts, 0, sizeof (timeline->levels[level][i].counts));
+		}
+}
+
+/* [ hittimeline_free ]
+ * Free a timeline
+ */
+void
+hittimeline_free (HitTimeline *timeline)
+{
+	gint level;
+
+	for (level = 0; level < HITTIMELINE_NUM_LEVELS; level++)
+		g_free (timeline->levels[level]);
+	g_free (timeline);
+}
@@ -0,0 +1,47 @@
+/*---[ hittimeline.h ]------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Counts of hits over time, at a few fixed resolutions
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_HITTIMELINE
+#define _FORTIFIED_HITTIMELINE
+
+#include <config.h>
+#include <gnome.h>
+
+typedef enum
+{
+	HITTIMELINE_INBOUND,
+	HITTIMELINE_OUTBOUND,
+	HITTIMELINE_SERIOUS_INBOUND,
+	HITTIMELINE_SERIOUS_OUTBOUND,
+	HITTIMELINE_NUM_SERIES
+} HitTimelineSeries;
+
+typedef enum
+{
+	HITTIMELINE_SECONDS,
+	HITTIMELINE_MINUTES,
+	HITTIMELINE_HOURS,
+	HITTIMELINE_DAYS,
+	HITTIMELINE_NUM_LEVELS
+} HitTimelineLevel;
+
+typedef struct _HitTimeline HitTimeline;
+
+HitTimeline *hittimeline_new (void);
+void hittimeline_add (HitTimeline *timeline, gint64 time, HitTimelineSeries series);
+guint hittimeline_get_length (HitTimelineLevel level);
+void hittimeline_get (const HitTimeline *timeline, HitTimelineLevel level, gint64 now,
+                      HitTimelineSeries series, guint32 *counts);
+void hittimeline_clear (HitTimeline *timeline);
+void hittimeline_free (HitTimeline *timeline);
+
+#endif
@@ -0,0 +1,221 @@
+/*---[ hittop.c ]-----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Bounded counts of the most frequent keys of a stream of hits
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+
+#include "hittop.h"
+
+/* The Space-Saving algorithm: a fixed number of counters, each owned by
+   a key. A key without one takes over the smallest counter, inheriting
+   its count as the error. Any key seen more than total / capacity times
+   is sure to own a counter, with a count at most that much too high.
+   The counters are kept in a heap on their counts, smallest first, so
+   that the one to take over is found at once */
+struct _HitTop
+{
+	HitTopEntry *counters;
+	guint *heap; /* Counters, a parent never counts more than its children */
+	guint *places; /* Place of each counter in the heap */
+	guint capacity;
+	guint used;
+	GHashTable *owners; /* Key to its counter plus one */
+	guint64 total;
+};
+
+/* [ heap_count ]
+ * Return the count of the counter at a place in the heap
+ */
+static guint32
+heap_count (const HitTop *top, guint place)
+{
+	return top->counters[top->heap[place]].count;
+}
+
+/* [ heap_swap ]
+ * Swap the counters at two places in the heap
+ */
+static void
+heap_swap (HitTop *top, guint a, guint b)
+{
+	guint counter = top->heap[a];
+
+	top->heap[a] = top->heap[b];
+	top->heap[b] = counter;
+	top->places[top->heap[a]] = a;
+	top->places[top->heap[b]] = b;
+}
+
+/* [ heap_up ]
+ * Move a counter up the heap, to its place among larger counts
+ */
+static void
+heap_up (HitTop *top, guint place)
+{
+	guint parent;
+
+	while (place > 0) {
+		parent = (place - 1) / 2;
+		if (heap_count (top, parent) <= heap_count (top, place))
+			break;
+		heap_swap (top, place, parent);
+		place = parent;
+	}
+}
+
+/* [ heap_down ]
+ * Move a counter down the heap after its count grew
+ */
+static void
+heap_down (HitTop *top, guint place)
+{
+	guint child;
+
+	for (;;) {
+		child = place * 2 + 1;
+		if (child >= top->used)
+			break;
+		if (child + 1 < top->used && heap_count (top, child + 1) < heap_count (top, child))
+			child++;
+		if (heap_count (top, child) >= heap_count (top, place))
+			break;
+		heap_swap (top, place, child);
+		place = child;
+	}
+}
+
+/* [ hittop_new ]
+ * Create a sketch counting at most the given number of keys
+ */
+HitTop *
+hittop_new (guint capacity)
+{
+	HitTop *top = g_new0 (HitTop, 1);
+
+	top->capacity = MAX (capacity, 1);
+	top->counters = g_new (HitTopEntry, top->capacity);
+	top->heap = g_new (guint, top->capacity);
+	top->places = g_new (guint, top->capacity);
+	top->owners = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	return top;
+}
+
+/* [ hittop_add ]
+ * Count one more occurrence of a key
+ */
+void
+hittop_add (HitTop *top, guint32 key)
+{
+	gpointer owner = g_hash_table_lookup (top->owners, GUINT_TO_POINTER (key));
+	HitTopEntry *entry;
+	guint counter;
+
+	top->total++;
+
+	if (owner != NULL) {
+		counter = GPOINTER_TO_UINT (owner) - 1;
+		top->counters[counter].count++;
+		heap_down (top, top->places[counter]);
+		return;
+	}
+
+	if (top->used < top->capacity) {
+		counter = top->used++;
+		entry = &top->counters[counter];
+		entry->key = key;
+		entry->count = 1;
+		entry->error = 0;
+		top->heap[counter] = counter;
+		top->places[counter] = counter;
+		g_hash_table_insert (top->owners, GUINT_TO_POINTER (key), GUINT_TO_POINTER (counter + 1));
+		heap_up (top, counter);
+		return;
+	}
+
+	counter = top->heap[0];
+	entry = &top->counters[counter];
+	g_hash_table_remove (top->owners, GUINT_TO_POINTER (entry->key));
+	entry->key = key;
+	entry->error = entry->count;
+	entry->count++;
+	g_hash_table_insert (top->owners, GUINT_TO_POINTER (key), GUINT_TO_POINTER (counter + 1));
+	heap_down (top, 0);
+}
+
+/* [ compare_entries ]
+ * Order entries by count, highest first, then by key
+ */
+static gint
+compare_entries (gconstpointer a, gconstpointer b, gpointer data)
+{
+	const HitTopEntry *entry1 = a, *entry2 = b;
+
+	if (entry1->count != entry2->count)
+		return (entry1->count < entry2->count) ? 1 : -1;
+
+	return (entry1->key > entry2->key) - (entry1->key < entry2->key);
+}
+
+/* [ hittop_get ]
+ * Fill entries with up to n of the keys counted most, highest first.
+ * Return the number filled
+ */
+guint
+hittop_get (const HitTop *top, HitTopEntry *entries, guint n)
+{
+	HitTopEntry *sorted;
+
+	n = MIN (n, top->used);
+	if (n == 0)
+		return 0;
+
+	sorted = g_memdup (top->counters, top->used * sizeof (HitTopEntry));
+	g_qsort_with_data (sorted, top->used, sizeof (HitTopEntry), compare_entries, NULL);
+	memcpy (entries, sorted, n * sizeof (HitTopEntry));
+	g_free (sorted);
+
+	return n;
+}
+
+/* [ hittop_get_total ]
+ * Return the number of keys counted, all of them
+ */
+guint64
+hittop_get_total (const HitTop *top)
+{
+	return top->total;
+}
+
+/* [ hittop_clear ]
+ * Forget all the keys counted
+ */
+void
+hittop_clear (HitTop *top)
+{
+	g_hash_table_remove_all (top->owners);
+	top->used = 0;
+	top->total = 0;
+}
+
+/* [ hittop_free ]
+ * Free a sketch
+ */
+void
+hittop_free (HitTop *top)
+{
+	g_hash_table_destroy (top->owners);
+	g_free (top->counters);
+	g_free (top->heap);
+	g_free (top->places);
+	g_free (top);
+}
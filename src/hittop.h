@@ -0,0 +1,38 @@
+/*---[ hittop.h ]-----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Bounded counts of the most frequent keys of a stream of hits
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_HITTOP
+#define _FORTIFIED_HITTOP
+
+#include <config.h>
+#include <gnome.h>
+
+/* A key counted by a sketch. The true count is between count - error
+   and count */
+typedef struct _HitTopEntry HitTopEntry;
+struct _HitTopEntry
+{
+	guint32 key;
+	guint32 count;
+	guint32 error;
+};
+
+typedef struct _HitTop HitTop;
+
+HitTop *hittop_new (guint capacity);
+void hittop_add (HitTop *top, guint32 key);
+guint hittop_get (const HitTop *top, HitTopEntry *entries, guint n);
+guint64 hittop_get_total (const HitTop *top);
+void hittop_clear (HitTop *top);
+void hittop_free (HitTop *top);
+
+#endif
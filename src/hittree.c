@@ -0,0 +1,547 @@
+/*---[ hittree.c ]----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Rows of the events list kept sorted, found by position
+ *--------------------------------------------------------------------*/
+
+
+#include <config.h>
+#include <gnome.h>
+
+#include "hittree.h"
+
+#define TREE_ORDER 128 /* Most rows of a leaf, or children of a branch */
+#define TREE_MIN (TREE_ORDER/4) /* With fewer, a node takes some from a neighbour or joins it */
+#define TREE_FILL (TREE_ORDER*3/4) /* Of the nodes built at once, leaving room for more */
+
+/* A B+tree counting the rows under each node, so that a row is found by
+   its position as well as by comparing it. A branch keeps the first row
+   under each of its children to compare with, always a row still in the
+   tree, as the rows are given out again once gone. Rows go in and out in
+   logarithmic time, where an array would move every row after them */
+typedef struct _HitTreeNode HitTreeNode;
+struct _HitTreeNode
+{
+	HitTreeNode *parent;
+	guint count; /* Rows under the node */
+	guint n; /* Rows of a leaf, or children of a branch */
+	gboolean leaf;
+	guint rows[TREE_ORDER]; /* Of a leaf, or the first row under each child of a branch */
+	HitTreeNode *children[TREE_ORDER]; /* Of a branch, not allocated for a leaf */
+};
+
+struct _HitTree
+{
+	HitTreeNode *root; /* NULL while empty */
+	HitTreeNode *leaf; /* Of the last row found by position, or NULL */
+	guint leaf_start; /* Position of its first row */
+	HitTreeCompareFunc compare;
+	gpointer data; /* Passed to compare */
+};
+
+/* [ node_new ]
+ * Create an empty node
+ */
+static HitTreeNode *
+node_new (gboolean leaf)
+{
+	HitTreeNode *node;
+
+	node = g_malloc (leaf ? G_STRUCT_OFFSET (HitTreeNode, children) : sizeof (HitTreeNode));
+	node->parent = NULL;
+	node->count = 0;
+	node->n = 0;
+	node->leaf = leaf;
+
+	return node;
+}
+
+/* [ node_free ]
+ * Free a node and everything under it
+ */
+static void
+node_free (HitTreeNode *node)
+{
+	guint i;
+
+	if (!node->leaf)
+		for (i = 0; i < node->n; i++)
+			node_free (node->children[i]);
+	g_free (node);
+}
+
+/* [ child_index ]
+ * Return the place of a node among the children of its parent
+ */
+static guint
+child_index (const HitTreeNode *node)
+{
+	guint i = 0;
+
+	while (node->parent->children[i] != node)
+		i++;
+
+	return i;
+}
+
+/* [ add_count ]
+ * Change the count of rows of a node and of those above it
+ */
+static void
+add_count (HitTreeNode *node, gint delta)
+{
+	for (; node != NULL; node = node->parent)
+		node->count += delta;
+}
+
+/* [ update_first ]
+ * Tell the branches above a node its first row changed
+ */
+static void
+update_first (HitTreeNode *node)
+{
+	guint i;
+
+	while (node->parent != NULL) {
+		i = child_index (node);
+		node->parent->rows[i] = node->rows[0];
+		if (i > 0)
+			break;
+		node = node->parent;
+	}
+}
+
+/* [ descend ]
+ * Find the leaf a row is in or would go in. index is set to its place in
+ * the leaf, position to its place in the tree
+ */
+static HitTreeNode *
+descend (const HitTree *tree, guint row, guint *index, guint *position)
+{
+	HitTreeNode *node = tree->root;
+	guint low, high, middle, i;
+
+	*position = 0;
+	while (!node->leaf) {
+		/* The last child starting at or before the row */
+		low = 1;
+		high = node->n;
+		while (low < high) {
+			middle = low + (high - low) / 2;
+			if (tree->compare (node->rows[middle], row, tree->data) <= 0)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		for (i = 0; i < low - 1; i++)
+			*position += node->children[i]->count;
+		node = node->children[low - 1];
+	}
+
+	low = 0;
+	high = node->n;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (tree->compare (node->rows[middle], row, tree->data) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	*index = low;
+	*position += low;
+
+	return node;
+}
+
+/* [ move_entries ]
+ * Move count rows, or children, from a place of one node to a place of
+ * another. Both places must be at the end of the node or free. Return the
+ * number of rows moved
+ */
+static guint
+move_entries (HitTreeNode *from, guint from_index, HitTreeNode *to, guint to_index, guint count)
+{
+	guint moved = count, i;
+
+	memcpy (&to->rows[to_index], &from->rows[from_index], count * sizeof (guint));
+	if (!from->leaf) {
+		moved = 0;
+		memcpy (&to->children[to_index], &from->children[from_index], count * sizeof (HitTreeNode *));
+		for (i = to_index; i < to_index + count; i++) {
+			to->children[i]->parent = to;
+			moved += to->children[i]->count;
+		}
+	}
+
+	return moved;
+}
+
+/* [ open_gap ]
+ * Make room for count entries at a place of a node
+ */
+static void
+open_gap (HitTreeNode *node, guint index, guint count)
+{
+	memmove (&node->rows[index + count], &node->rows[index], (node->n - index) * sizeof (guint));
+	if (!node->leaf)
+		memmove (&node->children[index + count], &node->children[index],
+		         (node->n - index) * sizeof (HitTreeNode *));
+	node->n += count;
+}
+
+/* [ close_gap ]
+ * Drop count entries at a place of a node
+ */
+static void
+close_gap (HitTreeNode *node, guint index, guint count)
+{
+	node->n -= count;
+	memmove (&node->rows[index], &node->rows[index + count], (node->n - index) * sizeof (guint));
+	if (!node->leaf)
+		memmove (&node->children[index], &node->children[index + count],
+		         (node->n - index) * sizeof (HitTreeNode *));
+}
+
+/* [ add_child ]
+ * Put a node among the children of a branch, at a place of them
+ */
+static void
+add_child (HitTreeNode *parent, guint index, HitTreeNode *child)
+{
+	open_gap (parent, index, 1);
+	parent->rows[index] = child->rows[0];
+	parent->children[index] = child;
+	child->parent = parent;
+}
+
+/* [ split_node ]
+ * Move the upper half of a full node to a new one next to it
+ */
+static void
+split_node (HitTree *tree, HitTreeNode *node)
+{
+	HitTreeNode *sibling = node_new (node->leaf);
+	guint half = node->n / 2, moved;
+
+	moved = move_entries (node, half, sibling, 0, node->n - half);
+	sibling->n = node->n - half;
+	sibling->count = moved;
+	node->n = half;
+	node->count -= moved;
+
+	if (node->parent == NULL) {
+		tree->root = node_new (FALSE);
+		tree->root->count = node->count + sibling->count;
+		add_child (tree->root, 0, node);
+	}
+	add_child (node->parent, child_index (node) + 1, sibling);
+
+	if (node->parent->n == TREE_ORDER)
+		split_node (tree, node->parent);
+}
+
+/* [ rebalance ]
+ * Fill up a node left with too few rows or children from a neighbour, or
+ * join the two
+ */
+static void
+rebalance (HitTree *tree, HitTreeNode *node)
+{
+	HitTreeNode *parent = node->parent, *left, *right;
+	guint i, target, moved;
+
+	if (parent == NULL) {
+		/* The root keeps a single branch only while it has more than one child */
+		if (node->n == 0) {
+			g_free (node);
+			tree->root = NULL;
+		} else if (!node->leaf && node->n == 1) {
+			tree->root = node->children[0];
+			tree->root->parent = NULL;
+			g_free (node);
+		}
+		return;
+	}
+
+	if (node->n >= TREE_MIN)
+		return;
+
+	i = child_index (node);
+	if (node->n == 0) {
+		close_gap (parent, i, 1);
+		g_free (node);
+		if (i == 0 && parent->n > 0)
+			update_first (parent);
+		rebalance (tree, parent);
+		return;
+	}
+
+	if (parent->n == 1)
+		return;
+
+	i = MAX (i, 1);
+	left = parent->children[i - 1];
+	right = parent->children[i];
+
+	if (left->n + right->n < TREE_ORDER) {
+		moved = move_entries (right, 0, left, left->n, right->n);
+		left->n += right->n;
+		left->count += moved;
+		close_gap (parent, i, 1);
+		g_free (right);
+		rebalance (tree, parent);
+		return;
+	}
+
+	/* Even them out, only the first row of the right one changes */
+	target = (left->n + right->n) / 2;
+	if (left->n < target) {
+		moved = move_entries (right, 0, left, left->n, target - left->n);
+		close_gap (right, 0, target - left->n);
+		left->n = target;
+		left->count += moved;
+		right->count -= moved;
+	} else {
+		open_gap (right, 0, left->n - target);
+		moved = move_entries (left, target, right, 0, left->n - target);
+		left->n = target;
+		left->count -= moved;
+		right->count += moved;
+	}
+	parent->rows[i] = right->rows[0];
+}
+
+/* [ hittree_new ]
+ * Create an empty tree of rows, kept in the order compare gives them
+ * with data
+ */
+HitTree *
+hittree_new (HitTreeCompareFunc compare, gpointer data)
+{
+	HitTree *tree = g_new0 (HitTree, 1);
+
+	tree->compare = compare;
+	tree->data = data;
+
+	return tree;
+}
+
+/* [ hittree_get_count ]
+ * Return the number of rows in the tree
+ */
+guint
+hittree_get_count (const HitTree *tree)
+{
+	return (tree->root != NULL ? tree->root->count : 0);
+}
+
+/* [ hittree_nth ]
+ * Return the row at a position of the tree
+ */
+guint
+hittree_nth (HitTree *tree, guint n)
+{
+	HitTreeNode *node = tree->root;
+	guint i, start = n;
+
+	g_return_val_if_fail (n < hittree_get_count (tree), 0);
+
+	/* The rows are mostly asked for one after the other */
+	if (tree->leaf != NULL && n >= tree->leaf_start && n - tree->leaf_start < tree->leaf->n)
+		return tree->leaf->rows[n - tree->leaf_start];
+
+	while (!node->leaf) {
+		for (i = 0; n >= node->children[i]->count; i++)
+			n -= node->children[i]->count;
+		node = node->children[i];
+	}
+	tree->leaf = node;
+	tree->leaf_start = start - n;
+
+	return node->rows[n];
+}
+
+/* [ hittree_find ]
+ * Return the position of a row in the tree
+ */
+guint
+hittree_find (const HitTree *tree, guint row)
+{
+	guint index, position;
+
+	g_return_val_if_fail (tree->root != NULL, 0);
+
+	descend (tree, row, &index, &position);
+
+	return position;
+}
+
+/* [ hittree_insert ]
+ * Add a row to the tree, return its position
+ */
+guint
+hittree_insert (HitTree *tree, guint row)
+{
+	HitTreeNode *leaf;
+	guint index, position;
+
+	if (tree->root == NULL)
+		tree->root = node_new (TRUE);
+	tree->leaf = NULL;
+
+	leaf = descend (tree, row, &index, &position);
+	open_gap (leaf, index, 1);
+	leaf->rows[index] = row;
+	add_count (leaf, 1);
+	if (index == 0)
+		update_first (leaf);
+
+	if (leaf->n == TREE_ORDER)
+		split_node (tree, leaf);
+
+	return position;
+}
+
+/* [ hittree_remove ]
+ * Take a row out of the tree, return the position it was at. It must be
+ * in the tree and still compare the way it did when added
+ */
+guint
+hittree_remove (HitTree *tree, guint row)
+{
+	HitTreeNode *leaf;
+	guint index, position;
+
+	g_return_val_if_fail (tree->root != NULL, 0);
+	tree->leaf = NULL;
+
+	leaf = descend (tree, row, &index, &position);
+	g_return_val_if_fail (index < leaf->n && leaf->rows[index] == row, position);
+
+	close_gap (leaf, index, 1);
+	add_count (leaf, -1);
+	if (index == 0 && leaf->n > 0)
+		update_first (leaf);
+	rebalance (tree, leaf);
+
+	return position;
+}
+
+/* [ build_level ]
+ * Put the nodes of a level under new branches, return the branches
+ */
+static GPtrArray *
+build_level (GPtrArray *nodes)
+{
+	GPtrArray *branches;
+	guint count, i, j, k = 0;
+
+	count = (nodes->len + TREE_FILL - 1) / TREE_FILL;
+	branches = g_ptr_array_sized_new (count);
+	for (i = 0; i < count; i++) {
+		HitTreeNode *branch = node_new (FALSE);
+		guint end = (guint64)nodes->len * (i + 1) / count;
+
+		for (j = 0; k < end; j++, k++) {
+			HitTreeNode *child = g_ptr_array_index (nodes, k);
+
+			add_child (branch, j, child);
+			branch->count += child->count;
+		}
+		g_ptr_array_add (branches, branch);
+	}
+
+	return branches;
+}
+
+/* [ hittree_set_rows ]
+ * Replace the rows of the tree with ones already in order, building the
+ * tree in linear time
+ */
+void
+hittree_set_rows (HitTree *tree, const guint *rows, guint count)
+{
+	GPtrArray *nodes, *branches;
+	guint leaves, i, start = 0;
+
+	hittree_clear (tree);
+	if (count == 0)
+		return;
+
+	leaves = (count + TREE_FILL - 1) / TREE_FILL;
+	nodes = g_ptr_array_sized_new (leaves);
+	for (i = 0; i < leaves; i++) {
+		HitTreeNode *leaf = node_new (TRUE);
+		guint end = (guint64)count * (i + 1) / leaves;
+
+		leaf->n = leaf->count = end - start;
+		memcpy (leaf->rows, &rows[start], leaf->n * sizeof (guint));
+		g_ptr_array_add (nodes, leaf);
+		start = end;
+	}
+
+	while (nodes->len > 1) {
+		branches = build_level (nodes);
+		g_ptr_array_free (nodes, TRUE);
+		nodes = branches;
+	}
+
+	tree->root = g_ptr_array_index (nodes, 0);
+	g_ptr_array_free (nodes, TRUE);
+}
+
+/* [ get_node_rows ]
+ * Copy the rows under a node, in order, return the position after them
+ */
+static guint
+get_node_rows (const HitTreeNode *node, guint *rows, guint position)
+{
+	guint i;
+
+	if (node->leaf) {
+		memcpy (&rows[position], node->rows, node->n * sizeof (guint));
+		return position + node->n;
+	}
+
+	for (i = 0; i < node->n; i++)
+		position = get_node_rows (node->children[i], rows, position);
+
+	return position;
+}
+
+/* [ hittree_get_rows ]
+ * Copy the rows of the tree, in order, to an array of hittree_get_count of them
+ */
+void
+hittree_get_rows (const HitTree *tree, guint *rows)
+{
+	if (tree->root != NULL)
+		get_node_rows (tree->root, rows, 0);
+}
+
+/* [ hittree_clear ]
+ * Take all the rows out of the tree
+ */
+void
+hittree_clear (HitTree *tree)
+{
+	if (tree->root != NULL)
+		node_free (tree->root);
+	tree->root = NULL;
+	tree->leaf = NULL;
+}
+
+/* [ hittree_free ]
+ * Free a tree
+ */
+void
+hittree_free (HitTree *tree)
+{
+	hittree_clear (tree);
+	g_free (tree);
+}
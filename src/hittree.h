@@ -0,0 +1,38 @@
+/*---[ hittree.h ]----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Rows of the events list kept sorted, found by position
+ *--------------------------------------------------------------------*/
+
+
+#ifndef _FORTIFIED_HITTREE
+#define _FORTIFIED_HITTREE
+
+#include <config.h>
+#include <gnome.h>
+
+/* Compare two rows the way strcmp does, no two rows of a tree are equal */
+typedef gint (*HitTreeCompareFunc) (guint a, guint b, gpointer data);
+
+typedef struct _HitTree HitTree;
+
+HitTree *hittree_new (HitTreeCompareFunc compare, gpointer data);
+guint hittree_get_count (const HitTree *tree);
+guint hittree_nth (HitTree *tree, guint n);
+guint hittree_find (const HitTree *tree, guint row);
+
+guint hittree_insert (HitTree *tree, guint row);
+guint hittree_remove (HitTree *tree, guint row);
+
+void hittree_set_rows (HitTree *tree, const guint *rows, guint count);
+void hittree_get_rows (const HitTree *tree, guint *rows);
+
+void hittree_clear (HitTree *tree);
+void hittree_free (HitTree *tree);
+
+#endif
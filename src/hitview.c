@@ -12,24 +12,60 @@
 #include <config.h>
 #include <gnome.h>
 #include <libgnomevfs/gnome-vfs.h>
+#include <arpa/inet.h>
 
 #include "fortified.h"
 #include "globals.h"
 #include "hitview.h"
+#include "hitring.h"
+#include "hitmodel.h"
+#include "hitflush.h"
+#include "hitquery.h"
 #include "util.h"
 #include "menus.h"
 #include "preferences.h"
 #include "statusview.h"
 #include "logread.h"
+#include "journal.h"
+#include "nflog.h"
+#include "kmsg.h"
+#include "loghistory.h"
 #include "scriptwriter.h"
 
 #define COLOR_SERIOUS_HIT "#bd1f00"
 #define COLOR_BROADCAST_HIT "#6d6d6d"
-
-static GtkListStore *hitstore;
+#define HIT_ROW_SIZE (sizeof (Hit) + 96) /* A hit, its place in the list and its row in the view, roughly */
+#define FRAME_INTERVAL 16 /* Milliseconds between putting new hits into the list, unless set */
+#define INDEX_SLACK 16 /* The limits are worked out again once the index changes by this fraction */
+#define QUERY_DELAY 300 /* Milliseconds after the typing stops before the query is run */
+#define QUERY_HELP N_("Show only the events matching all the terms, eg. src:10.0.0.0/8 port:20-25 " \
+	"proto:tcp service:ssh dir:in since:18:00 until:2016-01-31T19:00. A term without its " \
+	"field is taken as an address, ports, in or out, a protocol or a service")
+
+static HitModel *hitmodel;
 static GtkWidget *hitview;
+static HitFlush *hitflush; /* New hits waiting to go into the list together */
 static Hit *last_hit = NULL;
 static GnomeVFSAsyncHandle *hitview_ghandle = (GnomeVFSAsyncHandle*)NULL;
+static LogHistory *hitview_history = NULL;
+static LogMap *hitview_map = NULL;
+static JournalReader *hitview_journal = NULL;
+static KmsgReader *hitview_kmsg = NULL;
+static guint hitview_reload_source = 0;
+static guint flush_source = 0;
+static gsize limited_index_size = 0; /* Size of the index of the rows when the limits were applied */
+static gboolean reload_newest_first = FALSE; /* The hits being reloaded come newest first */
+static gboolean reload_history_next = FALSE; /* The rotated logs are read after the current one */
+static gboolean reload_covered = FALSE; /* Lines of the current log were reloaded, a copy of it skips them */
+static guint64 covered_start, covered_end; /* Those lines */
+static guint32 covered_hash; /* Of the line they end with */
+static Hit *newest_hit = NULL; /* The first hit reloaded newest first */
+static Hit *reloaded_hit = NULL; /* The last hit reloaded newest first */
+static GHashTable *hostnames = NULL; /* Resolved names of addresses, shown in their place */
+static GtkWidget *query_entry = NULL; /* The query bar */
+static guint query_source = 0;
+
+static void reload_log_done (void);
 
 const Hit *
 get_last_hit (void)
@@ -40,7 +76,8 @@ get_last_hit (void)
 gboolean
 hitview_reload_in_progress (void)
 {
-	return (hitview_ghandle != NULL);
+	return (hitview_ghandle != NULL || hitview_map != NULL || hitview_history != NULL ||
+	        hitview_journal != NULL || hitview_kmsg != NULL);
 }
 
 void
@@ -51,29 +88,53 @@ hitview_abort_reload_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult resul
 		g_warning ("Close error");
 	}
 	g_free (info->buffer);
-	g_pattern_spec_free (info->pattern);
+	g_string_free (info->pending, TRUE);
 	g_free (info);
 	hitview_ghandle = (GnomeVFSAsyncHandle*)NULL;
 
-	menus_update_events_reloading (FALSE, gui_get_active_view () == EVENTS_VIEW);
-	printf ("Finished reading events list\n");
+	reload_log_done ();
 }
 
-/* [ create_text_column ]
- * Convinience funtion for creating a text column for a treeview
+/* [ events_capacity ]
+ * Return the most rows the list may keep, by count and by memory. The
+ * index of the rows comes out of the memory they may take
  */
-static GtkTreeViewColumn *
-create_text_column (gint number, gchar * title)
+static guint
+events_capacity (void)
 {
-	GtkTreeViewColumn *column;
-	GtkCellRenderer *renderer;
+	guint capacity = HITRING_UNLIMITED;
+	gint max_events = preferences_get_int (PREFS_MAX_EVENTS);
+	gint max_memory = preferences_get_int (PREFS_MAX_EVENTS_MEMORY);
+	guint row_size = HIT_ROW_SIZE;
+	guint64 memory;
+	gsize index_size = 0;
+
+	/* Aggregated rows carry their totals and are looked up by their traffic */
+	if (preferences_get_bool (PREFS_AGGREGATE))
+		row_size += hitflush_get_aggregate_size ();
+
+	if (hitmodel != NULL)
+		index_size = hit_model_get_index_size (hitmodel);
+
+	if (max_events > 0)
+		capacity = max_events;
+	if (max_memory > 0) {
+		memory = (guint64)max_memory * 1024 * 1024;
+		memory = (memory > index_size) ? memory - index_size : 0;
+		capacity = MIN (capacity, memory / row_size);
+	}
 
-	renderer = gtk_cell_renderer_text_new ();
-	column = gtk_tree_view_column_new_with_attributes (title, renderer,
-	                                                   "text", number,
-	                                                   "foreground", HITCOL_COLOR,
-	                                                   NULL);
-	return column;
+	return capacity;
+}
+
+/* [ hitview_apply_limits ]
+ * Drop the oldest rows that no longer fit the limits in the preferences
+ */
+void
+hitview_apply_limits (void)
+{
+	hit_model_set_capacity (hitmodel, events_capacity ());
+	limited_index_size = hit_model_get_index_size (hitmodel);
 }
 
 /* [ hitview_clear ]
@@ -85,14 +146,31 @@ hitview_clear (void)
 	if (status_get_state () == STATUS_HIT)
 		status_set_state (STATUS_RUNNING);
 
+	if (flush_source != 0) {
+		g_source_remove (flush_source);
+		flush_source = 0;
+	}
+	hitflush_clear (hitflush);
+
 	menus_events_clear_enabled (FALSE);
 	menus_events_save_enabled (FALSE);
-	gtk_list_store_clear (hitstore);
+	/* Taken off the view, the rows go at once instead of one by one */
+	gtk_tree_view_set_model (GTK_TREE_VIEW (hitview), NULL);
+	hit_model_clear (hitmodel);
+	gtk_tree_view_set_model (GTK_TREE_VIEW (hitview), GTK_TREE_MODEL (hitmodel));
 	if (last_hit != NULL) {
 		free_hit (last_hit);
 		last_hit = NULL;
 	}
-	gtk_tree_view_columns_autosize (GTK_TREE_VIEW (hitview));
+	if (newest_hit != NULL) {
+		free_hit (newest_hit);
+		newest_hit = NULL;
+	}
+	if (reloaded_hit != NULL) {
+		free_hit (reloaded_hit);
+		reloaded_hit = NULL;
+	}
+	hitflush_autosize_columns (hitflush);
 	status_events_reset ();
 }
 
@@ -147,34 +225,162 @@ scroll_to_hit (GtkTreeIter *iter)
 	 gtk_tree_path_free (last);
 }
 
+/* [ scroll_to_newest ]
+ * Scroll the hitview to the last row, where the newest hit is when sorted
+ * by time, unless the user has selected a hit
+ */
+static void
+scroll_to_newest (void)
+{
+	GtkTreeIter iter;
+	gint rows;
+
+	rows = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (hitmodel), NULL);
+	if (rows > 0 && !has_selected () &&
+	    gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (hitmodel), &iter, NULL, rows-1))
+		scroll_to_hit (&iter);
+}
+
+/* [ get_aggregate_window ]
+ * Return true if repeated hits are counted into the rows of the first
+ * ones, window is set to how far apart in time they may be
+ */
+static gboolean
+get_aggregate_window (gint64 *window)
+{
+	*window = 0;
+	if (!preferences_get_bool (PREFS_AGGREGATE))
+		return FALSE;
+
+	*window = preferences_get_int (PREFS_AGGREGATE_WINDOW);
+	return TRUE;
+}
+
+/* [ flush_hits ]
+ * Put the hits queued since the last flush into the list, then scroll and
+ * update the menus once for all of them
+ */
+static gboolean
+flush_hits (gpointer data)
+{
+	GtkTreeIter iter;
+	gboolean aggregate;
+	gint64 window, newest;
+	gsize index_size;
+
+	flush_source = 0;
+
+	/* The index grows with the rows, the limits follow it */
+	index_size = hit_model_get_index_size (hitmodel);
+	if (index_size > limited_index_size + limited_index_size / INDEX_SLACK ||
+	    index_size + index_size / INDEX_SLACK < limited_index_size)
+		hitview_apply_limits ();
+
+	aggregate = get_aggregate_window (&window);
+	if (hitflush_run (hitflush, aggregate, window, &newest) &&
+	    !has_selected () && hit_model_find_serial (hitmodel, newest, &iter))
+		scroll_to_hit (&iter);
+
+	menus_events_clear_enabled (TRUE);
+	menus_events_save_enabled (TRUE);
+
+	return FALSE;
+}
+
+/* [ schedule_flush ]
+ * Flush the queued hits into the list when the interval is over
+ */
+static void
+schedule_flush (void)
+{
+	gint interval;
+
+	if (flush_source != 0)
+		return;
+
+	interval = preferences_get_int (PREFS_EVENTS_INTERVAL);
+	if (interval <= 0)
+		interval = FRAME_INTERVAL;
+	flush_source = g_timeout_add (interval, flush_hits, NULL);
+}
+
+/* [ flush_hits_now ]
+ * Put the queued hits into the list without waiting
+ */
+static void
+flush_hits_now (void)
+{
+	if (flush_source != 0) {
+		g_source_remove (flush_source);
+		flush_hits (NULL);
+	}
+}
+
+/* [ end_newest_first ]
+ * Stop reloading newest first. The newest hit reloaded becomes the last
+ * one, unless a new hit came in meanwhile
+ */
+static void
+end_newest_first (void)
+{
+	if (newest_hit != NULL) {
+		if (last_hit == NULL)
+			last_hit = newest_hit;
+		else
+			free_hit (newest_hit);
+		newest_hit = NULL;
+	}
+	if (reloaded_hit != NULL) {
+		free_hit (reloaded_hit);
+		reloaded_hit = NULL;
+	}
+	hitflush_end_older (hitflush);
+	hit_model_end_older (hitmodel);
+	reload_newest_first = FALSE;
+	reload_history_next = FALSE;
+	reload_covered = FALSE;
+}
+
+/* [ reload_finished ]
+ * Restore the UI after the events list has been read
+ */
+static void
+reload_finished (void)
+{
+	if (reload_newest_first)
+		scroll_to_newest ();
+	end_newest_first ();
+	menus_update_events_reloading (FALSE, gui_get_active_view () == EVENTS_VIEW);
+	printf ("Finished reading events list\n");
+}
+
 /* [ compare_to_last_hit ]
  * Loosely compare a hit to the previous one. Return true if they are similiar
  */
 static gboolean
-compare_to_last_hit (Hit *new)
+compare_to_last_hit (const Hit *old, Hit *new)
 {
-	const Hit *old = get_last_hit ();
 	gboolean same = TRUE;
 
 	if (old == NULL || new == NULL)
 		return FALSE;
 	
 	/* Going from most likely to differ to least */
-	if (strcmp (new->port, old->port) != 0) {
+	if (new->port != old->port) {
 		same = FALSE;
 	}
-	else if (strcmp (new->protocol, old->protocol) != 0) {
+	else if (new->protocol != old->protocol) {
 		same = FALSE;
 	}
-	else if (strcmp (new->source, old->source) != 0) {
+	else if (new->source != old->source) {
 		same = FALSE;
 	}
-	else if (strcmp (new->destination, old->destination) != 0) {
+	else if (new->destination != old->destination) {
 		same = FALSE;
 	}
-/*	else if (strcmp (new->in, old->in) == 0)
+/*	else if (new->in != old->in)
 		same = FALSE;
-	else if (strcmp (new->out, old->out) == 0)
+	else if (new->out != old->out)
 		same = FALSE;
 */
 	return same;
@@ -184,60 +390,104 @@ compare_to_last_hit (Hit *new)
  * Test if the destination of a hit matches the external interface IP
  */
 static gboolean
-hit_is_for_me (Hit *h)
+hit_is_for_me (const Hit *h)
 {
-	static gchar *myip = NULL;
-	
-	if (myip == NULL) {
-		myip = get_ip_of_interface (preferences_get_string (PREFS_FW_EXT_IF));
+	static gboolean known = FALSE;
+	static struct in_addr myip;
+
+	if (!known) {
+		gchar *ip = get_ip_of_interface (preferences_get_string (PREFS_FW_EXT_IF));
+
+		if (inet_pton (AF_INET, ip, &myip) != 1)
+			myip.s_addr = INADDR_NONE;
+		g_free (ip);
+		known = TRUE;
 	}
 
-	return (strcmp (myip, h->destination) == 0);
+	return ((h->flags & HIT_HAS_DESTINATION) && h->destination == myip.s_addr);
 }
 
 /* [ hit_is_serious ]
  * Test if a hit is classified as serious
  */
 static gboolean
-hit_is_serious (Hit *h)
+hit_is_serious (const Hit *h)
 {
-	return (hit_is_for_me (h) && atoi (h->port) < 1024);
+	return (hit_is_for_me (h) && h->port < 1024);
 }
 
 /* [ hit_is_broadcast ]
  * Test if the hit is a broadcasted message
  */
 static gboolean
-hit_is_broadcast (Hit *h)
+hit_is_broadcast (const Hit *h)
 {
-	return (g_str_has_suffix (h->destination, ".255"));
+	return ((h->flags & HIT_HAS_DESTINATION) && (ntohl (h->destination) & 0xFF) == 0xFF);
 }
 
 static gboolean
-hit_is_outbound (Hit *h)
+hit_is_outbound (const Hit *h)
 {
-	return g_str_equal (h->direction, "Outbound");
+	return (h->direction == HIT_OUTBOUND);
 }
 
 static gboolean
-hit_is_inbound (Hit *h)
+hit_is_inbound (const Hit *h)
 {
-	return g_str_equal (h->direction, "Inbound");
+	return (h->direction == HIT_INBOUND);
 }
 
-/* [ hitview_append_hit ]
- * Append a hit to the hitlist, return true if successful
+/* [ render_hit_cell ]
+ * Cell data function, show a field of the hit on a row. The text is only
+ * formatted for the rows drawn
  */
-gboolean
-hitview_append_hit (Hit *h)
+static void
+render_hit_cell (GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                 GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
 {
-	GtkTreeIter iter;
-	static gchar *color_serious = COLOR_SERIOUS_HIT;
-	static gchar *color_broadcast = COLOR_BROADCAST_HIT;
-	gchar *color = NULL;
+	gchar buffer[HIT_TEXT_MAX];
+	const gchar *text;
+	const gchar *color = NULL;
+	const Hit *h;
+
+	h = hit_model_get_hit (HIT_MODEL (model), iter);
+	text = hitflush_cell_text (hitflush, iter, GPOINTER_TO_INT (data), buffer);
+
+	if (hit_is_broadcast (h))
+		color = COLOR_BROADCAST_HIT;
+	else if (hit_is_serious (h))
+		color = COLOR_SERIOUS_HIT;
+
+	g_object_set (renderer, "text", text, "foreground", color, NULL);
+}
+
+/* [ create_text_column ]
+ * Convinience funtion for creating a text column for a treeview
+ */
+static GtkTreeViewColumn *
+create_text_column (gint number, gchar * title)
+{
+	GtkTreeViewColumn *column;
+	GtkCellRenderer *renderer;
+
+	renderer = gtk_cell_renderer_text_new ();
+	column = gtk_tree_view_column_new ();
+	gtk_tree_view_column_set_title (column, title);
+	gtk_tree_view_column_pack_start (column, renderer, TRUE);
+	gtk_tree_view_column_set_cell_data_func (column, renderer, render_hit_cell, GINT_TO_POINTER (number), NULL);
 
+	return column;
+}
+
+/* [ count_hit ]
+ * Filter a hit following the previous one in reading order, and count it on
+ * the status page. Return true if it is to be added
+ */
+static gboolean
+count_hit (Hit *h, const Hit *previous)
+{
 	if (preferences_get_bool (PREFS_SKIP_REDUNDANT))
-		if (compare_to_last_hit (h)) {
+		if (compare_to_last_hit (previous, h)) {
 			/* printf ("Hit filtered: Redundant\n"); */
 			return FALSE;
 		}
@@ -248,60 +498,78 @@ hitview_append_hit (Hit *h)
 			return FALSE;
 		}
 
-	if (hit_is_broadcast (h)) {
-		color = color_broadcast;
-	} else if (hit_is_serious (h)) {
-		color = color_serious;
+	if (!hit_is_broadcast (h) && hit_is_serious (h)) {
 		if (hit_is_outbound (h))
-			status_serious_event_out_inc ();
+			status_serious_event_out_inc (h->time);
 		else
-			status_serious_event_in_inc ();
+			status_serious_event_in_inc (h->time);
 	}
 
-	if (hit_is_outbound (h)) {
-		status_event_out_inc ();
-		g_free (h->direction);
-		h->direction = g_strdup (_("Outbound")); /* Localize the direction */
-	} else if (hit_is_inbound (h)) {
-		status_event_in_inc ();
-		g_free (h->direction);
-		h->direction = g_strdup (_("Inbound"));
-	} else {
-		g_free (h->direction);
-		h->direction = g_strdup (_("Unknown"));
-	}
-
-	gtk_list_store_append (hitstore, &iter);
-	gtk_list_store_set (hitstore, &iter,
-	                    HITCOL_TIME,        h->time,
-			    HITCOL_DIRECTION,	h->direction,
-	                    HITCOL_IN,          h->in,
-	                    HITCOL_OUT,         h->out,
-	                    HITCOL_PORT,        h->port,
-	                    HITCOL_SOURCE,      h->source,
-	                    HITCOL_DESTINATION, h->destination,
-	                    HITCOL_LENGTH,      h->length,
-	                    HITCOL_TOS,         h->tos,
-	                    HITCOL_PROTOCOL,    h->protocol,
-	                    HITCOL_SERVICE,     h->service,
-			    HITCOL_COLOR,       color,
-	                    -1);
-
-	if (!has_selected ())
-		scroll_to_hit (&iter);
+	if (hit_is_outbound (h))
+		status_event_out_inc (h->time);
+	else if (hit_is_inbound (h))
+		status_event_in_inc (h->time);
+	status_top_talkers_add (h);
 
-	if (last_hit != NULL) {
-		free_hit (last_hit);
-	}
-	last_hit = copy_hit (h);
+	return TRUE;
+}
 
-	menus_events_clear_enabled (TRUE);
-	menus_events_save_enabled (TRUE);
+/* [ hitview_append_hit ]
+ * Append a new hit to the hitlist, return true if successful. New hits
+ * always go in at the new end, even while the log is reloaded
+ */
+gboolean
+hitview_append_hit (Hit *h)
+{
+	if (!count_hit (h, get_last_hit ()))
+		return FALSE;
+
+	/* The hit handed in only lives as long as the chunk it was parsed from */
+	if (last_hit == NULL)
+		last_hit = g_new (Hit, 1);
+	*last_hit = *h;
+
+	/* The list keeps its own copy of the hit, the only one that outlives
+	   the parsing. New hits wait for the next flush, a burst of them goes
+	   into the list at once */
+	hitflush_queue (hitflush, h);
+	schedule_flush ();
+
+	return TRUE;
+}
+
+/* [ hitview_append_reloaded_hit ]
+ * Append a hit read back by a reload of the system log, return true if
+ * successful. Hits reloaded newest first go in at the old end
+ */
+gboolean
+hitview_append_reloaded_hit (Hit *h)
+{
+	gboolean aggregate;
+	gint64 window;
+
+	if (!reload_newest_first)
+		return hitview_append_hit (h);
 
-	/* Fixes a glitch in the view's rendering that causes
-	   text to jump around when mouse moves over an entry */
-	if (!hitview_reload_in_progress ())
-		gtk_tree_view_columns_autosize (GTK_TREE_VIEW (hitview));
+	if (!count_hit (h, reloaded_hit))
+		return FALSE;
+
+	if (reloaded_hit == NULL)
+		reloaded_hit = g_new (Hit, 1);
+	*reloaded_hit = *h;
+	if (newest_hit == NULL)
+		newest_hit = copy_hit (h);
+
+	/* Hits reloaded newest first go in at the old end, counted
+	   into the rows of the same traffic by the time they were logged as
+	   new hits are. Once the list is full, those that are not counted
+	   are older than every row and only go on the status page. They
+	   would drag the view back in time, it is scrolled once per batch
+	   instead */
+	aggregate = get_aggregate_window (&window);
+	if (!hitflush_put_older (hitflush, h, hitview_map != NULL, aggregate, window))
+		return FALSE;
+	schedule_flush ();
 
 	return TRUE;
 }
@@ -329,25 +597,185 @@ gvfs_open_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult result, gpointer
 	}
 
 	info->size = file_info->size;
+	info->anchor = file_info->mtime;
 	info->bytes_read = 0;
-	info->buffer = g_new (gchar, FILE_BUF+1);
-	info->pattern = g_pattern_spec_new ("* IN=* OUT=* SRC=* ");
-	info->continuous = FALSE;
+	info->buffer = g_new (gchar, FILE_BUF);
+	info->pending = g_string_sized_new (FILE_BUF);
 	gnome_vfs_file_info_unref (file_info);
 	gnome_vfs_async_read (handle, info->buffer, FILE_BUF, logread_async_read_callback, info);
 }
 
+/* [ reload_history_step ]
+ * Idle callback that adds the hits parsed from the rotated logs a batch at
+ * a time
+ */
+static gboolean
+reload_history_step (gpointer data)
+{
+	if (loghistory_parse_step (hitview_history)) {
+		if (reload_newest_first)
+			scroll_to_newest ();
+		return TRUE;
+	}
+
+	loghistory_close (hitview_history);
+	hitview_history = NULL;
+	hitview_reload_source = 0;
+	reload_finished ();
+
+	return FALSE;
+}
+
+/* [ reload_log_done ]
+ * The current system log has been read, fill in the older events from the
+ * rotated logs if they are to follow
+ */
+static void
+reload_log_done (void)
+{
+	if (reload_history_next) {
+		reload_history_next = FALSE;
+		hitview_history = loghistory_open (get_system_log_path ());
+		if (hitview_history != NULL) {
+			/* A log truncated into a copy while it was read has its lines there too */
+			if (reload_covered)
+				loghistory_skip_copy (hitview_history, covered_start, covered_end, covered_hash);
+			hitview_reload_source = g_idle_add (reload_history_step, NULL);
+			return;
+		}
+	}
+
+	reload_finished ();
+}
+
+/* [ reload_map_step ]
+ * Idle callback that adds the hits parsed from the mapped system log a batch
+ * at a time
+ */
+static gboolean
+reload_map_step (gpointer data)
+{
+	if (logread_map_parse_step (hitview_map)) {
+		if (reload_newest_first)
+			scroll_to_newest ();
+		return TRUE;
+	}
+
+	reload_covered = logread_map_get_covered (hitview_map, &covered_start, &covered_end, &covered_hash);
+	logread_map_close (hitview_map);
+	hitview_map = NULL;
+	hitview_reload_source = 0;
+	reload_log_done ();
+
+	return FALSE;
+}
+
+/* [ reload_current_log ]
+ * Start loading the current system log, newest events first. The file is
+ * mapped into memory and read backwards if possible, otherwise it is read
+ * asynchronously from the start
+ */
+static void
+reload_current_log (const gchar *path)
+{
+	hitview_map = logread_map_open_reverse (path);
+	if (hitview_map != NULL) {
+		reload_newest_first = TRUE;
+		hitview_reload_source = g_idle_add (reload_map_step, NULL);
+	} else
+		gnome_vfs_async_open (&hitview_ghandle, path, GNOME_VFS_OPEN_READ, GNOME_VFS_PRIORITY_DEFAULT, 
+		                      gvfs_open_callback, (gpointer)path);
+}
+
+/* [ reload_journal_step ]
+ * Idle callback that reads the journal a batch of entries at a time
+ */
+static gboolean
+reload_journal_step (gpointer data)
+{
+	if (journal_reload_step (hitview_journal))
+		return TRUE;
+
+	journal_reload_close (hitview_journal);
+	hitview_journal = NULL;
+	hitview_reload_source = 0;
+	reload_finished ();
+
+	return FALSE;
+}
+
+/* [ reload_kmsg_step ]
+ * Idle callback that reads the kernel's records a batch at a time
+ */
+static gboolean
+reload_kmsg_step (gpointer data)
+{
+	if (kmsg_reload_step (hitview_kmsg))
+		return TRUE;
+
+	kmsg_reload_close (hitview_kmsg);
+	hitview_kmsg = NULL;
+	hitview_reload_source = 0;
+	reload_finished ();
+
+	return FALSE;
+}
+
+/* [ reload_stop ]
+ * Abort the reload in progress, whichever way the log is being read
+ */
+static void
+reload_stop (void)
+{
+	if (hitview_ghandle != NULL) {
+		gnome_vfs_async_cancel (hitview_ghandle);
+		hitview_ghandle = (GnomeVFSAsyncHandle*)NULL;
+	}
+
+	if (hitview_history != NULL) {
+		g_source_remove (hitview_reload_source);
+		loghistory_close (hitview_history);
+		hitview_history = NULL;
+		hitview_reload_source = 0;
+	}
+
+	if (hitview_map != NULL) {
+		g_source_remove (hitview_reload_source);
+		logread_map_close (hitview_map);
+		hitview_map = NULL;
+		hitview_reload_source = 0;
+	}
+
+	if (hitview_journal != NULL) {
+		g_source_remove (hitview_reload_source);
+		journal_reload_close (hitview_journal);
+		hitview_journal = NULL;
+		hitview_reload_source = 0;
+	}
+
+	if (hitview_kmsg != NULL) {
+		g_source_remove (hitview_reload_source);
+		kmsg_reload_close (hitview_kmsg);
+		hitview_kmsg = NULL;
+		hitview_reload_source = 0;
+	}
+
+	/* Whatever was reloaded so far stays in the list */
+	end_newest_first ();
+}
+
 void
 hitview_reload_cancel (void)
 {
 	printf ("Canceled reload of events list\n");
-	gnome_vfs_async_cancel (hitview_ghandle);
+	reload_stop ();
 	menus_update_events_reloading (FALSE, gui_get_active_view () == EVENTS_VIEW);
-	hitview_ghandle = (GnomeVFSAsyncHandle*)NULL;
 }
 
 /* [ hitview_reload ]
- * Loads the entire kernel log file into the hitlist
+ * Loads the current kernel log into the hitlist, newest events first, and
+ * then the rotated log files. Without a log file the kernel messages in the
+ * journal, or failing that the ones the kernel still holds, are loaded instead
  */
 void
 hitview_reload (void)
@@ -355,13 +783,46 @@ hitview_reload (void)
 	const gchar *path;
 
 	 /* If a new reload request comes while the previous operation is still pending, cancel it */
-	if (hitview_reload_in_progress ()) { 	
-		gnome_vfs_async_cancel (hitview_ghandle);
+	if (hitview_reload_in_progress ())
+		reload_stop ();
+
+	/* Packets received over netlink never reach a log that could be read back */
+	if (nflog_is_active ()) {
+		show_error (_("Events are received through NFLOG, there is no log to reload."));
+		return;
+	}
+
+	/* Events come from the journal when there is no system log file */
+	if (journal_is_active ()) {
+		hitview_journal = journal_reload_open ();
+		if (hitview_journal == NULL) {
+			show_error (_("Error reading the system journal"));
+			return;
+		}
+
+		hitview_clear ();
+		hitview_reload_source = g_idle_add (reload_journal_step, NULL);
+		menus_update_events_reloading (TRUE, gui_get_active_view () == EVENTS_VIEW);
+		return;
+	}
+
+	/* The kernel still holds the most recent messages when there is no log at all */
+	if (kmsg_is_active ()) {
+		hitview_kmsg = kmsg_reload_open ();
+		if (hitview_kmsg == NULL) {
+			show_error (_("Error reading the kernel log"));
+			return;
+		}
+
+		hitview_clear ();
+		hitview_reload_source = g_idle_add (reload_kmsg_step, NULL);
+		menus_update_events_reloading (TRUE, gui_get_active_view () == EVENTS_VIEW);
+		return;
 	}
 
 	path = get_system_log_path ();
 
-	if (!g_file_test (path, G_FILE_TEST_EXISTS)) {
+	if (path == NULL || !g_file_test (path, G_FILE_TEST_EXISTS)) {
 		gchar *error = g_strdup_printf ("Error reading system log %s, file does not exist", path);
 		show_error (error);
 		g_free (error);
@@ -369,33 +830,57 @@ hitview_reload (void)
 	}
 
 	hitview_clear ();
-	gnome_vfs_async_open (&hitview_ghandle, path, GNOME_VFS_OPEN_READ, GNOME_VFS_PRIORITY_DEFAULT, 
-                              gvfs_open_callback, (gpointer)path);
+
+	/* The newest events are shown right away, the rotated logs with the
+	   older ones are read last */
+	reload_history_next = TRUE;
+	reload_current_log (path);
 
 	menus_update_events_reloading (TRUE, gui_get_active_view () == EVENTS_VIEW);
 }
 
+/* [ hitview_reload_range ]
+ * Loads the events logged between two times from the system log. The range
+ * is found by bisecting the log, only the lines in it are parsed. The rotated
+ * logs are not searched. Without a log file everything is reloaded
+ */
+void
+hitview_reload_range (time_t from, time_t to)
+{
+	const gchar *path;
+
+	if (hitview_reload_in_progress ())
+		reload_stop ();
+
+	path = get_system_log_path ();
+	if (nflog_is_active () || journal_is_active () || kmsg_is_active () || path == NULL) {
+		hitview_reload ();
+		return;
+	}
+
+	hitview_map = logread_map_open_range (path, from, to);
+	if (hitview_map == NULL) {
+		gchar *error = g_strdup_printf ("Error reading system log %s", path);
+		show_error (error);
+		g_free (error);
+		return;
+	}
+
+	hitview_clear ();
+	hitview_reload_source = g_idle_add (reload_map_step, NULL);
+	menus_update_events_reloading (TRUE, gui_get_active_view () == EVENTS_VIEW);
+}
+
 /* [ create_hitlist_model ]
  * Creates the list for storage of hits
  */
 static GtkTreeModel *
 create_hitlist_model (void)
 {
-	hitstore = gtk_list_store_new (NUM_HITCOLUMNS,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING,
-		G_TYPE_STRING);
+	/* The columns are drawn from the hit by render_hit_cell */
+	hitmodel = hit_model_new (events_capacity ());
 
-	return GTK_TREE_MODEL (hitstore);
+	return GTK_TREE_MODEL (hitmodel);
 }
 
 /* [ hitview_toggle_column_visibility ]
@@ -428,6 +913,9 @@ hitview_toggle_column_visibility (GtkWidget *widget, gint colnum)
 	  case 8: preferences_set_bool (PREFS_HITVIEW_TOS_COL, visible); break;
 	  case 9: preferences_set_bool (PREFS_HITVIEW_PROTOCOL_COL, visible); break;
 	  case 10: preferences_set_bool (PREFS_HITVIEW_SERVICE_COL, visible); break;
+	  case 11: preferences_set_bool (PREFS_HITVIEW_COUNT_COL, visible); break;
+	  case 12: preferences_set_bool (PREFS_HITVIEW_LAST_SEEN_COL, visible); break;
+	  case 13: preferences_set_bool (PREFS_HITVIEW_BYTES_COL, visible); break;
 	}
 }
 
@@ -516,6 +1004,22 @@ hitview_add_columns (GtkTreeView *treeview)
 	gtk_tree_view_append_column (treeview, column);	
 	visible = preferences_get_bool (PREFS_HITVIEW_SERVICE_COL);
 	gtk_tree_view_column_set_visible (column, visible);
+
+	/* The totals change in place, the list is not sorted by them */
+	column = create_text_column (HITCOL_COUNT, _("Count"));
+	gtk_tree_view_append_column (treeview, column);
+	visible = preferences_get_bool (PREFS_HITVIEW_COUNT_COL);
+	gtk_tree_view_column_set_visible (column, visible);
+
+	column = create_text_column (HITCOL_LAST_SEEN, _("Last Seen"));
+	gtk_tree_view_append_column (treeview, column);
+	visible = preferences_get_bool (PREFS_HITVIEW_LAST_SEEN_COL);
+	gtk_tree_view_column_set_visible (column, visible);
+
+	column = create_text_column (HITCOL_BYTES, _("Bytes"));
+	gtk_tree_view_append_column (treeview, column);
+	visible = preferences_get_bool (PREFS_HITVIEW_BYTES_COL);
+	gtk_tree_view_column_set_visible (column, visible);
 }
 
 /* [ get_hit ]
@@ -525,23 +1029,7 @@ static Hit *
 get_hit (GtkTreeModel *model,
          GtkTreeIter iter)
 {
-	Hit *h = g_new (Hit, 1);
-
-	gtk_tree_model_get (model, &iter,
-	                    HITCOL_TIME,        &h->time,
-			    HITCOL_DIRECTION,   &h->direction,
-	                    HITCOL_IN,          &h->in,
-	                    HITCOL_OUT,         &h->out,
-	                    HITCOL_PORT,        &h->port,
-	                    HITCOL_SOURCE,      &h->source,
-	                    HITCOL_DESTINATION, &h->destination,
-	                    HITCOL_LENGTH,      &h->length,
-	                    HITCOL_TOS,         &h->tos,
-	                    HITCOL_PROTOCOL,    &h->protocol,
-	                    HITCOL_SERVICE,     &h->service,
-	                    -1);
-
-	return h; 
+	return copy_hit ((Hit *)hit_model_get_hit (HIT_MODEL (model), &iter));
 }
 
 /* [ hit_activated_cb ]
@@ -601,6 +1089,7 @@ hitview_get_all_hits (void)
 	GtkTreeModel *model;
 	GtkTreeIter iter;
 
+	flush_hits_now ();
 	model = gtk_tree_view_get_model (GTK_TREE_VIEW (hitview));
 	if (gtk_tree_model_get_iter_first (model, &iter)) {
 		do {
@@ -679,13 +1168,14 @@ void
 hitview_disable_events_selected_source (void)
 {
 	Hit *h;
+	gchar buffer[HIT_TEXT_MAX];
 	gchar *data;
 
 	h = hitview_get_selected_hit ();
 	if (h == NULL)
 		return;
 
-	data = g_strconcat (h->source, "\n", NULL);
+	data = g_strconcat (hit_format (h, HIT_SOURCE, buffer), "\n", NULL);
 	append_filter_file (FORTIFIED_FILTER_HOSTS_SCRIPT, data);
 	g_free (h);
 	g_free (data);
@@ -697,13 +1187,14 @@ void
 hitview_disable_events_selected_port (void)
 {
 	Hit *h;
+	gchar buffer[HIT_TEXT_MAX];
 	gchar *data;
 
 	h = hitview_get_selected_hit ();
 	if (h == NULL)
 		return;
 
-	data = g_strconcat (h->port, "\n", NULL);
+	data = g_strconcat (hit_format (h, HIT_PORT, buffer), "\n", NULL);
 	append_filter_file (FORTIFIED_FILTER_PORTS_SCRIPT, data);
 	g_free (h);
 	g_free (data);
@@ -762,153 +1253,65 @@ hitview_allow_service_from (void)
 	g_free (h);
 }
 
+/* [ remember_hostname ]
+ * Resolve an address and show the name in its place from now on
+ */
+static void
+remember_hostname (const Hit *h, HitField field)
+{
+	gchar buffer[HIT_TEXT_MAX];
+	gchar *ip, *hostname;
+
+	ip = g_strdup (hit_format (h, field, buffer));
+	if (*ip != '\0') {
+		hostname = lookup_ip (ip);
+		if (hostname != NULL && strcmp (hostname, ip) != 0) {
+			if (hostnames == NULL) {
+				hostnames = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+				hitflush_set_hostnames (hitflush, hostnames);
+			}
+			g_hash_table_replace (hostnames, GUINT_TO_POINTER (field == HIT_SOURCE ? h->source : h->destination),
+			                      g_strdup (hostname));
+		}
+	}
+	g_free (ip);
+}
+
 /* [ lookup_selected_hit ]
- * Resolve the IP address/hostname from the selected line in hitview
+ * Resolve the IP address/hostname from the selected line in hitview. The
+ * names are shown on every row with the same addresses
  */
 void
 hitview_lookup_selected_hit (void)
 {
-	GtkTreeSelection *selection;
-	GtkTreeIter iter;
-	static GtkTreeModel *model = NULL;
-	gchar *source, *destination;
-	gchar *hostname = NULL;
+	Hit *h;
 
-	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (hitview));
-	if (!gtk_tree_selection_get_selected (selection, NULL, &iter))
+	h = hitview_get_selected_hit ();
+	if (h == NULL)
 		return;
 
-	if (!model)
-		model = gtk_tree_view_get_model (GTK_TREE_VIEW (hitview));
-
-	gtk_tree_model_get (model, &iter,
-	                    HITCOL_SOURCE, &source,
-			    HITCOL_DESTINATION, &destination,
-	                    -1);
-	hostname = lookup_ip (source);
-	if (hostname != NULL)
-		gtk_list_store_set (hitstore, &iter,
-	        	            HITCOL_SOURCE, hostname,
-	         	           -1);
-	hostname = lookup_ip (destination);
-	if (hostname != NULL)
-		gtk_list_store_set (hitstore, &iter,
-	        	            HITCOL_DESTINATION, hostname,
-	         	           -1);
-
-	gtk_tree_view_columns_autosize (GTK_TREE_VIEW (hitview));
-	g_free (source);
-	g_free (destination);
-}
-
-/* [ month_number ]
- * Convert a three letter month identifier to a number
- */
-static int
-month_number (gchar *month)
-{
-	int num = 0;
-
-	if (strcmp (month, "Jan") == 0)
-		num = 1;
-	else if (strcmp (month, "Feb") == 0)
-		num = 2;
-	else if (strcmp (month, "Mar") == 0)
-		num = 3;
-	else if (strcmp (month, "Apr") == 0)
-		num = 4;
-	else if (strcmp (month, "May") == 0)
-		num = 5;
-	else if (strcmp (month, "Jun") == 0)
-		num = 6;
-	else if (strcmp (month, "Jul") == 0)
-		num = 7;
-	else if (strcmp (month, "Aug") == 0)
-		num = 8;
-	else if (strcmp (month, "Sep") == 0)
-		num = 9;
-	else if (strcmp (month, "Oct") == 0)
-		num = 10;
-	else if (strcmp (month, "Nov") == 0)
-		num = 11;
-	else if (strcmp (month, "Dec") == 0)
-		num = 12;
-
-	return num;
-}
-
-/* [ time_sort_func ]
- * Function for sorting the time column
- */
-static int
-time_sort_func (GtkTreeModel *model, 
-	        GtkTreeIter  *a, 
-	        GtkTreeIter  *b, 
-	        gpointer      user_data)
-{
-	enum { MONTH, DATE, CLOCK };
-
-	gchar *data1, *data2;
-	gchar **time1, **time2;
-	gint month1, month2;
-	gint day1, day2;
-	gint sort = 0;
-
-	gtk_tree_model_get (model, a, HITCOL_TIME, &data1, -1);
-	gtk_tree_model_get (model, b, HITCOL_TIME, &data2, -1);
-
-	time1 = g_strsplit (data1, " ", 3);
-	time2 = g_strsplit (data2, " ", 3);
-
-	month1 = month_number (time1[MONTH]);
-	month2 = month_number (time2[MONTH]); 
-
-	/* Compare first month, then the day, and last the clock */
-	if (month1 != month2)
-		sort = ((month1 < month2) ? -1:1);
-	else {
-		day1 = atoi (time1[DATE]);
-		day2 = atoi (time2[DATE]);
-
-		if (day1 != day2)
-			sort = ((day1 < day2) ? -1:1);
-		else
-			sort = strcasecmp (time1[CLOCK], time2[CLOCK]);
-	}
-
-	g_free (data1);
-	g_free (data2);
-	g_strfreev (time1);
-	g_strfreev (time2);
+	remember_hostname (h, HIT_SOURCE);
+	remember_hostname (h, HIT_DESTINATION);
+	free_hit (h);
 
-	return sort;
+	gtk_widget_queue_draw (hitview);
+	hitflush_autosize_columns (hitflush);
 }
 
-/* [ num_sort_func ]
- * Function for sorting a (text) column with only numbers in it
+/* [ search_equal_func ]
+ * Interactive search function, match the start of the time of a hit
  */
-static int
-num_sort_func (GtkTreeModel *model, 
-	       GtkTreeIter  *a, 
-	       GtkTreeIter  *b, 
-	       gpointer      column)
+static gboolean
+search_equal_func (GtkTreeModel *model, gint column, const gchar *key,
+                   GtkTreeIter *iter, gpointer data)
 {
-	gchar *data1, *data2;
-	gint n1, n2;
-
-	gtk_tree_model_get (model, a, (gint)column, &data1, -1);
-	gtk_tree_model_get (model, b, (gint)column, &data2, -1);
+	gchar buffer[HIT_TEXT_MAX];
+	const Hit *h;
 
-	n1 = atoi (data1);
-	n2 = atoi (data2);
+	h = hit_model_get_hit (HIT_MODEL (model), iter);
 
-	g_free (data1);
-	g_free (data2);
-
-	if (n1 == n2)
-		return 0;
-	else
-		return ((n1 < n2) ? -1:1);
+	/* FALSE means the row matches */
+	return (g_ascii_strncasecmp (hit_format (h, HIT_TIME, buffer), key, strlen (key)) != 0);
 }
 
 /* [ copy_selected_hit ]
@@ -918,6 +1321,8 @@ void
 copy_selected_hit (void)
 {
 	Hit *h;
+	gchar time[HIT_TEXT_MAX], source[HIT_TEXT_MAX], destination[HIT_TEXT_MAX];
+	gchar port[HIT_TEXT_MAX], length[HIT_TEXT_MAX], tos[HIT_TEXT_MAX];
 	gchar *text;
 	GtkClipboard *cb;
 
@@ -929,16 +1334,16 @@ copy_selected_hit (void)
 	cb = gtk_clipboard_get (GDK_SELECTION_CLIPBOARD);
 
 	text = g_strconcat (
-		"Time: ", h->time,
-		" Source: ", h->source,
-		" Destination: ", h->destination,
-		" In IF: ", h->in,
-		" Out IF: ", h->out,
-		" Port: ", h->port,
-		" Length: ", h->length,
-		" ToS: ", h->tos,
-		" Protocol: ", h->protocol,
-		" Service: ", h->service,
+		"Time: ", hit_format (h, HIT_TIME, time),
+		" Source: ", hit_format (h, HIT_SOURCE, source),
+		" Destination: ", hit_format (h, HIT_DESTINATION, destination),
+		" In IF: ", hit_format (h, HIT_IN, NULL),
+		" Out IF: ", hit_format (h, HIT_OUT, NULL),
+		" Port: ", hit_format (h, HIT_PORT, port),
+		" Length: ", hit_format (h, HIT_LENGTH, length),
+		" ToS: ", hit_format (h, HIT_TOS, tos),
+		" Protocol: ", hit_format (h, HIT_PROTOCOL, NULL),
+		" Service: ", hit_format (h, HIT_SERVICE, NULL),
 		NULL);
 
 	gtk_clipboard_set_text (cb, text, strlen (text));
@@ -946,6 +1351,88 @@ copy_selected_hit (void)
 	free_hit (h);
 }
 
+/* [ apply_query ]
+ * Show only the hits matching the query typed, or all of them if there is
+ * none. A query that doesn't read leaves the list as it was
+ */
+static gboolean
+apply_query (gpointer data)
+{
+	HitQuery *query;
+	GdkColor color;
+	gchar *error;
+
+	query_source = 0;
+
+	query = hitquery_parse (gtk_entry_get_text (GTK_ENTRY (query_entry)), &error);
+	if (error != NULL) {
+		gdk_color_parse (COLOR_SERIOUS_HIT, &color);
+		gtk_widget_modify_text (query_entry, GTK_STATE_NORMAL, &color);
+		gtk_tooltips_set_tip (Fortified.ttips, query_entry, error, NULL);
+		g_free (error);
+		return FALSE;
+	}
+	gtk_widget_modify_text (query_entry, GTK_STATE_NORMAL, NULL);
+	gtk_tooltips_set_tip (Fortified.ttips, query_entry, _(QUERY_HELP), NULL);
+
+	/* Taken off the view, the rows are shown again at once */
+	flush_hits_now ();
+	gtk_tree_view_set_model (GTK_TREE_VIEW (hitview), NULL);
+	hit_model_set_query (hitmodel, query);
+	hitview_apply_limits ();
+	gtk_tree_view_set_model (GTK_TREE_VIEW (hitview), GTK_TREE_MODEL (hitmodel));
+	scroll_to_newest ();
+
+	return FALSE;
+}
+
+/* [ query_changed_cb ]
+ * Run the query once the typing stops
+ */
+static void
+query_changed_cb (GtkEditable *editable, gpointer data)
+{
+	if (query_source != 0)
+		g_source_remove (query_source);
+	query_source = g_timeout_add (QUERY_DELAY, apply_query, NULL);
+}
+
+/* [ query_activate_cb ]
+ * Run the query right away
+ */
+static void
+query_activate_cb (GtkEntry *entry, gpointer data)
+{
+	if (query_source != 0)
+		g_source_remove (query_source);
+	apply_query (NULL);
+}
+
+/* [ create_query_bar ]
+ * Create the entry for the query picking the hits shown
+ */
+static GtkWidget *
+create_query_bar (void)
+{
+	GtkWidget *hbox;
+	GtkWidget *label;
+
+	hbox = gtk_hbox_new (FALSE, GNOME_PAD_SMALL);
+	label = gtk_label_new_with_mnemonic (_("_Show only:"));
+	gtk_box_pack_start (GTK_BOX (hbox), label, FALSE, FALSE, 0);
+
+	query_entry = gtk_entry_new ();
+	gtk_label_set_mnemonic_widget (GTK_LABEL (label), query_entry);
+	gtk_box_pack_start (GTK_BOX (hbox), query_entry, TRUE, TRUE, 0);
+	g_signal_connect (G_OBJECT (query_entry), "changed",
+	                  G_CALLBACK (query_changed_cb), NULL);
+	g_signal_connect (G_OBJECT (query_entry), "activate",
+	                  G_CALLBACK (query_activate_cb), NULL);
+	gtk_tooltips_set_tip (Fortified.ttips, query_entry, _(QUERY_HELP), NULL);
+
+	return hbox;
+}
+
 /* [ create_hitview_page ]
  * Create the hitview
  */
@@ -953,14 +1440,13 @@ GtkWidget *
 create_hitview_page (void)
 {
 	GtkWidget *hitpagebox;
-	GtkTreeModel *hitmodel;
 	GtkWidget *scrolledwin;
 	GtkWidget *frame;
 	GtkWidget *label;
 
 	hitpagebox = gtk_vbox_new (FALSE, 0);
-	hitmodel = create_hitlist_model ();
-	hitview = gtk_tree_view_new_with_model (hitmodel);
+	hitview = gtk_tree_view_new_with_model (create_hitlist_model ());
+	hitflush = hitflush_new (hitmodel, GTK_TREE_VIEW (hitview));
 
 	frame = gtk_frame_new (NULL);
 	label = gtk_label_new (NULL);
@@ -969,6 +1455,7 @@ create_hitview_page (void)
 	gtk_frame_set_label_widget (GTK_FRAME (frame), label);
 	gtk_frame_set_shadow_type (GTK_FRAME (frame), GTK_SHADOW_NONE);
 	gtk_box_pack_start (GTK_BOX (hitpagebox), frame, FALSE, FALSE, GNOME_PAD_SMALL);
+	gtk_box_pack_start (GTK_BOX (hitpagebox), create_query_bar (), FALSE, FALSE, GNOME_PAD_SMALL);
 
 	scrolledwin = gtk_scrolled_window_new (NULL, NULL);
 	gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolledwin),
@@ -981,29 +1468,18 @@ create_hitview_page (void)
 	gtk_container_add (GTK_CONTAINER (scrolledwin), hitview);
 	hitview_add_columns (GTK_TREE_VIEW (hitview));
 	gtk_tree_view_set_rules_hint (GTK_TREE_VIEW (hitview), TRUE);
-	gtk_tree_view_set_search_column (GTK_TREE_VIEW (hitview),
-		HITCOL_TIME);
+	gtk_tree_view_set_search_column (GTK_TREE_VIEW (hitview), HIT_MODEL_HIT);
+	gtk_tree_view_set_search_equal_func (GTK_TREE_VIEW (hitview), search_equal_func, NULL, NULL);
 
 	g_signal_connect (G_OBJECT (hitview), "button_press_event",
 	                  G_CALLBACK (hitview_button_press_cb), NULL);
 	g_signal_connect (G_OBJECT (hitview), "row-activated",
 	                  G_CALLBACK (hit_activated_cb), NULL);
 
-	/* The list is by default sorted by time */
+	/* The list is by default sorted by time. The model is kept referenced,
+	   the view lets go of it while it is cleared */
 	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (hitmodel), HITCOL_TIME, GTK_SORT_ASCENDING);
 
-	/* Some of the columns need special functions for sorting */
-	gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (hitmodel), HITCOL_TIME,
-	                                 time_sort_func, NULL, NULL);
-
-	gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (hitmodel), HITCOL_PORT,
-	                                 num_sort_func, (gpointer)HITCOL_PORT, NULL);
-
-	gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (hitmodel), HITCOL_LENGTH,
-	                                 num_sort_func, (gpointer)HITCOL_LENGTH, NULL);
-
-	g_object_unref (G_OBJECT (hitmodel));
-
 	/* Default icon states */
 	menus_events_clear_enabled (FALSE);
 	menus_events_save_enabled (FALSE);
@@ -19,11 +19,14 @@
 #include "fortified.h"
 
 void hitview_clear (void);
+void hitview_apply_limits (void);
 void hitview_reload (void);
+void hitview_reload_range (time_t from, time_t to);
 void hitview_reload_cancel (void);
 gboolean hitview_reload_in_progress (void);
 void hitview_abort_reload_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult result, gpointer data);
 gboolean hitview_append_hit (Hit *h);
+gboolean hitview_append_reloaded_hit (Hit *h);
 void hitview_toggle_column_visibility (GtkWidget *widget, gint colnum);
 
 Hit *hitview_get_selected_hit (void);
@@ -42,20 +45,24 @@ void hitview_allow_service_from (void);
 
 GtkWidget *create_hitview_page (void);
 
+/* The columns of the events list, one for each field of a hit and then
+   the totals of the hits counted into a row */
 enum
 {
-	HITCOL_TIME,
-	HITCOL_DIRECTION,
-	HITCOL_IN,
-	HITCOL_OUT,
-	HITCOL_PORT,
- 	HITCOL_SOURCE,
-	HITCOL_DESTINATION,
-	HITCOL_LENGTH,
-	HITCOL_TOS,
-	HITCOL_PROTOCOL,
-	HITCOL_SERVICE,
-	HITCOL_COLOR,
+	HITCOL_TIME = HIT_TIME,
+	HITCOL_DIRECTION = HIT_DIRECTION,
+	HITCOL_IN = HIT_IN,
+	HITCOL_OUT = HIT_OUT,
+	HITCOL_PORT = HIT_PORT,
+ 	HITCOL_SOURCE = HIT_SOURCE,
+	HITCOL_DESTINATION = HIT_DESTINATION,
+	HITCOL_LENGTH = HIT_LENGTH,
+	HITCOL_TOS = HIT_TOS,
+	HITCOL_PROTOCOL = HIT_PROTOCOL,
+	HITCOL_SERVICE = HIT_SERVICE,
+	HITCOL_COUNT = NUM_HIT_FIELDS,
+	HITCOL_LAST_SEEN,
+	HITCOL_BYTES,
 	NUM_HITCOLUMNS
 };
 
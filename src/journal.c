@@ -0,0 +1,382 @@
+/*---[ journal.c ]----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Event source reading the systemd journal
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+
+#ifdef HAVE_SYSTEMD_JOURNAL
+#include <systemd/sd-journal.h>
+#endif
+
+#include "journal.h"
+#include "logparse.h"
+#include "logscan.h"
+#include "hitview.h"
+#include "statusview.h"
+#include "util.h"
+
+#define JOURNAL_SLICE 20000 /* Journal entries read per main loop iteration during a reload */
+#define MESSAGE_FIELD "MESSAGE="
+
+#ifdef HAVE_SYSTEMD_JOURNAL
+
+struct _JournalReader
+{
+	sd_journal *journal;
+	gchar *end_cursor; /* Where the live source took over, or NULL to read everything */
+	gboolean done;
+};
+
+typedef struct _JournalEntry JournalEntry;
+struct _JournalEntry
+{
+	sd_journal *journal;
+	gboolean added;
+};
+
+static sd_journal *live = NULL;
+static gchar *live_cursor = NULL; /* The last entry delivered by the live source */
+static guint live_watch = 0;
+
+/* [ entry_time ]
+ * Return the time of the current entry in seconds since the epoch, or 0
+ */
+static gint64
+entry_time (sd_journal *journal)
+{
+	guint64 usec;
+
+	if (sd_journal_get_realtime_usec (journal, &usec) < 0)
+		return 0;
+
+	return usec / G_USEC_PER_SEC;
+}
+
+/* [ parse_message ]
+ * Scanner callback, add a hit for a kernel message written by the LOG target
+ */
+static void
+parse_message (const gchar *message, gsize length, gpointer data)
+{
+	JournalEntry *entry = data;
+	LogTokens t;
+	Hit h;
+
+	if (!logparse_tokenize_message (message, length, &t))
+		return;
+
+	/* The view copies the hits it keeps, this one can live on the stack */
+	logparse_fill_hit (&t, &h);
+	h.time = entry_time (entry->journal);
+
+	if (hitview_append_hit (&h))
+		entry->added = TRUE;
+}
+
+/* [ parse_entry ]
+ * Feed the message of the current entry to the hit pipeline. The message is
+ * used in place, it never goes through a text log. Return TRUE if a hit was added
+ */
+static gboolean
+parse_entry (sd_journal *journal)
+{
+	JournalEntry entry;
+	const void *data;
+	size_t length;
+
+	if (sd_journal_get_data (journal, "MESSAGE", &data, &length) < 0)
+		return FALSE;
+
+	/* The data comes as "MESSAGE=text" */
+	if (length <= strlen (MESSAGE_FIELD))
+		return FALSE;
+
+	entry.journal = journal;
+	entry.added = FALSE;
+	logscan_candidates ((const gchar *)data + strlen (MESSAGE_FIELD),
+	                    length - strlen (MESSAGE_FIELD), parse_message, &entry);
+
+	return entry.added;
+}
+
+/* [ open_kernel_journal ]
+ * Open the local system journal, restricted to messages from the kernel
+ */
+static sd_journal *
+open_kernel_journal (void)
+{
+	sd_journal *journal;
+
+	if (sd_journal_open (&journal, SD_JOURNAL_LOCAL_ONLY | SD_JOURNAL_SYSTEM) < 0)
+		return NULL;
+
+	/* Journal matches are exact, so the IN=/OUT= shape is left to the scanner */
+	if (sd_journal_add_match (journal, "_TRANSPORT=kernel", 0) < 0) {
+		sd_journal_close (journal);
+		return NULL;
+	}
+
+	return journal;
+}
+
+/* [ remember_cursor ]
+ * Store the cursor of the current entry of the live journal
+ */
+static void
+remember_cursor (void)
+{
+	gchar *cursor;
+
+	if (sd_journal_get_cursor (live, &cursor) < 0)
+		return;
+
+	g_free (live_cursor);
+	live_cursor = g_strdup (cursor);
+	free (cursor);
+}
+
+/* [ resume_from_cursor ]
+ * Position the live journal on the last entry delivered, so that reading
+ * carries on with the one after it. Needed when the journal files change
+ */
+static void
+resume_from_cursor (void)
+{
+	if (live_cursor == NULL || sd_journal_seek_cursor (live, live_cursor) < 0) {
+		sd_journal_seek_tail (live);
+		sd_journal_previous (live);
+		return;
+	}
+
+	/* Seeking leaves the journal before the entry, step onto it */
+	if (sd_journal_next (live) > 0 && sd_journal_test_cursor (live, live_cursor) <= 0)
+		sd_journal_previous (live); /* The entry is gone, don't skip its successor */
+}
+
+/* [ journal_event ]
+ * Called when the journal changes, deliver the new kernel messages
+ */
+static gboolean
+journal_event (GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+	gboolean added = FALSE;
+	gboolean moved = FALSE;
+	gint change;
+
+	change = sd_journal_process (live);
+	if (change == SD_JOURNAL_NOP)
+		return TRUE;
+	if (change == SD_JOURNAL_INVALIDATE)
+		resume_from_cursor ();
+
+	while (sd_journal_next (live) > 0) {
+		if (parse_entry (live))
+			added = TRUE;
+		moved = TRUE;
+	}
+
+	if (moved)
+		remember_cursor ();
+
+	if (added && !hitview_reload_in_progress ())
+		status_set_state (STATUS_HIT);
+
+	return TRUE;
+}
+
+/* [ journal_available ]
+ * Test if the system journal can be read
+ */
+gboolean
+journal_available (void)
+{
+	static gint available = -1;
+
+	if (available < 0) {
+		sd_journal *journal = open_kernel_journal ();
+
+		available = (journal != NULL);
+		if (journal != NULL)
+			sd_journal_close (journal);
+	}
+
+	return available;
+}
+
+/* [ journal_open ]
+ * Start following the journal for new kernel messages. Return FALSE if the
+ * journal can't be read
+ */
+gboolean
+journal_open (void)
+{
+	GIOChannel *channel;
+	gint fd;
+
+	if (live != NULL)
+		journal_close ();
+
+	live = open_kernel_journal ();
+	if (live == NULL)
+		return FALSE;
+
+	fd = sd_journal_get_fd (live);
+	if (fd < 0) {
+		g_warning ("Failed to watch the journal: %s", g_strerror (-fd));
+		journal_close ();
+		return FALSE;
+	}
+
+	/* Only events that happen from now on are of interest */
+	sd_journal_seek_tail (live);
+	if (sd_journal_previous (live) > 0)
+		remember_cursor ();
+
+	channel = g_io_channel_unix_new (fd);
+	live_watch = g_io_add_watch (channel, G_IO_IN, journal_event, NULL);
+	g_io_channel_unref (channel);
+
+	return TRUE;
+}
+
+/* [ journal_close ]
+ * Stop following the journal
+ */
+void
+journal_close (void)
+{
+	if (live_watch != 0) {
+		g_source_remove (live_watch);
+		live_watch = 0;
+	}
+
+	if (live != NULL) {
+		sd_journal_close (live);
+		live = NULL;
+	}
+
+	g_free (live_cursor);
+	live_cursor = NULL;
+}
+
+/* [ journal_is_active ]
+ * Test if events are being read from the journal
+ */
+gboolean
+journal_is_active (void)
+{
+	return (live != NULL);
+}
+
+/* [ journal_reload_open ]
+ * Prepare to read the kernel messages in the journal from the beginning up
+ * to where the live source took over, so that no event is shown twice
+ */
+JournalReader *
+journal_reload_open (void)
+{
+	JournalReader *reader;
+	sd_journal *journal;
+
+	journal = open_kernel_journal ();
+	if (journal == NULL)
+		return NULL;
+
+	sd_journal_seek_head (journal);
+
+	reader = g_new (JournalReader, 1);
+	reader->journal = journal;
+	reader->end_cursor = g_strdup (live_cursor);
+	reader->done = FALSE;
+
+	return reader;
+}
+
+/* [ journal_reload_step ]
+ * Read the next batch of entries. Return TRUE while there is more left to read
+ */
+gboolean
+journal_reload_step (JournalReader *reader)
+{
+	gint i;
+
+	for (i = 0; i < JOURNAL_SLICE && !reader->done; i++) {
+		if (sd_journal_next (reader->journal) <= 0) {
+			reader->done = TRUE;
+			break;
+		}
+
+		parse_entry (reader->journal);
+
+		if (reader->end_cursor != NULL &&
+		    sd_journal_test_cursor (reader->journal, reader->end_cursor) > 0)
+			reader->done = TRUE;
+	}
+
+	return !reader->done;
+}
+
+/* [ journal_reload_close ]
+ * Release the reload reader
+ */
+void
+journal_reload_close (JournalReader *reader)
+{
+	sd_journal_close (reader->journal);
+	g_free (reader->end_cursor);
+	g_free (reader);
+}
+
+#else /* HAVE_SYSTEMD_JOURNAL */
+
+/* Built without libsystemd, the journal is never available */
+
+gboolean
+journal_available (void)
+{
+	return FALSE;
+}
+
+gboolean
+journal_open (void)
+{
+	return FALSE;
+}
+
+void
+journal_close (void)
+{
+}
+
+gboolean
+journal_is_active (void)
+{
+	return FALSE;
+}
+
+JournalReader *
+journal_reload_open (void)
+{
+	return NULL;
+}
+
+gboolean
+journal_reload_step (JournalReader *reader)
+{
+	return FALSE;
+}
+
+void
+journal_reload_close (JournalReader *reader)
+{
+}
+
+#endif /* HAVE_SYSTEMD_JOURNAL */
@@ -0,0 +1,29 @@
+/*---[ journal.h ]----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Event source reading the systemd journal
+ *--------------------------------------------------------------------*/
+
+#ifndef _FORTIFIED_JOURNAL
+#define _FORTIFIED_JOURNAL
+
+#include <config.h>
+#include <gnome.h>
+
+gboolean journal_available (void);
+gboolean journal_open (void);
+void journal_close (void);
+gboolean journal_is_active (void);
+
+typedef struct _JournalReader JournalReader;
+
+JournalReader *journal_reload_open (void);
+gboolean journal_reload_step (JournalReader *reader);
+void journal_reload_close (JournalReader *reader);
+
+#endif
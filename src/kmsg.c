@@ -0,0 +1,357 @@
+/*---[ kmsg.c ]-------------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Event source reading kernel log records from /dev/kmsg
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "kmsg.h"
+#include "logparse.h"
+#include "logscan.h"
+#include "hitview.h"
+#include "statusview.h"
+#include "util.h"
+
+#define KMSG_PATH "/dev/kmsg"
+#define KMSG_RECORD 8192 /* The kernel never returns a record longer than this */
+#define KMSG_SLICE 2000 /* Records read per main loop iteration during a reload */
+
+typedef struct _KmsgRecord KmsgRecord;
+struct _KmsgRecord
+{
+	gint facility;
+	guint64 seq;
+	guint64 usec; /* Microseconds since boot */
+	const gchar *message;
+	gsize length;
+	gboolean added; /* Set once the message produced a hit */
+};
+
+struct _KmsgReader
+{
+	gint fd;
+	gchar *buffer;
+	guint64 end_seq; /* Where the live source took over */
+	gboolean done;
+};
+
+static gint kmsg_fd = -1;
+static guint kmsg_watch = 0;
+static guint64 kmsg_next_seq = 0; /* The sequence number expected next */
+static guint64 kmsg_dropped = 0;
+static gchar *kmsg_buffer = NULL;
+
+/* [ parse_record ]
+ * Split a "facility/level,seq,usec,flags;message" record into its parts.
+ * Continuation lines holding the record's dictionary are ignored
+ */
+static gboolean
+parse_record (const gchar *data, gsize length, KmsgRecord *record)
+{
+	const gchar *end = data+length;
+	const gchar *text, *eol;
+	gchar *next;
+
+	text = memchr (data, ';', length);
+	if (text == NULL)
+		return FALSE;
+
+	/* The header is plain ASCII numbers, and text can't be reached before ';' */
+	record->facility = strtoul (data, &next, 10) >> 3;
+	if (*next != ',')
+		return FALSE;
+	record->seq = g_ascii_strtoull (next+1, &next, 10);
+	if (*next != ',')
+		return FALSE;
+	record->usec = g_ascii_strtoull (next+1, &next, 10);
+
+	text++;
+	eol = memchr (text, '\n', end-text);
+	record->message = text;
+	record->length = (eol != NULL ? eol : end) - text;
+
+	return TRUE;
+}
+
+/* [ record_time ]
+ * Turn a time since boot into seconds since the epoch
+ */
+static gint64
+record_time (guint64 usec)
+{
+	struct timespec realtime, monotonic;
+	gint64 boot;
+
+	/* The kernel stamps records with its monotonic clock */
+	clock_gettime (CLOCK_REALTIME, &realtime);
+	clock_gettime (CLOCK_MONOTONIC, &monotonic);
+	boot = (gint64)realtime.tv_sec - monotonic.tv_sec;
+
+	return boot + usec / G_USEC_PER_SEC;
+}
+
+/* [ parse_message ]
+ * Scanner callback, add a hit for a kernel message written by the LOG target
+ */
+static void
+parse_message (const gchar *message, gsize length, gpointer data)
+{
+	KmsgRecord *record = data;
+	LogTokens t;
+	Hit h;
+
+	if (!logparse_tokenize_message (message, length, &t))
+		return;
+
+	/* The view copies the hits it keeps, this one can live on the stack */
+	logparse_fill_hit (&t, &h);
+	h.time = record_time (record->usec);
+
+	if (hitview_append_hit (&h))
+		record->added = TRUE;
+}
+
+/* [ parse_kernel_record ]
+ * Feed the message of a record to the hit pipeline. Return TRUE if a hit was added
+ */
+static gboolean
+parse_kernel_record (KmsgRecord *record)
+{
+	/* Userspace can write to /dev/kmsg too, the LOG target uses facility kern */
+	if (record->facility != 0)
+		return FALSE;
+
+	record->added = FALSE;
+	logscan_candidates (record->message, record->length, parse_message, record);
+
+	return record->added;
+}
+
+/* [ read_record ]
+ * Read the next record from fd into a buffer of KMSG_RECORD bytes. Return the
+ * length read, 0 if there is nothing more to read for now, or -1 on an error
+ */
+static gssize
+read_record (gint fd, gchar *buffer)
+{
+	gssize n;
+
+	for (;;) {
+		n = read (fd, buffer, KMSG_RECORD);
+		if (n >= 0)
+			return n;
+
+		switch (errno) {
+		case EINTR:
+			continue;
+		case EPIPE: /* Records were overwritten before we got to them, skip ahead */
+			continue;
+		case EAGAIN:
+			return 0;
+		default:
+			return -1;
+		}
+	}
+}
+
+/* [ kmsg_event ]
+ * Called when new records are available, add a hit for each firewall one
+ */
+static gboolean
+kmsg_event (GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+	gboolean added = FALSE;
+	guint64 lost = 0;
+	gssize n;
+
+	while ((n = read_record (kmsg_fd, kmsg_buffer)) > 0) {
+		KmsgRecord record;
+
+		if (!parse_record (kmsg_buffer, n, &record))
+			continue;
+
+		/* A gap in the sequence numbers means records were dropped */
+		if (record.seq > kmsg_next_seq)
+			lost += record.seq - kmsg_next_seq;
+		kmsg_next_seq = record.seq + 1;
+
+		if (parse_kernel_record (&record))
+			added = TRUE;
+	}
+
+	if (n < 0) {
+		g_warning ("Error reading %s: %s", KMSG_PATH, g_strerror (errno));
+		kmsg_close ();
+		return FALSE;
+	}
+
+	if (lost > 0) {
+		kmsg_dropped += lost;
+		g_warning ("%" G_GUINT64_FORMAT " kernel log records were overwritten before they could be read", lost);
+	}
+
+	if (added && !hitview_reload_in_progress ())
+		status_set_state (STATUS_HIT);
+
+	return TRUE;
+}
+
+/* [ kmsg_available ]
+ * Test if kernel log records can be read from /dev/kmsg
+ */
+gboolean
+kmsg_available (void)
+{
+	return (access (KMSG_PATH, R_OK) == 0);
+}
+
+/* [ kmsg_open ]
+ * Start following /dev/kmsg for new kernel messages. Return FALSE if it
+ * can't be read
+ */
+gboolean
+kmsg_open (void)
+{
+	GIOChannel *channel;
+	gssize n;
+
+	if (kmsg_fd >= 0)
+		kmsg_close ();
+
+	kmsg_fd = open (KMSG_PATH, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (kmsg_fd < 0)
+		return FALSE;
+
+	kmsg_buffer = g_new (gchar, KMSG_RECORD);
+	kmsg_dropped = 0;
+	kmsg_next_seq = 0;
+
+	/* Only events that happen from now on are of interest. Skipping the
+	   records already there tells where the sequence numbers continue from */
+	while ((n = read_record (kmsg_fd, kmsg_buffer)) > 0) {
+		KmsgRecord record;
+
+		if (parse_record (kmsg_buffer, n, &record))
+			kmsg_next_seq = record.seq + 1;
+	}
+
+	channel = g_io_channel_unix_new (kmsg_fd);
+	kmsg_watch = g_io_add_watch (channel, G_IO_IN, kmsg_event, NULL);
+	g_io_channel_unref (channel);
+
+	return TRUE;
+}
+
+/* [ kmsg_close ]
+ * Stop following /dev/kmsg
+ */
+void
+kmsg_close (void)
+{
+	if (kmsg_fd < 0)
+		return;
+
+	if (kmsg_watch != 0) {
+		g_source_remove (kmsg_watch);
+		kmsg_watch = 0;
+	}
+
+	close (kmsg_fd);
+	kmsg_fd = -1;
+
+	g_free (kmsg_buffer);
+	kmsg_buffer = NULL;
+}
+
+/* [ kmsg_is_active ]
+ * Test if events are being read from /dev/kmsg
+ */
+gboolean
+kmsg_is_active (void)
+{
+	return (kmsg_fd >= 0);
+}
+
+/* [ kmsg_get_dropped ]
+ * Number of records the kernel overwrote before they could be read
+ */
+guint64
+kmsg_get_dropped (void)
+{
+	return kmsg_dropped;
+}
+
+/* [ kmsg_reload_open ]
+ * Prepare to read the kernel messages still held by the kernel, up to where
+ * the live source took over, so that no event is shown twice
+ */
+KmsgReader *
+kmsg_reload_open (void)
+{
+	KmsgReader *reader;
+	gint fd;
+
+	/* A new descriptor starts at the oldest record the kernel still has */
+	fd = open (KMSG_PATH, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	reader = g_new (KmsgReader, 1);
+	reader->fd = fd;
+	reader->buffer = g_new (gchar, KMSG_RECORD);
+	reader->end_seq = kmsg_next_seq;
+	reader->done = FALSE;
+
+	return reader;
+}
+
+/* [ kmsg_reload_step ]
+ * Read the next batch of records. Return TRUE while there is more left to read
+ */
+gboolean
+kmsg_reload_step (KmsgReader *reader)
+{
+	gint i;
+
+	for (i = 0; i < KMSG_SLICE && !reader->done; i++) {
+		KmsgRecord record;
+		gssize n;
+
+		n = read_record (reader->fd, reader->buffer);
+		if (n <= 0) {
+			reader->done = TRUE;
+			break;
+		}
+
+		if (!parse_record (reader->buffer, n, &record))
+			continue;
+
+		if (record.seq >= reader->end_seq)
+			reader->done = TRUE;
+		else
+			parse_kernel_record (&record);
+	}
+
+	return !reader->done;
+}
+
+/* [ kmsg_reload_close ]
+ * Release the reload reader
+ */
+void
+kmsg_reload_close (KmsgReader *reader)
+{
+	close (reader->fd);
+	g_free (reader->buffer);
+	g_free (reader);
+}
@@ -0,0 +1,30 @@
+/*---[ kmsg.h ]-------------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Event source reading kernel log records from /dev/kmsg
+ *--------------------------------------------------------------------*/
+
+#ifndef _FORTIFIED_KMSG
+#define _FORTIFIED_KMSG
+
+#include <config.h>
+#include <gnome.h>
+
+gboolean kmsg_available (void);
+gboolean kmsg_open (void);
+void kmsg_close (void);
+gboolean kmsg_is_active (void);
+guint64 kmsg_get_dropped (void);
+
+typedef struct _KmsgReader KmsgReader;
+
+KmsgReader *kmsg_reload_open (void);
+gboolean kmsg_reload_step (KmsgReader *reader);
+void kmsg_reload_close (KmsgReader *reader);
+
+#endif
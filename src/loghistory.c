@@ -0,0 +1,504 @@
+/*---[ loghistory.c ]-------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Reading of the rotated, possibly compressed, system log history
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "loghistory.h"
+#include "logparse.h"
+#include "logscan.h"
+#include "hitview.h"
+#include "util.h"
+
+#define HISTORY_CHUNK (256*1024) /* Bytes decompressed and parsed at a time */
+#define HISTORY_QUEUED 4 /* Parsed chunks a worker may get ahead of the view, per file */
+#define HISTORY_BATCH 5000 /* Hits added to the view per main loop iteration */
+#define HISTORY_WAIT (10*1000) /* Microseconds to wait for a worker before returning to the main loop */
+
+/* The hits parsed from one chunk, allocated together and freed together */
+typedef struct _HistoryBatch HistoryBatch;
+struct _HistoryBatch
+{
+	GPtrArray *hits;
+	Arena *arena;
+};
+
+typedef struct _HistoryFile HistoryFile;
+struct _HistoryFile
+{
+	gchar *path;
+	time_t mtime;
+	gint number; /* The N of a log.N or log.N.gz name */
+	LogFormat format; /* Detected from the first chunk */
+	guint64 skip_start; /* Lines left out, their hits were added from the log copied into the file */
+	guint64 skip_end;
+	GQueue *batches; /* HistoryBatches of parsed hits, oldest first */
+	gboolean finished; /* The worker is done with the file */
+};
+
+struct _LogHistory
+{
+	GPtrArray *files; /* Oldest first */
+	GThreadPool *pool;
+	GMutex lock;
+	GCond changed; /* Signaled when a batch is added or taken, or the file is finished */
+	gboolean cancelled;
+	guint queued; /* Files handed to the workers so far */
+	guint current; /* File being added to the view */
+	HistoryBatch *batch; /* Batch being added to the view */
+	guint position; /* Next hit of the batch */
+};
+
+/* [ rotated_name_number ]
+ * Test if name is a rotated copy of the log named base, as in "base.1",
+ * "base.2.gz" or "base-20160101.gz". Return the number in the name, or -1
+ */
+static gint
+rotated_name_number (const gchar *name, const gchar *base)
+{
+	gsize len = strlen (base);
+	const gchar *p;
+	gchar *end;
+	glong number;
+
+	if (strncmp (name, base, len) != 0 || (name[len] != '.' && name[len] != '-'))
+		return -1;
+
+	p = name+len+1;
+	if (!g_ascii_isdigit (*p))
+		return -1;
+
+	number = strtol (p, &end, 10);
+	if (*end != '\0' && strcmp (end, ".gz") != 0)
+		return -1;
+
+#ifndef HAVE_ZLIB
+	if (*end != '\0')
+		return -1; /* Compressed history can't be read */
+#endif
+
+	return (gint)MIN (number, G_MAXINT);
+}
+
+/* [ compare_age ]
+ * Order rotated logs oldest first, by modification time and then by the
+ * number in the name, where a higher number means older
+ */
+static gint
+compare_age (gconstpointer a, gconstpointer b)
+{
+	const HistoryFile *file1 = *(HistoryFile **)a;
+	const HistoryFile *file2 = *(HistoryFile **)b;
+
+	if (file1->mtime != file2->mtime)
+		return (file1->mtime < file2->mtime) ? -1 : 1;
+
+	return file2->number - file1->number;
+}
+
+/* [ find_rotated_logs ]
+ * List the rotated copies of a log, oldest first
+ */
+static GPtrArray *
+find_rotated_logs (const gchar *logpath)
+{
+	GPtrArray *files = g_ptr_array_new ();
+	gchar *dirname, *base;
+	const gchar *name;
+	GDir *dir;
+
+	dirname = g_path_get_dirname (logpath);
+	base = g_path_get_basename (logpath);
+
+	dir = g_dir_open (dirname, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			HistoryFile *file;
+			struct stat st;
+			gchar *path;
+			gint number;
+
+			number = rotated_name_number (name, base);
+			if (number < 0)
+				continue;
+
+			path = g_build_filename (dirname, name, NULL);
+			if (stat (path, &st) != 0 || !S_ISREG (st.st_mode)) {
+				g_free (path);
+				continue;
+			}
+
+			file = g_new0 (HistoryFile, 1);
+			file->path = path;
+			file->mtime = st.st_mtime;
+			file->number = number;
+			file->batches = g_queue_new ();
+			g_ptr_array_add (files, file);
+		}
+		g_dir_close (dir);
+	}
+
+	g_ptr_array_sort (files, compare_age);
+
+	g_free (dirname);
+	g_free (base);
+
+	return files;
+}
+
+/* [ free_batch ]
+ * Free a batch of hits, along with the arena holding them
+ */
+static void
+free_batch (HistoryBatch *batch)
+{
+	g_ptr_array_free (batch->hits, TRUE);
+	arena_free (batch->arena);
+	g_free (batch);
+}
+
+/* [ push_hits ]
+ * Parse the complete lines of a chunk and queue the hits for the view. Blocks
+ * while the view is behind, so memory use stays bounded. Return FALSE if the
+ * reload was cancelled
+ */
+static gboolean
+push_hits (LogHistory *history, HistoryFile *file, const gchar *buffer, gsize length)
+{
+	GArray *tokens;
+	HistoryBatch *batch;
+	gboolean cancelled;
+	guint i;
+
+	tokens = g_array_new (FALSE, FALSE, sizeof (LogTokens));
+	logparse_tokenize_buffer (buffer, length, file->format, file->mtime, tokens);
+
+	batch = g_new (HistoryBatch, 1);
+	batch->arena = arena_new (MAX (tokens->len * sizeof (Hit), ARENA_BLOCK));
+	batch->hits = g_ptr_array_sized_new (tokens->len);
+	for (i = 0; i < tokens->len; i++)
+		g_ptr_array_add (batch->hits, logparse_make_hit (&g_array_index (tokens, LogTokens, i), batch->arena));
+	g_array_free (tokens, TRUE);
+
+	g_mutex_lock (&history->lock);
+	while (!history->cancelled && g_queue_get_length (file->batches) >= HISTORY_QUEUED)
+		g_cond_wait (&history->changed, &history->lock);
+
+	cancelled = history->cancelled;
+	if (!cancelled && batch->hits->len > 0) {
+		g_queue_push_tail (file->batches, batch);
+		batch = NULL;
+		g_cond_broadcast (&history->changed);
+	}
+	g_mutex_unlock (&history->lock);
+
+	if (batch != NULL)
+		free_batch (batch);
+
+	return !cancelled;
+}
+
+/* [ push_lines ]
+ * Like push_hits, for the lines of a chunk found at offset in the file. The
+ * lines the file skips are left out
+ */
+static gboolean
+push_lines (LogHistory *history, HistoryFile *file, const gchar *buffer, gsize length, guint64 offset)
+{
+	guint64 end = offset + length;
+	guint64 skip_start = CLAMP (file->skip_start, offset, end);
+	guint64 skip_end = CLAMP (file->skip_end, offset, end);
+
+	if (skip_start >= skip_end)
+		return push_hits (history, file, buffer, length);
+
+	return push_hits (history, file, buffer, skip_start - offset) &&
+	       push_hits (history, file, buffer + (skip_end - offset), end - skip_end);
+}
+
+/* [ history_file_open ]
+ * Open a rotated log for streaming, compressed or not. Return NULL on error
+ */
+static gpointer
+history_file_open (const gchar *path)
+{
+#ifdef HAVE_ZLIB
+	gzFile gz;
+
+	/* gzread passes uncompressed files through untouched */
+	gz = gzopen (path, "rb");
+	if (gz != NULL)
+		gzbuffer (gz, HISTORY_CHUNK);
+	return gz;
+#else
+	gint fd = open (path, O_RDONLY | O_CLOEXEC);
+
+	return (fd >= 0) ? GINT_TO_POINTER (fd + 1) : NULL;
+#endif
+}
+
+/* [ history_file_read ]
+ * Read the next decompressed chunk. Return the length read, 0 at the end
+ */
+static gssize
+history_file_read (gpointer handle, gchar *buffer, gsize length)
+{
+#ifdef HAVE_ZLIB
+	return gzread (handle, buffer, length);
+#else
+	return read (GPOINTER_TO_INT (handle) - 1, buffer, length);
+#endif
+}
+
+/* [ history_file_close ]
+ * Close a rotated log opened with history_file_open
+ */
+static void
+history_file_close (gpointer handle)
+{
+#ifdef HAVE_ZLIB
+	gzclose (handle);
+#else
+	close (GPOINTER_TO_INT (handle) - 1);
+#endif
+}
+
+/* [ history_worker ]
+ * Worker thread, stream one rotated log through the decompressor and parser
+ */
+static void
+history_worker (gpointer data, gpointer user_data)
+{
+	HistoryFile *file = data;
+	LogHistory *history = user_data;
+	GString *pending;
+	gpointer handle;
+	gchar *buffer;
+	gboolean first = TRUE;
+	guint64 offset = 0; /* Of the pending data in the file */
+	gssize n;
+
+	handle = history_file_open (file->path);
+	if (handle == NULL) {
+		g_warning ("Failed to open %s", file->path);
+	} else {
+		buffer = g_new (gchar, HISTORY_CHUNK);
+		pending = g_string_sized_new (HISTORY_CHUNK);
+
+		while ((n = history_file_read (handle, buffer, HISTORY_CHUNK)) > 0) {
+			const gchar *last;
+			gsize complete;
+
+			/* The first lines tell what format the file is written in */
+			if (first) {
+				file->format = logparse_detect_format (buffer, n);
+				first = FALSE;
+			}
+			g_string_append_len (pending, buffer, n);
+
+			last = logscan_last_newline (pending->str, pending->len);
+			if (last == NULL)
+				continue;
+
+			complete = last - pending->str + 1;
+			if (!push_lines (history, file, pending->str, complete, offset))
+				break;
+			g_string_erase (pending, 0, complete);
+			offset += complete;
+		}
+
+		if (n < 0)
+			g_warning ("Error reading %s", file->path);
+
+		/* The last line may lack a terminator */
+		if (n == 0 && pending->len > 0)
+			push_lines (history, file, pending->str, pending->len, offset);
+
+		history_file_close (handle);
+		g_string_free (pending, TRUE);
+		g_free (buffer);
+	}
+
+	g_mutex_lock (&history->lock);
+	file->finished = TRUE;
+	g_cond_broadcast (&history->changed);
+	g_mutex_unlock (&history->lock);
+}
+
+
+/* [ free_history_file ]
+ * Free a rotated log entry and the hits still queued for it
+ */
+static void
+free_history_file (HistoryFile *file)
+{
+	g_queue_foreach (file->batches, (GFunc)free_batch, NULL);
+	g_queue_free (file->batches);
+	g_free (file->path);
+	g_free (file);
+}
+
+/* [ queue_files ]
+ * Start as many files as there are workers ahead of the one being added
+ */
+static void
+queue_files (LogHistory *history)
+{
+	guint limit = history->current + g_thread_pool_get_max_threads (history->pool);
+
+	while (history->queued < history->files->len && history->queued < limit) {
+		g_thread_pool_push (history->pool, g_ptr_array_index (history->files, history->queued), NULL);
+		history->queued++;
+	}
+}
+
+/* [ loghistory_open ]
+ * Start reading the rotated copies of a log in worker threads. Return NULL
+ * if there are none
+ */
+LogHistory *
+loghistory_open (const gchar *logpath)
+{
+	LogHistory *history;
+	GPtrArray *files;
+	gint workers;
+
+	files = find_rotated_logs (logpath);
+	if (files->len == 0) {
+		g_ptr_array_free (files, TRUE);
+		return NULL;
+	}
+
+	workers = CLAMP (sysconf (_SC_NPROCESSORS_ONLN), 1, 64);
+
+	history = g_new0 (LogHistory, 1);
+	history->files = files;
+	g_mutex_init (&history->lock);
+	g_cond_init (&history->changed);
+	history->pool = g_thread_pool_new (history_worker, history, MIN (workers, files->len), FALSE, NULL);
+
+	return history;
+}
+
+/* [ loghistory_skip_copy ]
+ * Leave out the lines from start to end of the newest rotated log, if it is
+ * the copy of a log whose hits were added from those lines already. The log
+ * is copied and then truncated, the lines are at the same place in both,
+ * and the line ending at end hashes to hash. Call before the first step
+ */
+void
+loghistory_skip_copy (LogHistory *history, guint64 start, guint64 end, guint32 hash)
+{
+	HistoryFile *file = g_ptr_array_index (history->files, history->files->len - 1);
+	gchar buffer[LINE_HASH_SPAN+1];
+	gsize length = MIN (end, sizeof (buffer));
+	gint fd;
+
+	if (start >= end)
+		return;
+
+	/* A compressed copy doesn't hold the line where the log did */
+	fd = open (file->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	if (pread (fd, buffer, length, end-length) == (gssize)length && buffer[length-1] == '\n' &&
+	    hash_line_end (buffer, length) == hash) {
+		file->skip_start = start;
+		file->skip_end = end;
+	}
+	close (fd);
+}
+
+/* [ loghistory_parse_step ]
+ * Add the next batch of parsed hits to the view, oldest log first. Waits only
+ * briefly for the workers so the main loop stays responsive. Return TRUE
+ * while there is more left to add
+ */
+gboolean
+loghistory_parse_step (LogHistory *history)
+{
+	guint added = 0;
+
+	queue_files (history);
+
+	while (history->current < history->files->len && added < HISTORY_BATCH) {
+		HistoryFile *file = g_ptr_array_index (history->files, history->current);
+
+		if (history->batch == NULL) {
+			gint64 deadline = g_get_monotonic_time () + HISTORY_WAIT;
+			gboolean finished;
+
+			g_mutex_lock (&history->lock);
+			while (g_queue_is_empty (file->batches) && !file->finished &&
+			       g_cond_wait_until (&history->changed, &history->lock, deadline));
+
+			history->batch = g_queue_pop_head (file->batches);
+			finished = file->finished;
+			if (history->batch != NULL)
+				g_cond_broadcast (&history->changed); /* The worker may be waiting for room */
+			g_mutex_unlock (&history->lock);
+
+			if (history->batch == NULL) {
+				if (!finished)
+					break; /* The worker is still busy, come back on the next iteration */
+
+				history->current++;
+				queue_files (history);
+				continue;
+			}
+			history->position = 0;
+		}
+
+		while (history->position < history->batch->hits->len && added < HISTORY_BATCH) {
+			hitview_append_reloaded_hit (g_ptr_array_index (history->batch->hits, history->position));
+			history->position++;
+			added++;
+		}
+
+		if (history->position == history->batch->hits->len) {
+			free_batch (history->batch);
+			history->batch = NULL;
+		}
+	}
+
+	return (history->current < history->files->len);
+}
+
+/* [ loghistory_close ]
+ * Stop the workers and free everything not yet added to the view
+ */
+void
+loghistory_close (LogHistory *history)
+{
+	g_mutex_lock (&history->lock);
+	history->cancelled = TRUE;
+	g_cond_broadcast (&history->changed);
+	g_mutex_unlock (&history->lock);
+
+	g_thread_pool_free (history->pool, TRUE, TRUE);
+
+	if (history->batch != NULL)
+		free_batch (history->batch);
+	g_ptr_array_foreach (history->files, (GFunc)free_history_file, NULL);
+	g_ptr_array_free (history->files, TRUE);
+
+	g_mutex_clear (&history->lock);
+	g_cond_clear (&history->changed);
+	g_free (history);
+}
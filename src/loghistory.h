@@ -0,0 +1,25 @@
+/*---[ loghistory.h ]-------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Reading of the rotated, possibly compressed, system log history
+ *--------------------------------------------------------------------*/
+
+#ifndef _FORTIFIED_LOGHISTORY
+#define _FORTIFIED_LOGHISTORY
+
+#include <config.h>
+#include <gnome.h>
+
+typedef struct _LogHistory LogHistory;
+
+LogHistory *loghistory_open (const gchar *logpath);
+void loghistory_skip_copy (LogHistory *history, guint64 start, guint64 end, guint32 hash);
+gboolean loghistory_parse_step (LogHistory *history);
+void loghistory_close (LogHistory *history);
+
+#endif
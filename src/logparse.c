@@ -0,0 +1,1000 @@
+/*---[ logparse.c ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Tokenizers for the lines written by the netfilter LOG target, in the
+ * formats a system log may be stored in
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+#include "logparse.h"
+#include "logscan.h"
+#include "util.h"
+
+#define TIME_LENGTH 15 /* Length of a syslog timestamp, eg. "Jan  1 00:00:00" */
+#define TAG_SEARCH 2 /* Tokens after the hostname that may be the "kernel:" tag */
+#define DETECT_LENGTH (64*1024) /* Bytes at the start of a log looked at to detect its format */
+#define ANCHOR_SKEW (24*60*60) /* How far a syslog time may be past the anchor and still be in its year */
+#define EXPORT_LOOKBACK 8192 /* How far back a journal export record is searched for its time */
+#define EXPORT_TIME "__REALTIME_TIMESTAMP="
+#define EXPORT_MESSAGE "MESSAGE="
+#define MARKER "IN="
+#define MARKER_LEN 3
+
+#define KEY_IS(key, len, name) ((len) == sizeof (name) - 1 && memcmp ((key), (name), (len)) == 0)
+#define HAS_PREFIX(p, end, name) ((end) - (p) >= (gssize)sizeof (name) - 1 && memcmp ((p), (name), sizeof (name) - 1) == 0)
+
+typedef gboolean (*DetectFunc) (const gchar *line, gsize length);
+typedef gboolean (*TokenizeFunc) (const gchar *buffer, const gchar *line, gsize length, LogTokens *t);
+
+typedef struct _LogFormatInfo LogFormatInfo;
+struct _LogFormatInfo
+{
+	DetectFunc detect; /* Test if a line is in the format, NULL if it's never detected */
+	DetectFunc header; /* Test if a line starts the way every line of the format does, NULL if they may not */
+	TokenizeFunc tokenize; /* Tokenize a line, the buffer it's in bounds any look back */
+};
+
+/* [ lookup_field ]
+ * Map the key of a KEY=value token to a field, return -1 if it's not known
+ */
+static gint
+lookup_field (const gchar *key, gsize len)
+{
+	switch (key[0]) {
+	case 'C':
+		if (KEY_IS (key, len, "CODE")) return LOGFIELD_CODE;
+		break;
+	case 'D':
+		if (KEY_IS (key, len, "DST")) return LOGFIELD_DST;
+		if (KEY_IS (key, len, "DPT")) return LOGFIELD_DPT;
+		break;
+	case 'I':
+		if (KEY_IS (key, len, "IN")) return LOGFIELD_IN;
+		if (KEY_IS (key, len, "ID")) return LOGFIELD_ID;
+		break;
+	case 'L':
+		if (KEY_IS (key, len, "LEN")) return LOGFIELD_LEN;
+		break;
+	case 'M':
+		if (KEY_IS (key, len, "MAC")) return LOGFIELD_MAC;
+		if (KEY_IS (key, len, "MARK")) return LOGFIELD_MARK;
+		break;
+	case 'O':
+		if (KEY_IS (key, len, "OUT")) return LOGFIELD_OUT;
+		break;
+	case 'P':
+		if (KEY_IS (key, len, "PROTO")) return LOGFIELD_PROTO;
+		if (KEY_IS (key, len, "PREC")) return LOGFIELD_PREC;
+		break;
+	case 'R':
+		if (KEY_IS (key, len, "RES")) return LOGFIELD_RES;
+		break;
+	case 'S':
+		if (KEY_IS (key, len, "SRC")) return LOGFIELD_SRC;
+		if (KEY_IS (key, len, "SPT")) return LOGFIELD_SPT;
+		break;
+	case 'T':
+		if (KEY_IS (key, len, "TOS")) return LOGFIELD_TOS;
+		if (KEY_IS (key, len, "TTL")) return LOGFIELD_TTL;
+		if (KEY_IS (key, len, "TYPE")) return LOGFIELD_TYPE;
+		break;
+	case 'U':
+		if (KEY_IS (key, len, "URGP")) return LOGFIELD_URGP;
+		break;
+	case 'W':
+		if (KEY_IS (key, len, "WINDOW")) return LOGFIELD_WINDOW;
+		break;
+	}
+
+	return -1;
+}
+
+/* [ set_slice ]
+ * Record the part of the line between two pointers, trimming spaces
+ */
+static void
+set_slice (LogSlice *slice, const gchar *line, const gchar *start, const gchar *end)
+{
+	while (start < end && *start == ' ')
+		start++;
+	while (end > start && end[-1] == ' ')
+		end--;
+
+	slice->offset = start - line;
+	slice->length = end - start;
+}
+
+/* [ skip_spaces ]
+ * Return the first character at or after p that is not a space
+ */
+static inline const gchar *
+skip_spaces (const gchar *p, const gchar *end)
+{
+	while (p < end && *p == ' ')
+		p++;
+
+	return p;
+}
+
+/* [ token_end ]
+ * Return the end of the space separated token starting at p
+ */
+static inline const gchar *
+token_end (const gchar *p, const gchar *end)
+{
+	const gchar *space = memchr (p, ' ', end-p);
+
+	return (space != NULL) ? space : end;
+}
+
+/* [ find_marker ]
+ * Return the first "IN=" between p and end, or NULL if there is none
+ */
+static const gchar *
+find_marker (const gchar *p, const gchar *end)
+{
+	while (end-p >= MARKER_LEN) {
+		p = memchr (p, MARKER[0], end-p - MARKER_LEN + 1);
+		if (p == NULL)
+			return NULL;
+		if (memcmp (p, MARKER, MARKER_LEN) == 0)
+			return p;
+		p++;
+	}
+
+	return NULL;
+}
+
+/* [ tokenize_fields ]
+ * Split a kernel message into the log prefix and the KEY=value fields in one
+ * pass. Nothing is copied, the offsets are relative to t->line. With glued set
+ * the prefix may run straight into "IN=", as nftables writes it. Return TRUE
+ * if the message was written by the LOG target
+ */
+static inline gboolean
+tokenize_fields (LogTokens *t, const gchar *message, const gchar *end, gboolean glued)
+{
+	const gchar *p;
+
+	t->present = 0;
+	t->prefix.offset = t->prefix.length = 0;
+
+	/* Offsets are 16 bits, a LOG line is never anywhere near that long */
+	if (end - t->line > G_MAXUINT16)
+		return FALSE;
+
+	/* Skip the "[ 1234.567890]" uptime stamp some kernels add */
+	message = skip_spaces (message, end);
+	if (message < end && *message == '[') {
+		p = memchr (message, ']', end-message);
+		if (p != NULL)
+			message = p+1;
+	}
+
+	p = message;
+	if (glued) {
+		p = find_marker (message, end);
+		if (p == NULL)
+			return FALSE;
+	}
+
+	while (p < end) {
+		const gchar *token, *equals;
+		gint field;
+
+		token = skip_spaces (p, end);
+		if (token == end)
+			break;
+		p = token_end (token, end);
+
+		equals = memchr (token, '=', p-token);
+		if (equals == NULL || equals == token)
+			continue;
+
+		field = lookup_field (token, equals-token);
+		if (field < 0 || (t->present & (1 << field)))
+			continue; /* The first occurrence wins, later ones belong to an ICMP payload */
+
+		if (field == LOGFIELD_IN)
+			set_slice (&t->prefix, t->line, message, token);
+
+		t->fields[field].offset = equals+1 - t->line;
+		t->fields[field].length = p - (equals+1);
+		t->present |= 1 << field;
+	}
+
+	return LOGTOKENS_HAS (t, LOGFIELD_IN) &&
+	       LOGTOKENS_HAS (t, LOGFIELD_OUT) &&
+	       LOGTOKENS_HAS (t, LOGFIELD_SRC);
+}
+
+/* [ tokenize_syslog ]
+ * Tokenize a traditional syslog line. The message follows the time, the
+ * hostname and the "kernel:" tag. Lines from other programs, such as ulogd,
+ * have it right after the hostname
+ */
+static inline gboolean
+tokenize_syslog (const gchar *line, gsize length, LogTokens *t, LogFormat format, gboolean glued)
+{
+	const gchar *end = line+length;
+	const gchar *p, *message;
+	gint i;
+
+	if (length < TIME_LENGTH)
+		return FALSE;
+
+	t->line = line;
+	t->format = format;
+	t->time.offset = 0;
+	t->time.length = TIME_LENGTH;
+
+	p = skip_spaces (line+TIME_LENGTH, end);
+	message = p = token_end (p, end);
+	for (i = 0; i < TAG_SEARCH && p < end; i++) {
+		const gchar *token = skip_spaces (p, end);
+
+		p = token_end (token, end);
+		if (KEY_IS (token, p-token, "kernel:")) {
+			message = p;
+			break;
+		}
+	}
+
+	return tokenize_fields (t, message, end, glued);
+}
+
+/* [ tokenize_bsd ]
+ * Tokenize a line of a traditional syslog file
+ */
+static gboolean
+tokenize_bsd (const gchar *buffer, const gchar *line, gsize length, LogTokens *t)
+{
+	return tokenize_syslog (line, length, t, LOGFORMAT_BSD, FALSE);
+}
+
+/* [ tokenize_nftables ]
+ * Tokenize a line of a syslog file written by nftables, where the log prefix
+ * has no space before "IN="
+ */
+static gboolean
+tokenize_nftables (const gchar *buffer, const gchar *line, gsize length, LogTokens *t)
+{
+	return tokenize_syslog (line, length, t, LOGFORMAT_NFTABLES, TRUE);
+}
+
+/* [ tokenize_rfc5424 ]
+ * Tokenize an RFC 5424 line, "<4>1 TIME HOST kernel - - - MSG", or one of the
+ * "TIME HOST kernel: MSG" lines rsyslog writes with RFC 3339 timestamps
+ */
+static gboolean
+tokenize_rfc5424 (const gchar *buffer, const gchar *line, gsize length, LogTokens *t)
+{
+	const gchar *end = line+length;
+	const gchar *p = line;
+	const gchar *token;
+	gint i;
+
+	t->line = line;
+	t->format = LOGFORMAT_RFC5424;
+
+	/* The "<PRI>VERSION" header is left out of files */
+	if (p < end && *p == '<')
+		p = token_end (p, end);
+
+	token = skip_spaces (p, end);
+	p = token_end (token, end);
+	set_slice (&t->time, line, token, p);
+
+	/* The hostname, then the application */
+	token = skip_spaces (p, end);
+	p = token_end (token, end);
+	token = skip_spaces (p, end);
+	p = token_end (token, end);
+
+	if (!KEY_IS (token, p-token, "kernel:")) {
+		if (!KEY_IS (token, p-token, "kernel"))
+			return FALSE;
+
+		/* The process and message ids */
+		for (i = 0; i < 2; i++)
+			p = token_end (skip_spaces (p, end), end);
+
+		/* Structured data is either "-" or a run of [...] elements */
+		p = skip_spaces (p, end);
+		if (p < end && *p == '-')
+			p++;
+		while (p < end && *p == '[') {
+			for (p++; p < end && *p != ']'; p++) {
+				if (*p == '\\' && p+1 < end)
+					p++;
+			}
+			if (p < end)
+				p++;
+		}
+
+		p = skip_spaces (p, end);
+		if (HAS_PREFIX (p, end, "\xEF\xBB\xBF"))
+			p += 3; /* UTF-8 byte order mark */
+	}
+
+	return tokenize_fields (t, p, end, FALSE);
+}
+
+/* [ tokenize_export ]
+ * Tokenize the MESSAGE= line of a journal export record. The time is on the
+ * __REALTIME_TIMESTAMP= line earlier in the same record, which is searched
+ * for back to the blank line ending the previous record
+ */
+static gboolean
+tokenize_export (const gchar *buffer, const gchar *line, gsize length, LogTokens *t)
+{
+	const gchar *end = line+length;
+	const gchar *p = line;
+
+	if (!HAS_PREFIX (line, end, EXPORT_MESSAGE))
+		return FALSE;
+
+	t->line = line;
+	t->format = LOGFORMAT_JOURNAL_EXPORT;
+	t->time.offset = t->time.length = 0;
+
+	while (p > buffer && line-p < EXPORT_LOOKBACK) {
+		const gchar *start = p-1;
+
+		while (start > buffer && start[-1] != '\n')
+			start--;
+		if (start == p-1)
+			break;
+
+		if (HAS_PREFIX (start, p-1, EXPORT_TIME)) {
+			t->line = start;
+			set_slice (&t->time, start, start + sizeof (EXPORT_TIME) - 1, p-1);
+			break;
+		}
+		p = start;
+	}
+
+	return tokenize_fields (t, line + sizeof (EXPORT_MESSAGE) - 1, end, TRUE);
+}
+
+/* [ tokenize_message ]
+ * Tokenize a bare kernel message, the prefix may be written by either the
+ * iptables or the nftables LOG target
+ */
+static gboolean
+tokenize_message (const gchar *buffer, const gchar *line, gsize length, LogTokens *t)
+{
+	t->line = line;
+	t->format = LOGFORMAT_MESSAGE;
+	t->time.offset = t->time.length = 0;
+
+	return tokenize_fields (t, line, line+length, TRUE);
+}
+
+/* [ detect_bsd ]
+ * Test if a line starts with a syslog timestamp, eg. "Jan  1 00:00:00 "
+ */
+static gboolean
+detect_bsd (const gchar *line, gsize length)
+{
+	return length > TIME_LENGTH &&
+	       g_ascii_isupper (line[0]) && g_ascii_islower (line[1]) && g_ascii_islower (line[2]) &&
+	       line[3] == ' ' && (line[4] == ' ' || g_ascii_isdigit (line[4])) && g_ascii_isdigit (line[5]) &&
+	       line[6] == ' ' && line[9] == ':' && line[12] == ':' && line[TIME_LENGTH] == ' ';
+}
+
+/* [ detect_nftables ]
+ * Test if a line is a syslog line with a log prefix running into "IN="
+ */
+static gboolean
+detect_nftables (const gchar *line, gsize length)
+{
+	const gchar *marker;
+
+	if (!detect_bsd (line, length))
+		return FALSE;
+
+	marker = find_marker (line+TIME_LENGTH, line+length);
+	return marker != NULL && marker[-1] != ' ';
+}
+
+/* [ detect_rfc5424 ]
+ * Test if a line starts with an RFC 5424 header or an RFC 3339 timestamp,
+ * eg. "<4>1 " or "2016-01-01T00:00:00"
+ */
+static gboolean
+detect_rfc5424 (const gchar *line, gsize length)
+{
+	const gchar *p;
+
+	if (length > 0 && line[0] == '<') {
+		p = memchr (line, '>', MIN (length, 5));
+		return p != NULL && p+1 < line+length && g_ascii_isdigit (p[1]);
+	}
+
+	return length > 19 &&
+	       g_ascii_isdigit (line[0]) && g_ascii_isdigit (line[3]) && line[4] == '-' && line[7] == '-' &&
+	       line[10] == 'T' && line[13] == ':' && line[16] == ':';
+}
+
+/* [ detect_export ]
+ * Test if a line is one of the fields that start a journal export record
+ */
+static gboolean
+detect_export (const gchar *line, gsize length)
+{
+	return HAS_PREFIX (line, line+length, "__CURSOR=") ||
+	       HAS_PREFIX (line, line+length, EXPORT_TIME);
+}
+
+/* Indexed by LogFormat */
+static const LogFormatInfo formats[NUM_LOGFORMATS] = {
+	{ detect_bsd, detect_bsd, tokenize_bsd },
+	{ detect_rfc5424, detect_rfc5424, tokenize_rfc5424 },
+	{ detect_export, NULL, tokenize_export },
+	{ detect_nftables, detect_bsd, tokenize_nftables },
+	{ NULL, NULL, tokenize_message }
+};
+
+/* The formats a log may be detected as, the more specific ones first */
+static const LogFormat detect_order[] = { LOGFORMAT_JOURNAL_EXPORT, LOGFORMAT_RFC5424,
+                                          LOGFORMAT_NFTABLES, LOGFORMAT_BSD };
+
+/* [ detect_line ]
+ * Detect the format of a single line. Return NUM_LOGFORMATS if it is in none
+ */
+static LogFormat
+detect_line (const gchar *line, gsize length)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (detect_order); i++) {
+		if (formats[detect_order[i]].detect (line, length))
+			return detect_order[i];
+	}
+
+	return NUM_LOGFORMATS;
+}
+
+/* [ line_format ]
+ * Return the format to read a line of a log in, the one of the log unless
+ * the line doesn't start the way the lines of that format do
+ */
+static inline LogFormat
+line_format (const gchar *line, gsize length, LogFormat format)
+{
+	LogFormat own;
+
+	if (formats[format].header == NULL || formats[format].header (line, length))
+		return format;
+
+	own = detect_line (line, length);
+	return (own != NUM_LOGFORMATS) ? own : format;
+}
+
+/* [ logparse_detect_format ]
+ * Detect the format of a log from the lines at the start of a buffer. The
+ * more specific formats are tried first, the first to match any line wins.
+ * Return LOGFORMAT_BSD if none does. It is only a first guess, a line that
+ * doesn't fit it is read in the format it is found to be in
+ */
+LogFormat
+logparse_detect_format (const gchar *buffer, gsize length)
+{
+	const gchar *end = buffer + MIN (length, DETECT_LENGTH);
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (detect_order); i++) {
+		const gchar *line = buffer;
+
+		while (line < end) {
+			const gchar *eol = memchr (line, '\n', end-line);
+
+			if (eol == NULL)
+				eol = end;
+			if (formats[detect_order[i]].detect (line, eol-line))
+				return detect_order[i];
+			line = eol+1;
+		}
+	}
+
+	return LOGFORMAT_BSD;
+}
+
+/* The last hours bsd_time converted, kept per thread */
+typedef struct _TimeCache TimeCache;
+struct _TimeCache
+{
+	time_t anchor;
+	gint anchor_year; /* Of the anchor, in local time */
+	struct {
+		gint year, mon, mday, hour;
+		time_t start;
+		gboolean uniform; /* The clocks don't change during the hour */
+	} hours[2]; /* Indexed by the parity of the year, a line may go either side of new year */
+};
+
+static GPrivate time_cache = G_PRIVATE_INIT (g_free);
+
+/* [ make_time ]
+ * Convert a local time, seconds being those past the start of the hour
+ */
+static time_t
+make_time (gint year, gint mon, gint mday, gint hour, gint seconds)
+{
+	struct tm tm;
+
+	memset (&tm, 0, sizeof (tm));
+	tm.tm_year = year;
+	tm.tm_mon = mon;
+	tm.tm_mday = mday;
+	tm.tm_hour = hour;
+	tm.tm_min = seconds / 60;
+	tm.tm_sec = seconds % 60;
+	tm.tm_isdst = -1;
+
+	return mktime (&tm);
+}
+
+/* [ get_time_cache ]
+ * Return the calling thread's cache of converted hours
+ */
+static TimeCache *
+get_time_cache (void)
+{
+	TimeCache *cache = g_private_get (&time_cache);
+
+	if (cache == NULL) {
+		cache = g_new0 (TimeCache, 1);
+		cache->anchor = -1;
+		cache->hours[0].mday = cache->hours[1].mday = -1; /* Nothing converted yet */
+		g_private_set (&time_cache, cache);
+	}
+
+	return cache;
+}
+
+/* [ local_time ]
+ * Convert a local time, seconds being those past the start of the hour.
+ * mktime reads the time zone again on every call, lines mostly come in
+ * order so the start of the hours last converted is remembered
+ */
+static time_t
+local_time (TimeCache *cache, gint year, gint mon, gint mday, gint hour, gint seconds)
+{
+	gint i = year & 1;
+
+	if (year != cache->hours[i].year || mon != cache->hours[i].mon ||
+	    mday != cache->hours[i].mday || hour != cache->hours[i].hour) {
+		time_t end = make_time (year, mon, mday, hour, 59*60 + 59);
+
+		cache->hours[i].start = make_time (year, mon, mday, hour, 0);
+		cache->hours[i].uniform = (cache->hours[i].start != (time_t)-1 && end - cache->hours[i].start == 59*60 + 59);
+		cache->hours[i].year = year;
+		cache->hours[i].mon = mon;
+		cache->hours[i].mday = mday;
+		cache->hours[i].hour = hour;
+	}
+
+	if (!cache->hours[i].uniform)
+		return make_time (year, mon, mday, hour, seconds);
+
+	return cache->hours[i].start + seconds;
+}
+
+/* [ bsd_time ]
+ * Read a "Jan  1 00:00:00" syslog time. The year is the one that puts the
+ * time closest before the anchor, allowing for some clock skew
+ */
+static time_t
+bsd_time (const gchar *line, time_t anchor)
+{
+	static const gchar months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	TimeCache *cache;
+	const gchar *month;
+	gint mon, mday, hour, seconds;
+	time_t when;
+
+	for (month = months; *month != '\0' && memcmp (month, line, 3) != 0; month += 3);
+	if (*month == '\0')
+		return -1;
+
+	cache = get_time_cache ();
+	if (anchor != cache->anchor) {
+		struct tm tm;
+
+		localtime_r (&anchor, &tm);
+		cache->anchor = anchor;
+		cache->anchor_year = tm.tm_year;
+	}
+
+	mon = (month - months) / 3;
+	mday = (line[4] == ' ' ? 0 : (line[4] - '0') * 10) + (line[5] - '0');
+	hour = (line[7] - '0') * 10 + (line[8] - '0');
+	seconds = ((line[10] - '0') * 10 + (line[11] - '0')) * 60 + (line[13] - '0') * 10 + (line[14] - '0');
+
+	when = local_time (cache, cache->anchor_year, mon, mday, hour, seconds);
+	if (when > anchor + ANCHOR_SKEW)
+		when = local_time (cache, cache->anchor_year - 1, mon, mday, hour, seconds);
+
+	return when;
+}
+
+/* [ read_digits ]
+ * Read a number of count digits, advancing p past them. Return FALSE if
+ * there are fewer digits before end
+ */
+static gboolean
+read_digits (const gchar **p, const gchar *end, gint count, gint *value)
+{
+	*value = 0;
+	if (end - *p < count)
+		return FALSE;
+
+	for (; count > 0; count--, (*p)++) {
+		if (!g_ascii_isdigit (**p))
+			return FALSE;
+		*value = *value * 10 + (**p - '0');
+	}
+
+	return TRUE;
+}
+
+/* [ civil_days ]
+ * Return the days from the epoch to a date of the proleptic Gregorian
+ * calendar, mon counting from 1
+ */
+static gint64
+civil_days (gint year, gint mon, gint mday)
+{
+	gint64 era, years, days;
+
+	year -= (mon <= 2);
+	era = (year >= 0 ? year : year - 399) / 400;
+	years = year - era * 400;
+	days = years * 365 + years/4 - years/100 + (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+
+	return era * 146097 + days - 719468;
+}
+
+/* [ rfc3339_time ]
+ * Read an RFC 3339 time, "2016-01-01T00:00:00.000000+00:00", that runs
+ * from p to end, in place. A time without an offset is in local time.
+ * Return -1 if the text is not such a time
+ */
+static time_t
+rfc3339_time (const gchar *p, const gchar *end)
+{
+	static const guint8 month_days[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	gint year, mon, mday, hour, min, sec, offset_hour, offset_min;
+	gint sign;
+	time_t when;
+
+	if (!read_digits (&p, end, 4, &year) || p == end || *p++ != '-' ||
+	    !read_digits (&p, end, 2, &mon) || p == end || *p++ != '-' ||
+	    !read_digits (&p, end, 2, &mday) || p == end || (*p != 'T' && *p != 't' && *p != ' '))
+		return -1;
+	p++;
+	if (!read_digits (&p, end, 2, &hour) || p == end || *p++ != ':' ||
+	    !read_digits (&p, end, 2, &min) || p == end || *p++ != ':' ||
+	    !read_digits (&p, end, 2, &sec))
+		return -1;
+
+	if (mon < 1 || mon > 12 || mday < 1 || mday > month_days[mon-1] ||
+	    (mon == 2 && mday == 29 && (year % 4 != 0 || (year % 100 == 0 && year % 400 != 0))) ||
+	    hour > 23 || min > 59 || sec > 59)
+		return -1;
+
+	/* The fraction of the second */
+	if (p < end && *p == '.') {
+		for (p++; p < end && g_ascii_isdigit (*p); p++);
+		if (!g_ascii_isdigit (p[-1]))
+			return -1;
+	}
+
+	if (p == end)
+		return local_time (get_time_cache (), year - 1900, mon - 1, mday, hour, min * 60 + sec);
+
+	when = civil_days (year, mon, mday) * 86400 + hour * 3600 + min * 60 + sec;
+	if ((*p == 'Z' || *p == 'z') && p+1 == end)
+		return when;
+
+	if (*p != '+' && *p != '-')
+		return -1;
+	sign = (*p++ == '+') ? 1 : -1;
+	if (!read_digits (&p, end, 2, &offset_hour) || p == end || *p++ != ':' ||
+	    !read_digits (&p, end, 2, &offset_min) || p != end ||
+	    offset_hour > 23 || offset_min > 59)
+		return -1;
+
+	return when - sign * (offset_hour * 3600 + offset_min * 60);
+}
+
+/* [ logparse_line_time ]
+ * Read the time a line of a log was written, as seconds since the epoch.
+ * anchor is a time no line is much later than, usually when the log was
+ * last modified, it completes times without a year. Return -1 if the line
+ * has no time, as lines in the middle of a journal export record don't
+ */
+time_t
+logparse_line_time (const gchar *line, gsize length, LogFormat format, time_t anchor)
+{
+	const gchar *end = line+length;
+	const gchar *p;
+	guint64 usec;
+
+	switch (line_format (line, length, format)) {
+	case LOGFORMAT_BSD:
+	case LOGFORMAT_NFTABLES:
+		return detect_bsd (line, length) ? bsd_time (line, anchor) : -1;
+	case LOGFORMAT_RFC5424:
+		if (!detect_rfc5424 (line, length))
+			return -1;
+		p = (*line == '<') ? skip_spaces (token_end (line, end), end) : line;
+		return rfc3339_time (p, token_end (p, end));
+	case LOGFORMAT_JOURNAL_EXPORT:
+		if (!HAS_PREFIX (line, end, EXPORT_TIME))
+			return -1;
+		usec = 0;
+		for (p = line + sizeof (EXPORT_TIME) - 1; p < end && g_ascii_isdigit (*p); p++)
+			usec = usec * 10 + (*p - '0');
+		return usec / G_USEC_PER_SEC;
+	default:
+		return -1;
+	}
+}
+
+/* [ logparse_tokenize_message ]
+ * Tokenize a kernel message without the syslog header, as stored in the
+ * journal. The time is left empty. Return TRUE if it was written by the LOG target
+ */
+gboolean
+logparse_tokenize_message (const gchar *message, gsize length, LogTokens *t)
+{
+	t->anchor = 0;
+	return tokenize_message (message, message, length, t);
+}
+
+typedef struct _TokenizeBatch TokenizeBatch;
+struct _TokenizeBatch
+{
+	const gchar *buffer;
+	LogFormat format;
+	time_t anchor;
+	GArray *results;
+	guint found;
+};
+
+/* [ tokenize_candidate ]
+ * Scanner callback, tokenize a line that passed the prefilter. A line that
+ * isn't in the format of the buffer, or doesn't read in it, is tried in the
+ * format it is found to be in
+ */
+static void
+tokenize_candidate (const gchar *line, gsize length, gpointer data)
+{
+	TokenizeBatch *batch = data;
+	LogFormat format = line_format (line, length, batch->format);
+	LogTokens t;
+
+	if (!formats[format].tokenize (batch->buffer, line, length, &t)) {
+		format = detect_line (line, length);
+		if (format == NUM_LOGFORMATS || format == batch->format ||
+		    !formats[format].tokenize (batch->buffer, line, length, &t))
+			return;
+	}
+
+	t.anchor = batch->anchor;
+	g_array_append_val (batch->results, t);
+	batch->found++;
+}
+
+/* [ logparse_tokenize_buffer ]
+ * Tokenize every line of a buffer in the given format, appending the
+ * LogTokens of the lines written by the LOG target to results. Lines in
+ * another format are read in their own. Lines without an IN= marker are
+ * rejected by the scanner before reaching the parser. anchor is a time no
+ * line is much later than, usually when the log was last modified. Return
+ * the number of lines appended
+ */
+guint
+logparse_tokenize_buffer (const gchar *buffer, gsize length, LogFormat format, time_t anchor, GArray *results)
+{
+	TokenizeBatch batch;
+
+	batch.buffer = buffer;
+	batch.format = format;
+	batch.anchor = anchor;
+	batch.results = results;
+	batch.found = 0;
+	logscan_candidates (buffer, length, tokenize_candidate, &batch);
+
+	return batch.found;
+}
+
+/* [ logparse_get_int ]
+ * Return the decimal value of a field, or 0 if it's missing
+ */
+gint
+logparse_get_int (const LogTokens *t, LogField field)
+{
+	const gchar *p, *end;
+	gint value = 0;
+
+	if (!LOGTOKENS_HAS (t, field))
+		return 0;
+
+	p = t->line + t->fields[field].offset;
+	end = p + t->fields[field].length;
+	while (p < end && g_ascii_isdigit (*p))
+		value = value * 10 + (*p++ - '0');
+
+	return value;
+}
+
+/* [ slice_equal ]
+ * Test if a slice of the line is the given text
+ */
+static gboolean
+slice_equal (const LogTokens *t, const LogSlice *slice, const gchar *text)
+{
+	return (slice->length == strlen (text) && memcmp (t->line + slice->offset, text, slice->length) == 0);
+}
+
+/* [ field_intern ]
+ * Return the interned value of a field, missing fields are empty
+ */
+static guint16
+field_intern (const LogTokens *t, LogField field)
+{
+	if (!LOGTOKENS_HAS (t, field))
+		return 0;
+
+	return hit_intern (t->line + t->fields[field].offset, t->fields[field].length);
+}
+
+/* [ field_address ]
+ * Read an IPv4 address field, return FALSE if it's missing or not one
+ */
+static gboolean
+field_address (const LogTokens *t, LogField field, guint32 *address)
+{
+	gchar text[INET_ADDRSTRLEN];
+	const LogSlice *slice = &t->fields[field];
+
+	if (!LOGTOKENS_HAS (t, field) || slice->length >= sizeof (text))
+		return FALSE;
+
+	memcpy (text, t->line + slice->offset, slice->length);
+	text[slice->length] = '\0';
+
+	return (inet_pton (AF_INET, text, address) == 1);
+}
+
+/* [ field_hex ]
+ * Return the value of a field written in hex, eg. "0x10", or 0 if it's missing
+ */
+static guint
+field_hex (const LogTokens *t, LogField field)
+{
+	const gchar *p, *end;
+	guint value = 0;
+
+	if (!LOGTOKENS_HAS (t, field))
+		return 0;
+
+	p = t->line + t->fields[field].offset;
+	end = p + t->fields[field].length;
+	if (end-p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		p += 2;
+	while (p < end && g_ascii_isxdigit (*p))
+		value = value * 16 + g_ascii_xdigit_value (*p++);
+
+	return value;
+}
+
+/* [ tokens_time ]
+ * Return the time of a line in seconds since the epoch, or 0 if it has
+ * none. Syslog times have no year, it is the one that puts the time
+ * closest before the anchor of the tokens, as when the log is bisected
+ */
+static gint64
+tokens_time (const LogTokens *t)
+{
+	const gchar *p = t->line + t->time.offset;
+	guint64 usec = 0;
+	time_t when;
+	guint i;
+
+	switch (t->format) {
+	case LOGFORMAT_RFC5424:
+		when = rfc3339_time (p, p + t->time.length);
+		return (when != (time_t)-1) ? when : 0;
+	case LOGFORMAT_JOURNAL_EXPORT:
+		/* Microseconds */
+		for (i = 0; i < t->time.length && g_ascii_isdigit (p[i]); i++)
+			usec = usec * 10 + (p[i] - '0');
+		return usec / G_USEC_PER_SEC;
+	default:
+		if (t->time.length != TIME_LENGTH)
+			return 0;
+		when = bsd_time (p, t->anchor);
+		return (when != (time_t)-1) ? when : 0;
+	}
+}
+
+/* [ logparse_fill_hit ]
+ * Fill in a hit from a tokenized line, nothing is allocated. Safe to call
+ * from any thread
+ */
+void
+logparse_fill_hit (const LogTokens *t, Hit *h)
+{
+	const LogSlice *proto = &t->fields[LOGFIELD_PROTO];
+	gint protocol = -1;
+
+	memset (h, 0, sizeof (*h));
+	h->time = tokens_time (t);
+	if (slice_equal (t, &t->prefix, "Inbound"))
+		h->direction = HIT_INBOUND;
+	else if (slice_equal (t, &t->prefix, "Outbound"))
+		h->direction = HIT_OUTBOUND;
+	h->in = field_intern (t, LOGFIELD_IN);
+	h->out = field_intern (t, LOGFIELD_OUT);
+
+	if (field_address (t, LOGFIELD_SRC, &h->source))
+		h->flags |= HIT_HAS_SOURCE;
+	if (field_address (t, LOGFIELD_DST, &h->destination))
+		h->flags |= HIT_HAS_DESTINATION;
+	if (LOGTOKENS_HAS (t, LOGFIELD_LEN)) {
+		h->length = MIN (logparse_get_int (t, LOGFIELD_LEN), G_MAXUINT16);
+		h->flags |= HIT_HAS_LENGTH;
+	}
+	if (LOGTOKENS_HAS (t, LOGFIELD_TOS)) {
+		h->tos = field_hex (t, LOGFIELD_TOS);
+		h->flags |= HIT_HAS_TOS;
+	}
+	if (LOGTOKENS_HAS (t, LOGFIELD_DPT)) {
+		h->port = MIN (logparse_get_int (t, LOGFIELD_DPT), G_MAXUINT16);
+		h->flags |= HIT_HAS_PORT;
+	}
+
+	/* The protocol is logged by name, or by number if it has none */
+	if (LOGTOKENS_HAS (t, LOGFIELD_PROTO)) {
+		if (g_ascii_isdigit (t->line[proto->offset]))
+			protocol = logparse_get_int (t, LOGFIELD_PROTO);
+		else
+			protocol = hit_protocol_number (t->line + proto->offset, proto->length);
+	}
+	if (protocol >= 0 && protocol <= G_MAXUINT8) {
+		h->protocol = protocol;
+		h->flags |= HIT_HAS_PROTOCOL;
+	}
+
+	/* Determine service used based on the port and protocol */
+	hit_set_service (h, LOGTOKENS_HAS (t, LOGFIELD_TYPE) ? logparse_get_int (t, LOGFIELD_TYPE) : -1);
+}
+
+/* [ logparse_make_hit ]
+ * Build a hit from a tokenized line, allocated from an arena whose lifetime
+ * matches the chunk being parsed. The view keeps its own copy of the hits
+ * it shows. Safe to call from any thread, with an arena of its own
+ */
+Hit *
+logparse_make_hit (const LogTokens *t, Arena *arena)
+{
+	Hit *h = arena_alloc (arena, sizeof (Hit));
+
+	logparse_fill_hit (t, h);
+
+	return h;
+}
@@ -0,0 +1,90 @@
+/*---[ logparse.h ]---------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Tokenizers for the lines written by the netfilter LOG target, in the
+ * formats a system log may be stored in
+ *--------------------------------------------------------------------*/
+
+#ifndef _FORTIFIED_LOGPARSE
+#define _FORTIFIED_LOGPARSE
+
+#include <config.h>
+#include <gnome.h>
+
+#include "fortified.h"
+#include "arena.h"
+
+/* Layouts of a log file, detected from its first lines */
+typedef enum
+{
+	LOGFORMAT_BSD, /* Traditional syslog, "Jan  1 00:00:00 host kernel: ..." */
+	LOGFORMAT_RFC5424, /* RFC 5424, or the RFC 3339 timestamps written by rsyslog */
+	LOGFORMAT_JOURNAL_EXPORT, /* journalctl -o export records */
+	LOGFORMAT_NFTABLES, /* Syslog with nftables prefixes running into "IN=" */
+	LOGFORMAT_MESSAGE, /* A bare kernel message, never detected */
+	NUM_LOGFORMATS
+} LogFormat;
+
+/* The KEY=value fields of a LOG target line that are recognized */
+typedef enum
+{
+	LOGFIELD_IN,
+	LOGFIELD_OUT,
+	LOGFIELD_MAC,
+	LOGFIELD_SRC,
+	LOGFIELD_DST,
+	LOGFIELD_LEN,
+	LOGFIELD_TOS,
+	LOGFIELD_PREC,
+	LOGFIELD_TTL,
+	LOGFIELD_ID,
+	LOGFIELD_PROTO,
+	LOGFIELD_SPT,
+	LOGFIELD_DPT,
+	LOGFIELD_WINDOW,
+	LOGFIELD_RES,
+	LOGFIELD_URGP,
+	LOGFIELD_TYPE,
+	LOGFIELD_CODE,
+	LOGFIELD_MARK,
+	NUM_LOGFIELDS
+} LogField;
+
+/* A part of a line, relative to the start of the line */
+typedef struct _LogSlice LogSlice;
+struct _LogSlice
+{
+	guint16 offset;
+	guint16 length;
+};
+
+typedef struct _LogTokens LogTokens;
+struct _LogTokens
+{
+	const gchar *line; /* Not owned, the tokens are valid as long as the line is */
+	LogFormat format; /* How to read the time */
+	LogSlice time;
+	time_t anchor; /* No line is much later, completes times without a year */
+	LogSlice prefix; /* The --log-prefix text, eg. "Inbound" */
+	LogSlice fields[NUM_LOGFIELDS];
+	guint32 present; /* Bit mask of the fields found on the line */
+};
+
+#define LOGTOKENS_HAS(t, field) (((t)->present & (1 << (field))) != 0)
+
+LogFormat logparse_detect_format (const gchar *buffer, gsize length);
+time_t logparse_line_time (const gchar *line, gsize length, LogFormat format, time_t anchor);
+
+gboolean logparse_tokenize_message (const gchar *message, gsize length, LogTokens *t);
+guint logparse_tokenize_buffer (const gchar *buffer, gsize length, LogFormat format, time_t anchor, GArray *results);
+
+gint logparse_get_int (const LogTokens *t, LogField field);
+void logparse_fill_hit (const LogTokens *t, Hit *h);
+Hit *logparse_make_hit (const LogTokens *t, Arena *arena);
+
+#endif
@@ -11,186 +11,1252 @@
 
 #include <config.h>
 #include <gnome.h>
-#include <netdb.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "globals.h"
 #include "logread.h"
+#include "logparse.h"
+#include "logscan.h"
+#include "hitcache.h"
 #include "util.h"
 #include "hitview.h"
 #include "statusview.h"
-#include "service.h"
+#include "preferences.h"
 
-static gboolean BUSY = FALSE;
+#define MAP_SEGMENT (4*1024*1024) /* Bytes of a mapped log parsed by a worker at a time */
+#define MAP_AHEAD 2 /* Segments queued per worker ahead of the one being added to the view */
+#define MAP_BATCH 5000 /* Hits added to the view per main loop iteration */
+#define MAP_WAIT (10*1000) /* Microseconds to wait for a worker before returning to the main loop */
+#define BISECT_SCAN (64*1024) /* Below this many bytes a time is searched for line by line */
+#define TAIL_BUF 65536 /* Size of a single read from the tailed log */
+#define TAIL_BATCH_MAX (4*TAIL_BUF) /* Hand over to the main loop at least this often */
+#define TAIL_POLL_INTERVAL 500 /* Milliseconds between checks when inotify is unavailable */
+#define CHECKPOINT_INTERVAL 30 /* Seconds between saves of the read position */
+#define MAP_GUARDS 8 /* Logs that can be mapped at the same time */
 
-/* [ gvfs_seek_callback ]
- * Zero the buffer and read again
+/* How far the log has been read, saved so the next session can pick up
+   the events logged while Fortified wasn't running */
+typedef struct _LogCheckpoint LogCheckpoint;
+struct _LogCheckpoint
+{
+	guint64 dev;
+	guint64 inode;
+	guint64 offset; /* Just past the last complete line read */
+	guint32 hash; /* Of the end of that line, tells if the file was replaced */
+};
+
+typedef struct _LogTail LogTail;
+struct _LogTail
+{
+	gchar *path;
+	gint fd;
+	gint old_fd; /* The log before it was rotated, read until the writer moves on */
+	gint inotify_fd;
+	gint watch; /* Follows the opened file */
+	gint dir_watch; /* Notices a new file being created in place of the log */
+	gint wakeup[2]; /* Pipe used to interrupt the reader thread */
+	gchar *buffer;
+	GString *pending; /* Data read but not yet handed to the main loop */
+	guint64 last_size; /* Of the file at the last check, it only shrinks when truncated */
+	LogCheckpoint mark; /* Last complete line read, gone when the file was truncated and refilled */
+	LogFormat format;
+	gboolean detected; /* The format was detected from a complete line of the current file */
+	GThread *thread;
+	volatile gint running;
+};
+
+typedef struct _LogBatch LogBatch;
+struct _LogBatch
+{
+	gchar *data;
+	gsize length;
+	LogFormat format;
+	time_t anchor; /* Completes syslog times */
+	gboolean checkpointed; /* All the lines came from the current file */
+	LogCheckpoint checkpoint;
+};
+
+typedef struct _LogSegment LogSegment;
+struct _LogSegment
+{
+	gsize start;
+	gsize end;
+	GPtrArray *hits; /* Filled in by a worker */
+	Arena *arena; /* Holds the hits */
+	GByteArray *records; /* The hits encoded for the cache */
+	guint count; /* Hits in the records */
+	gint64 staged; /* Position of the records set aside by a reverse read, or -1 */
+	gsize length; /* Of the staged records */
+	gboolean ready;
+};
+
+struct _LogMap
+{
+	gchar *data;
+	gsize size;
+	LogFormat format;
+	time_t mtime; /* Of the file when it was mapped, completes syslog times */
+	HitCache *cache; /* Or NULL if hits are not cached */
+	gboolean reading_cache; /* Cached hits are still being added to the view */
+	gboolean reverse; /* Newest lines first, the cached hits come last */
+	volatile sig_atomic_t truncated; /* The file shrank under the mapping */
+	gboolean end_hashed; /* The last line was read whole and ends with a newline */
+	guint32 end_hash; /* Of that line, tells a copy of the log apart */
+	GThreadPool *pool;
+	GMutex lock;
+	GCond ready; /* Signaled when a worker finishes a segment */
+	GPtrArray *segments; /* Newline aligned, in file order */
+	guint queued; /* Segments handed to the workers so far, in reading order */
+	guint current; /* Segment being added to the view, in reading order */
+	guint position; /* Hits of the current segment added so far */
+};
+
+static LogMap *volatile guarded[MAP_GUARDS]; /* The mapped logs, for the SIGBUS handler */
+static gsize page_size; /* For the SIGBUS handler, getpagesize isn't safe to call there */
+static LogTail *tail = NULL;
+static LogCheckpoint checkpoint; /* Of the lines added to the view */
+static gboolean checkpoint_changed = FALSE;
+static guint checkpoint_timeout = 0;
+
+/* [ logread_parse_buffer ]
+ * Parse a buffer of log lines in the given format, add matches to the
+ * hitview. anchor is a time no line is much later than, it completes
+ * syslog times. The buffer is not modified. Return true if a hit was added
  */
-static void
-gvfs_seek_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult result, gpointer data)
+gboolean
+logread_parse_buffer (const gchar *buffer, gsize length, LogFormat format, time_t anchor)
 {
-	Parse *info = data;
-	if (result != GNOME_VFS_OK) {
-		g_warning ("Seek error");
+	static GArray *tokens = NULL;
+	static Arena *arena = NULL;
+	gboolean added = FALSE;
+	guint i;
+
+	/* Reused between calls so that a batch of lines costs no allocations */
+	if (tokens == NULL) {
+		tokens = g_array_new (FALSE, FALSE, sizeof (LogTokens));
+		arena = arena_new (0);
 	}
+	g_array_set_size (tokens, 0);
 
-	memset (info->buffer, 0, FILE_BUF);
-	gnome_vfs_async_read (handle, info->buffer, FILE_BUF, logread_async_read_callback, info);
-}
+	logparse_tokenize_buffer (buffer, length, format, anchor, tokens);
 
-static void
-gvfs_seek_end_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult result, gpointer data)
-{
-	if (result != GNOME_VFS_OK)
-		g_warning ("Seek end error");
+	/* The view copies the hits it keeps, the rest go with the arena */
+	for (i = 0; i < tokens->len; i++) {
+		if (hitview_append_hit (logparse_make_hit (&g_array_index (tokens, LogTokens, i), arena)))
+			added = TRUE;
+	}
+	arena_reset (arena);
+
+	if (added && !hitview_reload_in_progress ())
+		status_set_state (STATUS_HIT);
+
+	return added;
 }
 
 /* [ logread_async_read_callback ]
- * Read file parsing for iptables pattern, add to hitview on match
+ * Read file parsing for iptables pattern, add to hitview on match.
+ * A line split between two reads is carried over to the next one
  */
 void
 logread_async_read_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult result, gpointer buffer,
                              GnomeVFSFileSize bytes_requested, GnomeVFSFileSize bytes_read, gpointer data)
 {
-	gchar **lines = NULL;
 	Parse *info = data;
-	Hit *h;
-	int i = 0;
-	
-	if (g_str_has_suffix (info->buffer,"\n"))
-		info->half_line=0;
-	else 
-		info->half_line=1;
 
 	if (result == GNOME_VFS_OK && bytes_read > 0) {
-	/* split line into (gchar **) and check for pattern */
-		lines = g_strsplit_set (info->buffer, "\n",-1);
-		while (*(lines+(i+info->half_line)) && (*lines+i != NULL)) {
-			if (g_pattern_match_string (info->pattern,*(lines+i) )) {
-				h = parse_log_line (*(lines+i));
-
-				if (hitview_append_hit (h) && !hitview_reload_in_progress ())
-					status_set_state (STATUS_HIT);
-				free_hit (h);
-			}
-			i++;
-		}
-		/* end of file or error */
-		if (bytes_requested != bytes_read) {
-			if (info->continuous) {
-				memset (info->buffer, 0, FILE_BUF); /* fill buffer with zeros, next line might be half line */
-				BUSY = FALSE;
-			} else
-				gnome_vfs_async_close (handle, hitview_abort_reload_callback, info);
-		} else if ((info->half_line) == 1 && (i > 1)) { /* if last line was half line seek back */
-			int len=strlen (*(lines+i));
-			gnome_vfs_async_seek (handle,GNOME_VFS_SEEK_CURRENT, -len,
-			                      gvfs_seek_callback, info);
+		const gchar *last;
 
-		} else {
-			memset (info->buffer, 0, FILE_BUF); /* fill buffer with zeros, next line might be half line */
-			info->bytes_read += bytes_read;
-			gnome_vfs_async_read (handle, info->buffer, FILE_BUF, logread_async_read_callback, info);
+		if (info->bytes_read == 0)
+			info->format = logparse_detect_format (buffer, bytes_read);
+		g_string_append_len (info->pending, buffer, bytes_read);
+		info->bytes_read += bytes_read;
+
+		last = logscan_last_newline (info->pending->str, info->pending->len);
+		if (last != NULL) {
+			gsize complete = last - info->pending->str + 1;
+
+			logread_parse_buffer (info->pending->str, complete, info->format, info->anchor);
+			g_string_erase (info->pending, 0, complete);
 		}
+		gnome_vfs_async_read (handle, info->buffer, FILE_BUF, logread_async_read_callback, info);
 	} else {
-		if (info->continuous) {
-			memset (info->buffer, 0, FILE_BUF); /* fill buffer with zeros, next line might be half line */
-			BUSY = FALSE;
+		/* End of file or error, the last line may lack a terminator */
+		if (info->pending->len > 0)
+			logread_parse_buffer (info->pending->str, info->pending->len, info->format, info->anchor);
+		gnome_vfs_async_close (handle, hitview_abort_reload_callback, info);
+	}
+}
+
+/* [ map_segment_worker ]
+ * Worker thread, build the hits of one segment of a mapped log
+ */
+static void
+map_segment_worker (gpointer data, gpointer user_data)
+{
+	LogSegment *segment = data;
+	LogMap *map = user_data;
+	GArray *tokens;
+	guint32 hash = 0;
+	guint i;
+
+	tokens = g_array_new (FALSE, FALSE, sizeof (LogTokens));
+	logparse_tokenize_buffer (map->data+segment->start, segment->end-segment->start, map->format, map->mtime, tokens);
+
+	/* The hits live as long as the segment, and are freed all at once */
+	segment->arena = arena_new (MAX (tokens->len * sizeof (Hit), ARENA_BLOCK));
+	segment->hits = g_ptr_array_sized_new (tokens->len);
+	for (i = 0; i < tokens->len; i++)
+		g_ptr_array_add (segment->hits, logparse_make_hit (&g_array_index (tokens, LogTokens, i), segment->arena));
+	g_array_free (tokens, TRUE);
+
+	if (map->cache != NULL)
+		segment->records = hitcache_encode (segment->hits);
+
+	/* The last line of the log tells a copy of it among the rotated logs */
+	if (segment->end == map->size && map->data[map->size-1] == '\n')
+		hash = hash_line_end (map->data+segment->start, segment->end-segment->start);
+
+	g_mutex_lock (&map->lock);
+	if (segment->end == map->size && map->data[map->size-1] == '\n' && !map->truncated) {
+		map->end_hash = hash;
+		map->end_hashed = TRUE;
+	}
+	segment->ready = TRUE;
+	g_cond_broadcast (&map->ready);
+	g_mutex_unlock (&map->lock);
+}
+
+/* [ split_segments ]
+ * Cut a mapped log, from start on, into segments that end on a line boundary
+ */
+static GPtrArray *
+split_segments (const gchar *data, gsize start, gsize size)
+{
+	GPtrArray *segments = g_ptr_array_new ();
+
+	while (start < size) {
+		LogSegment *segment;
+		gsize end;
+
+		if (size - start <= MAP_SEGMENT) {
+			end = size;
 		} else {
-			gnome_vfs_async_close (handle, hitview_abort_reload_callback, info);
+			const gchar *last;
+
+			last = logscan_last_newline (data+start, MAP_SEGMENT);
+			if (last == NULL) /* A single line spanning the whole segment */
+				last = memchr (data+start+MAP_SEGMENT, '\n', size - start - MAP_SEGMENT);
+			end = (last != NULL) ? (gsize)(last - data) + 1 : size;
 		}
 
+		segment = g_new0 (LogSegment, 1);
+		segment->start = start;
+		segment->end = end;
+		segment->staged = -1;
+		g_ptr_array_add (segments, segment);
 
+		start = end;
 	}
 
-	if (lines)
-		g_strfreev (lines);
+	return segments;
 }
 
-/* [ poll_log_timeout ]
- * Polls the logfile every 500ms for change, if change, parse lines
+/* [ free_segment ]
+ * Free a segment and any hits it still holds
  */
-static int
-poll_log_timeout (gpointer data)
+static void
+free_segment (LogSegment *segment)
 {
-	Parse *info = data;
+	if (segment->hits != NULL)
+		g_ptr_array_free (segment->hits, TRUE);
+	if (segment->arena != NULL)
+		arena_free (segment->arena);
+	if (segment->records != NULL)
+		g_byte_array_free (segment->records, TRUE);
+	g_free (segment);
+}
+
+/* [ sigbus_handler ]
+ * Touching the pages of a mapped log past the end of the file raises SIGBUS,
+ * which happens when the log is truncated while it's read (copytruncate).
+ * Those pages are replaced with zeroes, that hold no lines, and the reading
+ * goes on. Any other SIGBUS is fatal as usual.
+ * mmap isn't on the list of async-signal-safe functions, but it is a plain
+ * system call that takes no lock in user space. The signal is raised by a
+ * read of the mapping itself, never from inside the allocator or another
+ * mmap, so nothing it could disturb is half done. The map is marked first,
+ * so a worker that reads the zeroes always finds it truncated
+ */
+static void
+sigbus_handler (gint signum, siginfo_t *info, gpointer context)
+{
+	gchar *address = info->si_addr;
+	guint i;
+
+	for (i = 0; i < MAP_GUARDS; i++) {
+		LogMap *map = guarded[i];
+		gchar *start;
+
+		if (map == NULL || address < map->data || address >= map->data + map->size)
+			continue;
+
+		map->truncated = TRUE;
+		start = map->data + (address - map->data) / page_size * page_size;
+		if (mmap (start, map->data + map->size - start, PROT_READ,
+		          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+			return;
+	}
+
+	signal (SIGBUS, SIG_DFL);
+}
+
+/* [ guard_map ]
+ * Protect a mapped log against being truncated while it's read. Return
+ * FALSE if too many logs are mapped already
+ */
+static gboolean
+guard_map (LogMap *map)
+{
+	static gboolean installed = FALSE;
+	guint i;
+
+	if (!installed) {
+		struct sigaction action;
+
+		page_size = getpagesize ();
+		memset (&action, 0, sizeof (action));
+		action.sa_sigaction = sigbus_handler;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset (&action.sa_mask);
+		if (sigaction (SIGBUS, &action, NULL) != 0)
+			return FALSE;
+		installed = TRUE;
+	}
+
+	for (i = 0; i < MAP_GUARDS; i++) {
+		if (guarded[i] == NULL) {
+			guarded[i] = map;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* [ unguard_map ]
+ * Stop protecting a mapped log, before it's unmapped
+ */
+static void
+unguard_map (LogMap *map)
+{
+	guint i;
+
+	for (i = 0; i < MAP_GUARDS; i++) {
+		if (guarded[i] == map)
+			guarded[i] = NULL;
+	}
+}
+
+/* [ map_log ]
+ * Map a log file into memory, guarded against the file being truncated.
+ * Return NULL if the file can't be mapped, in which case it has to be read
+ * through a buffer instead
+ */
+static LogMap *
+map_log (const gchar *path, struct stat *st)
+{
+	LogMap *map;
+	gpointer data;
+	gint fd;
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat (fd, st) != 0 || !S_ISREG (st->st_mode) || st->st_size == 0) {
+		close (fd);
+		return NULL;
+	}
+
+	data = mmap (NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd); /* The mapping keeps its own reference to the file */
+	if (data == MAP_FAILED)
+		return NULL;
+
+	map = g_new0 (LogMap, 1);
+	map->data = data;
+	map->size = st->st_size;
+	map->mtime = st->st_mtime;
+	if (!guard_map (map)) {
+		munmap (map->data, map->size);
+		g_free (map);
+		return NULL;
+	}
+	map->format = logparse_detect_format (map->data, map->size);
+
+	return map;
+}
+
+/* [ map_start ]
+ * Start parsing the part of a mapped log between start and end in a pool
+ * of worker threads
+ */
+static void
+map_start (LogMap *map, gsize start, gsize end)
+{
+	gint workers = CLAMP (sysconf (_SC_NPROCESSORS_ONLN), 1, 64);
+
+	map->segments = split_segments (map->data, start, end);
+	g_mutex_init (&map->lock);
+	g_cond_init (&map->ready);
+	map->pool = g_thread_pool_new (map_segment_worker, map, workers, FALSE, NULL);
+}
+
+/* [ logread_map_open_reverse ]
+ * Map a log file into memory and start parsing it in a pool of worker
+ * threads, to add its hits newest first. The log is parsed from the end
+ * backwards a segment at a time, the hits of each one in reverse. The hits
+ * of the part parsed by an earlier reload are cached, they are the oldest
+ * and are added last, newest first. Return NULL if the file can't be
+ * mapped, in which case it has to be read through a buffer instead
+ */
+LogMap *
+logread_map_open_reverse (const gchar *path)
+{
+	LogMap *map;
+	struct stat st;
+
+	map = map_log (path, &st);
+	if (map == NULL)
+		return NULL;
+
+	map->cache = hitcache_open (map->data, map->size, &st);
+	map->reading_cache = (map->cache != NULL);
+	map->reverse = TRUE;
+	map_start (map, (map->cache != NULL) ? hitcache_get_offset (map->cache) : 0, map->size);
+
+	return map;
+}
+
+/* [ timed_line ]
+ * Find the first line starting at or after offset, and before limit, that
+ * has a time. Return its start and set when, or return limit if there is none
+ */
+static gsize
+timed_line (const LogMap *map, gsize offset, gsize limit, time_t anchor, time_t *when)
+{
+	const gchar *eol;
+
+	/* Resynchronize to the start of a line */
+	if (offset > 0 && map->data[offset-1] != '\n') {
+		eol = memchr (map->data+offset, '\n', map->size-offset);
+		offset = (eol != NULL) ? (gsize)(eol - map->data) + 1 : map->size;
+	}
+
+	while (offset < limit) {
+		gsize end;
+
+		eol = memchr (map->data+offset, '\n', map->size-offset);
+		end = (eol != NULL) ? (gsize)(eol - map->data) : map->size;
+
+		*when = logparse_line_time (map->data+offset, end-offset, map->format, anchor);
+		if (*when != (time_t)-1)
+			return offset;
+		offset = end+1;
+	}
+
+	return limit;
+}
+
+/* [ find_time ]
+ * Bisect a mapped log for the first line logged at or after target, taking
+ * the lines to be in time order. Return its offset, or the size of the log
+ * if every line is older
+ */
+static gsize
+find_time (const LogMap *map, time_t anchor, time_t target)
+{
+	gsize low = 0, high = map->size;
+	gsize offset;
+	time_t when;
+
+	while (high - low > BISECT_SCAN) {
+		gsize middle = low + (high - low) / 2;
+
+		offset = timed_line (map, middle, high, anchor, &when);
+		if (offset == high || when >= target)
+			high = middle;
+		else
+			low = offset+1;
+	}
+
+	/* Close enough, go through the remaining lines one by one */
+	offset = timed_line (map, low, map->size, anchor, &when);
+	while (offset < map->size && when < target)
+		offset = timed_line (map, offset+1, map->size, anchor, &when);
+
+	return offset;
+}
+
+/* [ logread_map_open_range ]
+ * Map a log file into memory and start parsing the lines logged between
+ * from and to, inclusive, to add their hits in file order. The ends of the range are found by bisecting the
+ * log. Syslog times have no year, it is taken from the time the log was
+ * last written to
+ */
+LogMap *
+logread_map_open_range (const gchar *path, time_t from, time_t to)
+{
+	LogMap *map;
+	struct stat st;
+	gsize start, end, page;
+
+	map = map_log (path, &st);
+	if (map == NULL)
+		return NULL;
+
+	/* Only a few pages are touched while searching, don't read ahead */
+	madvise (map->data, map->size, MADV_RANDOM);
+	start = find_time (map, map->mtime, from);
+	end = MAX (start, find_time (map, map->mtime, to+1));
+
+	page = getpagesize ();
+	if (end > start)
+		madvise (map->data + start - start % page, end - start + start % page, MADV_SEQUENTIAL);
+	map_start (map, start, end);
+
+	return map;
+}
+
+/* [ map_segment ]
+ * Return the segment that is read at the given position
+ */
+static LogSegment *
+map_segment (const LogMap *map, guint n)
+{
+	if (map->reverse)
+		n = map->segments->len - 1 - n;
+
+	return g_ptr_array_index (map->segments, n);
+}
+
+/* [ add_cached_hits ]
+ * Add the next cached hits to the view, newest first, until the batch is
+ * full. Return the number of hits added to the batch so far
+ */
+static guint
+add_cached_hits (LogMap *map, guint added)
+{
+	Hit h;
+
+	while (map->reading_cache && added < MAP_BATCH) {
+		if (!hitcache_read_reverse (map->cache, &h)) {
+			map->reading_cache = FALSE;
+			break;
+		}
+		hitview_append_reloaded_hit (&h);
+		added++;
+	}
+
+	return added;
+}
+
+/* [ cache_segments ]
+ * Append the hits of a log read in reverse, staged a segment at a time,
+ * to the cache in file order now that all of them have been added
+ */
+static void
+cache_segments (LogMap *map)
+{
+	guint i;
+
+	for (i = 0; i < map->segments->len; i++) {
+		LogSegment *segment = g_ptr_array_index (map->segments, i);
+
+		hitcache_append_staged (map->cache, segment->staged, segment->length, segment->count, map->data, segment->end);
+	}
+}
+
+/* [ queue_segments ]
+ * Keep the workers busy, but only a few segments ahead of the view so
+ * that the parsed hits waiting to be added don't pile up
+ */
+static void
+queue_segments (LogMap *map)
+{
+	guint limit = map->current + MAP_AHEAD * g_thread_pool_get_max_threads (map->pool);
+
+	while (map->queued < map->segments->len && map->queued < limit) {
+		g_thread_pool_push (map->pool, map_segment (map, map->queued), NULL);
+		map->queued++;
+	}
+}
+
+/* [ logread_map_parse_step ]
+ * Add the next batch of parsed hits to the view, in file order or in
+ * reverse. Waits only briefly for the workers so the main loop stays
+ * responsive. Return TRUE while there is more left to add
+ */
+gboolean
+logread_map_parse_step (LogMap *map)
+{
+	guint added = 0;
+
+	queue_segments (map);
+
+	while (map->current < map->segments->len && added < MAP_BATCH) {
+		LogSegment *segment = map_segment (map, map->current);
+		gsize start, end;
+		gboolean ready;
+
+		g_mutex_lock (&map->lock);
+		if (!segment->ready) {
+			gint64 deadline = g_get_monotonic_time () + MAP_WAIT;
+
+			while (!segment->ready && g_cond_wait_until (&map->ready, &map->lock, deadline));
+		}
+		ready = segment->ready;
+		g_mutex_unlock (&map->lock);
+
+		/* The worker is still busy, come back on the next iteration */
+		if (!ready)
+			break;
+
+		/* Truncated while it was read, the rest of the log went to a copy.
+		   A segment started on was parsed before, it is finished */
+		if (map->truncated && map->position == 0)
+			return FALSE;
+
+		while (map->position < segment->hits->len && added < MAP_BATCH) {
+			guint i = map->reverse ? segment->hits->len - 1 - map->position : map->position;
+			Hit *h = g_ptr_array_index (segment->hits, i);
+
+			hitview_append_reloaded_hit (h);
+			map->position++;
+			added++;
+		}
+
+		if (map->position < segment->hits->len)
+			break;
+
+		/* The segment is done, cache its hits, release its pages and move to the next one.
+		   The hits are staged until the earlier segments are cached */
+		segment->count = segment->hits->len;
+		if (map->cache != NULL) {
+			segment->staged = hitcache_stage (map->cache, segment->records);
+			segment->length = segment->records->len;
+			g_byte_array_free (segment->records, TRUE);
+			segment->records = NULL;
+		}
+		g_ptr_array_free (segment->hits, TRUE);
+		segment->hits = NULL;
+		arena_free (segment->arena);
+		segment->arena = NULL;
+
+		start = segment->start - segment->start % getpagesize ();
+		end = segment->end - segment->end % getpagesize ();
+		if (end > start)
+			madvise (map->data+start, end-start, MADV_DONTNEED);
+
+		map->current++;
+		map->position = 0;
+		queue_segments (map);
+	}
+
+	/* The older cached hits come after the parsed ones */
+	if (map->current == map->segments->len && map->reading_cache) {
+		added = add_cached_hits (map, added);
+		if (!map->reading_cache && !map->truncated)
+			cache_segments (map);
+	}
+
+	return (map->reading_cache || map->current < map->segments->len);
+}
+
+/* [ logread_map_get_covered ]
+ * Find the lines of a log read newest first whose hits were all added, from
+ * start to the end of the log, and the hash of the line it ends with. A log
+ * truncated while it was read has the same lines at the same place in the
+ * copy it went to, the rotated logs read next leave them out. Return FALSE
+ * if there are none
+ */
+gboolean
+logread_map_get_covered (LogMap *map, guint64 *start, guint64 *end, guint32 *hash)
+{
+	if (!map->reverse || !map->end_hashed || map->current == 0)
+		return FALSE;
+
+	/* The cached hits are the oldest, their lines are covered once they are all added */
+	if (map->current == map->segments->len && !map->reading_cache)
+		*start = 0;
+	else
+		*start = map_segment (map, map->current - 1)->start;
+	*end = map->size;
+	*hash = map->end_hash;
+
+	return TRUE;
+}
+
+/* [ logread_map_close ]
+ * Stop the workers, dropping the segments they haven't started on, and
+ * unmap the log
+ */
+void
+logread_map_close (LogMap *map)
+{
+	g_thread_pool_free (map->pool, TRUE, TRUE);
+
+	g_ptr_array_foreach (map->segments, (GFunc)free_segment, NULL);
+	g_ptr_array_free (map->segments, TRUE);
+
+	if (map->cache != NULL)
+		hitcache_close (map->cache);
+	g_mutex_clear (&map->lock);
+	g_cond_clear (&map->ready);
+	unguard_map (map);
+	munmap (map->data, map->size);
+	g_free (map);
+}
+
+/* [ read_line_hash ]
+ * Hash the line of a file that ends just before offset. Return FALSE if
+ * offset is not at the start of a line
+ */
+static gboolean
+read_line_hash (gint fd, guint64 offset, guint32 *hash)
+{
+	gchar buffer[LINE_HASH_SPAN+1];
+	gsize length;
+
+	*hash = 0;
+	if (offset == 0)
+		return TRUE;
+
+	length = MIN (offset, sizeof (buffer));
+	if (pread (fd, buffer, length, offset-length) != (gssize)length || buffer[length-1] != '\n')
+		return FALSE;
+
+	*hash = hash_line_end (buffer, length);
+	return TRUE;
+}
+
+/* [ checkpoint_valid ]
+ * Test if a file still has the line a checkpoint was taken after
+ */
+static gboolean
+checkpoint_valid (gint fd, const LogCheckpoint *c)
+{
+	guint32 hash;
+
+	return read_line_hash (fd, c->offset, &hash) && hash == c->hash;
+}
+
+/* [ checkpoint_at ]
+ * Take a checkpoint at the current position of a file. Return FALSE if the
+ * position is not at the start of a line
+ */
+static gboolean
+checkpoint_at (gint fd, LogCheckpoint *c)
+{
+	struct stat st;
+	off_t offset;
+
+	offset = lseek (fd, 0, SEEK_CUR);
+	if (offset < 0 || fstat (fd, &st) != 0)
+		return FALSE;
+
+	c->dev = st.st_dev;
+	c->inode = st.st_ino;
+	c->offset = offset;
+
+	return read_line_hash (fd, c->offset, &c->hash);
+}
+
+/* [ save_checkpoint ]
+ * Store the position reached in the log, if it moved since the last save
+ */
+static void
+save_checkpoint (void)
+{
+	gchar *value;
+
+	if (!checkpoint_changed)
+		return;
+
+	value = g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ":%u",
+	                         checkpoint.dev, checkpoint.inode, checkpoint.offset, checkpoint.hash);
+	preferences_set_string (PREFS_LOG_CHECKPOINT, value);
+	g_free (value);
+	checkpoint_changed = FALSE;
+}
+
+/* [ checkpoint_timeout_func ]
+ * Save the position in the log periodically, so a crash loses little
+ */
+static gboolean
+checkpoint_timeout_func (gpointer data)
+{
+	save_checkpoint ();
+	return TRUE;
+}
+
+/* [ load_checkpoint ]
+ * Read the position the last session reached in the log. Return FALSE if
+ * there is none
+ */
+static gboolean
+load_checkpoint (LogCheckpoint *c)
+{
+	gchar *value;
+	gboolean valid;
+
+	value = preferences_get_string (PREFS_LOG_CHECKPOINT);
+	if (value == NULL)
+		return FALSE;
+
+	valid = sscanf (value, "%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ":%u",
+	                &c->dev, &c->inode, &c->offset, &c->hash) == 4;
+	g_free (value);
+
+	return valid;
+}
+
+/* [ open_rotated ]
+ * Find the file a checkpoint was taken in among the rotated copies of the log.
+ * Return an open descriptor, or -1 if it was compressed or removed since
+ */
+static gint
+open_rotated (const gchar *logpath, const LogCheckpoint *c)
+{
+	gchar *dir, *base;
+	const gchar *name;
+	GDir *d;
+	gint fd = -1;
+
+	dir = g_path_get_dirname (logpath);
+	base = g_path_get_basename (logpath);
+
+	d = g_dir_open (dir, 0, NULL);
+	if (d != NULL) {
+		while (fd < 0 && (name = g_dir_read_name (d)) != NULL) {
+			struct stat st;
+			gchar *path;
+
+			if (!g_str_has_prefix (name, base))
+				continue;
+
+			/* Renaming a file keeps its inode */
+			path = g_build_filename (dir, name, NULL);
+			if (stat (path, &st) == 0 && S_ISREG (st.st_mode) &&
+			    st.st_dev == c->dev && st.st_ino == c->inode)
+				fd = open (path, O_RDONLY | O_CLOEXEC);
+			g_free (path);
+		}
+		g_dir_close (d);
+	}
+
+	g_free (base);
+	g_free (dir);
+
+	return fd;
+}
+
+/* [ tail_resume ]
+ * Position a newly opened log where the last session stopped reading, so the
+ * events logged in between are delivered. If the log was rotated meanwhile,
+ * the rest of the old file is read first. Without a usable checkpoint only
+ * events that happen from now on are read
+ */
+static void
+tail_resume (LogTail *t)
+{
+	LogCheckpoint saved;
+	struct stat st;
+	gint fd;
+
+	if (load_checkpoint (&saved) && fstat (t->fd, &st) == 0) {
+		if (st.st_dev == saved.dev && st.st_ino == saved.inode) {
+			/* A file truncated since, or a new one reusing the inode, is all new */
+			lseek (t->fd, checkpoint_valid (t->fd, &saved) ? saved.offset : 0, SEEK_SET);
+			return;
+		}
+
+		fd = open_rotated (t->path, &saved);
+		if (fd >= 0 && checkpoint_valid (fd, &saved)) {
+			lseek (fd, saved.offset, SEEK_SET);
+			t->old_fd = fd;
+			return;
+		}
+		if (fd >= 0)
+			close (fd);
+	}
+
+	lseek (t->fd, 0, SEEK_END);
+}
+
+/* [ tail_detect_format ]
+ * Detect the format of the log from the complete lines at the start of the
+ * current file. Until it has one the format is not settled, it is detected
+ * again from the first lines read
+ */
+static void
+tail_detect_format (LogTail *t)
+{
+	const gchar *last = NULL;
+	gssize n;
+
+	n = pread (t->fd, t->buffer, TAIL_BUF, 0);
+	if (n > 0)
+		last = logscan_last_newline (t->buffer, n);
+
+	t->detected = (last != NULL);
+	if (t->detected)
+		t->format = logparse_detect_format (t->buffer, last - t->buffer + 1);
+}
+
+/* [ deliver_batch ]
+ * Idle callback, parse a batch of lines handed over by the reader thread
+ */
+static gboolean
+deliver_batch (gpointer data)
+{
+	LogBatch *batch = data;
+
+	logread_parse_buffer (batch->data, batch->length, batch->format, batch->anchor);
+
+	if (batch->checkpointed) {
+		checkpoint = batch->checkpoint;
+		checkpoint_changed = TRUE;
+	}
+
+	g_free (batch->data);
+	g_free (batch);
+	return FALSE;
+}
+
+/* [ tail_flush ]
+ * Pass all complete lines read so far to the main loop
+ */
+static void
+tail_flush (LogTail *t)
+{
+	LogBatch *batch;
+	GString *remainder;
+	const gchar *last;
+	struct stat st;
+	gsize complete;
+
+	last = logscan_last_newline (t->pending->str, t->pending->len);
+	if (last == NULL)
+		return;
+
+	complete = last - t->pending->str + 1;
+	remainder = g_string_new_len (last+1, t->pending->len - complete);
+
+	/* A log empty or partly written when it was opened is settled by its first lines */
+	if (!t->detected) {
+		t->format = logparse_detect_format (t->pending->str, complete);
+		t->detected = TRUE;
+	}
 
-	if (BUSY == FALSE) { /* start reading only when previous read has finished */
-		BUSY = TRUE;
-		gnome_vfs_async_read (info->handle, info->buffer, FILE_BUF, logread_async_read_callback, info);
-	}	
-	return TRUE; /* TRUE means we want to keep calling the function */
+	/* Hand over the buffer itself, only the partial line is copied */
+	batch = g_new (LogBatch, 1);
+	batch->length = complete;
+	batch->format = t->format;
+	batch->anchor = time (NULL); /* The lines were just written */
+	batch->data = g_string_free (t->pending, FALSE);
+	t->pending = remainder;
+
+	/* Only a position in the current file is worth saving */
+	batch->checkpointed = (t->old_fd < 0 && fstat (t->fd, &st) == 0);
+	if (batch->checkpointed) {
+		batch->checkpoint.dev = st.st_dev;
+		batch->checkpoint.inode = st.st_ino;
+		batch->checkpoint.offset = lseek (t->fd, 0, SEEK_CUR) - remainder->len;
+		batch->checkpoint.hash = hash_line_end (batch->data, batch->length);
+	}
+
+	g_idle_add (deliver_batch, batch);
 }
 
+/* [ tail_read ]
+ * Read everything appended to a file since the last wakeup in large chunks
+ */
 static void
-gvfs_open_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult result, gpointer data)
+tail_read (LogTail *t, gint fd)
 {
-	Parse *info;
-	
-	if (result != GNOME_VFS_OK) {
+	gssize n;
+
+	while ((n = read (fd, t->buffer, TAIL_BUF)) > 0) {
+		g_string_append_len (t->pending, t->buffer, n);
+		if (t->pending->len >= TAIL_BATCH_MAX)
+			tail_flush (t);
+	}
+
+	if (n < 0 && errno != EINTR)
+		g_warning ("Error reading %s: %s", t->path, g_strerror (errno));
+}
+
+/* [ tail_retire_old ]
+ * Read the rotated log to the end one last time and close it
+ */
+static void
+tail_retire_old (LogTail *t)
+{
+	tail_read (t, t->old_fd);
+	close (t->old_fd);
+	t->old_fd = -1;
+
+	/* Don't let an unterminated last line run into the new file */
+	if (t->pending->len > 0 && t->pending->str[t->pending->len-1] != '\n')
+		g_string_append_c (t->pending, '\n');
+}
+
+/* [ tail_drain ]
+ * Read the rotated log, if any, and then the current one, so that lines are
+ * delivered in the order they were written
+ */
+static void
+tail_drain (LogTail *t)
+{
+	if (t->old_fd >= 0) {
+		struct stat st;
+
+		tail_read (t, t->old_fd);
+
+		/* Once the writer has started on the new file, the old one is complete */
+		if (fstat (t->fd, &st) == 0 && st.st_size > 0)
+			tail_retire_old (t);
+	}
+
+	tail_read (t, t->fd);
+	tail_flush (t);
+
+	/* Remember the line that ends where reading stopped, unless it came from the old file */
+	if (t->old_fd < 0) {
+		/* Failing means it was truncated meanwhile, and then the mark won't match */
+		t->mark.offset = lseek (t->fd, 0, SEEK_CUR) - t->pending->len;
+		read_line_hash (t->fd, t->mark.offset, &t->mark.hash);
+	}
+}
+
+/* [ tail_watch ]
+ * Point the inotify watch at the file currently open
+ */
+static void
+tail_watch (LogTail *t)
+{
+	if (t->inotify_fd < 0)
+		return;
+
+	if (t->watch >= 0)
+		inotify_rm_watch (t->inotify_fd, t->watch);
+	t->watch = inotify_add_watch (t->inotify_fd, t->path, IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+}
+
+/* [ tail_check_rotation ]
+ * Detect the log being rotated. A new file at the log path is opened from the
+ * start, the old one is kept around until it has been read to the end. A file
+ * truncated in place (copytruncate) is read again from the start. It may have
+ * been refilled past the old position by the time it's checked, so the file
+ * shrinking or losing the last line read also count as a truncation
+ */
+static void
+tail_check_rotation (LogTail *t)
+{
+	struct stat fd_st, path_st;
+	off_t offset;
+
+	if (fstat (t->fd, &fd_st) != 0)
+		return;
+
+	if (stat (t->path, &path_st) == 0 &&
+	    (path_st.st_ino != fd_st.st_ino || path_st.st_dev != fd_st.st_dev)) {
+		gint fd;
+
+		fd = open (t->path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return; /* Keep following the old file and try again later */
+
+		/* Rotated twice in a row, the oldest file can't grow anymore */
+		if (t->old_fd >= 0)
+			tail_retire_old (t);
+
+		t->old_fd = t->fd;
+		t->fd = fd;
+		t->last_size = 0;
+		t->mark.offset = 0;
+		t->mark.hash = 0;
+		tail_detect_format (t);
+		tail_watch (t);
+		return;
+	}
+
+	offset = lseek (t->fd, 0, SEEK_CUR);
+	if (offset > fd_st.st_size || (guint64)fd_st.st_size < t->last_size ||
+	    !checkpoint_valid (t->fd, &t->mark)) {
+		lseek (t->fd, 0, SEEK_SET);
+		t->mark.offset = 0;
+		t->mark.hash = 0;
+		/* The rest of a partially read line went with the copy */
+		g_string_truncate (t->pending, 0);
+		tail_detect_format (t);
+	}
+	t->last_size = fd_st.st_size;
+}
+
+/* [ tail_wait ]
+ * Sleep until the log or its directory is modified, or the reader is asked
+ * to stop
+ */
+static void
+tail_wait (LogTail *t)
+{
+	struct pollfd fds[2];
+	gint nfds = 1;
+	gint timeout = TAIL_POLL_INTERVAL;
+	gchar events[4096];
+
+	fds[0].fd = t->wakeup[0];
+	fds[0].events = POLLIN;
+	if (t->inotify_fd >= 0) {
+		fds[1].fd = t->inotify_fd;
+		fds[1].events = POLLIN;
+		nfds = 2;
+	}
+
+	/* A rotated log is no longer watched, but may still be written to */
+	if (t->inotify_fd >= 0 && t->watch >= 0 && t->old_fd < 0)
+		timeout = -1;
+
+	if (poll (fds, nfds, timeout) <= 0)
+		return;
+
+	/* Only the fact that the file changed matters, discard the events */
+	if (nfds == 2 && (fds[1].revents & POLLIN))
+		while (read (t->inotify_fd, events, sizeof (events)) > 0);
+}
+
+/* [ tail_thread ]
+ * The reader thread, alternates between draining the log and sleeping.
+ * Rotation is checked on every wakeup, which includes the log directory
+ * changing
+ */
+static gpointer
+tail_thread (gpointer data)
+{
+	LogTail *t = data;
+
+	while (g_atomic_int_get (&t->running)) {
+		tail_check_rotation (t);
+		tail_drain (t);
+		tail_wait (t);
+	}
+
+	return NULL;
+}
+
+/* [ open_logfile ]
+ * Open the system log and start a reader thread following it
+ */
+void
+open_logfile (const gchar *logpath)
+{
+	LogTail *t;
+	gint fd;
+
+	if (tail != NULL)
+		close_logfile ();
+
+	if (logpath == NULL || (fd = open (logpath, O_RDONLY | O_CLOEXEC)) < 0) {
 		g_warning ("Log file not found or access denied.\n"
 		           "Firewall log monitoring disabled.");
-	} else {
-		info = g_new (Parse, 1);
-		info->buffer = g_new (gchar, FILE_BUF+1);
-		info->pattern = g_pattern_spec_new ("* IN=* OUT=* SRC=* ");
-		info->handle = handle;
-		info->continuous = TRUE;
-		/* seek to the end of file and add a timeout */
-		gnome_vfs_async_seek (handle, GNOME_VFS_SEEK_END, 0, gvfs_seek_end_callback, info);
-		g_timeout_add (500, poll_log_timeout, info);
-	}
-}
-
-Hit *
-parse_log_line (gchar *line)
-{
-	struct protoent *protocol;
-	Hit *h;
-	gchar *type = NULL; // ICMP service type, not part of hit model
-
-	h = g_new0 (Hit, 1);
-
-	/* Take 15 first characters as timestamp */
-	h->time = g_strndup (line, 15);
-
-	h->direction = g_strstrip (get_text_between (line, "kernel:", "IN"));
-	h->in = get_text_between (line, "IN=", " ");
-	h->out = get_text_between (line, "OUT=", " ");
-	h->source = get_text_between (line, "SRC=", " ");
-	h->destination = get_text_between (line, "DST=", " ");
-	h->length = get_text_between (line, "LEN=", " ");
-	h->tos = get_text_between (line, "TOS=", " ");
-	h->protocol = get_text_between (line, "PROTO=", " ");
-	type = get_text_between (line, "TYPE=", " ");
-	h->port = get_text_between (line, "DPT=", " ");
-
-	/* If the protocol is a number we do a protocol name lookup */
-	if (h->protocol != NULL)
-		if (g_ascii_isdigit(h->protocol[0])) {
-			protocol = getprotobynumber (atoi (h->protocol));
-			if (protocol != NULL) {
-				g_free (h->protocol);
-				h->protocol = g_utf8_strup (protocol->p_name, -1);
-			}
+		return;
+	}
+
+	t = g_new0 (LogTail, 1);
+	t->path = g_strdup (logpath);
+	t->fd = fd;
+	t->old_fd = -1;
+	t->watch = -1;
+	t->dir_watch = -1;
+	t->buffer = g_new (gchar, TAIL_BUF);
+	t->pending = g_string_sized_new (TAIL_BUF);
+
+	if (pipe (t->wakeup) != 0) {
+		g_warning ("Failed to create the log reader pipe: %s", g_strerror (errno));
+		close (fd);
+		g_string_free (t->pending, TRUE);
+		g_free (t->buffer);
+		g_free (t->path);
+		g_free (t);
+		return;
+	}
+
+	t->inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+	if (t->inotify_fd >= 0) {
+		gchar *dir = g_path_get_dirname (logpath);
+
+		tail_watch (t);
+		t->dir_watch = inotify_add_watch (t->inotify_fd, dir, IN_CREATE | IN_MOVED_TO);
+		g_free (dir);
+
+		if (t->watch < 0 || t->dir_watch < 0) {
+			close (t->inotify_fd);
+			t->inotify_fd = -1;
 		}
+	}
+	if (t->inotify_fd < 0)
+		g_warning ("inotify not available, polling %s for changes", logpath);
+
+	/* The lines already in the log tell what format it's written in */
+	tail_detect_format (t);
 
-	/* Determine service used based on the port and protocol */
-	if (type != "" && strcmp (h->protocol, "icmp") == 0) {
-		h->service = service_get_icmp_name (atoi (type));
-	} else if (h->port != NULL && h->protocol != NULL)
-		h->service = service_get_name (atoi (h->port), g_strdup (h->protocol));
+	tail_resume (t);
+	if (t->old_fd < 0 && checkpoint_at (t->fd, &checkpoint))
+		checkpoint_changed = TRUE;
+	checkpoint_timeout = g_timeout_add_seconds (CHECKPOINT_INTERVAL, checkpoint_timeout_func, NULL);
 
-	g_free (type);
-	return h;
+	t->running = TRUE;
+	t->thread = g_thread_new ("logread", tail_thread, t);
+	tail = t;
 }
 
-/* [ open_logfile ]
- * Open the system log and attach a reader function with a timeout
+/* [ close_logfile ]
+ * Stop the reader thread and close the system log
  */
 void
-open_logfile (char *logpath) {
-	GnomeVFSAsyncHandle *handle;
+close_logfile (void)
+{
+	if (tail == NULL)
+		return;
+
+	g_atomic_int_set (&tail->running, FALSE);
+	if (write (tail->wakeup[1], "", 1) != 1)
+		g_warning ("Failed to wake up the log reader");
+	g_thread_join (tail->thread);
+
+	g_source_remove (checkpoint_timeout);
+	checkpoint_timeout = 0;
+	save_checkpoint ();
+
+	if (tail->inotify_fd >= 0)
+		close (tail->inotify_fd);
+	close (tail->wakeup[0]);
+	close (tail->wakeup[1]);
+	if (tail->old_fd >= 0)
+		close (tail->old_fd);
+	close (tail->fd);
 
-	gnome_vfs_async_open(&handle, logpath, GNOME_VFS_OPEN_READ, GNOME_VFS_PRIORITY_DEFAULT,
-	                     gvfs_open_callback, NULL);
+	g_string_free (tail->pending, TRUE);
+	g_free (tail->buffer);
+	g_free (tail->path);
+	g_free (tail);
+	tail = NULL;
 }
@@ -16,26 +16,36 @@
 #include <gnome.h>
 #include <libgnomevfs/gnome-vfs.h>
 #include "fortified.h"
+#include "logparse.h"
 
 #define FILE_BUF 4096
 
-void open_logfile (char *logpath);
+void open_logfile (const gchar *logpath);
+void close_logfile (void);
+
+gboolean logread_parse_buffer (const gchar *buffer, gsize length, LogFormat format, time_t anchor);
+
+typedef struct _LogMap LogMap;
+
+LogMap *logread_map_open_range (const gchar *path, time_t from, time_t to);
+LogMap *logread_map_open_reverse (const gchar *path);
+gboolean logread_map_parse_step (LogMap *map);
+gboolean logread_map_get_covered (LogMap *map, guint64 *start, guint64 *end, guint32 *hash);
+void logread_map_close (LogMap *map);
 
 void logread_async_read_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult result, gpointer buffer,
                                   GnomeVFSFileSize bytes_requested, GnomeVFSFileSize bytes_read, gpointer data);
 
-Hit *parse_log_line (gchar *line);
-
 typedef struct _Parse Parse;
 struct _Parse
 {
 	gchar *buffer;
-	GPatternSpec *pattern;
-	int half_line;
+	GString *pending; /* Trailing bytes of an unterminated line */
 	GnomeVFSFileSize size;
 	GnomeVFSFileSize bytes_read;
 	GnomeVFSAsyncHandle *handle;
-	gboolean continuous;
+	LogFormat format; /* Detected from the first read */
+	time_t anchor; /* When the file was last modified, completes syslog times */
 };
 
 #endif
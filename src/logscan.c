@@ -0,0 +1,226 @@
+/*---[ logscan.c ]----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Vectorized scanning of log buffers for firewall lines
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+
+#include "logscan.h"
+
+/* The vectorized scanners need GCC style function multiversioning */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SCAN_SIMD
+#include <immintrin.h>
+#endif
+
+#define MARKER "IN="
+#define MARKER_LEN 3
+
+typedef gsize (*ScanFunc) (const gchar *buffer, gsize length, LogScanFunc func, gpointer data);
+
+/* [ line_has_marker ]
+ * Test if a line, not null terminated, contains the IN= marker
+ */
+static gboolean
+line_has_marker (const gchar *line, gsize length)
+{
+	const gchar *end = line+length;
+
+	while ((gsize)(end-line) >= MARKER_LEN) {
+		line = memchr (line, MARKER[0], end-line - MARKER_LEN + 1);
+		if (line == NULL)
+			return FALSE;
+		if (memcmp (line, MARKER, MARKER_LEN) == 0)
+			return TRUE;
+		line++;
+	}
+
+	return FALSE;
+}
+
+/* [ scan_scalar ]
+ * Portable scanner, split lines with memchr and search each one for the marker.
+ * Return the number of bytes consumed, which is always the whole buffer
+ */
+static gsize
+scan_scalar (const gchar *buffer, gsize length, LogScanFunc func, gpointer data)
+{
+	const gchar *line = buffer;
+	const gchar *end = buffer+length;
+
+	while (line < end) {
+		const gchar *eol;
+
+		eol = memchr (line, '\n', end-line);
+		if (eol == NULL)
+			eol = end;
+
+		if (line_has_marker (line, eol-line))
+			func (line, eol-line, data);
+		line = eol+1;
+	}
+
+	return length;
+}
+
+#ifdef HAVE_SCAN_SIMD
+
+/* [ scan_masks ]
+ * Walk the newline and marker bit masks of one block. Each bit stands for a
+ * byte at block+bit. Return the start of the line still open at the end of
+ * the block, and whether that line has a marker so far in has_marker
+ */
+static inline const gchar *
+scan_masks (const gchar *block, guint64 newlines, guint64 markers,
+            const gchar *line, gboolean *has_marker, LogScanFunc func, gpointer data)
+{
+	while (newlines != 0) {
+		gint bit = __builtin_ctzll (newlines);
+		guint64 before = (G_GUINT64_CONSTANT (1) << bit) - 1;
+		const gchar *eol = block+bit;
+
+		if (*has_marker || (markers & before))
+			func (line, eol-line, data);
+
+		line = eol+1;
+		*has_marker = FALSE;
+		markers &= ~before;
+		newlines &= newlines - 1;
+	}
+
+	if (markers != 0)
+		*has_marker = TRUE;
+
+	return line;
+}
+
+/* [ scan_sse2 ]
+ * Scan 16 bytes at a time for newlines and the marker. Return the number of
+ * bytes consumed, always ending on a line boundary
+ */
+__attribute__ ((target ("sse2")))
+static gsize
+scan_sse2 (const gchar *buffer, gsize length, LogScanFunc func, gpointer data)
+{
+	const __m128i newline = _mm_set1_epi8 ('\n');
+	const __m128i m0 = _mm_set1_epi8 (MARKER[0]);
+	const __m128i m1 = _mm_set1_epi8 (MARKER[1]);
+	const __m128i m2 = _mm_set1_epi8 (MARKER[2]);
+	const gchar *line = buffer;
+	const gchar *p = buffer;
+	gboolean has_marker = FALSE;
+
+	/* The marker compares look up to two bytes past the block */
+	while ((gsize)(buffer+length - p) >= 16 + MARKER_LEN - 1) {
+		__m128i v0 = _mm_loadu_si128 ((const __m128i *)p);
+		__m128i v1 = _mm_loadu_si128 ((const __m128i *)(p+1));
+		__m128i v2 = _mm_loadu_si128 ((const __m128i *)(p+2));
+		guint64 newlines, markers;
+
+		newlines = (guint) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v0, newline));
+		markers = (guint) _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (v0, m0),
+		                                     _mm_and_si128 (_mm_cmpeq_epi8 (v1, m1),
+		                                                    _mm_cmpeq_epi8 (v2, m2))));
+		if (newlines | markers)
+			line = scan_masks (p, newlines, markers, line, &has_marker, func, data);
+		p += 16;
+	}
+
+	return line - buffer;
+}
+
+/* [ scan_avx2 ]
+ * Scan 32 bytes at a time for newlines and the marker. Return the number of
+ * bytes consumed, always ending on a line boundary
+ */
+__attribute__ ((target ("avx2")))
+static gsize
+scan_avx2 (const gchar *buffer, gsize length, LogScanFunc func, gpointer data)
+{
+	const __m256i newline = _mm256_set1_epi8 ('\n');
+	const __m256i m0 = _mm256_set1_epi8 (MARKER[0]);
+	const __m256i m1 = _mm256_set1_epi8 (MARKER[1]);
+	const __m256i m2 = _mm256_set1_epi8 (MARKER[2]);
+	const gchar *line = buffer;
+	const gchar *p = buffer;
+	gboolean has_marker = FALSE;
+
+	while ((gsize)(buffer+length - p) >= 32 + MARKER_LEN - 1) {
+		__m256i v0 = _mm256_loadu_si256 ((const __m256i *)p);
+		__m256i v1 = _mm256_loadu_si256 ((const __m256i *)(p+1));
+		__m256i v2 = _mm256_loadu_si256 ((const __m256i *)(p+2));
+		guint64 newlines, markers;
+
+		newlines = (guint) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v0, newline));
+		markers = (guint) _mm256_movemask_epi8 (_mm256_and_si256 (_mm256_cmpeq_epi8 (v0, m0),
+		                                        _mm256_and_si256 (_mm256_cmpeq_epi8 (v1, m1),
+		                                                          _mm256_cmpeq_epi8 (v2, m2))));
+		if (newlines | markers)
+			line = scan_masks (p, newlines, markers, line, &has_marker, func, data);
+		p += 32;
+	}
+
+	return line - buffer;
+}
+
+#endif /* HAVE_SCAN_SIMD */
+
+/* [ get_scanner ]
+ * Pick the fastest scanner the CPU supports, the choice is made once
+ */
+static ScanFunc
+get_scanner (void)
+{
+	static ScanFunc scanner = NULL;
+
+	if (scanner == NULL) {
+		scanner = scan_scalar;
+#ifdef HAVE_SCAN_SIMD
+		__builtin_cpu_init ();
+		if (__builtin_cpu_supports ("avx2"))
+			scanner = scan_avx2;
+		else if (__builtin_cpu_supports ("sse2"))
+			scanner = scan_sse2;
+#endif
+	}
+
+	return scanner;
+}
+
+/* [ logscan_last_newline ]
+ * Return a pointer to the last newline in a buffer, or NULL if there is none
+ */
+const gchar *
+logscan_last_newline (const gchar *buffer, gsize length)
+{
+	while (length > 0) {
+		if (buffer[--length] == '\n')
+			return buffer+length;
+	}
+
+	return NULL;
+}
+
+/* [ logscan_candidates ]
+ * Split a buffer into lines in a single pass, calling func only for the lines
+ * containing the IN= marker. Everything else is rejected without being parsed
+ */
+void
+logscan_candidates (const gchar *buffer, gsize length, LogScanFunc func, gpointer data)
+{
+	ScanFunc scanner = get_scanner ();
+	gsize done;
+
+	done = scanner (buffer, length, func, data);
+
+	/* The vector scanners leave the last partial block to the scalar one */
+	if (done < length)
+		scan_scalar (buffer+done, length-done, func, data);
+}
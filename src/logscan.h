@@ -0,0 +1,24 @@
+/*---[ logscan.h ]----------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Vectorized scanning of log buffers for firewall lines
+ *--------------------------------------------------------------------*/
+
+#ifndef _FORTIFIED_LOGSCAN
+#define _FORTIFIED_LOGSCAN
+
+#include <config.h>
+#include <gnome.h>
+
+/* Called for every line that may have been written by the LOG target */
+typedef void (*LogScanFunc) (const gchar *line, gsize length, gpointer data);
+
+void logscan_candidates (const gchar *buffer, gsize length, LogScanFunc func, gpointer data);
+const gchar *logscan_last_newline (const gchar *buffer, gsize length);
+
+#endif
@@ -13,6 +13,7 @@
 #include "fortified.h"
 #include "wizard.h"
 #include "savelog.h"
+#include "reloadrange.h"
 #include "preferences.h"
 #include "gui.h"
 #include "hitview.h"
@@ -60,6 +61,7 @@ static GtkActionEntry entries[] = {
 /*F12*/	{ "SaveEventList", GTK_STOCK_SAVE, N_("_Save List"), "F12", N_("Save the events to a file"), savelog_show_dialog },
 /*L*/	{ "ClearEventList", GTK_STOCK_CLEAR, N_("_Clear"), "<control>L", N_("Clear the events"), hitview_clear },
 	{ "ReloadEventList", GTK_STOCK_REFRESH, N_("_Reload"), NULL, N_("Reload the events"), hitview_reload },
+	{ "ReloadEventRange", NULL, N_("Reload _Time Range..."), NULL, N_("Reload the events logged in a time range"), reloadrange_show_dialog },
 	{ "CancelReloadEventList", GTK_STOCK_STOP, N_("_Cancel"), NULL, N_("Cancel reloading the events"), hitview_reload_cancel },
 
 	{ "RemoveRule", GTK_STOCK_REMOVE, N_("_Remove Rule"), NULL, N_("Remove the selected rule"), policyview_remove_rule },
@@ -86,7 +88,7 @@ static GtkActionEntry entries[] = {
 };
 
 /* Toggle items */
-#define NUM_SHOW_TOGGLES 11
+#define NUM_SHOW_TOGGLES 14
 static GtkToggleActionEntry toggle_entries[] = {
 	{ "ShowCol0", NULL, N_("Time"), "<control>1", N_("Show time column"), NULL, FALSE },
 	{ "ShowCol1", NULL, N_("Direction"), "<control>2", N_("Show direction column"), NULL, FALSE },
@@ -99,6 +101,9 @@ static GtkToggleActionEntry toggle_entries[] = {
 	{ "ShowCol8", NULL, N_("ToS"), "<control>9", N_("Show port column"), NULL, FALSE },
 	{ "ShowCol9", NULL, N_("Protocol"), "<control>0", N_("Show port column"), NULL, FALSE },
 	{ "ShowCol10", NULL, N_("Service"), "<control>plus", N_("Show port column"), NULL, FALSE },
+	{ "ShowCol11", NULL, N_("Count"), NULL, N_("Show count column"), NULL, FALSE },
+	{ "ShowCol12", NULL, N_("Last Seen"), NULL, N_("Show last seen column"), NULL, FALSE },
+	{ "ShowCol13", NULL, N_("Bytes"), NULL, N_("Show bytes column"), NULL, FALSE },
 };
 
 static const char *ui_description =
@@ -121,6 +126,7 @@ static const char *ui_description =
 	"    <menu action='EventsMenu'>"
 	"      <menuitem action='ClearEventList'/>"
 	"      <menuitem action='ReloadEventList'/>"
+	"      <menuitem action='ReloadEventRange'/>"
 	"      <separator name='1'/>"
 	"      <menuitem action='SaveEventList'/>"
 	"      <separator name='2' />"
@@ -136,6 +142,9 @@ static const char *ui_description =
 	"        <menuitem action='ShowCol8'/>"
 	"        <menuitem action='ShowCol9'/>"
 	"        <menuitem action='ShowCol10'/>"
+	"        <menuitem action='ShowCol11'/>"
+	"        <menuitem action='ShowCol12'/>"
+	"        <menuitem action='ShowCol13'/>"
 	"      </menu>"
 	"    </menu>"
 	"    <menu action='PolicyMenu'>"
@@ -418,6 +427,9 @@ menus_initialize (GtkWidget *window)
 	toggle_entries[8].is_active = preferences_get_bool (PREFS_HITVIEW_TOS_COL);
 	toggle_entries[9].is_active = preferences_get_bool (PREFS_HITVIEW_PROTOCOL_COL);
 	toggle_entries[10].is_active = preferences_get_bool (PREFS_HITVIEW_SERVICE_COL);
+	toggle_entries[11].is_active = preferences_get_bool (PREFS_HITVIEW_COUNT_COL);
+	toggle_entries[12].is_active = preferences_get_bool (PREFS_HITVIEW_LAST_SEEN_COL);
+	toggle_entries[13].is_active = preferences_get_bool (PREFS_HITVIEW_BYTES_COL);
 
 	gtk_action_group_add_toggle_actions (action_group, toggle_entries, G_N_ELEMENTS (toggle_entries), NULL);
 
@@ -502,6 +514,17 @@ menus_events_clear_enabled (gboolean enabled)
 	g_object_set (G_OBJECT (action), "sensitive", enabled, NULL);
 }
 
+void
+menus_events_reload_enabled (gboolean enabled)
+{
+	GtkAction *action;
+
+	action = gtk_ui_manager_get_action (ui_manager, "/MainMenu/EventsMenu/ReloadEventList");
+	g_object_set (G_OBJECT (action), "sensitive", enabled, NULL);
+	action = gtk_ui_manager_get_action (ui_manager, "/MainMenu/EventsMenu/ReloadEventRange");
+	g_object_set (G_OBJECT (action), "sensitive", enabled, NULL);
+}
+
 void
 menus_policy_edit_enabled (gboolean enabled)
 {
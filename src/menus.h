@@ -29,6 +29,7 @@ GtkWidget *menus_get_connections_context_menu (void);
 
 void menus_events_save_enabled (gboolean sensitive);
 void menus_events_clear_enabled (gboolean sensitive);
+void menus_events_reload_enabled (gboolean sensitive);
 
 void menus_policy_edit_enabled (gboolean sensitive);
 void menus_policy_remove_enabled (gboolean sensitive);
@@ -396,6 +396,9 @@ write_netfilter_script (void)
 	fprintf (script, "$MPB ipt_TOS 2> /dev/null\n");
 	fprintf (script, "$MPB ipt_MASQUERADE 2> /dev/null\n");
 	fprintf (script, "$MPB ipt_LOG 2> /dev/null\n");
+	fprintf (script, "if [ \"$NFLOG\" = \"on\" ]; then\n"
+			 "	$MPB xt_NFLOG 2> /dev/null\n"
+			 "fi\n");
 	fprintf (script, "$MPB iptable_mangle 2> /dev/null\n");
 	fprintf (script, "$MPB ipt_ipv4optsstrip 2> /dev/null\n");
 	fprintf (script, "if [ \"$NAT\" = \"on\" ]; then\n"
@@ -425,11 +428,27 @@ write_netfilter_script (void)
 			 "	return %d\n"
 			 "fi\n\n", RETURN_NO_IPTABLES);
 
-	fprintf (script, "# Logging support check\n"
-			 "log_supported=1\n"
-			 "if [ \"`$IPT -A test -j LOG 2>&1`\" ]; then\n"
-			 "	echo Warning: Logging not supported by kernel, you will recieve no firewall event updates.\n"
-			 "	log_supported=\"\"\n"
+	fprintf (script, "# Logging support check, NFLOG falls back on the system log.\n"
+			 "# The target used is recorded for the GUI in $LOG_TARGET_NAME\n"
+			 "log_supported=\"\"\n"
+			 "LOG_TARGET=\"LOG --log-level=$LOG_LEVEL --log-prefix\"\n"
+			 "LOG_TARGET_NAME=LOG\n"
+			 "if [ \"$NFLOG\" = \"on\" ]; then\n"
+			 "	if [ \"`$IPT -A test -j NFLOG --nflog-group $NFLOG_GROUP 2>&1`\" ]; then\n"
+			 "		echo Warning: NFLOG not supported by kernel, logging to the system log instead.\n"
+			 "	else\n"
+			 "		log_supported=1\n"
+			 "		LOG_TARGET=\"NFLOG --nflog-group $NFLOG_GROUP --nflog-threshold $NFLOG_THRESHOLD --nflog-prefix\"\n"
+			 "		LOG_TARGET_NAME=NFLOG\n"
+			 "	fi\n"
+			 "fi\n"
+			 "if [ -z \"$log_supported\" ]; then\n"
+			 "	log_supported=1\n"
+			 "	if [ \"`$IPT -A test -j LOG 2>&1`\" ]; then\n"
+			 "		echo Warning: Logging not supported by kernel, you will recieve no firewall event updates.\n"
+			 "		log_supported=\"\"\n"
+			 "		LOG_TARGET_NAME=\"\"\n"
+			 "	fi\n"
 			 "fi\n\n");
 
 	fprintf (script, "if [ \"$NAT\" = \"on\" ]; then\n"
@@ -506,16 +525,16 @@ write_netfilter_script (void)
 	                 "$IPT -A LSI -j LOG_FILTER\n"
 	                 "if [ \"$log_supported\" ]; then\n"
 	                 "	# Syn-flood protection\n"
-	                 "	$IPT -A LSI -p tcp --syn -m limit --limit 1/s -j LOG --log-level=$LOG_LEVEL --log-prefix \"Inbound \"\n"
+	                 "	$IPT -A LSI -p tcp --syn -m limit --limit 1/s -j $LOG_TARGET \"Inbound \"\n"
 	                 "	$IPT -A LSI -p tcp --syn -j $STOP_TARGET\n"
 	                 "	# Rapid portscan protection\n"
-	                 "	$IPT -A LSI -p tcp --tcp-flags SYN,ACK,FIN,RST RST -m limit --limit 1/s -j LOG --log-level=$LOG_LEVEL --log-prefix \"Inbound \"\n"
+	                 "	$IPT -A LSI -p tcp --tcp-flags SYN,ACK,FIN,RST RST -m limit --limit 1/s -j $LOG_TARGET \"Inbound \"\n"
 	                 "	$IPT -A LSI -p tcp --tcp-flags SYN,ACK,FIN,RST RST -j $STOP_TARGET\n"
 	                 "	# Ping of death protection\n"
-	                 "	$IPT -A LSI -p icmp --icmp-type echo-request -m limit --limit 1/s -j LOG --log-level=$LOG_LEVEL --log-prefix \"Inbound \"\n"
+	                 "	$IPT -A LSI -p icmp --icmp-type echo-request -m limit --limit 1/s -j $LOG_TARGET \"Inbound \"\n"
 	                 "	$IPT -A LSI -p icmp --icmp-type echo-request -j $STOP_TARGET\n"
 	                 "	# Log everything\n"
-	                 "	$IPT -A LSI -m limit --limit 5/s -j LOG --log-level=$LOG_LEVEL --log-prefix \"Inbound \"\n"
+	                 "	$IPT -A LSI -m limit --limit 5/s -j $LOG_TARGET \"Inbound \"\n"
 	                 "fi\n"
 	                 "$IPT -A LSI -j $STOP_TARGET # Terminate evaluation\n\n");
 
@@ -525,7 +544,7 @@ write_netfilter_script (void)
 	                 "$IPT -A LSO -j LOG_FILTER\n"
 	                 "if [ \"$log_supported\" ]; then\n"
 	                 "	# Log everything\n"
-	                 "	$IPT -A LSO -m limit --limit 5/s -j LOG --log-level=$LOG_LEVEL --log-prefix \"Outbound \"\n"
+	                 "	$IPT -A LSO -m limit --limit 5/s -j $LOG_TARGET \"Outbound \"\n"
 	                 "fi\n"
 	                 "$IPT -A LSO -j REJECT # Terminate evaluation\n\n");
 
@@ -789,11 +808,11 @@ write_netfilter_script (void)
 
 	fprintf (script, "\n# --------( Unsupported Traffic Catch-All )--------\n\n"
 			 "$IPT -A INPUT -j LOG_FILTER\n"
-			 "$IPT -A INPUT -j LOG --log-level=$LOG_LEVEL --log-prefix \"Unknown Input\"\n"
+			 "$IPT -A INPUT -j $LOG_TARGET \"Unknown Input\"\n"
 			 "$IPT -A OUTPUT -j LOG_FILTER\n"
-			 "$IPT -A OUTPUT -j LOG --log-level=$LOG_LEVEL --log-prefix \"Unknown Output\"\n"
+			 "$IPT -A OUTPUT -j $LOG_TARGET \"Unknown Output\"\n"
 			 "$IPT -A FORWARD -j LOG_FILTER\n"
-			 "$IPT -A FORWARD -j LOG --log-level=$LOG_LEVEL --log-prefix \"Unknown Forward\"\n\n");
+			 "$IPT -A FORWARD -j $LOG_TARGET \"Unknown Forward\"\n\n");
 
 	fprintf (script, "return 0\n");
 
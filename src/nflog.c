@@ -0,0 +1,381 @@
+/*---[ nflog.c ]------------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Event source receiving packets from the NFLOG target over netlink
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_log.h>
+
+#include "nflog.h"
+#include "hitview.h"
+#include "statusview.h"
+#include "util.h"
+
+#define NFLOG_BUF 65536 /* A single receive can hold a whole batch of packets */
+#define NFLOG_COPY_RANGE 128 /* Only the IP and transport headers are needed */
+#define NFLOG_FLUSH_TIMEOUT 10 /* Hundredths of a second before a partial batch is sent */
+
+static gint nflog_fd = -1;
+static guint nflog_watch = 0;
+static guint16 nflog_group;
+static gchar *nflog_buffer = NULL;
+
+/* [ add_attr ]
+ * Append a netlink attribute to a message being built
+ */
+static void
+add_attr (struct nlmsghdr *nlh, guint16 type, const void *data, gsize length)
+{
+	struct nlattr *attr = (struct nlattr *)((gchar *)nlh + NLMSG_ALIGN (nlh->nlmsg_len));
+
+	attr->nla_type = type;
+	attr->nla_len = NLA_HDRLEN + length;
+	memcpy ((gchar *)attr + NLA_HDRLEN, data, length);
+	nlh->nlmsg_len = NLMSG_ALIGN (nlh->nlmsg_len) + NLA_ALIGN (attr->nla_len);
+}
+
+/* [ send_config ]
+ * Send a configuration message for the group and wait for the kernel to
+ * acknowledge it. Return FALSE on error
+ */
+static gboolean
+send_config (guint8 family, guint16 group, guint16 type, const void *data, gsize length)
+{
+	gchar message[NLMSG_SPACE (sizeof (struct nfgenmsg) + NLA_HDRLEN + 16)];
+	struct nlmsghdr *nlh = (struct nlmsghdr *)message;
+	struct nfgenmsg *nfg;
+	gssize n;
+
+	memset (message, 0, sizeof (message));
+	nlh->nlmsg_len = NLMSG_LENGTH (sizeof (struct nfgenmsg));
+	nlh->nlmsg_type = (NFNL_SUBSYS_ULOG << 8) | NFULNL_MSG_CONFIG;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+
+	nfg = NLMSG_DATA (nlh);
+	nfg->nfgen_family = family;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons (group);
+
+	add_attr (nlh, type, data, length);
+
+	if (send (nflog_fd, message, nlh->nlmsg_len, 0) < 0)
+		return FALSE;
+
+	/* Once bound, logged packets may arrive ahead of the acknowledgement */
+	for (;;) {
+		n = recv (nflog_fd, nflog_buffer, NFLOG_BUF, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FALSE;
+
+		for (nlh = (struct nlmsghdr *)nflog_buffer; NLMSG_OK (nlh, n); nlh = NLMSG_NEXT (nlh, n)) {
+			struct nlmsgerr *err;
+
+			if (nlh->nlmsg_type != NLMSG_ERROR)
+				continue;
+
+			err = NLMSG_DATA (nlh);
+			errno = -err->error;
+			return (err->error == 0);
+		}
+	}
+}
+
+/* [ send_command ]
+ * Send a NFULA_CFG_CMD configuration command
+ */
+static gboolean
+send_command (guint8 family, guint16 group, guint8 command)
+{
+	struct nfulnl_msg_config_cmd cmd;
+
+	cmd.command = command;
+	return send_config (family, group, NFULA_CFG_CMD, &cmd, sizeof (cmd));
+}
+
+/* [ get_interface ]
+ * Interned name of a network interface, as the LOG target would print it
+ */
+static guint16
+get_interface (const struct nlattr *attr)
+{
+	gchar name[IF_NAMESIZE];
+	guint32 index;
+
+	if (attr == NULL)
+		return 0;
+
+	memcpy (&index, (const gchar *)attr + NLA_HDRLEN, sizeof (index));
+	if (if_indextoname (ntohl (index), name) == NULL)
+		return 0;
+
+	return hit_intern (name, strlen (name));
+}
+
+/* [ get_direction ]
+ * Direction of a packet, from the prefix it was logged with
+ */
+static HitDirection
+get_direction (const struct nlattr *attr)
+{
+	const gchar *prefix, *end;
+
+	if (attr == NULL)
+		return HIT_UNKNOWN;
+
+	/* Compared where it lies, without the terminator and the spaces
+	   around it */
+	prefix = (const gchar *)attr + NLA_HDRLEN;
+	end = prefix + attr->nla_len - NLA_HDRLEN;
+	while (end > prefix && (end[-1] == '\0' || g_ascii_isspace (end[-1])))
+		end--;
+	while (prefix < end && g_ascii_isspace (*prefix))
+		prefix++;
+
+	if (end - prefix == 7 && memcmp (prefix, "Inbound", 7) == 0)
+		return HIT_INBOUND;
+	if (end - prefix == 8 && memcmp (prefix, "Outbound", 8) == 0)
+		return HIT_OUTBOUND;
+
+	return HIT_UNKNOWN;
+}
+
+/* [ fill_hit ]
+ * Fill a hit directly from the attributes of a logged packet. Return FALSE
+ * if the packet isn't IPv4
+ */
+static gboolean
+fill_hit (struct nlattr *attrs[], Hit *h)
+{
+	const struct iphdr *ip;
+	const guchar *transport;
+	gsize length;
+	gint icmp_type = -1;
+
+	if (attrs[NFULA_PAYLOAD] == NULL)
+		return FALSE;
+
+	ip = (const struct iphdr *)((gchar *)attrs[NFULA_PAYLOAD] + NLA_HDRLEN);
+	length = attrs[NFULA_PAYLOAD]->nla_len - NLA_HDRLEN;
+	if (length < sizeof (struct iphdr) || ip->version != 4 || ip->ihl * 4 > length)
+		return FALSE;
+
+	memset (h, 0, sizeof (*h));
+
+	if (attrs[NFULA_TIMESTAMP] != NULL) {
+		struct nfulnl_msg_packet_timestamp stamp;
+
+		memcpy (&stamp, (gchar *)attrs[NFULA_TIMESTAMP] + NLA_HDRLEN, sizeof (stamp));
+		h->time = GUINT64_FROM_BE (stamp.sec);
+	} else
+		h->time = time (NULL);
+
+	h->direction = get_direction (attrs[NFULA_PREFIX]);
+	h->in = get_interface (attrs[NFULA_IFINDEX_INDEV]);
+	h->out = get_interface (attrs[NFULA_IFINDEX_OUTDEV]);
+	h->source = ip->saddr;
+	h->destination = ip->daddr;
+	h->length = ntohs (ip->tot_len);
+	h->tos = ip->tos;
+	h->protocol = ip->protocol;
+	h->flags = HIT_HAS_SOURCE | HIT_HAS_DESTINATION | HIT_HAS_LENGTH | HIT_HAS_TOS | HIT_HAS_PROTOCOL;
+
+	/* Fragments other than the first carry no transport header */
+	transport = (const guchar *)ip + ip->ihl * 4;
+	length -= ip->ihl * 4;
+	if ((ntohs (ip->frag_off) & 0x1FFF) != 0)
+		length = 0;
+
+	if ((ip->protocol == IPPROTO_TCP || ip->protocol == IPPROTO_UDP) && length >= 4) {
+		h->port = (transport[2] << 8) | transport[3];
+		h->flags |= HIT_HAS_PORT;
+	} else if (ip->protocol == IPPROTO_ICMP && length >= 1) {
+		icmp_type = transport[0];
+	}
+	hit_set_service (h, icmp_type);
+
+	return TRUE;
+}
+
+/* [ parse_packet ]
+ * Split a NFULNL_MSG_PACKET message into its attributes and add the hit.
+ * Return TRUE if a hit was added
+ */
+static gboolean
+parse_packet (struct nlmsghdr *nlh)
+{
+	struct nlattr *attrs[NFULA_MAX+1];
+	struct nlattr *attr;
+	gint remaining;
+	Hit h;
+
+	memset (attrs, 0, sizeof (attrs));
+
+	attr = (struct nlattr *)((gchar *)NLMSG_DATA (nlh) + NLMSG_ALIGN (sizeof (struct nfgenmsg)));
+	remaining = nlh->nlmsg_len - NLMSG_LENGTH (NLMSG_ALIGN (sizeof (struct nfgenmsg)));
+
+	while (remaining >= NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN && attr->nla_len <= remaining) {
+		gint type = attr->nla_type & NLA_TYPE_MASK;
+
+		if (type <= NFULA_MAX)
+			attrs[type] = attr;
+
+		remaining -= NLA_ALIGN (attr->nla_len);
+		attr = (struct nlattr *)((gchar *)attr + NLA_ALIGN (attr->nla_len));
+	}
+
+	/* The view copies the hits it keeps, this one can live on the stack */
+	if (!fill_hit (attrs, &h))
+		return FALSE;
+
+	return hitview_append_hit (&h);
+}
+
+/* [ nflog_event ]
+ * Called when packets are waiting on the netlink socket, add a hit for each
+ */
+static gboolean
+nflog_event (GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+	gboolean added = FALSE;
+	gssize n;
+
+	while ((n = recv (nflog_fd, nflog_buffer, NFLOG_BUF, MSG_DONTWAIT)) > 0) {
+		struct nlmsghdr *nlh = (struct nlmsghdr *)nflog_buffer;
+
+		for (; NLMSG_OK (nlh, n); nlh = NLMSG_NEXT (nlh, n)) {
+			if (nlh->nlmsg_type == ((NFNL_SUBSYS_ULOG << 8) | NFULNL_MSG_PACKET) &&
+			    parse_packet (nlh))
+				added = TRUE;
+		}
+	}
+
+	/* The socket buffer overflowed and packets were dropped, keep going */
+	if (n < 0 && errno == ENOBUFS)
+		g_warning ("NFLOG receive buffer overrun, some events were lost");
+
+	if (added && !hitview_reload_in_progress ())
+		status_set_state (STATUS_HIT);
+
+	return TRUE;
+}
+
+/* [ configure_group ]
+ * Bind the socket to a NFLOG group and set up copying and batching
+ */
+static gboolean
+configure_group (guint16 group, guint32 threshold)
+{
+	struct nfulnl_msg_config_mode mode;
+	struct sockaddr_nl addr;
+	guint32 value;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.nl_family = AF_NETLINK;
+	if (bind (nflog_fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+		return FALSE;
+
+	/* Older kernels need the protocol family bound before anything else */
+	send_command (AF_INET, 0, NFULNL_CFG_CMD_PF_UNBIND);
+	if (!send_command (AF_INET, 0, NFULNL_CFG_CMD_PF_BIND) ||
+	    !send_command (AF_UNSPEC, group, NFULNL_CFG_CMD_BIND))
+		return FALSE;
+
+	memset (&mode, 0, sizeof (mode));
+	mode.copy_mode = NFULNL_COPY_PACKET;
+	mode.copy_range = htonl (NFLOG_COPY_RANGE);
+	if (!send_config (AF_UNSPEC, group, NFULA_CFG_MODE, &mode, sizeof (mode)))
+		return FALSE;
+
+	/* Failing to batch only means packets come one at a time */
+	value = htonl (MAX (threshold, 1));
+	send_config (AF_UNSPEC, group, NFULA_CFG_QTHRESH, &value, sizeof (value));
+	value = htonl (NFLOG_FLUSH_TIMEOUT);
+	send_config (AF_UNSPEC, group, NFULA_CFG_TIMEOUT, &value, sizeof (value));
+
+	return TRUE;
+}
+
+/* [ nflog_open ]
+ * Bind to a NFLOG group and start receiving logged packets, which the kernel
+ * sends in batches of threshold. Return FALSE if the group can't be bound
+ */
+gboolean
+nflog_open (guint16 group, guint32 threshold)
+{
+	GIOChannel *channel;
+
+	if (nflog_fd >= 0)
+		nflog_close ();
+
+	nflog_fd = socket (AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+	if (nflog_fd < 0) {
+		g_warning ("Failed to open the NFLOG socket: %s", g_strerror (errno));
+		return FALSE;
+	}
+
+	nflog_buffer = g_new (gchar, NFLOG_BUF);
+
+	if (!configure_group (group, threshold)) {
+		g_warning ("Failed to bind to NFLOG group %d: %s", group, g_strerror (errno));
+		close (nflog_fd);
+		nflog_fd = -1;
+		g_free (nflog_buffer);
+		nflog_buffer = NULL;
+		return FALSE;
+	}
+
+	nflog_group = group;
+
+	channel = g_io_channel_unix_new (nflog_fd);
+	nflog_watch = g_io_add_watch (channel, G_IO_IN, nflog_event, NULL);
+	g_io_channel_unref (channel);
+
+	return TRUE;
+}
+
+/* [ nflog_close ]
+ * Unbind from the NFLOG group
+ */
+void
+nflog_close (void)
+{
+	if (nflog_fd < 0)
+		return;
+
+	g_source_remove (nflog_watch);
+	nflog_watch = 0;
+
+	send_command (AF_UNSPEC, nflog_group, NFULNL_CFG_CMD_UNBIND);
+	close (nflog_fd);
+	nflog_fd = -1;
+
+	g_free (nflog_buffer);
+	nflog_buffer = NULL;
+}
+
+/* [ nflog_is_active ]
+ * Test if events are being received through NFLOG
+ */
+gboolean
+nflog_is_active (void)
+{
+	return (nflog_fd >= 0);
+}
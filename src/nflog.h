@@ -0,0 +1,22 @@
+/*---[ nflog.h ]------------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Event source receiving packets from the NFLOG target over netlink
+ *--------------------------------------------------------------------*/
+
+#ifndef _FORTIFIED_NFLOG
+#define _FORTIFIED_NFLOG
+
+#include <config.h>
+#include <gnome.h>
+
+gboolean nflog_open (guint16 group, guint32 threshold);
+void nflog_close (void);
+gboolean nflog_is_active (void);
+
+#endif
@@ -1095,35 +1095,38 @@ clear_ruleview (GtkWidget *view)
 	gtk_list_store_clear (GTK_LIST_STORE (model));
 }
 
-void
-policyview_create_rule (RuleType type, Hit *h)
+/* [ create_rule ]
+ * Add a rule of a type for a service, port and host, and apply it
+ */
+static void
+create_rule (RuleType type, const gchar *service, const gchar *port, const gchar *source, const gchar *destination)
 {
 	gchar *data = NULL;
 	gchar *path = NULL;
 	GtkWidget *view = NULL;
 
 	if (type == RULETYPE_INBOUND_ALLOW_FROM) {
-		data = g_strconcat (h->source, ", ", NULL);
+		data = g_strconcat (source, ", ", NULL);
 		view = in_allow_from;
 		path = POLICY_IN_ALLOW_FROM;
 	} else if (type == RULETYPE_INBOUND_ALLOW_SERVICE) {
-		data = g_strconcat (h->service, ", ", h->port, ", everyone", ", ", NULL);
+		data = g_strconcat (service, ", ", port, ", everyone", ", ", NULL);
 		view = in_allow_service;
 		path = POLICY_IN_ALLOW_SERVICE;
 	} else if (type == RULETYPE_INBOUND_ALLOW_SERVICE_FROM) {
-		data = g_strconcat (h->service, ", ", h->port, ", ", h->source, ", ", NULL);
+		data = g_strconcat (service, ", ", port, ", ", source, ", ", NULL);
 		view = in_allow_service;
 		path = POLICY_IN_ALLOW_SERVICE;
 	} else if (type == RULETYPE_OUTBOUND_ALLOW_TO) {
-		data = g_strconcat (h->destination, ", ", NULL);
+		data = g_strconcat (destination, ", ", NULL);
 		view = out_allow_to;
 		path = POLICY_OUT_ALLOW_TO;
 	} else if (type == RULETYPE_OUTBOUND_ALLOW_SERVICE) {
-		data = g_strconcat (h->service, ", ", h->port, ", everyone", ", ", NULL);
+		data = g_strconcat (service, ", ", port, ", everyone", ", ", NULL);
 		view = out_allow_service;
 		path = POLICY_OUT_ALLOW_SERVICE;
 	} else if (type == RULETYPE_OUTBOUND_ALLOW_SERVICE_FROM) {
-		data = g_strconcat (h->service, ", ", h->port, ", ", h->source, ", ", NULL);
+		data = g_strconcat (service, ", ", port, ", ", source, ", ", NULL);
 		view = out_allow_service;
 		path = POLICY_OUT_ALLOW_SERVICE;
 	}
@@ -1137,29 +1140,24 @@ policyview_create_rule (RuleType type, Hit *h)
 	}
 }
 
+void
+policyview_create_rule (RuleType type, Hit *h)
+{
+	gchar port[HIT_TEXT_MAX], source[HIT_TEXT_MAX], destination[HIT_TEXT_MAX];
+
+	create_rule (type, hit_format (h, HIT_SERVICE, NULL), hit_format (h, HIT_PORT, port),
+	             hit_format (h, HIT_SOURCE, source), hit_format (h, HIT_DESTINATION, destination));
+}
+
 /* [ policyview_install_default_ruleset ]
  * Set some sane outbound defaults so the user doesn't lock himself out
  */
 void
 policyview_install_default_ruleset (void)
 {
-	Hit *h;
-
-	h = g_new0 (Hit, 1);
-	h->service = g_strdup ("DNS");
-	h->port = g_strdup ("53");
-	policyview_create_rule (RULETYPE_OUTBOUND_ALLOW_SERVICE, h);
-	free_hit (h);
-	h = g_new0 (Hit, 1);
-	h->service = g_strdup ("HTTP");
-	h->port = g_strdup ("80");
-	policyview_create_rule (RULETYPE_OUTBOUND_ALLOW_SERVICE, h);
-	free_hit (h);
-	h = g_new0 (Hit, 1);
-	h->service = g_strdup ("DHCP");
-	h->port = g_strdup ("67-68");
-	policyview_create_rule (RULETYPE_OUTBOUND_ALLOW_SERVICE, h);
-	free_hit (h);
+	create_rule (RULETYPE_OUTBOUND_ALLOW_SERVICE, "DNS", "53", NULL, NULL);
+	create_rule (RULETYPE_OUTBOUND_ALLOW_SERVICE, "HTTP", "80", NULL, NULL);
+	create_rule (RULETYPE_OUTBOUND_ALLOW_SERVICE, "DHCP", "67-68", NULL, NULL);
 }
 
 static GtkWidget *
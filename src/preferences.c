@@ -26,6 +26,7 @@
 #include "service.h"
 #include "tray.h"
 #include "dhcp-server.h"
+#include "hitview.h"
 
 typedef enum
 {
@@ -53,6 +54,10 @@ struct _PreferencesDialog
 /* Events */
 	GtkWidget *check_skip_redundant;
 	GtkWidget *check_skip_not_for_firewall;
+	GtkWidget *check_aggregate;
+	GtkWidget *spin_aggregate_window;
+	GtkWidget *spin_max_events;
+	GtkWidget *spin_max_events_memory;
 
 	GtkWidget *window_host_filter;
 	GtkWidget *window_port_filter;
@@ -177,6 +182,15 @@ preferences_get_bool (const gchar *gconf_key)
 	return gconf_client_get_bool (client, gconf_key, NULL);
 }
 
+gint
+preferences_get_int (const gchar *gconf_key)
+{
+	if (!prefs_init)
+		preferences_init ();
+
+	return gconf_client_get_int (client, gconf_key, NULL);
+}
+
 gchar *
 preferences_get_string (const gchar *gconf_key)
 {
@@ -201,6 +215,17 @@ preferences_set_bool (const gchar *gconf_key, gboolean data)
 	gconf_client_set_bool (client, gconf_key, data, NULL);
 }
 
+void
+preferences_set_int (const gchar *gconf_key, gint data)
+{
+	g_return_if_fail (gconf_key);
+
+	if (!prefs_init)
+		preferences_init ();
+
+	gconf_client_set_int (client, gconf_key, data, NULL);
+}
+
 void
 preferences_set_string (const gchar *gconf_key, const gchar *data)
 {
@@ -509,6 +534,8 @@ setup_events_section (PreferencesDialog *dialog)
 			{_("Ports"), G_TYPE_STRING, TRUE},
 		}
 	};
+
+	gui_widget_sensitivity_sync (GTK_TOGGLE_BUTTON (dialog->check_aggregate), dialog->spin_aggregate_window);
 	
 	/* Set up list of filtered hosts */
 	window = dialog->window_host_filter;
@@ -578,7 +605,12 @@ setup_tos_section (PreferencesDialog *dialog)
 void
 preferences_update_widget_from_conf (GtkWidget *widget, const gchar *gconf_key)
 {
-	if (GTK_IS_ENTRY (widget)) {
+	if (GTK_IS_SPIN_BUTTON (widget)) {
+		gint value;
+
+		value = preferences_get_int (gconf_key);
+		gtk_spin_button_set_value (GTK_SPIN_BUTTON (widget), value);
+	} else if (GTK_IS_ENTRY (widget)) {
 		gchar *data;
 
 		data = preferences_get_string (gconf_key);
@@ -599,7 +631,12 @@ preferences_update_widget_from_conf (GtkWidget *widget, const gchar *gconf_key)
 void
 preferences_update_conf_from_widget (GtkWidget *widget, const gchar *gconf_key)
 {
-	if (GTK_IS_ENTRY (widget)) {
+	if (GTK_IS_SPIN_BUTTON (widget)) {
+		gint value;
+
+		value = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+		preferences_set_int (gconf_key, value);
+	} else if (GTK_IS_ENTRY (widget)) {
 		const gchar *data;
 
 		data = gtk_entry_get_text (GTK_ENTRY (widget));
@@ -691,6 +728,11 @@ load_preferences (PreferencesDialog *dialog)
 	/* Events */
 	preferences_update_widget_from_conf (dialog->check_skip_redundant, PREFS_SKIP_REDUNDANT);
 	preferences_update_widget_from_conf (dialog->check_skip_not_for_firewall, PREFS_SKIP_NOT_FOR_FIREWALL);
+	preferences_update_widget_from_conf (dialog->check_aggregate, PREFS_AGGREGATE);
+	preferences_update_widget_from_conf (dialog->spin_aggregate_window, PREFS_AGGREGATE_WINDOW);
+	gtk_widget_set_sensitive (dialog->spin_aggregate_window, preferences_get_bool (PREFS_AGGREGATE));
+	preferences_update_widget_from_conf (dialog->spin_max_events, PREFS_MAX_EVENTS);
+	preferences_update_widget_from_conf (dialog->spin_max_events_memory, PREFS_MAX_EVENTS_MEMORY);
 	
 	/* Policy */
 	preferences_update_widget_from_conf (dialog->check_apply_policy_instantly, PREFS_APPLY_POLICY_INSTANTLY);
@@ -768,6 +810,11 @@ save_preferences (PreferencesDialog *dialog)
 	/* Events */
 	preferences_update_conf_from_widget (dialog->check_skip_redundant, PREFS_SKIP_REDUNDANT);
 	preferences_update_conf_from_widget (dialog->check_skip_not_for_firewall, PREFS_SKIP_NOT_FOR_FIREWALL);
+	preferences_update_conf_from_widget (dialog->check_aggregate, PREFS_AGGREGATE);
+	preferences_update_conf_from_widget (dialog->spin_aggregate_window, PREFS_AGGREGATE_WINDOW);
+	preferences_update_conf_from_widget (dialog->spin_max_events, PREFS_MAX_EVENTS);
+	preferences_update_conf_from_widget (dialog->spin_max_events_memory, PREFS_MAX_EVENTS_MEMORY);
+	hitview_apply_limits ();
 	
 	/* Policy */
 	preferences_update_conf_from_widget (dialog->check_apply_policy_instantly, PREFS_APPLY_POLICY_INSTANTLY);
@@ -945,6 +992,10 @@ get_preferences_dialog (GtkWindow *parent)
 	/* Set up the events section */
 	dialog->check_skip_redundant = glade_xml_get_widget (gui, "check_skip_redundant");
 	dialog->check_skip_not_for_firewall = glade_xml_get_widget (gui, "check_skip_not_for_firewall");
+	dialog->check_aggregate = glade_xml_get_widget (gui, "check_aggregate");
+	dialog->spin_aggregate_window = glade_xml_get_widget (gui, "spin_aggregate_window");
+	dialog->spin_max_events = glade_xml_get_widget (gui, "spin_max_events");
+	dialog->spin_max_events_memory = glade_xml_get_widget (gui, "spin_max_events_memory");
 
 	dialog->window_host_filter = glade_xml_get_widget (gui, "window_host_filter");
 	dialog->window_port_filter = glade_xml_get_widget (gui, "window_port_filter");
@@ -15,12 +15,18 @@
 
 #define PREFS_FIRST_RUN "/apps/fortified/client/first_run"
 #define PREFS_SYSLOG_FILE "/apps/fortified/client/system_log"
+#define PREFS_LOG_CHECKPOINT "/apps/fortified/client/system_log_checkpoint"
 
 #define PREFS_ENABLE_TRAY_ICON "/apps/fortified/client/enable_tray_icon"
 #define PREFS_MINIMIZE_TO_TRAY "/apps/fortified/client/minimize_to_tray"
 
 #define PREFS_SKIP_REDUNDANT "/apps/fortified/client/filter/redundant"
 #define PREFS_SKIP_NOT_FOR_FIREWALL "/apps/fortified/client/filter/not_for_firewall"
+#define PREFS_AGGREGATE "/apps/fortified/client/filter/aggregate"
+#define PREFS_AGGREGATE_WINDOW "/apps/fortified/client/filter/aggregate_window"
+#define PREFS_MAX_EVENTS "/apps/fortified/client/max_events"
+#define PREFS_MAX_EVENTS_MEMORY "/apps/fortified/client/max_events_memory"
+#define PREFS_EVENTS_INTERVAL "/apps/fortified/client/events_interval"
 
 #define PREFS_APPLY_POLICY_INSTANTLY "/apps/fortified/client/policy_auto_apply"
 
@@ -64,6 +70,10 @@
 
 #define PREFS_FW_RESTRICTIVE_OUTBOUND_MODE "/apps/fortified/firewall/restrictive_outbound"
 
+#define PREFS_FW_NFLOG "/apps/fortified/firewall/nflog/enable"
+#define PREFS_FW_NFLOG_GROUP "/apps/fortified/firewall/nflog/group"
+#define PREFS_FW_NFLOG_THRESHOLD "/apps/fortified/firewall/nflog/threshold"
+
 #define PREFS_HITVIEW_TIME_COL "/apps/fortified/client/ui/hitview_time_col"
 #define PREFS_HITVIEW_DIRECTION_COL "/apps/fortified/client/ui/hitview_direction_col"
 #define PREFS_HITVIEW_IN_COL "/apps/fortified/client/ui/hitview_in_col"
@@ -75,6 +85,9 @@
 #define PREFS_HITVIEW_TOS_COL "/apps/fortified/client/ui/hitview_tos_col"
 #define PREFS_HITVIEW_PROTOCOL_COL "/apps/fortified/client/ui/hitview_protocol_col"
 #define PREFS_HITVIEW_SERVICE_COL "/apps/fortified/client/ui/hitview_service_col"
+#define PREFS_HITVIEW_COUNT_COL "/apps/fortified/client/ui/hitview_count_col"
+#define PREFS_HITVIEW_LAST_SEEN_COL "/apps/fortified/client/ui/hitview_last_seen_col"
+#define PREFS_HITVIEW_BYTES_COL "/apps/fortified/client/ui/hitview_bytes_col"
 
 #include <config.h>
 #include <gnome.h>
@@ -83,6 +96,8 @@ void preferences_check_schema (void);
 
 gboolean preferences_get_bool   (const gchar *gconf_key);
 void     preferences_set_bool   (const gchar *gconf_key, gboolean data);
+gint     preferences_get_int    (const gchar *gconf_key);
+void     preferences_set_int    (const gchar *gconf_key, gint data);
 gchar   *preferences_get_string (const gchar *gconf_key);
 void     preferences_set_string (const gchar *gconf_key, const gchar *data);
 
@@ -0,0 +1,147 @@
+/*---[ reloadrange.c ]------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Dialog for reloading the events of a time range
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+#include <time.h>
+
+#include "reloadrange.h"
+#include "fortified.h"
+#include "globals.h"
+#include "hitview.h"
+#include "util.h"
+
+#define TIME_FORMAT "%Y-%m-%d %H:%M"
+#define DEFAULT_RANGE (60*60) /* Seconds back from now the range starts at by default */
+
+/* [ format_entry_time ]
+ * Write a time into an entry in the format the dialog reads back
+ */
+static void
+format_entry_time (GtkWidget *entry, time_t when)
+{
+	gchar text[64];
+	struct tm tm;
+
+	localtime_r (&when, &tm);
+	strftime (text, sizeof (text), TIME_FORMAT, &tm);
+	gtk_entry_set_text (GTK_ENTRY (entry), text);
+}
+
+/* [ parse_entry_time ]
+ * Read the local time typed into an entry, seconds may be left out.
+ * Return FALSE if it's not a valid time
+ */
+static gboolean
+parse_entry_time (GtkWidget *entry, time_t *when)
+{
+	const gchar *text;
+	struct tm tm;
+	gint length = 0;
+
+	memset (&tm, 0, sizeof (tm));
+	text = gtk_entry_get_text (GTK_ENTRY (entry));
+	if (sscanf (text, "%d-%d-%d %d:%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+	            &tm.tm_hour, &tm.tm_min, &length) != 5)
+		return FALSE;
+	if (text[length] == ':' && sscanf (text+length, ":%d%n", &tm.tm_sec, &length) == 1)
+		text += length;
+	if (text[length] != '\0')
+		return FALSE;
+
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	tm.tm_isdst = -1;
+	*when = mktime (&tm);
+
+	return (*when != (time_t)-1);
+}
+
+static void
+range_dialog_response_cb (GtkDialog *dialog, gint response_id, gpointer user_data)
+{
+	if (response_id == GTK_RESPONSE_ACCEPT) {
+		time_t from, to;
+
+		if (!parse_entry_time (g_object_get_data (G_OBJECT (dialog), "from"), &from) ||
+		    !parse_entry_time (g_object_get_data (G_OBJECT (dialog), "to"), &to)) {
+			show_error (_("Enter the times as year-month-day hours:minutes, eg. 2016-01-31 18:30"));
+			return;
+		}
+		if (to < from) {
+			show_error (_("The end of the time range is before its start"));
+			return;
+		}
+
+		hitview_reload_range (from, to);
+	}
+
+	gtk_widget_destroy (GTK_WIDGET (dialog));
+}
+
+/* [ add_time_entry ]
+ * Add a labeled time entry to a row of the dialog's table
+ */
+static GtkWidget *
+add_time_entry (GtkWidget *dialog, GtkWidget *table, gint row, const gchar *title, const gchar *key, time_t when)
+{
+	GtkWidget *label;
+	GtkWidget *entry;
+
+	label = gtk_label_new_with_mnemonic (title);
+	gtk_misc_set_alignment (GTK_MISC (label), 0.0, 0.5);
+	gtk_table_attach (GTK_TABLE (table), label, 0, 1, row, row+1,
+		GTK_FILL, GTK_FILL, GNOME_PAD_SMALL, GNOME_PAD_SMALL);
+
+	entry = gtk_entry_new ();
+	gtk_entry_set_activates_default (GTK_ENTRY (entry), TRUE);
+	gtk_label_set_mnemonic_widget (GTK_LABEL (label), entry);
+	format_entry_time (entry, when);
+	gtk_table_attach (GTK_TABLE (table), entry, 1, 2, row, row+1,
+		GTK_EXPAND | GTK_FILL, GTK_FILL, GNOME_PAD_SMALL, GNOME_PAD_SMALL);
+
+	g_object_set_data (G_OBJECT (dialog), key, entry);
+
+	return entry;
+}
+
+/* [ reloadrange_show_dialog ]
+ * Ask for a time range and reload the events logged in it. The range
+ * defaults to the last hour
+ */
+void
+reloadrange_show_dialog (void)
+{
+	GtkWidget *dialog;
+	GtkWidget *table;
+	time_t now = time (NULL);
+
+	dialog = gtk_dialog_new_with_buttons (_("Reload Time Range"),
+	                                      GTK_WINDOW (Fortified.window),
+	                                      GTK_DIALOG_DESTROY_WITH_PARENT | GTK_DIALOG_NO_SEPARATOR,
+	                                      GTK_STOCK_CANCEL, GTK_RESPONSE_REJECT,
+	                                      GTK_STOCK_REFRESH, GTK_RESPONSE_ACCEPT,
+	                                      NULL);
+	gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_ACCEPT);
+	gtk_container_set_border_width (GTK_CONTAINER (dialog), 8);
+	gtk_window_set_resizable (GTK_WINDOW (dialog), FALSE);
+
+	table = gtk_table_new (2, 2, FALSE);
+	gtk_box_pack_start (GTK_BOX (GTK_DIALOG (dialog)->vbox), table, FALSE, FALSE, 0);
+
+	add_time_entry (dialog, table, 0, _("_From:"), "from", now - DEFAULT_RANGE);
+	add_time_entry (dialog, table, 1, _("_To:"), "to", now);
+
+	g_signal_connect (G_OBJECT (dialog), "response",
+	                  G_CALLBACK (range_dialog_response_cb), NULL);
+
+	gtk_widget_show_all (dialog);
+}
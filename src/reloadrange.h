@@ -0,0 +1,20 @@
+/*---[ reloadrange.h ]------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Dialog for reloading the events of a time range
+ *--------------------------------------------------------------------*/
+
+#ifndef _FORTIFIED_RELOADRANGE
+#define _FORTIFIED_RELOADRANGE
+
+#include <config.h>
+#include <gnome.h>
+
+void reloadrange_show_dialog (void);
+
+#endif
@@ -22,22 +22,28 @@ write_event (gpointer data, gpointer user_data)
 	GIOChannel *out = (GIOChannel *)user_data;
 
 	if (h != NULL) {
+		gchar text[NUM_HIT_FIELDS][HIT_TEXT_MAX];
+		const gchar *fields[NUM_HIT_FIELDS];
 		gchar *data;
+		gint i;
+
+		for (i = 0; i < NUM_HIT_FIELDS; i++)
+			fields[i] = hit_format (h, i, text[i]);
 
 		data = g_strdup_printf ("Time:%s Direction: %s In:%s Out:%s "
 		                        "Port:%s Source:%s Destination:%s Length:%s "
 					"TOS:%s Protocol:%s Service:%s\n",
-		                        h->time,
-		                        h->direction,
-		                        h->in,
-		                        h->out,
-		                        h->port,
-		                        h->source,
-		                        h->destination,
-		                        h->length,
-		                        h->tos,
-		                        h->protocol,
-		                        h->service);
+		                        fields[HIT_TIME],
+		                        fields[HIT_DIRECTION],
+		                        fields[HIT_IN],
+		                        fields[HIT_OUT],
+		                        fields[HIT_PORT],
+		                        fields[HIT_SOURCE],
+		                        fields[HIT_DESTINATION],
+		                        fields[HIT_LENGTH],
+		                        fields[HIT_TOS],
+		                        fields[HIT_PROTOCOL],
+		                        fields[HIT_SERVICE]);
 
 		
 		g_io_channel_write_chars (out, data, -1, NULL, NULL);
@@ -131,12 +131,12 @@ scriptwriter_output_fortified_script ()
 
 	fprintf (f, "\n# --(Control Functions)--\n\n");
 
-	fprintf (f, "# Create Fortified lock file\n"
+	fprintf (f, "# Create Fortified lock file, holding the target events are logged with\n"
 		    "lock_fortified () {\n"
 		    "	if [ -e /var/lock/subsys ]; then\n"
-		    "		touch /var/lock/subsys/fortified\n"
+		    "		echo \"$1\" > /var/lock/subsys/fortified\n"
 		    "	else\n"
-		    "		touch /var/lock/fortified\n"
+		    "		echo \"$1\" > /var/lock/fortified\n"
 		    "	fi\n"
 		    "}\n\n");
 
@@ -207,6 +207,7 @@ scriptwriter_output_fortified_script ()
 		    "	source "FORTIFIED_FIREWALL_SCRIPT" 2>&1\n"
 		    "	retval=$?\n"
 		    "	if [ $retval -eq 0 ]; then\n"
+		    "		lock_fortified $LOG_TARGET_NAME\n"
 		    "		echo \"Firewall started\"\n"
 		    "	else\n"
 		    "		echo \"Firewall not started\"\n"
@@ -425,6 +426,12 @@ scriptwriter_output_configuration ()
 	fprintf (f, "# --(Logging)--\n"
 		    "# System log level\n"
 		    "LOG_LEVEL=info\n");
+	fprintf (f, "# Pass logged packets over netlink instead of the system log\n"
+		    "NFLOG=%s\n", test_bool (PREFS_FW_NFLOG));
+	fprintf (f, "# NFLOG netlink group\n"
+		    "NFLOG_GROUP=%d\n", CLAMP (preferences_get_int (PREFS_FW_NFLOG_GROUP), 0, 65535));
+	fprintf (f, "# Packets queued by the kernel before they are passed on\n"
+		    "NFLOG_THRESHOLD=%d\n", MAX (preferences_get_int (PREFS_FW_NFLOG_THRESHOLD), 1));
 
 	fprintf (f, "\n");
 
@@ -163,17 +163,25 @@ table_append_services (GHashTable *table, const Service *services, gint num_serv
 	}
 }
 
-/* [ service_get_name ]
- * Return the service/exploit used, based on the port and protocol given
+/* The tables and getservbyport are shared by the reload worker threads */
+G_LOCK_DEFINE_STATIC (services);
+
+/* [ service_lookup_name ]
+ * Return the service/exploit used, based on the port and protocol given.
+ * The name is owned by the services table and is never freed
  */
-gchar *
-service_get_name (gint port, gchar *proto)
+const gchar *
+service_lookup_name (gint port, const gchar *proto)
 {
 	static GHashTable *services_table = NULL;
-	gchar *name = NULL;
+	static GHashTable *unknown_table = NULL; /* "port/proto" pairs the system has no name for */
+	const gchar *name = NULL;
+	gchar key[32];
 
 	if (port == 0 || proto == NULL)
-		return (g_strdup (_("Unknown")));
+		return _("Unknown");
+
+	G_LOCK (services);
 
 	/* Initialize services table */
 	if (services_table == NULL) {
@@ -184,10 +192,14 @@ service_get_name (gint port, gchar *proto)
 		table_append_services (services_table, user_services, elements);
 		elements = sizeof (misc_services) / sizeof(Service);
 		table_append_services (services_table, misc_services, elements);
+		unknown_table = g_hash_table_new (g_str_hash, g_str_equal);
 	}
 
-	name = (gchar *)g_hash_table_lookup (services_table, GINT_TO_POINTER (port));
-	if (!name) { /* The service was not in our table, revert to system's service list */
+	name = (const gchar *)g_hash_table_lookup (services_table, GINT_TO_POINTER (port));
+	if (!name)
+		g_snprintf (key, sizeof (key), "%d/%s", port, proto);
+	if (!name && !g_hash_table_lookup (unknown_table, key)) {
+		/* The service was not in our table, revert to system's service list */
 		struct servent *ent;
 		gchar *lowercase_proto;
 		
@@ -195,51 +207,73 @@ service_get_name (gint port, gchar *proto)
 		ent = getservbyport (htons (port), lowercase_proto);
 		g_free (lowercase_proto);
 
-		if (ent && ent->s_name != "") {
-			name = ent->s_name;
-			name[0] = toupper(name[0]);
+		if (ent && ent->s_name[0] != '\0') {
+			gchar *copy = g_strdup (ent->s_name);
+
+			copy[0] = toupper(copy[0]);
 			/* Register the retrieved service with the table for future reference */
-			g_hash_table_insert (services_table, GINT_TO_POINTER (port), g_strdup(name));
+			g_hash_table_insert (services_table, GINT_TO_POINTER (port), copy);
+			name = copy;
+		} else {
+			/* Looking it up again would read the services file each time */
+			g_hash_table_insert (unknown_table, g_strdup (key), GINT_TO_POINTER (TRUE));
 		}
 	}
 
-	if (name)
-		return g_strdup(name);
-	else
-		return (g_strdup (_("Unknown")));
+	G_UNLOCK (services);
+
+	return name ? name : _("Unknown");
 }
 
+/* [ service_get_name ]
+ * Return a copy of the service/exploit used, based on the port and protocol given
+ */
 gchar *
-service_get_icmp_name (gint type) {
+service_get_name (gint port, gchar *proto)
+{
+	return g_strdup (service_lookup_name (port, proto));
+}
+
+/* [ service_lookup_icmp_name ]
+ * Return the name of an ICMP message type, never freed
+ */
+const gchar *
+service_lookup_icmp_name (gint type) {
 	
-	if (type==0) return (g_strdup ("Echo reply"));
-	if (type==1 || type == 2) return (g_strdup ("Unassigned"));
-	if (type==3) return (g_strdup ("Dest. unreachable"));
-	if (type==4) return (g_strdup ("Source quench"));
-	if (type==5) return (g_strdup ("Redirect"));
-	if (type==6) return (g_strdup ("Alternate host address"));
-	if (type==7) return (g_strdup ("Unassigned"));
-	if (type==8) return (g_strdup ("Echo"));
-	if (type==9) return (g_strdup ("Router advertisement"));
-	if (type==10) return (g_strdup ("Router selection"));
-	if (type==11) return (g_strdup ("Time exceeded"));
-	if (type==12) return (g_strdup ("Parameter problem"));
-	if (type==13) return (g_strdup ("Timestamp"));
-	if (type==14) return (g_strdup ("Timestamp reply"));
-	if (type==15) return (g_strdup ("Information request"));
-	if (type==16) return (g_strdup ("Information reply"));
-	if (type==17) return (g_strdup ("Address mask request"));
-	if (type==18) return (g_strdup ("Address mask reply"));
-	if (type==19) return (g_strdup ("Reserved"));
-	if (type >= 20 && type <= 29) return (g_strdup ("Reserved"));
-	if (type==30) return (g_strdup ("Traceroute"));
-	if (type==31) return (g_strdup ("Datagram conversion error"));
-	if (type==32) return (g_strdup ("Mobile host redirect"));
-	if (type==33) return (g_strdup ("IPv6 where-are-you"));
-	if (type==34) return (g_strdup ("IPv6 I-am-here"));
-	if (type==35) return (g_strdup ("Mobile registration request"));
-	if (type==36) return (g_strdup ("mobile registration reply"));
-	if (type >= 37 && type <= 255) return (g_strdup ("Reserved"));
+	if (type==0) return ("Echo reply");
+	if (type==1 || type == 2) return ("Unassigned");
+	if (type==3) return ("Dest. unreachable");
+	if (type==4) return ("Source quench");
+	if (type==5) return ("Redirect");
+	if (type==6) return ("Alternate host address");
+	if (type==7) return ("Unassigned");
+	if (type==8) return ("Echo");
+	if (type==9) return ("Router advertisement");
+	if (type==10) return ("Router selection");
+	if (type==11) return ("Time exceeded");
+	if (type==12) return ("Parameter problem");
+	if (type==13) return ("Timestamp");
+	if (type==14) return ("Timestamp reply");
+	if (type==15) return ("Information request");
+	if (type==16) return ("Information reply");
+	if (type==17) return ("Address mask request");
+	if (type==18) return ("Address mask reply");
+	if (type==19) return ("Reserved");
+	if (type >= 20 && type <= 29) return ("Reserved");
+	if (type==30) return ("Traceroute");
+	if (type==31) return ("Datagram conversion error");
+	if (type==32) return ("Mobile host redirect");
+	if (type==33) return ("IPv6 where-are-you");
+	if (type==34) return ("IPv6 I-am-here");
+	if (type==35) return ("Mobile registration request");
+	if (type==36) return ("mobile registration reply");
+	if (type >= 37 && type <= 255) return ("Reserved");
 	
-	return (g_strdup (_("Unknown")));
+	return (_("Unknown"));
+}
+
+gchar *
+service_get_icmp_name (gint type)
+{
+	return g_strdup (service_lookup_icmp_name (type));
 }
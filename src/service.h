@@ -18,5 +18,7 @@
 GtkListStore* services_get_model (void);
 gchar *service_get_name (gint port, gchar *proto);
 gchar *service_get_icmp_name (gint type);
+const gchar *service_lookup_name (gint port, const gchar *proto);
+const gchar *service_lookup_icmp_name (gint type);
 
 #endif
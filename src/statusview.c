@@ -28,6 +28,9 @@
 #include "service.h"
 #include "tray.h"
 #include "gui.h"
+#include "hittop.h"
+#include "hittimeline.h"
+#include "kmsg.h"
 #include "xpm/fortified-pixbufs.h"
  
 #define DEV_FILE "/proc/net/dev"
@@ -37,6 +40,10 @@
 #define REFRESH_RATE 1 /* Time in seconds between updates */
 #define HISTORY_LENGTH 5 /* Number of samples to use when averaging the traffic rate */
 #define COLOR_RETIRED_CONNECTION "#6d6d6d"
+#define TOP_CAPACITY 1000 /* Keys counted for each top talkers list */
+#define TOP_SHOWN 10 /* Rows of each top talkers list */
+#define TIMELINE_HEIGHT 40 /* Height of a timeline graph, in pixels */
+#define COLOR_SERIOUS_EVENTS "#bd1f00"
 
 static gboolean active_connections_visible = FALSE;
 
@@ -50,9 +57,15 @@ static GtkWidget *fw_state_label;
 
 static gint counter_events_in, counter_events_out, counter_serious_events_in, counter_serious_events_out;
 static GtkWidget *events_in, *events_out, *events_serious_in, *events_serious_out;
+static GtkWidget *events_lost_label, *events_lost; /* Shown once kernel messages were lost */
+static HitTimeline *timeline = NULL;
+static GtkWidget *timeline_graphs[HITTIMELINE_NUM_LEVELS];
 
 static GHashTable *conntrack_programs = NULL;
 
+static gboolean top_talkers_visible = FALSE;
+static gboolean top_talkers_changed = FALSE;
+
 
 typedef struct _Interface_info Interface_info;
 struct _Interface_info
@@ -94,6 +107,25 @@ enum
 	NUM_CONNECTIONCOLUMNS
 };
 
+enum
+{
+	TOP_SOURCES,
+	TOP_NETWORKS,
+	TOP_PORTS,
+	TOP_SERVICES,
+	NUM_TOPS
+};
+
+enum
+{
+	TOPCOL_NAME,
+	TOPCOL_HITS,
+	NUM_TOPCOLUMNS
+};
+
+static HitTop *tops[NUM_TOPS];
+static GtkWidget *topviews[NUM_TOPS];
+
 static GtkListStore*
 get_connectionstore (void)
 {
@@ -417,6 +449,90 @@ connectionview_refresh (GHashTable *entries)
 	g_io_channel_seek_position (in, 0, G_SEEK_SET, &error); /* Rewind */
 }
 
+/* [ draw_bar ]
+ * Draw a bar of a timeline graph, reaching up from the middle if extent
+ * is positive and down if it's negative
+ */
+static void
+draw_bar (GtkWidget *widget, GdkGC *gc, gint x, gint width, gint middle, gint extent)
+{
+	if (extent > 0)
+		gdk_draw_rectangle (widget->window, gc, TRUE, x, middle - extent, width, extent);
+	else if (extent < 0)
+		gdk_draw_rectangle (widget->window, gc, TRUE, x, middle + 1, width, -extent);
+}
+
+/* [ timeline_expose_cb ]
+ * Draw the graph of a level of the timeline, ending now. Inbound events
+ * rise above the middle and outbound ones fall below it, with the serious
+ * share of each in red
+ */
+static gboolean
+timeline_expose_cb (GtkWidget *widget, GdkEventExpose *event, gpointer data)
+{
+	static GdkGC *serious_gc = NULL;
+	HitTimelineLevel level = GPOINTER_TO_INT (data);
+	guint length = hittimeline_get_length (level);
+	guint32 *counts[HITTIMELINE_NUM_SERIES];
+	gint width = widget->allocation.width;
+	gint middle = widget->allocation.height / 2;
+	gint below = widget->allocation.height - middle - 1;
+	GtkStateType state = GTK_WIDGET_STATE (widget);
+	guint32 peak = 1;
+	gint64 now = time (NULL);
+	gint x, bar;
+	guint i;
+
+	if (serious_gc == NULL) {
+		GdkColor color;
+
+		gdk_color_parse (COLOR_SERIOUS_EVENTS, &color);
+		serious_gc = gdk_gc_new (widget->window);
+		gdk_gc_set_rgb_fg_color (serious_gc, &color);
+	}
+
+	for (i = 0; i < HITTIMELINE_NUM_SERIES; i++) {
+		counts[i] = g_new (guint32, length);
+		hittimeline_get (timeline, level, now, i, counts[i]);
+	}
+	for (i = 0; i < length; i++)
+		peak = MAX (peak, MAX (counts[HITTIMELINE_INBOUND][i], counts[HITTIMELINE_OUTBOUND][i]));
+
+	gdk_draw_line (widget->window, widget->style->mid_gc[state], 0, middle, width, middle);
+
+	for (i = 0; i < length; i++) {
+		x = i * width / length;
+		bar = MAX ((gint)((i + 1) * width / length) - x - 1, 1);
+
+		draw_bar (widget, widget->style->fg_gc[state], x, bar, middle,
+		          (gint64)counts[HITTIMELINE_INBOUND][i] * middle / peak);
+		draw_bar (widget, serious_gc, x, bar, middle,
+		          (gint64)counts[HITTIMELINE_SERIOUS_INBOUND][i] * middle / peak);
+		draw_bar (widget, widget->style->fg_gc[state], x, bar, middle,
+		          -(gint64)counts[HITTIMELINE_OUTBOUND][i] * below / peak);
+		draw_bar (widget, serious_gc, x, bar, middle,
+		          -(gint64)counts[HITTIMELINE_SERIOUS_OUTBOUND][i] * below / peak);
+	}
+
+	for (i = 0; i < HITTIMELINE_NUM_SERIES; i++)
+		g_free (counts[i]);
+
+	return TRUE;
+}
+
+/* [ refresh_timeline ]
+ * Redraw the timeline graphs
+ */
+static void
+refresh_timeline (void)
+{
+	gint level;
+
+	for (level = 0; level < HITTIMELINE_NUM_LEVELS; level++)
+		if (timeline_graphs[level] != NULL)
+			gtk_widget_queue_draw (timeline_graphs[level]);
+}
+
 void
 status_events_reset (void)
 {
@@ -428,46 +544,161 @@ status_events_reset (void)
 	gtk_label_set_text (GTK_LABEL (events_serious_in), "0");
 	gtk_label_set_text (GTK_LABEL (events_out), "0");
 	gtk_label_set_text (GTK_LABEL (events_serious_out), "0");
+	hittimeline_clear (timeline);
+	refresh_timeline ();
+
+	if (tops[0] != NULL) {
+		gint i;
+
+		for (i = 0; i < NUM_TOPS; i++)
+			hittop_clear (tops[i]);
+		top_talkers_changed = TRUE;
+	}
+}
+
+/* [ count_event ]
+ * Count an event in the timeline, unless its time is unknown
+ */
+static void
+count_event (gint64 when, HitTimelineSeries series)
+{
+	if (when != 0)
+		hittimeline_add (timeline, when, series);
 }
 
 void
-status_event_in_inc (void)
+status_event_in_inc (gint64 when)
 {
 	counter_events_in++;
 	gchar *label = g_strdup_printf ("%d", counter_events_in);
 
 	gtk_label_set_text (GTK_LABEL (events_in), label);
 	g_free (label);
+	count_event (when, HITTIMELINE_INBOUND);
 }
 
 void
-status_serious_event_in_inc (void)
+status_serious_event_in_inc (gint64 when)
 {
 	counter_serious_events_in++;
 	gchar *label = g_strdup_printf ("%d", counter_serious_events_in);
 
 	gtk_label_set_text (GTK_LABEL (events_serious_in), label);
 	g_free (label);
+	count_event (when, HITTIMELINE_SERIOUS_INBOUND);
 }
 
 void
-status_event_out_inc (void)
+status_event_out_inc (gint64 when)
 {
 	counter_events_out++;
 	gchar *label = g_strdup_printf ("%d", counter_events_out);
 
 	gtk_label_set_text (GTK_LABEL (events_out), label);
 	g_free (label);
+	count_event (when, HITTIMELINE_OUTBOUND);
 }
 
 void
-status_serious_event_out_inc (void)
+status_serious_event_out_inc (gint64 when)
 {
 	counter_serious_events_out++;
 	gchar *label = g_strdup_printf ("%d", counter_serious_events_out);
 
 	gtk_label_set_text (GTK_LABEL (events_serious_out), label);
 	g_free (label);
+	count_event (when, HITTIMELINE_SERIOUS_OUTBOUND);
+}
+
+/* [ status_top_talkers_add ]
+ * Count a hit toward the top talkers. Every hit logged is counted, those
+ * dropped from the events list or folded into a row of it too
+ */
+void
+status_top_talkers_add (const Hit *h)
+{
+	gint i;
+
+	if (tops[0] == NULL)
+		for (i = 0; i < NUM_TOPS; i++)
+			tops[i] = hittop_new (TOP_CAPACITY);
+
+	if (h->flags & HIT_HAS_SOURCE) {
+		hittop_add (tops[TOP_SOURCES], ntohl (h->source));
+		hittop_add (tops[TOP_NETWORKS], ntohl (h->source) & 0xFFFFFF00);
+	}
+	if (h->flags & HIT_HAS_PORT)
+		hittop_add (tops[TOP_PORTS], h->port);
+	if (h->service != 0)
+		hittop_add (tops[TOP_SERVICES], h->service);
+
+	top_talkers_changed = TRUE;
+}
+
+/* [ format_top_key ]
+ * Return the text of a key of one of the top talkers lists
+ */
+static gchar *
+format_top_key (gint top, guint32 key)
+{
+	struct in_addr address;
+	gchar buffer[INET_ADDRSTRLEN];
+
+	switch (top) {
+	case TOP_SOURCES:
+	case TOP_NETWORKS:
+		address.s_addr = htonl (key);
+		inet_ntop (AF_INET, &address, buffer, sizeof (buffer));
+		if (top == TOP_NETWORKS)
+			return g_strconcat (buffer, "/24", NULL);
+		return g_strdup (buffer);
+	case TOP_PORTS:
+		return g_strdup_printf ("%u", key);
+	default:
+		return g_strdup (hit_name (key));
+	}
+}
+
+/* [ refresh_top_talkers ]
+ * Fill the top talkers lists with the keys counted most. A count that may
+ * be too high, having been taken over from a key no longer counted, is
+ * marked as approximate
+ */
+static void
+refresh_top_talkers (void)
+{
+	HitTopEntry entries[TOP_SHOWN];
+	GtkListStore *store;
+	GtkTreeIter iter;
+	gchar *name, *hits;
+	guint i, n;
+	gint top;
+
+	top_talkers_changed = FALSE;
+	if (tops[0] == NULL)
+		return;
+
+	for (top = 0; top < NUM_TOPS; top++) {
+		store = GTK_LIST_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (topviews[top])));
+		gtk_list_store_clear (store);
+
+		n = hittop_get (tops[top], entries, TOP_SHOWN);
+		for (i = 0; i < n; i++) {
+			name = format_top_key (top, entries[i].key);
+			if (entries[i].error == 0)
+				hits = g_strdup_printf ("%u", entries[i].count);
+			else
+				hits = g_strdup_printf ("~%u", entries[i].count);
+
+			gtk_list_store_append (store, &iter);
+			gtk_list_store_set (store, &iter,
+			                    TOPCOL_NAME, name,
+			                    TOPCOL_HITS, hits,
+			                    -1);
+			g_free (name);
+			g_free (hits);
+		}
+	}
 }
 
 /* [ status_set_fw_state ]
@@ -777,6 +1008,29 @@ free_connection_entry (gpointer data)
 	g_free (data);
 }
 
+/* [ refresh_lost_events ]
+ * Show how many kernel messages were overwritten before they could be read.
+ * Only /dev/kmsg tells, the row stays hidden while there are none
+ */
+static void
+refresh_lost_events (void)
+{
+	guint64 dropped = kmsg_get_dropped ();
+	gchar *label;
+
+	if (dropped == 0) {
+		gtk_widget_hide (events_lost_label);
+		gtk_widget_hide (events_lost);
+		return;
+	}
+
+	label = g_strdup_printf ("%" G_GUINT64_FORMAT, dropped);
+	gtk_label_set_text (GTK_LABEL (events_lost), label);
+	g_free (label);
+	gtk_widget_show (events_lost_label);
+	gtk_widget_show (events_lost);
+}
+
 /* [ update_status_screen ]
  * Timeout callback for refreshing the status view page periodically
  */
@@ -801,6 +1055,12 @@ update_status_screen (gpointer data)
 	if (active_connections_visible)
 		connectionview_refresh (conntrack_entries);
 
+	refresh_timeline ();
+	refresh_lost_events ();
+
+	if (top_talkers_visible && top_talkers_changed)
+		refresh_top_talkers ();
+
 	return TRUE;
 }
 
@@ -893,28 +1153,80 @@ connectionview_button_press_cb (GtkWidget* view, GdkEventButton* event)
 	return retval;
 }
 
+/* [ expander_cb ]
+ * Show or hide the contents of an expander, keeping track of whether they
+ * are visible in the flag set as its "visible" data
+ */
 static void
 expander_cb (GObject *object, GParamSpec *param_spec, gpointer user_data)
 {
 	GtkExpander *expander;
 	GtkWidget *contents;
+	gboolean *visible;
 
 	expander = GTK_EXPANDER (object);
 	contents = GTK_WIDGET (user_data);
+	visible = g_object_get_data (object, "visible");
 
 	if (gtk_expander_get_expanded (expander)) {
 		gtk_widget_show (contents);
-		active_connections_visible = TRUE;
+		*visible = TRUE;
 	} else { /* Reclaim vertical space on expander collapse */
 		gint width;
 
 		gtk_window_get_size (GTK_WINDOW (Fortified.window), &width, NULL);
 		gtk_widget_hide (contents);
 		gtk_window_resize (GTK_WINDOW (Fortified.window), width, 1);
-		active_connections_visible = FALSE;
+		*visible = FALSE;
 	}
 }
 
+/* [ create_top_talkers ]
+ * Create the top talkers lists under an expander, packed into box
+ */
+static void
+create_top_talkers (GtkWidget *box)
+{
+	GtkWidget *expander;
+	GtkWidget *label;
+	GtkWidget *hbox;
+	GtkWidget *frame;
+	gint top;
+
+	View_def topview_defs[NUM_TOPS] = {
+		{2, {{_("Source"), G_TYPE_STRING, TRUE}, {_("Hits"), G_TYPE_STRING, TRUE}}},
+		{2, {{_("Network"), G_TYPE_STRING, TRUE}, {_("Hits"), G_TYPE_STRING, TRUE}}},
+		{2, {{_("Port"), G_TYPE_STRING, TRUE}, {_("Hits"), G_TYPE_STRING, TRUE}}},
+		{2, {{_("Service"), G_TYPE_STRING, TRUE}, {_("Hits"), G_TYPE_STRING, TRUE}}},
+	};
+
+	expander = gtk_expander_new (NULL);
+	label = gtk_label_new (NULL);
+	gtk_label_set_markup (GTK_LABEL (label), g_strconcat (
+		"<b>", _("Top talkers"), "</b>", NULL));
+	gtk_expander_set_label_widget (GTK_EXPANDER (expander), label);
+	gtk_expander_set_spacing (GTK_EXPANDER (expander), 5);
+	gtk_box_pack_start (GTK_BOX (box), expander, FALSE, FALSE, 10);
+
+	hbox = gtk_hbox_new (TRUE, GNOME_PAD_SMALL);
+	for (top = 0; top < NUM_TOPS; top++) {
+		topviews[top] = gui_create_list_view (&topview_defs[top], -1, -1);
+		frame = gtk_frame_new (NULL);
+		gtk_frame_set_shadow_type (GTK_FRAME (frame), GTK_SHADOW_IN);
+		gtk_container_add (GTK_CONTAINER (frame), topviews[top]);
+		gtk_box_pack_start (GTK_BOX (hbox), frame, TRUE, TRUE, 0);
+		gtk_widget_show_all (frame);
+	}
+
+	g_object_set_data (G_OBJECT (expander), "visible", &top_talkers_visible);
+	g_signal_connect (G_OBJECT (expander), "notify::expanded",
+	                  G_CALLBACK (expander_cb), hbox);
+	gtk_expander_set_expanded (GTK_EXPANDER (expander), FALSE);
+
+	gtk_box_pack_start (GTK_BOX (box), hbox, FALSE, FALSE, 1);
+	gtk_widget_set_no_show_all (hbox, TRUE);
+}
+
 /* [ create_hitview_page ]
  * Create the hitview
  */
@@ -930,6 +1242,14 @@ create_statusview_page (void)
 	GdkPixbuf *pixbuf;
 	GtkWidget *separator;
 	GtkWidget *expander;
+	gint level;
+
+	static const gchar *timeline_titles[HITTIMELINE_NUM_LEVELS] = {
+		N_("Last minute"),
+		N_("Last hour"),
+		N_("Last day"),
+		N_("Last 30 days"),
+	};
 
 	View_def connectionview_def = {6, {
 			{_("Source"), G_TYPE_STRING, TRUE},
@@ -1018,6 +1338,18 @@ create_statusview_page (void)
 	gtk_table_attach (GTK_TABLE (table2), events_serious_out, 2, 3, 2, 3,
 		GTK_FILL, GTK_FILL, GNOME_PAD, 5);
 
+	events_lost_label = gtk_label_new (NULL);
+	gtk_label_set_markup (GTK_LABEL (events_lost_label), g_strconcat (
+		"<span size=\"smaller\">", _("Lost"), "</span>", NULL));
+	gtk_table_attach (GTK_TABLE (table2), events_lost_label, 0, 1, 3, 4,
+		GTK_FILL, GTK_FILL, GNOME_PAD, 5);
+	gtk_widget_set_no_show_all (events_lost_label, TRUE);
+
+	events_lost = gtk_label_new ("0");
+	gtk_table_attach (GTK_TABLE (table2), events_lost, 1, 2, 3, 4,
+		GTK_FILL, GTK_FILL, GNOME_PAD, 5);
+	gtk_widget_set_no_show_all (events_lost, TRUE);
+
 
 
  	pixbuf = gdk_pixbuf_new_from_inline (-1, icon_start_large, FALSE, NULL);
@@ -1039,6 +1371,41 @@ create_statusview_page (void)
 	gtk_box_pack_start (GTK_BOX (statuspagebox), separator, FALSE, FALSE, 10);
 
 
+/* Event history */
+	frame = gtk_frame_new (NULL);
+	label = gtk_label_new (NULL);
+	gtk_label_set_markup (GTK_LABEL (label), g_strconcat (
+		"<b>", _("Event history"), "</b>", NULL));
+	gtk_frame_set_label_widget (GTK_FRAME (frame), label);
+	gtk_frame_set_shadow_type (GTK_FRAME (frame), GTK_SHADOW_NONE);
+	gtk_box_pack_start (GTK_BOX (statuspagebox), frame, FALSE, FALSE, 0);
+
+	table = gtk_table_new (HITTIMELINE_NUM_LEVELS, 2, FALSE);
+	gtk_table_set_row_spacings (GTK_TABLE(table), GNOME_PAD_SMALL);
+	gtk_table_set_col_spacings (GTK_TABLE(table), GNOME_PAD_SMALL);
+	gtk_container_add (GTK_CONTAINER (frame), table);
+
+	timeline = hittimeline_new ();
+	for (level = 0; level < HITTIMELINE_NUM_LEVELS; level++) {
+		label = gtk_label_new (NULL);
+		gtk_label_set_markup (GTK_LABEL (label), g_strconcat (
+			"<span size=\"smaller\">", _(timeline_titles[level]), "</span>", NULL));
+		gtk_misc_set_alignment (GTK_MISC (label), 1.0, 0.5);
+		gtk_table_attach (GTK_TABLE (table), label, 0, 1, level, level+1,
+			GTK_FILL, GTK_FILL, GNOME_PAD, 0);
+
+		timeline_graphs[level] = gtk_drawing_area_new ();
+		gtk_widget_set_size_request (timeline_graphs[level], -1, TIMELINE_HEIGHT);
+		g_signal_connect (G_OBJECT (timeline_graphs[level]), "expose_event",
+		                  G_CALLBACK (timeline_expose_cb), GINT_TO_POINTER (level));
+		gtk_table_attach (GTK_TABLE (table), timeline_graphs[level], 1, 2, level, level+1,
+			GTK_EXPAND | GTK_FILL, GTK_FILL, GNOME_PAD, 0);
+	}
+
+	separator = gtk_hseparator_new ();
+	gtk_box_pack_start (GTK_BOX (statuspagebox), separator, FALSE, FALSE, 10);
+
+
 /* Network */
 	frame = gtk_frame_new (NULL);
 	label = gtk_label_new (NULL);
@@ -1083,6 +1450,9 @@ create_statusview_page (void)
 	gtk_table_attach (GTK_TABLE (device_table), label, 4, 5, 0, 1,
 		GTK_FILL, GTK_FILL, GNOME_PAD, 5);	
 
+/* Top talkers */
+	create_top_talkers (statuspagebox);
+
 	expander = gtk_expander_new (NULL);
 	label = gtk_label_new (NULL);
 	gtk_label_set_markup (GTK_LABEL (label), g_strconcat (
@@ -1105,6 +1475,7 @@ create_statusview_page (void)
 	                                GTK_POLICY_AUTOMATIC);
 	gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scrolledwin), GTK_SHADOW_IN);
 
+	g_object_set_data (G_OBJECT (expander), "visible", &active_connections_visible);
 	g_signal_connect (G_OBJECT (expander), "notify::expanded",
 	                  G_CALLBACK (expander_cb), scrolledwin);
 	gtk_expander_set_expanded (GTK_EXPANDER (expander), FALSE);
@@ -32,10 +32,11 @@ FirewallStatus status_get_state (void);
 GtkWidget *create_statusview_page (void);
 
 void status_events_reset (void);
-void status_event_in_inc (void);
-void status_serious_event_in_inc (void);
-void status_event_out_inc (void);
-void status_serious_event_out_inc (void);
+void status_event_in_inc (gint64 when);
+void status_serious_event_in_inc (gint64 when);
+void status_event_out_inc (gint64 when);
+void status_serious_event_out_inc (gint64 when);
+void status_top_talkers_add (const Hit *h);
 
 gint status_sync_timeout (gpointer data);
 
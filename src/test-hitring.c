@@ -0,0 +1,177 @@
+/*---[ test-hitring.c ]-----------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Randomized test of the ring of the events list rows against a plain
+ * list, with rows coming in at both ends and the capacity changing
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+
+#include "hitring.h"
+
+#define SEED 20161017
+#define ROUNDS 200 /* Rings tested, each with its own capacity */
+#define STEPS 5000 /* Operations on each ring */
+#define MAX_CAPACITY 64 /* Small, so the ring fills and wraps often */
+
+static GArray *rows; /* What the ring should hold, oldest first */
+static guint older_count; /* Rows at the start of rows still coming in oldest first */
+static GArray *expected; /* Rows that should have been evicted, in order */
+static GArray *evicted; /* Rows the ring evicted, in order */
+
+/* [ record_evict ]
+ * Evict callback, remember the row
+ */
+static void
+record_evict (guint row, gpointer data)
+{
+	g_array_append_val (evicted, row);
+}
+
+/* [ expect_evict ]
+ * Drop the oldest row from the list, it should be evicted next. Those
+ * still coming in oldest first are the oldest of all
+ */
+static void
+expect_evict (void)
+{
+	g_array_append_val (expected, g_array_index (rows, guint, 0));
+	g_array_remove_index (rows, 0);
+	if (older_count > 0)
+		older_count--;
+}
+
+/* [ check_ring ]
+ * Test the ring holds the rows of the list and evicted the expected ones.
+ * Return FALSE and describe the first difference if not
+ */
+static gboolean
+check_ring (HitRing *ring, guint capacity, guint step, const gchar *op)
+{
+	guint i;
+
+	if (hitring_get_count (ring) != rows->len || rows->len > capacity) {
+		g_print ("step %u, %s: %u rows, expected %u, capacity %u\n",
+		         step, op, hitring_get_count (ring), rows->len, capacity);
+		return FALSE;
+	}
+
+	for (i = 0; i < rows->len; i++) {
+		if (hitring_nth (ring, i) != g_array_index (rows, guint, i)) {
+			g_print ("step %u, %s: row %u is %u, expected %u\n",
+			         step, op, i, hitring_nth (ring, i), g_array_index (rows, guint, i));
+			return FALSE;
+		}
+	}
+
+	if (evicted->len != expected->len ||
+	    (evicted->len > 0 && memcmp (evicted->data, expected->data, evicted->len * sizeof (guint)) != 0)) {
+		g_print ("step %u, %s: %u rows evicted, expected %u\n", step, op, evicted->len, expected->len);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* [ run_round ]
+ * Apply random operations to a ring and the list. Return FALSE on the first difference
+ */
+static gboolean
+run_round (GRand *rand)
+{
+	guint capacity = g_rand_int_range (rand, 1, MAX_CAPACITY);
+	HitRing *ring = hitring_new (capacity, record_evict, NULL);
+	gboolean reading_older = FALSE;
+	guint next_row = 0;
+	gboolean ok = TRUE;
+	guint step;
+
+	g_array_set_size (rows, 0);
+	g_array_set_size (expected, 0);
+	g_array_set_size (evicted, 0);
+	older_count = 0;
+
+	for (step = 0; ok && step < STEPS; step++) {
+		guint row = next_row++;
+		const gchar *op;
+		gint choice = g_rand_int_range (rand, 0, 100);
+
+		if (choice < 40) {
+			op = "push_back";
+			if (rows->len >= capacity)
+				expect_evict ();
+			hitring_push_back (ring, row);
+			g_array_append_val (rows, row);
+		} else if (choice < 75) {
+			op = "push_older";
+			if (!hitring_has_room_older (ring))
+				continue;
+			if (rows->len >= capacity)
+				expect_evict ();
+			reading_older = TRUE;
+			hitring_push_older (ring, row);
+			g_array_insert_val (rows, older_count, row);
+			older_count++;
+		} else if (choice < 85) {
+			op = "push_front";
+			if (reading_older || !hitring_has_room_front (ring))
+				continue;
+			hitring_push_front (ring, row);
+			g_array_prepend_val (rows, row);
+		} else if (choice < 93) {
+			op = "end_older";
+			hitring_end_older (ring);
+			reading_older = FALSE;
+			older_count = 0;
+		} else if (choice < 99) {
+			op = "set_capacity";
+			capacity = g_rand_int_range (rand, 1, MAX_CAPACITY);
+			hitring_set_capacity (ring, capacity);
+			while (rows->len > capacity)
+				expect_evict ();
+		} else {
+			op = "clear";
+			hitring_clear (ring);
+			g_array_set_size (rows, 0);
+			reading_older = FALSE;
+			older_count = 0;
+		}
+
+		ok = check_ring (ring, capacity, step, op);
+	}
+
+	hitring_free (ring);
+	return ok;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GRand *rand = g_rand_new_with_seed (SEED);
+	guint round;
+
+	rows = g_array_new (FALSE, FALSE, sizeof (guint));
+	expected = g_array_new (FALSE, FALSE, sizeof (guint));
+	evicted = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	for (round = 0; round < ROUNDS && run_round (rand); round++);
+
+	g_rand_free (rand);
+	g_array_free (rows, TRUE);
+	g_array_free (expected, TRUE);
+	g_array_free (evicted, TRUE);
+
+	if (round < ROUNDS) {
+		g_print ("round %u failed\n", round);
+		return 1;
+	}
+
+	g_print ("%u rounds of %u operations, the ring matched\n", ROUNDS, STEPS);
+	return 0;
+}
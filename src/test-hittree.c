@@ -0,0 +1,224 @@
+/*---[ test-hittree.c ]-----------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Randomized test of the sorted rows of the events list against a
+ * sorted array, with rows going in and out in bursts so the tree grows
+ * and shrinks through several levels
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+
+#include "hittree.h"
+
+#define SEED 20161017
+#define ROUNDS 10 /* Trees tested */
+#define STEPS 300 /* Bursts of operations on each tree */
+#define MAX_ROWS 40000 /* Enough for three levels */
+#define MAX_BURST 2000 /* Rows inserted or removed at once */
+#define KEYS 500 /* Few, so many rows compare equal on the key */
+#define LOOKUPS 200 /* Positions and rows checked after each burst */
+
+static guint keys[MAX_ROWS]; /* What the rows are sorted on, then their number */
+static gboolean present[MAX_ROWS];
+static GArray *rows; /* What the tree should hold, in order */
+
+/* [ compare_rows ]
+ * Order rows by key, then by number so no two are equal
+ */
+static gint
+compare_rows (guint a, guint b, gpointer data)
+{
+	if (keys[a] != keys[b])
+		return (keys[a] < keys[b]) ? -1 : 1;
+
+	return (a > b) - (a < b);
+}
+
+/* [ compare_row_pointers ]
+ * Order pointed to rows as compare_rows does, for sorting the list
+ */
+static gint
+compare_row_pointers (gconstpointer a, gconstpointer b, gpointer data)
+{
+	return compare_rows (*(const guint *)a, *(const guint *)b, data);
+}
+
+/* [ find_position ]
+ * Return the position of a row in the list, or where it would go
+ */
+static guint
+find_position (guint row)
+{
+	guint low = 0, high = rows->len;
+
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
+
+		if (compare_rows (g_array_index (rows, guint, middle), row, NULL) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+/* [ pick_row ]
+ * Return a random row that is in the tree, or one that isn't
+ */
+static guint
+pick_row (GRand *rand, gboolean in_tree)
+{
+	guint row;
+
+	do
+		row = g_rand_int_range (rand, 0, MAX_ROWS);
+	while (present[row] != in_tree);
+
+	return row;
+}
+
+/* [ check_tree ]
+ * Test the tree against the list at random positions and rows, and all of
+ * it now and then. Return FALSE and describe the first difference if not
+ */
+static gboolean
+check_tree (HitTree *tree, GRand *rand, guint step, const gchar *op)
+{
+	guint i;
+
+	if (hittree_get_count (tree) != rows->len) {
+		g_print ("step %u, %s: %u rows, expected %u\n", step, op, hittree_get_count (tree), rows->len);
+		return FALSE;
+	}
+	if (rows->len == 0)
+		return TRUE;
+
+	for (i = 0; i < LOOKUPS; i++) {
+		guint position = g_rand_int_range (rand, 0, rows->len);
+		guint row = g_array_index (rows, guint, position);
+
+		/* Neighbours now and then, the tree remembers the last leaf */
+		if (i % 2 == 1 && position + 1 < rows->len)
+			position++, row = g_array_index (rows, guint, position);
+
+		if (hittree_nth (tree, position) != row || hittree_find (tree, row) != position) {
+			g_print ("step %u, %s: row %u at %u, the tree has %u there and it at %u\n",
+			         step, op, row, position, hittree_nth (tree, position), hittree_find (tree, row));
+			return FALSE;
+		}
+	}
+
+	if (step % 20 == 0) {
+		guint *copy = g_new (guint, rows->len);
+		gboolean same;
+
+		hittree_get_rows (tree, copy);
+		same = (memcmp (copy, rows->data, rows->len * sizeof (guint)) == 0);
+		g_free (copy);
+		if (!same) {
+			g_print ("step %u, %s: the rows differ\n", step, op);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* [ run_round ]
+ * Apply random bursts of operations to a tree and the list. Return FALSE
+ * on the first difference
+ */
+static gboolean
+run_round (GRand *rand)
+{
+	HitTree *tree = hittree_new (compare_rows, NULL);
+	gboolean ok = TRUE;
+	guint step, i, row, position, got;
+
+	g_array_set_size (rows, 0);
+	memset (present, 0, sizeof (present));
+
+	for (step = 0; ok && step < STEPS; step++) {
+		guint burst = g_rand_int_range (rand, 1, MAX_BURST);
+		gint choice = g_rand_int_range (rand, 0, 100);
+		const gchar *op;
+
+		if (choice < 45) {
+			/* Rows given out again come back with another key */
+			op = "insert";
+			for (i = 0; i < burst && rows->len < MAX_ROWS; i++) {
+				row = pick_row (rand, FALSE);
+				keys[row] = g_rand_int_range (rand, 0, KEYS);
+				position = find_position (row);
+				got = hittree_insert (tree, row);
+				if (got != position) {
+					g_print ("step %u: row %u inserted at %u, expected %u\n", step, row, got, position);
+					ok = FALSE;
+					break;
+				}
+				g_array_insert_val (rows, position, row);
+				present[row] = TRUE;
+			}
+		} else if (choice < 90) {
+			op = "remove";
+			for (i = 0; i < burst && rows->len > 0; i++) {
+				row = pick_row (rand, TRUE);
+				position = find_position (row);
+				got = hittree_remove (tree, row);
+				if (got != position) {
+					g_print ("step %u: row %u removed from %u, expected %u\n", step, row, got, position);
+					ok = FALSE;
+					break;
+				}
+				g_array_remove_index (rows, position);
+				present[row] = FALSE;
+			}
+		} else if (choice < 97) {
+			/* Rebuilt from scratch, as when the list is sorted again */
+			op = "set_rows";
+			for (i = 0; i < rows->len; i++)
+				keys[g_array_index (rows, guint, i)] = g_rand_int_range (rand, 0, KEYS);
+			g_array_sort_with_data (rows, compare_row_pointers, NULL);
+			hittree_set_rows (tree, (const guint *)rows->data, rows->len);
+		} else {
+			op = "clear";
+			hittree_clear (tree);
+			g_array_set_size (rows, 0);
+			memset (present, 0, sizeof (present));
+		}
+
+		ok = ok && check_tree (tree, rand, step, op);
+	}
+
+	hittree_free (tree);
+	return ok;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GRand *rand = g_rand_new_with_seed (SEED);
+	guint round;
+
+	rows = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	for (round = 0; round < ROUNDS && run_round (rand); round++);
+
+	g_rand_free (rand);
+	g_array_free (rows, TRUE);
+
+	if (round < ROUNDS) {
+		g_print ("round %u failed\n", round);
+		return 1;
+	}
+
+	g_print ("%u rounds of %u bursts, the tree matched\n", ROUNDS, STEPS);
+	return 0;
+}
@@ -0,0 +1,218 @@
+/*---[ test-logtail.c ]-----------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Stress test of following the system log while it is rotated under load,
+ * by renaming it and by copying and truncating it in place
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+
+#include "logread.h"
+#include "hitview.h"
+
+#define LINES 400000 /* Written in total */
+#define BATCH_LINES 64 /* Lines written at once, the way a busy syslog daemon does */
+#define ROTATE_EVERY 5000 /* Lines between renames of the log */
+#define TRUNCATE_AT 32 /* Lines into a new file it is copied and truncated, less than a batch */
+#define PAUSE_EVERY 2048 /* Lines between pauses of the writer, for the reader to catch up sometimes */
+#define QUIET_TIMEOUT 5 /* Seconds without a new line after the writer finished before giving up */
+
+static gchar *logpath;
+static GMutex lock;
+static GArray *truncations; /* The first line written after each copytruncate */
+static volatile gint writing = TRUE;
+
+static guint received = 0;
+static gint last_seen = -1;
+static guint skipped = 0; /* Lines lost other than with a copy */
+static guint duplicated = 0;
+static gint64 last_arrival;
+
+/* [ add_line ]
+ * Add the numbered line n to a batch, the number goes in the source address
+ */
+static void
+add_line (GString *batch, guint n)
+{
+	g_string_append_printf (batch,
+	                        "Oct 17 06:21:00 host kernel: [  123.456789] Inbound IN=eth0 OUT= "
+	                        "MAC=00:11:22:33:44:55:66:77:88:99:aa:bb:08:00 SRC=10.%u.%u.%u DST=10.0.0.1 "
+	                        "LEN=60 TOS=0x00 PREC=0x00 TTL=64 ID=1 DF PROTO=TCP SPT=40000 DPT=22 "
+	                        "WINDOW=29200 RES=0x00 SYN URGP=0\n",
+	                        (n >> 16) & 0xff, (n >> 8) & 0xff, n & 0xff);
+}
+
+/* [ write_batch ]
+ * Write out the lines of a batch with a single call
+ */
+static void
+write_batch (gint fd, GString *batch)
+{
+	if (write (fd, batch->str, batch->len) != (gssize)batch->len)
+		g_error ("Writing %s: %s", logpath, g_strerror (errno));
+	g_string_truncate (batch, 0);
+}
+
+/* [ copy_truncate ]
+ * Rotate the way logrotate's copytruncate does, the writer keeps its file
+ */
+static void
+copy_truncate (gint fd, const gchar *rotated)
+{
+	gchar *contents;
+	gsize length;
+
+	if (!g_file_get_contents (logpath, &contents, &length, NULL) ||
+	    !g_file_set_contents (rotated, contents, length, NULL) ||
+	    ftruncate (fd, 0) != 0)
+		g_error ("Copying %s", logpath);
+	g_free (contents);
+}
+
+/* [ writer_thread ]
+ * Write the numbered lines, rotating the log as it goes. Each new file is
+ * renamed away after a while, but first copied and truncated early on, and
+ * the batch written right after that is longer than what was truncated
+ */
+static gpointer
+writer_thread (gpointer data)
+{
+	GString *batch;
+	gchar *rotated;
+	gint fd;
+	guint n;
+
+	batch = g_string_new (NULL);
+	rotated = g_strconcat (logpath, ".1", NULL);
+	fd = open (logpath, O_WRONLY | O_APPEND | O_CLOEXEC);
+
+	for (n = 0; n < LINES; n++) {
+		if (n > 0 && n % ROTATE_EVERY == 0) {
+			rename (logpath, rotated);
+			/* The batch still goes to the old file */
+			write_batch (fd, batch);
+			close (fd);
+			fd = open (logpath, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+		} else if (n % ROTATE_EVERY == TRUNCATE_AT) {
+			write_batch (fd, batch);
+			g_mutex_lock (&lock);
+			copy_truncate (fd, rotated);
+			g_array_append_val (truncations, n);
+			g_mutex_unlock (&lock);
+		}
+
+		add_line (batch, n);
+		if (n % BATCH_LINES == BATCH_LINES-1)
+			write_batch (fd, batch);
+		if (n % PAUSE_EVERY == 0)
+			g_usleep (g_random_int_range (0, 2000));
+	}
+
+	write_batch (fd, batch);
+	close (fd);
+	g_free (rotated);
+	g_string_free (batch, TRUE);
+	g_atomic_int_set (&writing, FALSE);
+	return NULL;
+}
+
+/* [ after_truncation ]
+ * Test if line n is the first one written after a copytruncate, lines
+ * before it may only have made it to the copy
+ */
+static gboolean
+after_truncation (guint n)
+{
+	gboolean found = FALSE;
+	guint i;
+
+	g_mutex_lock (&lock);
+	for (i = 0; i < truncations->len; i++)
+		found |= (g_array_index (truncations, guint, i) == n);
+	g_mutex_unlock (&lock);
+
+	return found;
+}
+
+/* [ hitview_append_hit ]
+ * Check the line numbers arrive in order, each once
+ */
+gboolean
+hitview_append_hit (Hit *h)
+{
+	gint n = GUINT32_FROM_BE (h->source) & 0xffffff;
+
+	if (n <= last_seen)
+		duplicated++;
+	else if (n != last_seen+1 && !after_truncation (n)) {
+		g_printerr ("Lines %d to %d skipped\n", last_seen+1, n-1);
+		skipped += n - (last_seen+1);
+	}
+
+	last_seen = MAX (last_seen, n);
+	received++;
+	last_arrival = g_get_monotonic_time ();
+	return TRUE;
+}
+
+/* [ check_done ]
+ * Stop once the last line arrived, or nothing did for a while
+ */
+static gboolean
+check_done (gpointer data)
+{
+	GMainLoop *loop = data;
+
+	if (g_atomic_int_get (&writing))
+		return TRUE;
+
+	if (last_seen == LINES-1 || g_get_monotonic_time () - last_arrival > QUIET_TIMEOUT*G_USEC_PER_SEC) {
+		g_main_loop_quit (loop);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GMainLoop *loop;
+	GThread *writer;
+	gchar *dir;
+
+	dir = g_dir_make_tmp ("fortified-logtail-XXXXXX", NULL);
+	logpath = g_build_filename (dir, "syslog", NULL);
+	if (!g_file_set_contents (logpath, "", 0, NULL))
+		g_error ("Creating %s", logpath);
+	truncations = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	loop = g_main_loop_new (NULL, FALSE);
+	open_logfile (logpath);
+	last_arrival = g_get_monotonic_time ();
+	writer = g_thread_new ("writer", writer_thread, NULL);
+	g_timeout_add (100, check_done, loop);
+	g_main_loop_run (loop);
+	g_thread_join (writer);
+	close_logfile ();
+
+	g_print ("%u lines written, %u received, %u skipped, %u duplicated, %u copytruncates, last %d\n",
+	         LINES, received, skipped, duplicated, truncations->len, last_seen);
+
+	g_remove (logpath);
+	g_free (logpath);
+	logpath = g_build_filename (dir, "syslog.1", NULL);
+	g_remove (logpath);
+	g_rmdir (dir);
+
+	return (skipped == 0 && duplicated == 0 && last_seen == LINES-1) ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+/*---[ test-stubs.c ]-------------------------------------------------
+ * Copyright (C) 2016 Draekko (draekko.software+fortified@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Stand-ins for the parts of Fortified around the modules the check and
+ * benchmark programs exercise, so those link without the GUI running
+ *--------------------------------------------------------------------*/
+
+#include <config.h>
+#include <gnome.h>
+
+#include "globals.h"
+#include "hitview.h"
+#include "statusview.h"
+#include "preferences.h"
+#include "journal.h"
+#include "kmsg.h"
+
+FortifiedApp Fortified;
+
+static GHashTable *preferences = NULL; /* Of the keys set, by key */
+
+gchar *
+preferences_get_string (const gchar *gconf_key)
+{
+	if (preferences == NULL)
+		return NULL;
+
+	return g_strdup (g_hash_table_lookup (preferences, gconf_key));
+}
+
+void
+preferences_set_string (const gchar *gconf_key, const gchar *data)
+{
+	if (preferences == NULL)
+		preferences = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	g_hash_table_replace (preferences, g_strdup (gconf_key), g_strdup (data));
+}
+
+gboolean
+hitview_reload_in_progress (void)
+{
+	return FALSE;
+}
+
+gboolean
+hitview_append_reloaded_hit (Hit *h)
+{
+	return hitview_append_hit (h);
+}
+
+void
+hitview_abort_reload_callback (GnomeVFSAsyncHandle *handle, GnomeVFSResult result, gpointer data)
+{
+}
+
+void
+status_set_state (FirewallStatus status)
+{
+}
+
+gboolean
+journal_available (void)
+{
+	return FALSE;
+}
+
+gboolean
+kmsg_available (void)
+{
+	return FALSE;
+}
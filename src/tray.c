@@ -118,7 +118,8 @@ void tray_update (FirewallStatus state)
 
 	if (state == STATUS_HIT) {
 		const Hit *h = get_last_hit ();
-		gchar *ip = g_strdup (h->source);
+		gchar source[HIT_TEXT_MAX];
+		gchar *ip = g_strdup (hit_format (h, HIT_SOURCE, source));
 
 		if (!animating) {
 
@@ -12,6 +12,7 @@
 
 #include <sys/stat.h>
 #include <stdio.h>
+#include <time.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -25,9 +26,21 @@
 #include "util.h"
 #include "hitview.h"
 #include "preferences.h"
+#include "service.h"
+#include "journal.h"
+#include "kmsg.h"
 
 extern int h_errno;
 
+/* Interface and service names of the hits, indexed by id */
+static GPtrArray *hit_names = NULL;
+static GHashTable *hit_name_ids = NULL;
+static GMutex hit_names_lock;
+
+/* getprotobynumber and getprotobyname return a static buffer, hits are
+   built in several threads */
+G_LOCK_DEFINE_STATIC (protocols);
+
 static void
 error_dialog_response (GtkDialog *dialog,
                        gint response_id,
@@ -110,8 +123,45 @@ show_error (gchar *message)
 		error_dialog (_("Fortified error"), NULL, message, Fortified.window);
 }
 
+/* [ format_syslog_time ]
+ * Format a time the way syslog does, eg. "Jan  1 00:00:00"
+ */
+static void
+format_syslog_time (time_t seconds, gchar *buffer, gsize size)
+{
+	static const gchar *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	                                "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+	struct tm tm;
+
+	localtime_r (&seconds, &tm);
+
+	g_snprintf (buffer, size, "%s %2d %02d:%02d:%02d", months[tm.tm_mon],
+	            tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+/* [ hash_line_end ]
+ * Hash the end of the line finished by the newline at the end of a buffer.
+ * At most LINE_HASH_SPAN bytes are hashed, so the result doesn't depend on
+ * how much of a long line the buffer holds
+ */
+guint32
+hash_line_end (const gchar *buffer, gsize length)
+{
+	const gchar *end = buffer+length-1;
+	const gchar *p = end;
+	guint32 hash = 2166136261U;
+
+	while (p > buffer && p[-1] != '\n' && end-p < LINE_HASH_SPAN)
+		p--;
+	for (; p < end; p++)
+		hash = (hash ^ (guchar)*p) * 16777619U;
+
+	return hash;
+}
+
 /* [ get_system_log_path ]
- * Get the correct path to the system log, which may vary with distributions
+ * Get the correct path to the system log, which may vary with distributions.
+ * Return NULL if there is no log file
  */
 const gchar *
 get_system_log_path (void)
@@ -133,7 +183,8 @@ get_system_log_path (void)
 				path = NULL;
 		}
 		
-		if (path == NULL) {
+		/* Without a log file, events are read from the journal or the kernel */
+		if (path == NULL && !journal_available () && !kmsg_available ()) {
 			show_error (g_strconcat (
 				"<span weight=\"bold\" size=\"larger\">",
 				_("Failed to open the system log\n\n"),
@@ -145,36 +196,264 @@ get_system_log_path (void)
 	return path;
 }
 
+/* [ hit_intern ]
+ * Return the id of an interface or service name, adding it to the names
+ * seen so far if it's new. Names longer than HIT_NAME_MAX are cut short and
+ * the empty name is always 0, as is any name once the ids run out. Safe to
+ * call from any thread
+ */
+guint16
+hit_intern (const gchar *name, gsize length)
+{
+	gchar key[HIT_NAME_MAX+1];
+	gpointer id;
+
+	length = MIN (length, HIT_NAME_MAX);
+	if (length == 0)
+		return 0;
+	memcpy (key, name, length);
+	key[length] = '\0';
+
+	g_mutex_lock (&hit_names_lock);
+	if (hit_names == NULL) {
+		hit_names = g_ptr_array_new ();
+		g_ptr_array_add (hit_names, g_strdup (""));
+		hit_name_ids = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+
+	if (!g_hash_table_lookup_extended (hit_name_ids, key, NULL, &id)) {
+		if (hit_names->len > G_MAXUINT16) {
+			id = GUINT_TO_POINTER (0);
+		} else {
+			gchar *copy = g_strdup (key);
+
+			id = GUINT_TO_POINTER (hit_names->len);
+			g_ptr_array_add (hit_names, copy);
+			g_hash_table_insert (hit_name_ids, copy, id);
+		}
+	}
+	g_mutex_unlock (&hit_names_lock);
+
+	return GPOINTER_TO_UINT (id);
+}
+
+/* [ hit_lookup ]
+ * Return the ids of the names seen so far that are equal to a name but for
+ * case, without adding it to them. count is set to how many there are,
+ * free them with g_free. Safe to call from any thread
+ */
+guint16 *
+hit_lookup (const gchar *name, guint *count)
+{
+	GArray *ids = g_array_new (FALSE, FALSE, sizeof (guint16));
+	gchar key[HIT_NAME_MAX+1];
+	gsize length;
+	guint16 id = 0;
+	guint i;
+
+	length = MIN (strlen (name), HIT_NAME_MAX);
+	memcpy (key, name, length);
+	key[length] = '\0';
+
+	if (length == 0)
+		g_array_append_val (ids, id);
+	else {
+		g_mutex_lock (&hit_names_lock);
+		for (i = 1; hit_names != NULL && i < hit_names->len; i++)
+			if (g_ascii_strcasecmp (g_ptr_array_index (hit_names, i), key) == 0) {
+				id = i;
+				g_array_append_val (ids, id);
+			}
+		g_mutex_unlock (&hit_names_lock);
+	}
+
+	*count = ids->len;
+	return (guint16 *)g_array_free (ids, FALSE);
+}
+
+/* [ hit_name ]
+ * Return the name an id was given by hit_intern. Safe to call from any thread
+ */
+const gchar *
+hit_name (guint16 id)
+{
+	const gchar *name = "";
+
+	g_mutex_lock (&hit_names_lock);
+	if (hit_names != NULL && id < hit_names->len)
+		name = g_ptr_array_index (hit_names, id);
+	g_mutex_unlock (&hit_names_lock);
+
+	return name;
+}
+
+/* [ hit_name_count ]
+ * Return the number of ids given by hit_intern so far, the empty name
+ * included. Safe to call from any thread
+ */
+guint
+hit_name_count (void)
+{
+	guint count;
+
+	g_mutex_lock (&hit_names_lock);
+	count = (hit_names != NULL ? hit_names->len : 1);
+	g_mutex_unlock (&hit_names_lock);
+
+	return count;
+}
+
+/* [ hit_protocol_number ]
+ * Return the number of an IP protocol given by name, as the kernel logs it,
+ * or -1 if it's unknown. Safe to call from any thread
+ */
+gint
+hit_protocol_number (const gchar *name, gsize length)
+{
+	struct protoent *protocol;
+	gchar key[HIT_NAME_MAX+1];
+	gint number = -1;
+	gsize i;
+
+	/* The ones logged the most */
+	if (length == 3 && g_ascii_strncasecmp (name, "tcp", 3) == 0)
+		return IPPROTO_TCP;
+	if (length == 3 && g_ascii_strncasecmp (name, "udp", 3) == 0)
+		return IPPROTO_UDP;
+	if (length == 4 && g_ascii_strncasecmp (name, "icmp", 4) == 0)
+		return IPPROTO_ICMP;
+
+	if (length == 0 || length > HIT_NAME_MAX)
+		return -1;
+	for (i = 0; i < length; i++)
+		key[i] = g_ascii_tolower (name[i]);
+	key[length] = '\0';
+
+	G_LOCK (protocols);
+	protocol = getprotobyname (key);
+	if (protocol != NULL)
+		number = protocol->p_proto & 0xFF;
+	G_UNLOCK (protocols);
+
+	return number;
+}
+
+/* [ hit_protocol_name ]
+ * Return the name of an IP protocol, in capitals. Protocols without a name
+ * are shown by number. Safe to call from any thread
+ */
+const gchar *
+hit_protocol_name (guint8 number)
+{
+	static const gchar *names[256];
+	const gchar *name;
+
+	G_LOCK (protocols);
+	if (names[number] == NULL) {
+		struct protoent *protocol = getprotobynumber (number);
+
+		if (protocol != NULL)
+			names[number] = g_ascii_strup (protocol->p_name, -1);
+		else
+			names[number] = g_strdup_printf ("%d", number);
+	}
+	name = names[number];
+	G_UNLOCK (protocols);
+
+	return name;
+}
+
+/* [ hit_format ]
+ * Return the text of a field of a hit, written into a buffer of
+ * HIT_TEXT_MAX bytes if it isn't a constant. Missing fields are empty
+ */
+const gchar *
+hit_format (const Hit *h, HitField field, gchar *buffer)
+{
+	struct in_addr address;
+
+	switch (field) {
+	case HIT_TIME:
+		if (h->time == 0)
+			return "";
+		format_syslog_time (h->time, buffer, HIT_TEXT_MAX);
+		return buffer;
+	case HIT_DIRECTION:
+		if (h->direction == HIT_INBOUND)
+			return _("Inbound");
+		if (h->direction == HIT_OUTBOUND)
+			return _("Outbound");
+		return _("Unknown");
+	case HIT_IN:
+		return hit_name (h->in);
+	case HIT_OUT:
+		return hit_name (h->out);
+	case HIT_PORT:
+		if (!(h->flags & HIT_HAS_PORT))
+			return "";
+		g_snprintf (buffer, HIT_TEXT_MAX, "%u", h->port);
+		return buffer;
+	case HIT_SOURCE:
+	case HIT_DESTINATION:
+		if (!(h->flags & (field == HIT_SOURCE ? HIT_HAS_SOURCE : HIT_HAS_DESTINATION)))
+			return "";
+		address.s_addr = (field == HIT_SOURCE) ? h->source : h->destination;
+		return inet_ntop (AF_INET, &address, buffer, HIT_TEXT_MAX);
+	case HIT_LENGTH:
+		if (!(h->flags & HIT_HAS_LENGTH))
+			return "";
+		g_snprintf (buffer, HIT_TEXT_MAX, "%u", h->length);
+		return buffer;
+	case HIT_TOS:
+		if (!(h->flags & HIT_HAS_TOS))
+			return "";
+		g_snprintf (buffer, HIT_TEXT_MAX, "0x%02X", h->tos);
+		return buffer;
+	case HIT_PROTOCOL:
+		return (h->flags & HIT_HAS_PROTOCOL) ? hit_protocol_name (h->protocol) : "";
+	case HIT_SERVICE:
+		return hit_name (h->service);
+	default:
+		return "";
+	}
+}
+
+/* [ hit_set_service ]
+ * Name the service of a hit from its port and protocol. ICMP hits are named
+ * by their type instead, if one is given (it's -1 otherwise)
+ */
+void
+hit_set_service (Hit *h, gint icmp_type)
+{
+	const gchar *service;
+
+	/* The names are owned by the services tables, nothing is allocated here */
+	if (icmp_type >= 0 && (h->flags & HIT_HAS_PROTOCOL) && h->protocol == IPPROTO_ICMP)
+		service = service_lookup_icmp_name (icmp_type);
+	else
+		service = service_lookup_name (h->port, (h->flags & HIT_HAS_PROTOCOL) ? hit_protocol_name (h->protocol) : NULL);
+
+	h->service = hit_intern (service, strlen (service));
+}
+
 void
 print_hit (Hit *h)
 {
+	gchar time[HIT_TEXT_MAX], source[HIT_TEXT_MAX], destination[HIT_TEXT_MAX], port[HIT_TEXT_MAX];
+
 	printf ("HIT: %s from %s to %s:%s, protocol %s, service %s\n",
-		h->time,
-		h->source,
-		h->destination,
-		h->port,
-		h->protocol,
-		h->service);
+		hit_format (h, HIT_TIME, time),
+		hit_format (h, HIT_SOURCE, source),
+		hit_format (h, HIT_DESTINATION, destination),
+		hit_format (h, HIT_PORT, port),
+		hit_format (h, HIT_PROTOCOL, NULL),
+		hit_format (h, HIT_SERVICE, NULL));
 }
 
 Hit *
 copy_hit (Hit *h)
 {
-	Hit *new = g_new (Hit, 1);
-	
-	new->time = g_strdup (h->time);
-	new->direction = g_strdup (h->direction);
-	new->in =  g_strdup (h->in);
-	new->out = g_strdup (h->out);
-	new->port = g_strdup (h->port);
-	new->source = g_strdup (h->source);
-	new->destination = g_strdup (h->destination);
-	new->length = g_strdup (h->length);
-	new->tos = g_strdup (h->tos);
-	new->protocol = g_strdup (h->protocol);
-	new->service = g_strdup (h->service);
-
-	return new;
+	return g_memdup (h, sizeof (Hit));
 }
 
 /* [ get_ip_of_interface ]
@@ -455,21 +734,6 @@ is_a_valid_host (const gchar *host)
 void
 free_hit (Hit *h)
 {
-	if (h == NULL)
-		return;
-
-	g_free (h->time);
-	g_free (h->direction);
-	g_free (h->in);
-	g_free (h->out);
-	g_free (h->port);
-	g_free (h->source);
-	g_free (h->destination);
-	g_free (h->length);
-	g_free (h->tos);
-	g_free (h->protocol);
-	g_free (h->service);
-
 	g_free (h);
 }
 
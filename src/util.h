@@ -18,6 +18,10 @@
 
 #include "fortified.h"
 
+#define LINE_HASH_SPAN 256 /* Bytes at the end of a line hashed by hash_line_end */
+#define HIT_NAME_MAX 63 /* Interface and service names are cut to this length */
+#define HIT_TEXT_MAX 64 /* Size of the buffer a field of a hit is formatted in */
+
 void show_error (gchar *message);
 void error_dialog (const gchar *title,
                    const gchar *header,
@@ -25,6 +29,16 @@ void error_dialog (const gchar *title,
 		   GtkWidget *parent);
 
 const gchar *get_system_log_path (void);
+guint32 hash_line_end (const gchar *buffer, gsize length);
+
+guint16 hit_intern (const gchar *name, gsize length);
+guint16 *hit_lookup (const gchar *name, guint *count);
+const gchar *hit_name (guint16 id);
+guint hit_name_count (void);
+gint hit_protocol_number (const gchar *name, gsize length);
+const gchar *hit_protocol_name (guint8 number);
+void hit_set_service (Hit *h, gint icmp_type);
+const gchar *hit_format (const Hit *h, HitField field, gchar *buffer);
 
 void print_hit (Hit *h);
 Hit *copy_hit (Hit *h);